@@ -1,31 +1,261 @@
-import React, { useEffect, useMemo, useRef, useState } from 'react';
-import { Buffer } from 'buffer';
+import React, { useEffect, useRef, useState } from 'react';
 import { Alert, NativeModules, Platform } from 'react-native';
 import { SafeAreaProvider } from 'react-native-safe-area-context';
-import dgram, { RemoteInfo, Socket } from 'react-native-udp';
 import * as DocumentPicker from '@react-native-documents/picker';
 import DeviceInfo from 'react-native-device-info';
 import RNFS from 'react-native-fs';
 import RootNavigator from './src/navigation/RootNavigator';
 
+type NativeTransferOptions = {
+  zeroCopySend?: boolean;
+  zeroCopyReceive?: boolean;
+  chunkSize?: number;
+  streams?: number;
+  pipelineDepth?: number;
+  ioUring?: boolean;
+  chunkDigests?: boolean;
+  compression?: boolean;
+  compressionWorkers?: number;
+  deltaSync?: boolean;
+  autoTune?: boolean;
+  cacheWindow?: number;
+  directWrite?: boolean;
+  encryption?: boolean;
+  // Suites a sender offers; empty offers all this device runs
+  encryptionSuites?: Array<'AES-256-GCM' | 'ChaCha20-Poly1305'>;
+  pairingSecret?: string;
+  maxActiveSends?: number;
+  sendRateLimit?: number;
+  reliableUdp?: boolean;
+  udpFecGroup?: number;
+  bufferBudget?: number;
+};
+
+type NativeIoStats = {
+  zeroCopyBytes: number;
+  copiedBytes: number;
+  pipelineNetworkWaits: number;
+  pipelineNetworkWaitMs: number;
+  pipelineReaderWaits: number;
+  pipelineReaderWaitMs: number;
+  pipelineCompressWaits: number;
+  pipelineCompressWaitMs: number;
+  uringBytes: number;
+  uringSubmits: number;
+  hashedBytes: number;
+  digestFailures: number;
+  compressedChunks: number;
+  rawChunks: number;
+  compressInBytes: number;
+  compressOutBytes: number;
+  deltaReusedBytes: number;
+  udpPackets: number;
+  udpRetransmits: number;
+  udpParityPackets: number;
+  udpRecovered: number;
+  bufferBytes: number;
+  bufferPeakBytes: number;
+  bufferWaits: number;
+  bufferRejects: number;
+};
+
+// Percentiles are histogram bucket edges, at most 2x above the truth
+type NativeLatency = {
+  count: number;
+  meanUs: number;
+  p50Us: number;
+  p90Us: number;
+  p99Us: number;
+  maxUs: number;
+  stalls: number; // samples over 100 ms
+};
+
+type NativeTelemetry = {
+  enabled: boolean;
+  latency: {
+    recv: NativeLatency;
+    send: NativeLatency;
+    read: NativeLatency;
+    write: NativeLatency;
+    chunk: NativeLatency;
+    jsQueue: NativeLatency;
+  };
+  shortReads: number;
+  shortWrites: number;
+  traceRecords: number;
+  traceCapacity: number;
+};
+
+type NativeLinkTuning = {
+  chunkSize: number;
+  preferredChunkSize: number;
+  sendBuffer: number;
+  notSentLowat: number;
+  congestion: string;
+  rttMs: number;
+  minRttMs: number;
+  goodputBytesPerSec: number;
+  settled: boolean;
+};
+
+type NativeTransferSession = {
+  id: number;
+  direction: 'send' | 'receive';
+  state: 'active' | 'completed' | 'failed' | 'cancelled';
+  phase:
+    | 'connecting'
+    | 'negotiating'
+    | 'transferring'
+    | 'verifying'
+    | 'done'
+    | 'queued';
+  fileName: string;
+  fileSize: number;
+  fileBytesTransferred: number;
+  fileIndex: number;
+  fileCount: number;
+  bytesTransferred: number;
+  totalBytes: number;
+  wireBytes: number;
+  elapsedMs: number;
+  tuning?: NativeLinkTuning;
+};
+
+// Scheduling of one send: higher priorities go first, and a cap of 0
+// leaves only the global sendRateLimit
+type NativeSendJob = {
+  priority?: number;
+  bytesPerSecond?: number;
+};
+
+// Pushed by subscribeProgress(); one per active session per tick, plus a
+// final one when a session ends
+type NativeProgressEvent = {
+  id: number;
+  direction: 'send' | 'receive';
+  state: 'active' | 'completed' | 'failed' | 'cancelled';
+  phase:
+    | 'connecting'
+    | 'negotiating'
+    | 'transferring'
+    | 'verifying'
+    | 'done'
+    | 'queued';
+  progress: number; // current file, as getProgress()
+  fileIndex: number;
+  fileCount: number;
+  fileBytesTransferred: number;
+  fileSize: number;
+  bytesTransferred: number;
+  totalBytes: number;
+  bytesPerSecond: number; // smoothed
+  etaMs: number; // -1 while unknown
+  elapsedMs: number;
+};
+
+// A device found by startPeerDiscovery(); IDs are 16 hex digits
+type NativePeer = {
+  id: string;
+  name: string;
+  address: string;
+  role: 'send' | 'receive';
+  transferPort: number;
+  capabilities: number; // CAP_* bits, see protocol.h
+};
+
+type NativePeerMessage = 'lock' | 'bye' | 'cancel';
+
+// Functions taking an optional sessionId fall back to the newest
+// transfer still in flight when it is omitted.
 declare global {
   var startReceiver: (port: number) => boolean;
-  var startSender: (path: string, ip: string, port: number) => boolean;
-  var getProgress: () => number;
-  var cancelTransfer: () => void;
-  var getCurrentFileName: () => string;
-  var getCurrentFileSize: () => number;
+  // Return the new session ID, 0 on failure
+  var startSender: (
+    path: string,
+    ip: string,
+    port: number,
+    job?: NativeSendJob,
+  ) => number;
+  var startSenderSession: (
+    paths: string[],
+    ip: string,
+    port: number,
+    job?: NativeSendJob,
+  ) => number;
+  var startSenderTree: (
+    directory: string,
+    ip: string,
+    port: number,
+    job?: NativeSendJob,
+  ) => number;
+  // Reorder or re-cap a send in flight; false once it has finished
+  var setTransferPriority: (sessionId: number, priority: number) => boolean;
+  var setTransferRateLimit: (
+    sessionId: number,
+    bytesPerSecond: number,
+  ) => boolean;
+  var getProgress: (sessionId?: number) => number;
+  var getSessionProgress: (sessionId?: number) => {
+    fileIndex: number;
+    fileCount: number;
+    bytesTransferred: number;
+    totalBytes: number;
+  };
+  var cancelTransfer: (sessionId?: number) => void;
+  var getCurrentFileName: (sessionId?: number) => string;
+  var getCurrentFileSize: (sessionId?: number) => number;
+  var getTransferSessionStats: (sessionId: number) => NativeTransferSession | null;
+  var listTransferSessions: () => NativeTransferSession[];
+  var setTransferOptions: (options: NativeTransferOptions) => boolean;
+  var getIoStats: () => NativeIoStats;
+  var getStats: () => {io: NativeIoStats; telemetry: NativeTelemetry};
+  // Telemetry is off until enabled; traceRecords > 0 also keeps a trace
+  var setTelemetry: (options: {
+    enabled?: boolean;
+    traceRecords?: number;
+    reset?: boolean;
+  }) => boolean;
+  // Binary trace, format in telemetry.h; false if none was kept
+  var dumpTrace: (path: string) => boolean;
+  // Calls back on the JS thread at up to rateHz (default 10) with the
+  // sessions that changed. False when pushes are unavailable.
+  var subscribeProgress: (
+    callback: (events: NativeProgressEvent[]) => void,
+    rateHz?: number,
+  ) => boolean;
+  var unsubscribeProgress: () => void;
+  // Float64 snapshot of the newest sessions, refreshed natively; see
+  // progress_reporter.h for the layout
+  var getProgressBuffer: () => ArrayBuffer;
+  // Announces this device and calls back on the JS thread with the whole
+  // peer list whenever it changes, and with every pairing message.
+  // Returns this device's ID, null if the discovery port is taken.
+  var startPeerDiscovery: (
+    settings: {
+      role: 'send' | 'receive';
+      name: string;
+      transferPort: number;
+    },
+    onPeers: (peers: NativePeer[]) => void,
+    onMessage: (
+      message: NativePeerMessage,
+      peer: NativePeer,
+      sessionId: string,
+    ) => void,
+  ) => string | null;
+  var stopPeerDiscovery: () => void;
+  // Returns the session ID sent, null if the peer is unknown; a 'lock'
+  // without one opens a new session
+  var sendPeerMessage: (
+    message: NativePeerMessage,
+    peerId: string,
+    sessionId?: string,
+  ) => string | null;
 }
 
-const DISCOVERY_PORT = 41234;
-const BROADCAST_ADDR = '255.255.255.255';
-const DISCOVER = 'SWIFTSHAREX_DISCOVER';
-const HELLO_PREFIX = 'SWIFTSHAREX_HELLO';
-const LOCK_PREFIX = 'SWIFTSHAREX_LOCK';
-const BYE_PREFIX = 'SWIFTSHAREX_BYE';
-const CANCEL_PREFIX = 'SWIFTSHAREX_CANCEL';
 const TRANSFER_PORT = 5001;
 const SEND_START_TIMEOUT_MS = 8000;
+const PROGRESS_RATE_HZ = 10;
 
 type Role = 'send' | 'receive';
 type DiscoveredDevice = {
@@ -33,10 +263,24 @@ type DiscoveredDevice = {
   name: string;
   address: string;
   role: Role;
+  transferPort?: number;
 };
 
+const toDevice = (peer: NativePeer): DiscoveredDevice => ({
+  id: peer.id,
+  name: peer.name || 'Unknown',
+  address: peer.address,
+  role: peer.role,
+  transferPort: peer.transferPort || undefined,
+});
+
 type TransferMode = 'idle' | 'sending' | 'receiving';
 
+type TransferRate = {
+  bytesPerSecond: number;
+  etaMs: number;
+};
+
 type PickedFile = {
   name: string;
   uri: string;
@@ -68,21 +312,19 @@ function App() {
     currentTransferModeRef.current = transferMode;
   }, [transferMode]);
   const [progress, setProgress] = useState<number>(0);
+  const [transferRate, setTransferRate] = useState<TransferRate | null>(null);
   const [pickedFile, setPickedFile] = useState<PickedFile | null>(null);
   const [pickerError, setPickerError] = useState<string | null>(null);
   const [sentFiles, setSentFiles] = useState<FileTransferRecord[]>([]);
   const [receivedFiles, setReceivedFiles] = useState<FileTransferRecord[]>([]);
   const [isPickingFile, setIsPickingFile] = useState<boolean>(false);
 
-  const discoverySocketRef = useRef<Socket | null>(null);
-  const discoveryIntervalRef = useRef<ReturnType<typeof setInterval> | null>(
-    null,
-  );
+  const discoveringRef = useRef<boolean>(false);
   const progressTimerRef = useRef<ReturnType<typeof setInterval> | null>(null);
+  const progressSubscribedRef = useRef<boolean>(false);
   const sendStartTimeoutRef = useRef<ReturnType<typeof setTimeout> | null>(
     null,
   );
-  const closingDiscoveryRef = useRef<boolean>(false);
   const currentTransferIdRef = useRef<string | null>(null);
   const currentTransferModeRef = useRef<TransferMode>('idle');
   const progressRef = useRef<number>(0);
@@ -90,7 +332,6 @@ function App() {
   const localCopyPathRef = useRef<string | null>(null);
   // const receivingFileNameRef = useRef<string>('Unknown File');
 
-  const deviceId = useMemo(() => Math.random().toString(36).slice(2, 8), []);
   const [deviceName, setDeviceName] = useState<string>(
     `SwiftShareX-${Platform.OS}`,
   );
@@ -128,78 +369,24 @@ function App() {
     // eslint-disable-next-line react-hooks/exhaustive-deps
   }, []);
 
-  const stopBroadcasting = () => {
-    if (discoveryIntervalRef.current) {
-      clearInterval(discoveryIntervalRef.current);
-      discoveryIntervalRef.current = null;
-    }
-  };
-
-  const stopDiscovery = () => {
-    if (closingDiscoveryRef.current) return;
-    closingDiscoveryRef.current = true;
-
-    stopBroadcasting();
-
-    const sock = discoverySocketRef.current;
-    discoverySocketRef.current = null;
-    if (sock) {
-      try {
-        // Just close without removing listeners - listeners handle any final errors
-        sock.close();
-      } catch {}
-    }
-
-    closingDiscoveryRef.current = false;
-  };
-
-  const sendHello = (sock: Socket, targetAddr: string, currentRole: Role) => {
-    try {
-      const hello = `${HELLO_PREFIX}|${deviceId}|${deviceName}|${currentRole}`;
-      sock.send(hello, 0, hello.length, DISCOVERY_PORT, targetAddr);
-    } catch (e) {
-      console.warn('sendHello failed:', e);
-    }
-  };
-
-  const sendLock = (
-    sock: Socket,
-    targetAddr: string,
-    newSessionId: string,
-    currentRole: Role,
-  ) => {
+  const setMulticastLock = (held: boolean) => {
+    const mod = NativeModules.SwiftShareJSI as
+      | { setMulticastLock?: (held: boolean) => void }
+      | undefined;
     try {
-      const lock = `${LOCK_PREFIX}|${newSessionId}|${deviceId}|${deviceName}|${currentRole}`;
-      sock.send(lock, 0, lock.length, DISCOVERY_PORT, targetAddr);
-    } catch (e) {
-      console.warn('sendLock failed:', e);
-    }
+      mod?.setMulticastLock?.(held);
+    } catch {}
   };
 
-  const sendBye = (
-    sock: Socket,
-    targetAddr: string,
-    currentSessionId: string,
-  ) => {
-    try {
-      const bye = `${BYE_PREFIX}|${currentSessionId}|${deviceId}`;
-      sock.send(bye, 0, bye.length, DISCOVERY_PORT, targetAddr);
-    } catch (e) {
-      console.warn('sendBye failed:', e);
-    }
-  };
+  const stopDiscovery = () => {
+    if (!discoveringRef.current) return;
+    discoveringRef.current = false;
 
-  const sendCancel = (
-    sock: Socket,
-    targetAddr: string,
-    currentSessionId: string,
-  ) => {
     try {
-      const cancel = `${CANCEL_PREFIX}|${currentSessionId}|${deviceId}`;
-      sock.send(cancel, 0, cancel.length, DISCOVERY_PORT, targetAddr);
-    } catch (e) {
-      console.warn('sendCancel failed:', e);
-    }
+      // Sends any pending BYE/CANCEL and a LEAVE before closing
+      globalThis.stopPeerDiscovery?.();
+    } catch {}
+    setMulticastLock(false);
   };
 
   const uriToPath = (uri?: string | null) => {
@@ -237,6 +424,11 @@ function App() {
       clearInterval(progressTimerRef.current);
       progressTimerRef.current = null;
     }
+    if (progressSubscribedRef.current) {
+      globalThis.unsubscribeProgress?.();
+      progressSubscribedRef.current = false;
+    }
+    setTransferRate(null);
   };
 
   const clearSendStartTimeout = () => {
@@ -248,233 +440,243 @@ function App() {
 
   const startProgressPolling = () => {
     stopProgressPolling();
+
+    // The engine pushes progress with its own rate and ETA; older
+    // builds without pushes are polled instead
+    const subscribed = globalThis.subscribeProgress?.(events => {
+      // The newest session is the one getProgress() would report
+      const latest = events.reduce((a, b) => (b.id > a.id ? b : a));
+      setTransferRate(
+        latest.state === 'active' && latest.bytesPerSecond > 0
+          ? { bytesPerSecond: latest.bytesPerSecond, etaMs: latest.etaMs }
+          : null,
+      );
+      // A session that failed or was cancelled reads as no progress,
+      // as getProgress() does once the engine drops it
+      applyProgress(
+        latest.state === 'active' || latest.state === 'completed'
+          ? latest.progress
+          : 0,
+      );
+    }, PROGRESS_RATE_HZ);
+    if (subscribed) {
+      progressSubscribedRef.current = true;
+      return;
+    }
+
     progressTimerRef.current = setInterval(() => {
       const p = globalThis.getProgress?.();
       if (typeof p === 'number') {
-        setProgress(p);
-        progressRef.current = p;
+        applyProgress(p);
+      }
+    }, 250);
+  };
 
-        // Transfer started moving, so we can clear the startup timeout
-        if (p > 0) {
-          clearSendStartTimeout();
-        }
+  const applyProgress = (p: number) => {
+    setProgress(p);
+    progressRef.current = p;
 
-        // Clear the justCancelled flag once progress is back to 0
-        if (p === 0 && justCancelledRef.current) {
-          justCancelledRef.current = false;
-        }
+    // Transfer started moving, so we can clear the startup timeout
+    if (p > 0) {
+      clearSendStartTimeout();
+    }
 
-        // If progress is happening (> 0 but < 1) and we're idle, switch to receiving
-        // But don't create a new transfer if we just cancelled (residual progress)
-        if (p > 0 && p < 1 && !justCancelledRef.current) {
-          setTransferMode(prev => {
-            if (prev === 'idle') {
-              const fileName =
-                globalThis.getCurrentFileName?.() || 'Unknown File';
-              const fileSize = globalThis.getCurrentFileSize?.() || undefined;
-              // Start tracking a new receiving transfer
-              const transferId = `recv-${Date.now()}`;
-              currentTransferIdRef.current = transferId;
-              setReceivedFiles(prevFiles => [
-                {
-                  id: transferId,
-                  fileName: fileName,
-                  fileSize: fileSize,
-                  timestamp: new Date(),
-                  status: 'in-progress',
-                },
-                ...prevFiles,
-              ]);
-              return 'receiving';
-            }
-            return prev;
-          });
+    // Clear the justCancelled flag once progress is back to 0
+    if (p === 0 && justCancelledRef.current) {
+      justCancelledRef.current = false;
+    }
+
+    // If progress is happening (> 0 but < 1) and we're idle, switch to receiving
+    // But don't create a new transfer if we just cancelled (residual progress)
+    if (p > 0 && p < 1 && !justCancelledRef.current) {
+      setTransferMode(prev => {
+        if (prev === 'idle') {
+          const fileName =
+            globalThis.getCurrentFileName?.() || 'Unknown File';
+          const fileSize = globalThis.getCurrentFileSize?.() || undefined;
+          // Start tracking a new receiving transfer
+          const transferId = `recv-${Date.now()}`;
+          currentTransferIdRef.current = transferId;
+          setReceivedFiles(prevFiles => [
+            {
+              id: transferId,
+              fileName: fileName,
+              fileSize: fileSize,
+              timestamp: new Date(),
+              status: 'in-progress',
+            },
+            ...prevFiles,
+          ]);
+          return 'receiving';
         }
-        // When transfer completes
-        if (p >= 1) {
-          // Capture current mode before setTimeout
-          setTransferMode(currentMode => {
-            const wasSending = currentMode === 'sending';
-            const wasReceiving = currentMode === 'receiving';
+        return prev;
+      });
+    }
+    // When transfer completes
+    if (p >= 1) {
+      // Capture current mode before setTimeout
+      setTransferMode(currentMode => {
+        const wasSending = currentMode === 'sending';
+        const wasReceiving = currentMode === 'receiving';
+        const transferId = currentTransferIdRef.current;
+        const finishedSendPath = localCopyPathRef.current;
+
+        // Small delay to show 100% before resetting
+        setTimeout(() => {
+          // Update transfer record to completed
+          if (wasSending && transferId) {
+            setSentFiles(prevFiles =>
+              prevFiles.map(f =>
+                f.id === transferId
+                  ? { ...f, status: 'completed' as const }
+                  : f,
+              ),
+            );
+          } else if (wasReceiving && transferId) {
+            setReceivedFiles(prevFiles =>
+              prevFiles.map(f =>
+                f.id === transferId
+                  ? { ...f, status: 'completed' as const }
+                  : f,
+              ),
+            );
+          }
+
+          setTransferMode('idle');
+          setProgress(0);
+          setTransferRate(null);
+          progressRef.current = 0;
+          currentTransferIdRef.current = null;
+          cleanupLocalCopy(finishedSendPath);
+
+          if (wasSending) {
+            setPickedFile(null);
+            setPickerError(null);
+          }
+        }, 500);
+        clearSendStartTimeout();
+        return currentMode; // Don't change mode yet
+      });
+    }
+  };
+
+  const handlePeers = (peers: NativePeer[]) => {
+    const next = peers.map(toDevice);
+    setDevices(next);
+    // Follow the session peer to a new address or port
+    setSessionPeer(current => {
+      if (!current) return current;
+      const seen = next.find(d => d.id === current.id);
+      if (
+        !seen ||
+        (seen.address === current.address &&
+          seen.transferPort === current.transferPort)
+      ) {
+        return current;
+      }
+      return {
+        ...current,
+        address: seen.address,
+        transferPort: seen.transferPort,
+      };
+    });
+  };
+
+  const handlePeerMessage = (
+    message: NativePeerMessage,
+    peer: NativePeer,
+    incomingSessionId: string,
+  ) => {
+    const peerId = peer.id;
+
+    if (message === 'lock') {
+      const derivedRole: Role = peer.role === 'send' ? 'receive' : 'send';
+
+      setSessionId(prev => prev ?? incomingSessionId);
+      setRole(prev => prev ?? derivedRole);
+      setSessionPeer(toDevice(peer));
+      setTransferMode('idle');
+      setProgress(0);
+      setPickedFile(null);
+      return;
+    }
+
+    if (message === 'bye') {
+      const shouldReset =
+        !sessionId ||
+        sessionId === incomingSessionId ||
+        (sessionPeer && sessionPeer.id === peerId);
+      if (shouldReset) {
+        terminateSession();
+      }
+      return;
+    }
+
+    if (message === 'cancel') {
+      // Use setState callbacks to get current values
+      setSessionId(currentSessionId => {
+        setSessionPeer(currentPeer => {
+          const shouldCancel =
+            currentSessionId === incomingSessionId ||
+            (currentPeer && currentPeer.id === peerId);
+
+          if (shouldCancel) {
+            // Peer cancelled their transfer
+            try {
+              globalThis.cancelTransfer?.();
+            } catch {}
+
+            // Set flag to prevent creating duplicate transfer entries
+            justCancelledRef.current = true;
+
+            // Mark current transfer as cancelled using ref for mode
             const transferId = currentTransferIdRef.current;
-            const finishedSendPath = localCopyPathRef.current;
+            const mode = currentTransferModeRef.current;
 
-            // Small delay to show 100% before resetting
-            setTimeout(() => {
-              // Update transfer record to completed
-              if (wasSending && transferId) {
+            if (transferId) {
+              if (mode === 'sending') {
                 setSentFiles(prevFiles =>
                   prevFiles.map(f =>
                     f.id === transferId
-                      ? { ...f, status: 'completed' as const }
+                      ? { ...f, status: 'cancelled' as const }
                       : f,
                   ),
                 );
-              } else if (wasReceiving && transferId) {
+              } else if (mode === 'receiving') {
                 setReceivedFiles(prevFiles =>
                   prevFiles.map(f =>
                     f.id === transferId
-                      ? { ...f, status: 'completed' as const }
+                      ? { ...f, status: 'cancelled' as const }
                       : f,
                   ),
                 );
               }
+            }
 
-              setTransferMode('idle');
-              setProgress(0);
-              progressRef.current = 0;
-              currentTransferIdRef.current = null;
-              cleanupLocalCopy(finishedSendPath);
-
-              if (wasSending) {
-                setPickedFile(null);
-                setPickerError(null);
-              }
-            }, 500);
-            clearSendStartTimeout();
-            return currentMode; // Don't change mode yet
-          });
-        }
-      }
-    }, 250);
-  };
-
-  const handleMessage =
-    (sock: Socket, currentRole: Role) => (msg: Buffer, rinfo: RemoteInfo) => {
-      const text = msg.toString();
-
-      if (text.startsWith(HELLO_PREFIX)) {
-        const [, peerId, peerName, peerRoleRaw] = text.split('|');
-        const peerRole: Role = peerRoleRaw === 'receive' ? 'receive' : 'send';
-        if (peerId === deviceId) return;
-
-        setDevices(prev => {
-          const already = prev.find(d => d.id === peerId);
-          if (already) return prev;
-          return [
-            ...prev,
-            {
-              id: peerId || rinfo.address,
-              name: peerName || 'Unknown',
-              address: rinfo.address,
-              role: peerRole,
-            },
-          ];
-        });
-        return;
-      }
-
-      if (text.startsWith(DISCOVER)) {
-        sendHello(sock, rinfo.address, currentRole);
-        return;
-      }
-
-      if (text.startsWith(LOCK_PREFIX)) {
-        const [, incomingSessionId, peerId, peerName, peerRoleRaw] =
-          text.split('|');
-        if (peerId === deviceId) return;
-
-        const peerRole: Role = peerRoleRaw === 'receive' ? 'receive' : 'send';
-        const derivedRole: Role = peerRole === 'send' ? 'receive' : 'send';
-
-        setSessionId(prev => prev ?? incomingSessionId);
-        setRole(prev => prev ?? derivedRole);
-        setSessionPeer({
-          id: peerId || rinfo.address,
-          name: peerName || 'Unknown',
-          address: rinfo.address,
-          role: peerRole,
-        });
-        stopBroadcasting();
-        setTransferMode('idle');
-        setProgress(0);
-        setPickedFile(null);
-        return;
-      }
-
-      if (text.startsWith(BYE_PREFIX)) {
-        const [, incomingSessionId, peerId] = text.split('|');
-        if (peerId === deviceId) return;
-
-        const shouldReset =
-          !sessionId ||
-          sessionId === incomingSessionId ||
-          (sessionPeer && sessionPeer.id === peerId);
-        if (shouldReset) {
-          terminateSession();
-        }
-        return;
-      }
-
-      if (text.startsWith(CANCEL_PREFIX)) {
-        const [, incomingSessionId, peerId] = text.split('|');
-        if (peerId === deviceId) return;
-
-        // Use setState callbacks to get current values
-        setSessionId(currentSessionId => {
-          setSessionPeer(currentPeer => {
-            const shouldCancel =
-              currentSessionId === incomingSessionId ||
-              (currentPeer && currentPeer.id === peerId);
+            stopProgressPolling();
+            setTransferMode('idle');
+            setProgress(0);
+            setPickedFile(null);
+            currentTransferIdRef.current = null;
+            cleanupLocalCopy();
 
-            if (shouldCancel) {
-              // Peer cancelled their transfer
+            // Restart the receiver so we can accept new transfers
+            setTimeout(() => {
               try {
-                globalThis.cancelTransfer?.();
-              } catch {}
-
-              // Set flag to prevent creating duplicate transfer entries
-              justCancelledRef.current = true;
-
-              // Mark current transfer as cancelled using ref for mode
-              const transferId = currentTransferIdRef.current;
-              const mode = currentTransferModeRef.current;
-
-              if (transferId) {
-                if (mode === 'sending') {
-                  setSentFiles(prevFiles =>
-                    prevFiles.map(f =>
-                      f.id === transferId
-                        ? { ...f, status: 'cancelled' as const }
-                        : f,
-                    ),
-                  );
-                } else if (mode === 'receiving') {
-                  setReceivedFiles(prevFiles =>
-                    prevFiles.map(f =>
-                      f.id === transferId
-                        ? { ...f, status: 'cancelled' as const }
-                        : f,
-                    ),
-                  );
+                const ok = globalThis.startReceiver?.(TRANSFER_PORT);
+                if (ok) {
+                  startProgressPolling();
                 }
-              }
-
-              stopProgressPolling();
-              setTransferMode('idle');
-              setProgress(0);
-              setPickedFile(null);
-              currentTransferIdRef.current = null;
-              cleanupLocalCopy();
-
-              // Restart the receiver so we can accept new transfers
-              setTimeout(() => {
-                try {
-                  const ok = globalThis.startReceiver?.(TRANSFER_PORT);
-                  if (ok) {
-                    startProgressPolling();
-                  }
-                } catch {}
-              }, 100);
-            }
+              } catch {}
+            }, 100);
+          }
 
-            return currentPeer;
-          });
-          return currentSessionId;
+          return currentPeer;
         });
-        return;
-      }
-    };
+        return currentSessionId;
+      });
+    }
+  };
 
   const startDiscovery = (nextRole: Role) => {
     setRole(nextRole);
@@ -485,108 +687,31 @@ function App() {
     setTransferMode('idle');
     setDevices([]);
     stopDiscovery();
-    closingDiscoveryRef.current = false;
 
-    let bindSucceeded = false;
-    let hasShownError = false;
-    let bindTimeout: ReturnType<typeof setTimeout> | null = null;
-
-    const showBindError = () => {
-      if (hasShownError) return;
-      hasShownError = true;
-      if (bindTimeout) clearTimeout(bindTimeout);
-
-      // Null out the ref BEFORE stopDiscovery to prevent re-closing
-      discoverySocketRef.current = null;
+    // Multicast beacons are dropped by Wi-Fi without the lock
+    setMulticastLock(true);
+    let started: string | null = null;
+    try {
+      started =
+        globalThis.startPeerDiscovery?.(
+          { role: nextRole, name: deviceName, transferPort: TRANSFER_PORT },
+          handlePeers,
+          handlePeerMessage,
+        ) ?? null;
+    } catch (e) {
+      console.error('Failed to start discovery:', e);
+    }
 
-      stopDiscovery();
+    if (!started) {
+      setMulticastLock(false);
       Alert.alert(
         'Network Error',
         'Could not start discovery. This can happen when:\n\n• Hotspot is starting up (wait a moment and try again)\n• Another app is using port 41234\n• Network permissions are restricted\n\nTry again in a few seconds.',
       );
       setRole(null);
-    };
-
-    try {
-      const sock = dgram.createSocket({ type: 'udp4', reuseAddr: true });
-      discoverySocketRef.current = sock;
-
-      // Handle socket errors (including bind failures and "Socket is closed")
-      sock.on('error', err => {
-        console.error('Discovery socket error:', err);
-
-        // If bind hasn't succeeded yet, this is a bind failure
-        if (!bindSucceeded && !hasShownError) {
-          discoverySocketRef.current = null;
-          try {
-            // Remove listeners from the local sock reference
-            sock.removeAllListeners?.();
-          } catch {}
-          try {
-            sock.close();
-          } catch {}
-          showBindError();
-        }
-        // Otherwise, just log and ignore (prevents "Unhandled error" crashes)
-        // This handles "Socket is closed" errors after cleanup
-      });
-
-      sock.on('message', handleMessage(sock, nextRole));
-
-      // Timeout for bind - if bind doesn't succeed in 3 seconds, show error
-      bindTimeout = setTimeout(() => {
-        if (!bindSucceeded) {
-          console.error(
-            'Socket bind timeout - network interface may not be ready',
-          );
-          showBindError();
-        }
-      }, 3000);
-
-      // Bind to any available address on the discovery port
-      try {
-        sock.bind(DISCOVERY_PORT, () => {
-          if (bindTimeout) clearTimeout(bindTimeout);
-          bindSucceeded = true;
-
-          try {
-            sock.setBroadcast?.(true);
-          } catch (e) {
-            console.warn('Failed to enable broadcast:', e);
-          }
-
-          try {
-            sendHello(sock, BROADCAST_ADDR, nextRole);
-          } catch (e) {
-            console.warn('Failed to send initial hello:', e);
-          }
-
-          // Only start interval if bind succeeded
-          discoveryIntervalRef.current = setInterval(() => {
-            try {
-              if (discoverySocketRef.current) {
-                const discover = `${DISCOVER}|${nextRole}`;
-                discoverySocketRef.current.send(
-                  discover,
-                  0,
-                  discover.length,
-                  DISCOVERY_PORT,
-                  BROADCAST_ADDR,
-                );
-              }
-            } catch (e) {
-              console.warn('Failed to send discovery broadcast:', e);
-            }
-          }, 1500);
-        });
-      } catch (bindError) {
-        console.error('Bind threw exception:', bindError);
-        showBindError();
-      }
-    } catch (e) {
-      console.error('Failed to start discovery:', e);
-      showBindError();
+      return;
     }
+    discoveringRef.current = true;
   };
 
   // const startReceiving = () => {
@@ -702,7 +827,7 @@ function App() {
     const ok = globalThis.startSender?.(
       path,
       sessionPeer.address,
-      TRANSFER_PORT,
+      sessionPeer.transferPort ?? TRANSFER_PORT,
     );
     if (!ok) {
       handleSendFailure('Could not start the transfer. Please try again.');
@@ -766,8 +891,8 @@ function App() {
     justCancelledRef.current = true;
 
     // Notify peer about cancellation
-    if (discoverySocketRef.current && sessionPeer && sessionId) {
-      sendCancel(discoverySocketRef.current, sessionPeer.address, sessionId);
+    if (sessionPeer && sessionId) {
+      globalThis.sendPeerMessage?.('cancel', sessionPeer.id, sessionId);
     }
 
     // Mark current transfer as cancelled
@@ -806,31 +931,24 @@ function App() {
   };
 
   const connectToDevice = (device: DiscoveredDevice) => {
-    if (!discoverySocketRef.current || !role) return;
-    const sock = discoverySocketRef.current;
-    const newSessionId = `${deviceId}-${Date.now()}`;
+    if (!discoveringRef.current || !role) return;
+    const newSessionId = globalThis.sendPeerMessage?.('lock', device.id);
+    if (!newSessionId) return;
 
     setSessionPeer(device);
     setSessionId(newSessionId);
-    stopBroadcasting();
     setTransferMode('idle');
     setProgress(0);
     setPickedFile(null);
     stopProgressPolling();
-
-    sendLock(sock, device.address, newSessionId, role);
   };
 
   const terminateSession = () => {
     clearSendStartTimeout();
 
-    if (sessionPeer && sessionId && discoverySocketRef.current) {
-      const existingSock = discoverySocketRef.current;
+    if (sessionPeer && sessionId) {
       try {
-        sendBye(existingSock, sessionPeer.address, sessionId);
-      } catch {}
-      try {
-        sendBye(existingSock, BROADCAST_ADDR, sessionId);
+        globalThis.sendPeerMessage?.('bye', sessionPeer.id, sessionId);
       } catch {}
     }
 
@@ -854,11 +972,7 @@ function App() {
     } catch {}
 
     stopProgressPolling();
-
-    // Defer socket shutdown slightly to allow BYE to flush
-    setTimeout(() => {
-      stopDiscovery();
-    }, 50);
+    stopDiscovery();
   };
 
   // Device renderer moved into DevicePickerScreen
@@ -874,6 +988,7 @@ function App() {
         pickerError={pickerError}
         transferMode={transferMode}
         progress={progress}
+        transferRate={transferRate}
         transferPort={TRANSFER_PORT}
         sentFiles={sentFiles}
         receivedFiles={receivedFiles}
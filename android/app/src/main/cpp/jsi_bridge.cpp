@@ -1,18 +1,31 @@
 #include <jni.h>
 #include <jsi/jsi.h>
+#include <fbjni/fbjni.h>
+#include <ReactCommon/CallInvokerHolder.h>
 
 using namespace facebook;
 
-extern void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance);
+extern void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance,
+                       std::shared_ptr<react::CallInvoker> jsInvoker);
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_swiftshare_SwiftShareJSIModule_nativeInstall(
     JNIEnv *env,
     jobject thiz,
-    jlong runtimePtr)
+    jlong runtimePtr,
+    jobject callInvokerHolder)
 {
     auto *runtime = reinterpret_cast<jsi::Runtime *>(runtimePtr);
 
+    // Progress pushes reach the JS thread through its call invoker
+    std::shared_ptr<react::CallInvoker> jsInvoker;
+    if (callInvokerHolder)
+    {
+        jni::alias_ref<react::CallInvokerHolder::javaobject> holder{
+            reinterpret_cast<react::CallInvokerHolder::javaobject>(callInvokerHolder)};
+        jsInvoker = holder->cthis()->getCallInvoker();
+    }
+
     // Pass the module instance so we can get the context
-    installJSI(*runtime, env, thiz);
+    installJSI(*runtime, env, thiz, std::move(jsInvoker));
 }
\ No newline at end of file
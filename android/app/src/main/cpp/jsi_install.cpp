@@ -1,5 +1,16 @@
 #include <jsi/jsi.h>
 #include <jni.h>
+#include <ReactCommon/CallInvoker.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <strings.h>
+#include "native-core/include/discovery.h"
+#include "native-core/include/key_exchange.h"
+#include "native-core/include/secure_channel.h"
 #include "native-core/include/transfer_engine.h"
 
 using namespace facebook;
@@ -9,13 +20,395 @@ static std::unique_ptr<TransferEngine> engine;
 static JavaVM *g_jvm = nullptr;
 static jobject g_contextRef = nullptr;
 static jclass g_resolverClass = nullptr; // Cache the class reference
+static jmethodID g_resolveMethod = nullptr; // FilePathResolver.getReceiveFilePath
+static std::shared_ptr<react::CallInvoker> g_jsInvoker; // JS thread only
+
+// Progress pushes. The callback is only touched on the JS thread.
+static std::unique_ptr<jsi::Function> g_progressCallback;
+
+// Batches from the reporter thread wait here for the JS thread. Only one
+// delivery is queued at a time; batches arriving meanwhile are merged
+// into it, newest event per session, so a busy JS thread is never
+// handed a backlog.
+struct ProgressMailbox
+{
+    std::mutex mutex;
+    std::vector<ProgressEvent> pending;
+    bool queued = false;
+    uint64_t queuedAtNs = 0; // telemetry start of the queued delivery
+};
+static std::shared_ptr<ProgressMailbox> g_progressMailbox;
+
+// Peer discovery. The callbacks are only touched on the JS thread; events
+// posted by an earlier start carry an older generation and are dropped.
+static std::unique_ptr<DiscoveryEngine> discovery;
+static std::unique_ptr<jsi::Function> g_peersCallback;
+static std::unique_ptr<jsi::Function> g_peerMessageCallback;
+static uint64_t g_discoveryGeneration = 0;
 
 #include <thread>
 #include <android/log.h>
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, "SwiftShare", __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, "SwiftShare", __VA_ARGS__)
 
-void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
+// Optional leading session ID argument; 0 selects the newest session
+static uint32_t sessionIdArg(const jsi::Value *args, size_t count)
+{
+    if (count < 1 || !args[0].isNumber() || args[0].asNumber() < 1)
+        return 0;
+    return static_cast<uint32_t>(args[0].asNumber());
+}
+
+// A port argument; anything but a whole number in 1..65535 throws rather
+// than wrapping around to some other port
+static uint16_t portArg(jsi::Runtime &rt, const jsi::Value &value, const char *function)
+{
+    double port = value.isNumber() ? value.asNumber() : 0;
+    if (!(port >= 1 && port <= 65535) || port != std::floor(port))
+        throw jsi::JSError(rt, std::string(function) + ": port must be an integer in 1..65535");
+    return static_cast<uint16_t>(port);
+}
+
+// Field maxima as the doubles JS numbers arrive in; 64-bit fields stop
+// at 2^53, past which a double no longer holds every integer
+static constexpr double kMaxUint16 = std::numeric_limits<uint16_t>::max();
+static constexpr double kMaxUint32 = std::numeric_limits<uint32_t>::max();
+static constexpr double kMaxSafeInteger = 9007199254740992.0;
+
+// A number option narrowed to its field. Values below `min`, and NaN,
+// leave the field as it was; values past `max` are cut to it, where the
+// cast alone would wrap or be undefined.
+template <typename T>
+static void numberOption(jsi::Runtime &rt, const jsi::Object &obj, const char *name,
+                         double min, double max, T &field)
+{
+    jsi::Value value = obj.getProperty(rt, name);
+    if (value.isNumber() && value.asNumber() >= min)
+        field = static_cast<T>(std::min(value.asNumber(), max));
+}
+
+// Optional { priority, bytesPerSecond } after a sender's port
+static SendJob sendJobArg(jsi::Runtime &rt, const jsi::Value *args, size_t count)
+{
+    SendJob job;
+    if (count < 4 || !args[3].isObject())
+        return job;
+    jsi::Object obj = args[3].asObject(rt);
+
+    numberOption(rt, obj, "priority", std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+                 job.priority);
+    numberOption(rt, obj, "bytesPerSecond", 0, kMaxSafeInteger, job.bytesPerSecond);
+    return job;
+}
+
+// Suite names, as suiteName() spells them (case ignored), to SUITE_*
+// bits; an empty array means every suite this device runs. False for a
+// value that is not an array of known names, or that leaves nothing this
+// device can run, which would fail every connection.
+static bool encryptionSuitesArg(jsi::Runtime &rt, const jsi::Value &value, uint8_t &suites)
+{
+    if (!value.isObject() || !value.asObject(rt).isArray(rt))
+    {
+        LOGE("setTransferOptions: encryptionSuites must be an array of suite names");
+        return false;
+    }
+
+    jsi::Array names = value.asObject(rt).asArray(rt);
+    uint8_t bits = 0;
+    for (size_t i = 0; i < names.size(rt); ++i)
+    {
+        jsi::Value item = names.getValueAtIndex(rt, i);
+        std::string name = item.isString() ? item.asString(rt).utf8(rt) : "";
+        uint8_t suite = 0;
+        for (uint8_t known : {SUITE_AES_256_GCM, SUITE_CHACHA20_POLY1305})
+            if (strcasecmp(name.c_str(), suiteName(known)) == 0)
+                suite = known;
+        if (suite == 0)
+        {
+            LOGE("setTransferOptions: unknown encryption suite '%s'", name.c_str());
+            return false;
+        }
+        bits |= suite;
+    }
+
+    if (bits != 0 && (bits & localSuites()) == 0)
+    {
+        LOGE("setTransferOptions: no requested encryption suite runs on this device");
+        return false;
+    }
+    suites = bits;
+    return true;
+}
+
+static jsi::Object sessionStatsToJs(jsi::Runtime &rt, const SessionStats &stats)
+{
+    jsi::Object result(rt);
+    result.setProperty(rt, "id", static_cast<double>(stats.id));
+    result.setProperty(rt, "direction", jsi::String::createFromAscii(rt, sessionDirectionName(stats.direction)));
+    result.setProperty(rt, "state", jsi::String::createFromAscii(rt, sessionStateName(stats.state)));
+    result.setProperty(rt, "phase", jsi::String::createFromAscii(rt, sessionPhaseName(stats.phase)));
+    result.setProperty(rt, "fileName", jsi::String::createFromUtf8(rt, stats.fileName));
+    result.setProperty(rt, "fileSize", static_cast<double>(stats.fileSize));
+    result.setProperty(rt, "fileBytesTransferred", static_cast<double>(stats.fileBytesTransferred));
+    result.setProperty(rt, "fileIndex", static_cast<double>(stats.progress.fileIndex));
+    result.setProperty(rt, "fileCount", static_cast<double>(stats.progress.fileCount));
+    result.setProperty(rt, "bytesTransferred", static_cast<double>(stats.progress.bytesTransferred));
+    result.setProperty(rt, "totalBytes", static_cast<double>(stats.progress.totalBytes));
+    result.setProperty(rt, "wireBytes", static_cast<double>(stats.wireBytes));
+    result.setProperty(rt, "elapsedMs", static_cast<double>(stats.elapsedMs));
+
+    if (stats.tuning.chunkSize > 0)
+    {
+        const LinkTuning &tuning = stats.tuning;
+        jsi::Object link(rt);
+        link.setProperty(rt, "chunkSize", static_cast<double>(tuning.chunkSize));
+        link.setProperty(rt, "preferredChunkSize", static_cast<double>(tuning.preferredChunkSize));
+        link.setProperty(rt, "sendBuffer", static_cast<double>(tuning.sendBuffer));
+        link.setProperty(rt, "notSentLowat", static_cast<double>(tuning.notSentLowat));
+        link.setProperty(rt, "congestion", jsi::String::createFromAscii(rt, tuning.congestion));
+        link.setProperty(rt, "rttMs", tuning.rttUs / 1000.0);
+        link.setProperty(rt, "minRttMs", tuning.minRttUs / 1000.0);
+        link.setProperty(rt, "goodputBytesPerSec", static_cast<double>(tuning.goodputBps));
+        link.setProperty(rt, "settled", tuning.settled);
+        result.setProperty(rt, "tuning", link);
+    }
+    return result;
+}
+
+static jsi::Object progressEventToJs(jsi::Runtime &rt, const ProgressEvent &event)
+{
+    jsi::Object result(rt);
+    result.setProperty(rt, "id", static_cast<double>(event.id));
+    result.setProperty(rt, "direction", jsi::String::createFromAscii(rt, sessionDirectionName(event.direction)));
+    result.setProperty(rt, "state", jsi::String::createFromAscii(rt, sessionStateName(event.state)));
+    result.setProperty(rt, "phase", jsi::String::createFromAscii(rt, sessionPhaseName(event.phase)));
+    // Same value getProgress() returns for this session
+    result.setProperty(rt, "progress", event.fileSize > 0 ? static_cast<double>(event.fileBytesTransferred) / event.fileSize : 0.0);
+    result.setProperty(rt, "fileIndex", static_cast<double>(event.fileIndex));
+    result.setProperty(rt, "fileCount", static_cast<double>(event.fileCount));
+    result.setProperty(rt, "fileBytesTransferred", static_cast<double>(event.fileBytesTransferred));
+    result.setProperty(rt, "fileSize", static_cast<double>(event.fileSize));
+    result.setProperty(rt, "bytesTransferred", static_cast<double>(event.bytesTransferred));
+    result.setProperty(rt, "totalBytes", static_cast<double>(event.totalBytes));
+    result.setProperty(rt, "bytesPerSecond", event.bytesPerSecond);
+    result.setProperty(rt, "etaMs", static_cast<double>(event.etaMs));
+    result.setProperty(rt, "elapsedMs", static_cast<double>(event.elapsedMs));
+    return result;
+}
+
+static jsi::Object ioStatsToJs(jsi::Runtime &rt, const IoStats &stats)
+{
+    jsi::Object result(rt);
+    result.setProperty(rt, "zeroCopyBytes", static_cast<double>(stats.zeroCopyBytes));
+    result.setProperty(rt, "copiedBytes", static_cast<double>(stats.copiedBytes));
+    result.setProperty(rt, "pipelineNetworkWaits", static_cast<double>(stats.pipelineNetworkWaits));
+    result.setProperty(rt, "pipelineNetworkWaitMs", stats.pipelineNetworkWaitNs / 1e6);
+    result.setProperty(rt, "pipelineReaderWaits", static_cast<double>(stats.pipelineReaderWaits));
+    result.setProperty(rt, "pipelineReaderWaitMs", stats.pipelineReaderWaitNs / 1e6);
+    result.setProperty(rt, "pipelineCompressWaits", static_cast<double>(stats.pipelineCompressWaits));
+    result.setProperty(rt, "pipelineCompressWaitMs", stats.pipelineCompressWaitNs / 1e6);
+    result.setProperty(rt, "uringBytes", static_cast<double>(stats.uringBytes));
+    result.setProperty(rt, "uringSubmits", static_cast<double>(stats.uringSubmits));
+    result.setProperty(rt, "hashedBytes", static_cast<double>(stats.hashedBytes));
+    result.setProperty(rt, "digestFailures", static_cast<double>(stats.digestFailures));
+    result.setProperty(rt, "compressedChunks", static_cast<double>(stats.compressedChunks));
+    result.setProperty(rt, "rawChunks", static_cast<double>(stats.rawChunks));
+    result.setProperty(rt, "compressInBytes", static_cast<double>(stats.compressInBytes));
+    result.setProperty(rt, "compressOutBytes", static_cast<double>(stats.compressOutBytes));
+    result.setProperty(rt, "deltaReusedBytes", static_cast<double>(stats.deltaReusedBytes));
+    result.setProperty(rt, "udpPackets", static_cast<double>(stats.udpPackets));
+    result.setProperty(rt, "udpRetransmits", static_cast<double>(stats.udpRetransmits));
+    result.setProperty(rt, "udpParityPackets", static_cast<double>(stats.udpParityPackets));
+    result.setProperty(rt, "udpRecovered", static_cast<double>(stats.udpRecovered));
+    result.setProperty(rt, "bufferBytes", static_cast<double>(stats.bufferBytes));
+    result.setProperty(rt, "bufferPeakBytes", static_cast<double>(stats.bufferPeakBytes));
+    result.setProperty(rt, "bufferWaits", static_cast<double>(stats.bufferWaits));
+    result.setProperty(rt, "bufferRejects", static_cast<double>(stats.bufferRejects));
+    return result;
+}
+
+// Latencies in microseconds, one entry per probe
+static jsi::Object telemetryToJs(jsi::Runtime &rt, const TelemetryStats &stats)
+{
+    jsi::Object latency(rt);
+    for (size_t i = 0; i < static_cast<size_t>(Probe::Count); ++i)
+    {
+        const LatencySummary &l = stats.latency[i];
+        jsi::Object probe(rt);
+        probe.setProperty(rt, "count", static_cast<double>(l.count));
+        probe.setProperty(rt, "meanUs", l.count > 0 ? l.totalNs / 1e3 / l.count : 0.0);
+        probe.setProperty(rt, "p50Us", l.p50Ns / 1e3);
+        probe.setProperty(rt, "p90Us", l.p90Ns / 1e3);
+        probe.setProperty(rt, "p99Us", l.p99Ns / 1e3);
+        probe.setProperty(rt, "maxUs", l.maxNs / 1e3);
+        probe.setProperty(rt, "stalls", static_cast<double>(l.stalls));
+        latency.setProperty(rt, probeName(static_cast<Probe>(i)), probe);
+    }
+
+    jsi::Object result(rt);
+    result.setProperty(rt, "enabled", stats.enabled);
+    result.setProperty(rt, "latency", latency);
+    result.setProperty(rt, "shortReads", static_cast<double>(stats.shortReads));
+    result.setProperty(rt, "shortWrites", static_cast<double>(stats.shortWrites));
+    result.setProperty(rt, "traceRecords", static_cast<double>(stats.traceRecords));
+    result.setProperty(rt, "traceCapacity", static_cast<double>(stats.traceCapacity));
+    return result;
+}
+
+// Device and session IDs are 64-bit; JS gets them as hex strings
+static std::string idToHex(uint64_t id)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id));
+    return hex;
+}
+
+static uint64_t hexToId(jsi::Runtime &rt, const jsi::Value &value)
+{
+    if (!value.isString())
+        return 0;
+    return std::strtoull(value.asString(rt).utf8(rt).c_str(), nullptr, 16);
+}
+
+static jsi::Object peerToJs(jsi::Runtime &rt, const DiscoveredPeer &peer)
+{
+    jsi::Object result(rt);
+    result.setProperty(rt, "id", jsi::String::createFromAscii(rt, idToHex(peer.deviceId)));
+    result.setProperty(rt, "name", jsi::String::createFromUtf8(rt, peer.name));
+    result.setProperty(rt, "address", jsi::String::createFromAscii(rt, peer.address));
+    result.setProperty(rt, "role", jsi::String::createFromAscii(rt, peerRoleName(peer.role)));
+    result.setProperty(rt, "transferPort", static_cast<double>(peer.transferPort));
+    result.setProperty(rt, "capabilities", static_cast<double>(peer.capabilities));
+    return result;
+}
+
+// Runs on the JS thread: hands everything in the mailbox to the callback
+static void deliverProgress(jsi::Runtime &rt, const std::shared_ptr<ProgressMailbox> &mailbox)
+{
+    std::vector<ProgressEvent> events;
+    uint64_t queuedAtNs;
+    {
+        std::lock_guard<std::mutex> lock(mailbox->mutex);
+        events.swap(mailbox->pending);
+        mailbox->queued = false;
+        queuedAtNs = mailbox->queuedAtNs;
+    }
+    if (engine)
+        engine->telemetry().record(Probe::JsQueue, queuedAtNs, events.size());
+    if (!g_progressCallback || mailbox != g_progressMailbox || events.empty())
+        return;
+
+    jsi::Array batch(rt, events.size());
+    for (size_t i = 0; i < events.size(); ++i)
+        batch.setValueAtIndex(rt, i, progressEventToJs(rt, events[i]));
+    try
+    {
+        g_progressCallback->call(rt, batch);
+    }
+    catch (const jsi::JSError &e)
+    {
+        LOGE("Progress callback threw: %s", e.getMessage().c_str());
+    }
+}
+
+// Runs on the reporter thread
+static void postProgress(const std::shared_ptr<react::CallInvoker> &jsInvoker,
+                         const std::shared_ptr<ProgressMailbox> &mailbox,
+                         const Telemetry &telemetry,
+                         const std::vector<ProgressEvent> &events)
+{
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(mailbox->mutex);
+        for (const ProgressEvent &event : events)
+        {
+            auto it = std::find_if(mailbox->pending.begin(), mailbox->pending.end(),
+                                   [&](const ProgressEvent &e)
+                                   { return e.id == event.id; });
+            if (it != mailbox->pending.end())
+                *it = event;
+            else
+                mailbox->pending.push_back(event);
+        }
+        schedule = !mailbox->queued;
+        mailbox->queued = true;
+        if (schedule)
+            mailbox->queuedAtNs = telemetry.start();
+    }
+    if (schedule)
+    {
+        jsInvoker->invokeAsync([mailbox](jsi::Runtime &rt)
+                               { deliverProgress(rt, mailbox); });
+    }
+}
+
+// Lets JS map the engine's progress board as an ArrayBuffer
+class ProgressBoardBuffer : public jsi::MutableBuffer
+{
+public:
+    explicit ProgressBoardBuffer(std::shared_ptr<ProgressBoard> board) : board_(std::move(board)) {}
+    size_t size() const override { return board_->size(); }
+    uint8_t *data() override { return board_->data(); }
+
+private:
+    std::shared_ptr<ProgressBoard> board_;
+};
+
+// Context.getFilesDir().getAbsolutePath(), empty on failure
+static std::string filesDirPath(JNIEnv *env, jobject context)
+{
+    std::string path;
+    jclass contextClass = env->GetObjectClass(context);
+    jmethodID getFilesDir = env->GetMethodID(contextClass, "getFilesDir", "()Ljava/io/File;");
+    jobject dir = getFilesDir ? env->CallObjectMethod(context, getFilesDir) : nullptr;
+    if (dir && !env->ExceptionCheck())
+    {
+        jclass fileClass = env->GetObjectClass(dir);
+        jmethodID getPath = env->GetMethodID(fileClass, "getAbsolutePath", "()Ljava/lang/String;");
+        jstring jPath = getPath ? (jstring)env->CallObjectMethod(dir, getPath) : nullptr;
+        if (jPath && !env->ExceptionCheck())
+        {
+            const char *chars = env->GetStringUTFChars(jPath, nullptr);
+            path = chars;
+            env->ReleaseStringUTFChars(jPath, chars);
+            env->DeleteLocalRef(jPath);
+        }
+        env->DeleteLocalRef(fileClass);
+        env->DeleteLocalRef(dir);
+    }
+    if (env->ExceptionCheck())
+    {
+        LOGE("Failed to get files directory");
+        env->ExceptionClear();
+    }
+    env->DeleteLocalRef(contextClass);
+    return path;
+}
+
+// FilePathResolver.getReceiveDirectory(context), empty on failure
+static std::string receiveDirectoryPath(JNIEnv *env, jclass resolverClass, jobject context)
+{
+    std::string path;
+    jmethodID method = env->GetStaticMethodID(resolverClass, "getReceiveDirectory",
+                                              "(Landroid/content/Context;)Ljava/lang/String;");
+    jstring jPath = method ? (jstring)env->CallStaticObjectMethod(resolverClass, method, context) : nullptr;
+    if (jPath && !env->ExceptionCheck())
+    {
+        const char *chars = env->GetStringUTFChars(jPath, nullptr);
+        path = chars;
+        env->ReleaseStringUTFChars(jPath, chars);
+        env->DeleteLocalRef(jPath);
+    }
+    if (env->ExceptionCheck())
+    {
+        LOGE("Failed to get receive directory");
+        env->ExceptionClear();
+    }
+    return path;
+}
+
+void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance,
+                std::shared_ptr<react::CallInvoker> jsInvoker)
 {
     // Get ReactApplicationContext from the module
     jclass moduleClass = env->GetObjectClass(moduleInstance);
@@ -55,6 +448,14 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
     }
     g_resolverClass = (jclass)env->NewGlobalRef(localResolverClass);
     env->DeleteLocalRef(localResolverClass);
+    g_resolveMethod = env->GetStaticMethodID(
+        g_resolverClass,
+        "getReceiveFilePath",
+        "(Landroid/content/Context;Ljava/lang/String;)Ljava/lang/String;");
+    if (!g_resolveMethod)
+    {
+        env->ExceptionClear();
+    }
 
     LOGI("FilePathResolver class loaded successfully");
 
@@ -64,6 +465,31 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
         engine = std::make_unique<TransferEngine>();
     }
 
+    // After a reload the old callback belongs to a runtime that is gone
+    // and cannot be destroyed safely; let it go without its destructor
+    engine->setProgressListener(nullptr);
+    g_progressCallback.release();
+    g_progressMailbox.reset();
+    if (discovery)
+        discovery->stop();
+    g_peersCallback.release();
+    g_peerMessageCallback.release();
+    ++g_discoveryGeneration;
+    g_jsInvoker = std::move(jsInvoker);
+
+    // Resume journals are app-private; the partial files stay where the resolver put them
+    std::string resumeDir = filesDirPath(env, reactContext);
+    if (!resumeDir.empty())
+        engine->setResumeDirectory(resumeDir + "/resume");
+
+    // Incoming files are named natively; the callback below only serves
+    // if the directory cannot be set up
+    std::string receiveDir = receiveDirectoryPath(env, g_resolverClass, reactContext);
+    if (receiveDir.empty() || !engine->setReceiveDirectory(receiveDir))
+    {
+        LOGE("Native path resolution unavailable, resolving through JNI");
+    }
+
     engine->setPathResolver([](const std::string &filename) -> std::string
                             {
         JNIEnv* env = nullptr;
@@ -85,17 +511,8 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
         std::string resultPath;
         
         if (env && g_contextRef && g_resolverClass) {
-            // Get the static method
-            jmethodID method = env->GetStaticMethodID(
-                g_resolverClass,
-                "getReceiveFilePath",
-                "(Landroid/content/Context;Ljava/lang/String;)Ljava/lang/String;"
-            );
-            
-            if (!method) {
+            if (!g_resolveMethod) {
                 LOGE("getReceiveFilePath method not found");
-                env->ExceptionDescribe();
-                env->ExceptionClear();
                 if (attached) g_jvm->DetachCurrentThread();
                 return "";
             }
@@ -104,7 +521,7 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
             jstring jFilename = env->NewStringUTF(filename.c_str());
             jstring jPath = (jstring)env->CallStaticObjectMethod(
                 g_resolverClass,
-                method,
+                g_resolveMethod,
                 g_contextRef,
                 jFilename
             );
@@ -167,7 +584,7 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
                     engine = std::make_unique<TransferEngine>();
                 }
 
-                uint16_t port = static_cast<uint16_t>(args[0].asNumber());
+                uint16_t port = portArg(rt, args[0], "startReceiver");
                 LOGI("Starting receiver on port %d", port);
                 bool ok = engine->startReceiver(port);
 
@@ -192,7 +609,7 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
                     !args[2].isNumber())
                 {
                     LOGE("startSender: invalid arguments");
-                    return jsi::Value(false);
+                    return jsi::Value(0);
                 }
 
                 if (!engine)
@@ -202,11 +619,91 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
 
                 std::string path = args[0].asString(rt).utf8(rt);
                 std::string ip = args[1].asString(rt).utf8(rt);
-                uint16_t port = static_cast<uint16_t>(args[2].asNumber());
+                uint16_t port = portArg(rt, args[2], "startSender");
 
                 LOGI("Starting sender: %s -> %s:%d", path.c_str(), ip.c_str(), port);
-                bool ok = engine->startSender(path, ip, port);
-                return jsi::Value(ok);
+                uint32_t sessionId = engine->startSender(path, ip, port, sendJobArg(rt, args, count));
+                return jsi::Value(static_cast<double>(sessionId));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "startSenderSession",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "startSenderSession"),
+            3,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 3 ||
+                    !args[0].isObject() ||
+                    !args[0].asObject(rt).isArray(rt) ||
+                    !args[1].isString() ||
+                    !args[2].isNumber())
+                {
+                    LOGE("startSenderSession: invalid arguments");
+                    return jsi::Value(0);
+                }
+
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+
+                jsi::Array jsPaths = args[0].asObject(rt).asArray(rt);
+                std::vector<std::string> paths;
+                paths.reserve(jsPaths.size(rt));
+                for (size_t i = 0; i < jsPaths.size(rt); ++i)
+                {
+                    jsi::Value item = jsPaths.getValueAtIndex(rt, i);
+                    if (item.isString())
+                        paths.push_back(item.asString(rt).utf8(rt));
+                }
+
+                std::string ip = args[1].asString(rt).utf8(rt);
+                uint16_t port = portArg(rt, args[2], "startSenderSession");
+
+                LOGI("Starting sender session: %zu files -> %s:%d", paths.size(), ip.c_str(), port);
+                uint32_t sessionId = engine->startSenderSession(paths, ip, port, sendJobArg(rt, args, count));
+                return jsi::Value(static_cast<double>(sessionId));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "startSenderTree",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "startSenderTree"),
+            3,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 3 ||
+                    !args[0].isString() ||
+                    !args[1].isString() ||
+                    !args[2].isNumber())
+                {
+                    LOGE("startSenderTree: invalid arguments");
+                    return jsi::Value(0);
+                }
+
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+
+                std::string directory = args[0].asString(rt).utf8(rt);
+                std::string ip = args[1].asString(rt).utf8(rt);
+                uint16_t port = portArg(rt, args[2], "startSenderTree");
+
+                LOGI("Starting tree sender: %s -> %s:%d", directory.c_str(), ip.c_str(), port);
+                uint32_t sessionId = engine->startSenderTree(directory, ip, port, sendJobArg(rt, args, count));
+                return jsi::Value(static_cast<double>(sessionId));
             }));
 
     runtime.global().setProperty(
@@ -215,18 +712,44 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
         jsi::Function::createFromHostFunction(
             runtime,
             jsi::PropNameID::forAscii(runtime, "getProgress"),
-            0,
+            1,
             [](jsi::Runtime &,
                const jsi::Value &,
-               const jsi::Value *,
-               size_t) -> jsi::Value
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
             {
                 if (!engine)
                 {
                     return jsi::Value(0.0);
                 }
 
-                return jsi::Value(engine->getProgress());
+                return jsi::Value(engine->getProgress(sessionIdArg(args, count)));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "getSessionProgress",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "getSessionProgress"),
+            1,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                SessionProgress progress{0, 0, 0, 0};
+                if (engine)
+                {
+                    progress = engine->getSessionProgress(sessionIdArg(args, count));
+                }
+
+                jsi::Object result(rt);
+                result.setProperty(rt, "fileIndex", static_cast<double>(progress.fileIndex));
+                result.setProperty(rt, "fileCount", static_cast<double>(progress.fileCount));
+                result.setProperty(rt, "bytesTransferred", static_cast<double>(progress.bytesTransferred));
+                result.setProperty(rt, "totalBytes", static_cast<double>(progress.totalBytes));
+                return result;
             }));
 
     runtime.global().setProperty(
@@ -235,39 +758,429 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
         jsi::Function::createFromHostFunction(
             runtime,
             jsi::PropNameID::forAscii(runtime, "cancelTransfer"),
-            0,
+            1,
             [](jsi::Runtime &,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (engine)
+                {
+                    // With a session ID only that transfer stops
+                    uint32_t sessionId = sessionIdArg(args, count);
+                    LOGI("Cancelling transfer %u", sessionId);
+                    if (sessionId != 0)
+                        engine->cancelSession(sessionId);
+                    else
+                        engine->cancel();
+                }
+
+                return jsi::Value::undefined();
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "setTransferPriority",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "setTransferPriority"),
+            2,
+            [](jsi::Runtime &,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (!engine || count < 2 || !args[1].isNumber())
+                {
+                    return jsi::Value(false);
+                }
+
+                return jsi::Value(engine->setSessionPriority(sessionIdArg(args, count),
+                                                             static_cast<int>(args[1].asNumber())));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "setTransferRateLimit",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "setTransferRateLimit"),
+            2,
+            [](jsi::Runtime &,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (!engine || count < 2 || !args[1].isNumber() || args[1].asNumber() < 0)
+                {
+                    return jsi::Value(false);
+                }
+
+                return jsi::Value(engine->setSessionRateLimit(sessionIdArg(args, count),
+                                                              static_cast<uint64_t>(args[1].asNumber())));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "getTransferSessionStats",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "getTransferSessionStats"),
+            1,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                SessionStats stats{};
+                if (!engine || !engine->getSessionStats(sessionIdArg(args, count), stats))
+                {
+                    return jsi::Value::null();
+                }
+
+                return sessionStatsToJs(rt, stats);
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "listTransferSessions",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "listTransferSessions"),
+            0,
+            [](jsi::Runtime &rt,
                const jsi::Value &,
                const jsi::Value *,
                size_t) -> jsi::Value
             {
+                std::vector<SessionStats> sessions;
                 if (engine)
                 {
-                    LOGI("Cancelling transfer");
-                    engine->cancel();
+                    sessions = engine->listSessions();
                 }
 
+                jsi::Array result(rt, sessions.size());
+                for (size_t i = 0; i < sessions.size(); ++i)
+                    result.setValueAtIndex(rt, i, sessionStatsToJs(rt, sessions[i]));
+                return result;
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "subscribeProgress",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "subscribeProgress"),
+            2,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 1 || !args[0].isObject() || !args[0].asObject(rt).isFunction(rt))
+                {
+                    LOGE("subscribeProgress: invalid arguments");
+                    return jsi::Value(false);
+                }
+                if (!g_jsInvoker)
+                {
+                    LOGE("subscribeProgress: no JS call invoker");
+                    return jsi::Value(false);
+                }
+
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+
+                // One subscriber; a new one replaces the old
+                double rateHz = count > 1 && args[1].isNumber() ? args[1].asNumber() : 10.0;
+                g_progressCallback = std::make_unique<jsi::Function>(args[0].asObject(rt).asFunction(rt));
+                g_progressMailbox = std::make_shared<ProgressMailbox>();
+                engine->setProgressListener(
+                    [jsInvoker = g_jsInvoker, mailbox = g_progressMailbox,
+                     telemetry = &engine->telemetry()](const std::vector<ProgressEvent> &events)
+                    { postProgress(jsInvoker, mailbox, *telemetry, events); },
+                    rateHz);
+                return jsi::Value(true);
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "unsubscribeProgress",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "unsubscribeProgress"),
+            0,
+            [](jsi::Runtime &,
+               const jsi::Value &,
+               const jsi::Value *,
+               size_t) -> jsi::Value
+            {
+                if (engine)
+                {
+                    engine->setProgressListener(nullptr);
+                }
+                g_progressCallback.reset();
+                g_progressMailbox.reset();
                 return jsi::Value::undefined();
             }));
 
     runtime.global().setProperty(
         runtime,
-        "getCurrentFileName",
+        "getProgressBuffer",
         jsi::Function::createFromHostFunction(
             runtime,
-            jsi::PropNameID::forAscii(runtime, "getCurrentFileName"),
+            jsi::PropNameID::forAscii(runtime, "getProgressBuffer"),
             0,
             [](jsi::Runtime &rt,
                const jsi::Value &,
                const jsi::Value *,
                size_t) -> jsi::Value
+            {
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+
+                auto buffer = std::make_shared<ProgressBoardBuffer>(engine->progressBoard());
+                return jsi::ArrayBuffer(rt, buffer);
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "setTransferOptions",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "setTransferOptions"),
+            1,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 1 || !args[0].isObject())
+                {
+                    LOGE("setTransferOptions: invalid arguments");
+                    return jsi::Value(false);
+                }
+
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+
+                // Unspecified keys keep their current value
+                jsi::Object obj = args[0].asObject(rt);
+                TransferOptions options = engine->getOptions();
+
+                jsi::Value zeroCopySend = obj.getProperty(rt, "zeroCopySend");
+                if (zeroCopySend.isBool())
+                    options.zeroCopySend = zeroCopySend.getBool();
+
+                jsi::Value zeroCopyReceive = obj.getProperty(rt, "zeroCopyReceive");
+                if (zeroCopyReceive.isBool())
+                    options.zeroCopyReceive = zeroCopyReceive.getBool();
+
+                numberOption(rt, obj, "chunkSize", 4096, kMaxUint32, options.chunkSize);
+
+                numberOption(rt, obj, "streams", 1, MAX_STREAMS, options.streams);
+
+                numberOption(rt, obj, "pipelineDepth", 0, kMaxUint16, options.pipelineDepth);
+
+                jsi::Value ioUring = obj.getProperty(rt, "ioUring");
+                if (ioUring.isBool())
+                    options.ioUring = ioUring.getBool();
+
+                jsi::Value chunkDigests = obj.getProperty(rt, "chunkDigests");
+                if (chunkDigests.isBool())
+                    options.chunkDigests = chunkDigests.getBool();
+
+                jsi::Value compression = obj.getProperty(rt, "compression");
+                if (compression.isBool())
+                    options.compression = compression.getBool();
+
+                numberOption(rt, obj, "compressionWorkers", 1, kMaxUint16, options.compressionWorkers);
+
+                jsi::Value deltaSync = obj.getProperty(rt, "deltaSync");
+                if (deltaSync.isBool())
+                    options.deltaSync = deltaSync.getBool();
+
+                jsi::Value autoTune = obj.getProperty(rt, "autoTune");
+                if (autoTune.isBool())
+                    options.autoTune = autoTune.getBool();
+
+                numberOption(rt, obj, "cacheWindow", 0, kMaxUint32, options.cacheWindow);
+
+                jsi::Value directWrite = obj.getProperty(rt, "directWrite");
+                if (directWrite.isBool())
+                    options.directWrite = directWrite.getBool();
+
+                jsi::Value encryption = obj.getProperty(rt, "encryption");
+                if (encryption.isBool())
+                    options.encryption = encryption.getBool();
+
+                // Rejected as a whole, leaving every option as it was,
+                // rather than dropping names the caller relies on
+                jsi::Value encryptionSuites = obj.getProperty(rt, "encryptionSuites");
+                if (!encryptionSuites.isUndefined() &&
+                    !encryptionSuitesArg(rt, encryptionSuites, options.encryptionSuites))
+                    return jsi::Value(false);
+
+                jsi::Value pairingSecret = obj.getProperty(rt, "pairingSecret");
+                if (pairingSecret.isString())
+                    options.pairingSecret = pairingSecret.asString(rt).utf8(rt);
+
+                numberOption(rt, obj, "maxActiveSends", 0, kMaxUint16, options.maxActiveSends);
+
+                numberOption(rt, obj, "sendRateLimit", 0, kMaxSafeInteger, options.sendRateLimit);
+
+                jsi::Value reliableUdp = obj.getProperty(rt, "reliableUdp");
+                if (reliableUdp.isBool())
+                    options.reliableUdp = reliableUdp.getBool();
+
+                numberOption(rt, obj, "udpFecGroup", 0, kMaxUint16, options.udpFecGroup);
+
+                // Raised to the pool's minimum like BufferPool::setBudget() would
+                jsi::Value bufferBudget = obj.getProperty(rt, "bufferBudget");
+                if (bufferBudget.isNumber() && bufferBudget.asNumber() > 0)
+                    options.bufferBudget = static_cast<uint32_t>(
+                        std::clamp<double>(bufferBudget.asNumber(), BufferPool::kMinBudget, BufferPool::kMaxBudget));
+
+                engine->setOptions(options);
+                return jsi::Value(true);
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "getIoStats",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "getIoStats"),
+            0,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *,
+               size_t) -> jsi::Value
+            {
+                IoStats stats{};
+                if (engine)
+                {
+                    stats = engine->getIoStats();
+                }
+                return ioStatsToJs(rt, stats);
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "getStats",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "getStats"),
+            0,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *,
+               size_t) -> jsi::Value
+            {
+                IoStats io{};
+                TelemetryStats telemetry{};
+                if (engine)
+                {
+                    io = engine->getIoStats();
+                    telemetry = engine->telemetry().stats();
+                }
+
+                jsi::Object result(rt);
+                result.setProperty(rt, "io", ioStatsToJs(rt, io));
+                result.setProperty(rt, "telemetry", telemetryToJs(rt, telemetry));
+                return result;
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "setTelemetry",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "setTelemetry"),
+            1,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 1 || !args[0].isObject())
+                {
+                    LOGE("setTelemetry: invalid arguments");
+                    return jsi::Value(false);
+                }
+
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+
+                jsi::Object obj = args[0].asObject(rt);
+                Telemetry &telemetry = engine->telemetry();
+
+                jsi::Value reset = obj.getProperty(rt, "reset");
+                if (reset.isBool() && reset.getBool())
+                    telemetry.reset();
+
+                jsi::Value enabled = obj.getProperty(rt, "enabled");
+                jsi::Value traceRecords = obj.getProperty(rt, "traceRecords");
+                size_t records = traceRecords.isNumber() && traceRecords.asNumber() > 0
+                                     ? static_cast<size_t>(traceRecords.asNumber())
+                                     : 0;
+                if (enabled.isBool())
+                    telemetry.enable(enabled.getBool(), records);
+                return jsi::Value(true);
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "dumpTrace",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "dumpTrace"),
+            1,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 1 || !args[0].isString())
+                {
+                    LOGE("dumpTrace: invalid arguments");
+                    return jsi::Value(false);
+                }
+                if (!engine)
+                {
+                    return jsi::Value(false);
+                }
+
+                std::string path = args[0].asString(rt).utf8(rt);
+                return jsi::Value(engine->telemetry().dumpTrace(path));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "getCurrentFileName",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "getCurrentFileName"),
+            1,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
             {
                 if (!engine)
                 {
                     return jsi::Value(jsi::String::createFromUtf8(rt, ""));
                 }
 
-                std::string fileName = engine->getCurrentFileName();
+                std::string fileName = engine->getCurrentFileName(sessionIdArg(args, count));
                 return jsi::Value(jsi::String::createFromUtf8(rt, fileName));
             }));
 
@@ -277,20 +1190,196 @@ void installJSI(jsi::Runtime &runtime, JNIEnv *env, jobject moduleInstance)
         jsi::Function::createFromHostFunction(
             runtime,
             jsi::PropNameID::forAscii(runtime, "getCurrentFileSize"),
-            0,
+            1,
             [](jsi::Runtime &,
                const jsi::Value &,
-               const jsi::Value *,
-               size_t) -> jsi::Value
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
             {
                 if (!engine)
                 {
                     return jsi::Value(0);
                 }
 
-                uint64_t fileSize = engine->getCurrentFileSize();
+                uint64_t fileSize = engine->getCurrentFileSize(sessionIdArg(args, count));
                 return jsi::Value(static_cast<double>(fileSize));
             }));
 
+    runtime.global().setProperty(
+        runtime,
+        "startPeerDiscovery",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "startPeerDiscovery"),
+            3,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 3 || !args[0].isObject() ||
+                    !args[1].isObject() || !args[1].asObject(rt).isFunction(rt) ||
+                    !args[2].isObject() || !args[2].asObject(rt).isFunction(rt))
+                {
+                    LOGE("startPeerDiscovery: invalid arguments");
+                    return jsi::Value::null();
+                }
+                if (!g_jsInvoker)
+                {
+                    LOGE("startPeerDiscovery: no JS call invoker");
+                    return jsi::Value::null();
+                }
+
+                if (!engine)
+                {
+                    engine = std::make_unique<TransferEngine>();
+                }
+                if (!discovery)
+                {
+                    discovery = std::make_unique<DiscoveryEngine>();
+                }
+                discovery->stop();
+
+                jsi::Object obj = args[0].asObject(rt);
+                DiscoverySettings settings;
+                jsi::Value role = obj.getProperty(rt, "role");
+                if (role.isString() && role.asString(rt).utf8(rt) == "receive")
+                    settings.role = PeerRole::Receive;
+                jsi::Value name = obj.getProperty(rt, "name");
+                if (name.isString())
+                    settings.name = name.asString(rt).utf8(rt);
+                jsi::Value transferPort = obj.getProperty(rt, "transferPort");
+                if (!transferPort.isUndefined())
+                    settings.transferPort = portArg(rt, transferPort, "startPeerDiscovery");
+                settings.capabilities = engine->capabilities();
+
+                g_peersCallback = std::make_unique<jsi::Function>(args[1].asObject(rt).asFunction(rt));
+                g_peerMessageCallback = std::make_unique<jsi::Function>(args[2].asObject(rt).asFunction(rt));
+                uint64_t generation = ++g_discoveryGeneration;
+
+                auto onPeers = [jsInvoker = g_jsInvoker, generation](const std::vector<DiscoveredPeer> &peers)
+                {
+                    jsInvoker->invokeAsync([peers, generation](jsi::Runtime &rt)
+                                           {
+                        if (generation != g_discoveryGeneration || !g_peersCallback)
+                            return;
+                        jsi::Array list(rt, peers.size());
+                        for (size_t i = 0; i < peers.size(); ++i)
+                            list.setValueAtIndex(rt, i, peerToJs(rt, peers[i]));
+                        try
+                        {
+                            g_peersCallback->call(rt, list);
+                        }
+                        catch (const jsi::JSError &e)
+                        {
+                            LOGE("Peers callback threw: %s", e.getMessage().c_str());
+                        } });
+                };
+                auto onMessage = [jsInvoker = g_jsInvoker, generation](PeerMessage message,
+                                                                       const DiscoveredPeer &peer,
+                                                                       uint64_t sessionId)
+                {
+                    jsInvoker->invokeAsync([message, peer, sessionId, generation](jsi::Runtime &rt)
+                                           {
+                        if (generation != g_discoveryGeneration || !g_peerMessageCallback)
+                            return;
+                        try
+                        {
+                            g_peerMessageCallback->call(rt,
+                                                        jsi::String::createFromAscii(rt, peerMessageName(message)),
+                                                        peerToJs(rt, peer),
+                                                        jsi::String::createFromAscii(rt, idToHex(sessionId)));
+                        }
+                        catch (const jsi::JSError &e)
+                        {
+                            LOGE("Peer message callback threw: %s", e.getMessage().c_str());
+                        } });
+                };
+
+                if (!discovery->start(settings, onPeers, onMessage))
+                {
+                    g_peersCallback.reset();
+                    g_peerMessageCallback.reset();
+                    return jsi::Value::null();
+                }
+                return jsi::String::createFromAscii(rt, idToHex(discovery->deviceId()));
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "stopPeerDiscovery",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "stopPeerDiscovery"),
+            0,
+            [](jsi::Runtime &,
+               const jsi::Value &,
+               const jsi::Value *,
+               size_t) -> jsi::Value
+            {
+                if (discovery)
+                {
+                    discovery->stop();
+                }
+                ++g_discoveryGeneration;
+                g_peersCallback.reset();
+                g_peerMessageCallback.reset();
+                return jsi::Value::undefined();
+            }));
+
+    runtime.global().setProperty(
+        runtime,
+        "sendPeerMessage",
+        jsi::Function::createFromHostFunction(
+            runtime,
+            jsi::PropNameID::forAscii(runtime, "sendPeerMessage"),
+            3,
+            [](jsi::Runtime &rt,
+               const jsi::Value &,
+               const jsi::Value *args,
+               size_t count) -> jsi::Value
+            {
+                if (count < 2 || !args[0].isString() || !args[1].isString())
+                {
+                    LOGE("sendPeerMessage: invalid arguments");
+                    return jsi::Value::null();
+                }
+                if (!discovery)
+                {
+                    return jsi::Value::null();
+                }
+
+                std::string type = args[0].asString(rt).utf8(rt);
+                PeerMessage message;
+                if (type == "lock")
+                    message = PeerMessage::Lock;
+                else if (type == "bye")
+                    message = PeerMessage::Bye;
+                else if (type == "cancel")
+                    message = PeerMessage::Cancel;
+                else
+                {
+                    LOGE("sendPeerMessage: unknown message %s", type.c_str());
+                    return jsi::Value::null();
+                }
+
+                // A LOCK without a session opens a new one
+                uint64_t sessionId = count > 2 ? hexToId(rt, args[2]) : 0;
+                while (sessionId == 0 && message == PeerMessage::Lock)
+                {
+                    if (!randomBytes(&sessionId, sizeof(sessionId)))
+                    {
+                        LOGE("sendPeerMessage: no random session id");
+                        return jsi::Value::null();
+                    }
+                }
+
+                if (!discovery->send(message, hexToId(rt, args[1]), sessionId))
+                {
+                    return jsi::Value::null();
+                }
+                return jsi::String::createFromAscii(rt, idToHex(sessionId));
+            }));
+
     LOGI("JSI installation complete");
 }
@@ -0,0 +1,589 @@
+// Loopback benchmark of the transfer engine on a plain Linux host.
+//
+// One process runs a receiver and a sender over 127.0.0.1 for every
+// combination of file size, chunk size and I/O mode, and prints one
+// result per line so two runs can be diffed:
+//
+//   transfer_bench [--sizes 1K,1M,64M,1G,8G] [--chunks 64K,256K,1M]
+//                  [--modes copy,zerocopy,pipeline,uring,striped,lz4,aes,chacha,
+//                           udp,udp-fec]
+//                  [--repeat N] [--format json|csv] [--data sparse|random]
+//                  [--dir /tmp] [--port 47800] [--no-digests] [--verbose]
+//                  [--telemetry] [--trace RECORDS]
+//                  [--loss PCT] [--delay MS] [--jitter MS] [--budget SIZE]
+//
+// Source files are created sparse by default, so an 8 GB case costs no
+// disk space (and reads as zeros, which flatters lz4). CPU time and
+// syscall counts cover sender and receiver together: both run in this
+// process. Syscalls are the read- and write-family counts the kernel
+// keeps in /proc/self/io, plus io_uring submissions. A case is ok only
+// when both sessions complete and the received file matches the source
+// byte for byte.
+//
+// --loss, --delay and --jitter impair the UDP modes' datagrams in both
+// directions, inside the engines; TCP modes run on the clean loopback.
+//
+// --budget sets each engine's buffer pool budget; buffer_waits counts
+// the times either engine held a reader back for it.
+//
+// --telemetry turns on the engines' latency histograms, to measure what
+// they cost, and prints a summary per engine to stderr at the end.
+// --trace also keeps that many trace records per engine and dumps them
+// next to the source files.
+
+#include "transfer_engine.h"
+#include "log.h"
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace swiftshare;
+
+namespace
+{
+    struct Mode
+    {
+        const char *name;
+        void (*apply)(TransferOptions &options);
+    };
+
+    const Mode kModes[] = {
+        {"copy", [](TransferOptions &o)
+         { o.zeroCopySend = false; o.zeroCopyReceive = false; }},
+        {"zerocopy", [](TransferOptions &) {}},
+        {"pipeline", [](TransferOptions &o)
+         { o.pipelineDepth = 8; }},
+        {"uring", [](TransferOptions &o)
+         { o.ioUring = true; }},
+        {"striped", [](TransferOptions &o)
+         { o.streams = 4; }},
+        {"lz4", [](TransferOptions &o)
+         { o.compression = true; }},
+        {"aes", [](TransferOptions &o)
+         { o.encryption = true; o.encryptionSuites = SUITE_AES_256_GCM; }},
+        {"chacha", [](TransferOptions &o)
+         { o.encryption = true; o.encryptionSuites = SUITE_CHACHA20_POLY1305; }},
+        {"udp", [](TransferOptions &o)
+         { o.reliableUdp = true; }},
+        {"udp-fec", [](TransferOptions &o)
+         { o.reliableUdp = true; o.udpFecGroup = 8; }},
+    };
+
+    struct Config
+    {
+        std::vector<uint64_t> sizes{1024ull, 1ull << 20, 64ull << 20, 1ull << 30, 8ull << 30};
+        std::vector<uint32_t> chunks{64 * 1024, 256 * 1024, 1024 * 1024};
+        std::vector<const Mode *> modes;
+        std::string dir = "/tmp";
+        uint16_t port = 47800;
+        int repeat = 1;
+        bool csv = false;
+        bool randomData = false;
+        bool digests = true;
+        bool verbose = false;
+        bool telemetry = false;
+        size_t traceRecords = 0;
+        LinkImpairment impairment;
+        uint64_t bufferBudget = 0; // 0 = the engine default
+    };
+
+    struct Counters
+    {
+        double cpuSeconds;
+        uint64_t syscr;
+        uint64_t syscw;
+        uint64_t uringSubmits;
+        uint64_t udpRetransmits;
+        uint64_t udpRecovered;
+        uint64_t bufferWaits;
+    };
+
+    struct Result
+    {
+        bool ok;
+        double seconds;
+        Counters used;
+        uint64_t peakRssKb;
+    };
+
+    bool verboseLog = false;
+
+    void benchLogSink(LogLevel level, const char *tag, const char *message)
+    {
+        if (level == LogLevel::Error || verboseLog)
+            fprintf(stderr, "%c/%s: %s\n", level == LogLevel::Error ? 'E' : 'I', tag, message);
+    }
+
+    // "64K", "1M", "8G" or plain bytes
+    bool parseSize(const std::string &text, uint64_t &value)
+    {
+        char *end = nullptr;
+        unsigned long long number = strtoull(text.c_str(), &end, 10);
+        if (end == text.c_str())
+            return false;
+        switch (*end)
+        {
+        case 'K': case 'k': number <<= 10; end++; break;
+        case 'M': case 'm': number <<= 20; end++; break;
+        case 'G': case 'g': number <<= 30; end++; break;
+        default: break;
+        }
+        value = number;
+        return *end == '\0' && number > 0;
+    }
+
+    std::vector<std::string> splitList(const std::string &text)
+    {
+        std::vector<std::string> items;
+        size_t start = 0;
+        while (start <= text.size())
+        {
+            size_t comma = text.find(',', start);
+            if (comma == std::string::npos)
+                comma = text.size();
+            if (comma > start)
+                items.push_back(text.substr(start, comma - start));
+            start = comma + 1;
+        }
+        return items;
+    }
+
+    std::string sizeLabel(uint64_t bytes)
+    {
+        const char *units[] = {"", "K", "M", "G"};
+        int unit = 0;
+        while (unit < 3 && bytes % 1024 == 0 && bytes >= 1024)
+        {
+            bytes /= 1024;
+            unit++;
+        }
+        return std::to_string(bytes) + units[unit];
+    }
+
+    void usage()
+    {
+        fprintf(stderr,
+                "usage: transfer_bench [--sizes LIST] [--chunks LIST] [--modes LIST]\n"
+                "                      [--repeat N] [--format json|csv] [--data sparse|random]\n"
+                "                      [--dir PATH] [--port N] [--no-digests] [--verbose]\n"
+                "                      [--telemetry] [--trace RECORDS]\n"
+                "                      [--loss PCT] [--delay MS] [--jitter MS] [--budget SIZE]\n"
+                "modes:");
+        for (const Mode &mode : kModes)
+            fprintf(stderr, " %s", mode.name);
+        fprintf(stderr, "\n");
+    }
+
+    bool parseArgs(int argc, char **argv, Config &config)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+            bool takesValue = arg != "--no-digests" && arg != "--verbose" && arg != "--telemetry";
+            if (takesValue && !value)
+                return false;
+
+            if (arg == "--sizes" || arg == "--chunks")
+            {
+                std::vector<uint64_t> sizes;
+                for (const std::string &item : splitList(value))
+                {
+                    uint64_t size = 0;
+                    if (!parseSize(item, size))
+                        return false;
+                    sizes.push_back(size);
+                }
+                if (arg == "--sizes")
+                    config.sizes = sizes;
+                else
+                    config.chunks.assign(sizes.begin(), sizes.end());
+            }
+            else if (arg == "--modes")
+            {
+                config.modes.clear();
+                for (const std::string &item : splitList(value))
+                {
+                    const Mode *found = nullptr;
+                    for (const Mode &mode : kModes)
+                        if (item == mode.name)
+                            found = &mode;
+                    if (!found)
+                        return false;
+                    config.modes.push_back(found);
+                }
+            }
+            else if (arg == "--repeat")
+                config.repeat = atoi(value);
+            else if (arg == "--format")
+                config.csv = strcmp(value, "csv") == 0;
+            else if (arg == "--data")
+                config.randomData = strcmp(value, "random") == 0;
+            else if (arg == "--dir")
+                config.dir = value;
+            else if (arg == "--port")
+                config.port = (uint16_t)atoi(value);
+            else if (arg == "--no-digests")
+                config.digests = false;
+            else if (arg == "--verbose")
+                config.verbose = true;
+            else if (arg == "--telemetry")
+                config.telemetry = true;
+            else if (arg == "--trace")
+            {
+                config.telemetry = true;
+                config.traceRecords = (size_t)atoll(value);
+            }
+            else if (arg == "--loss")
+                config.impairment.loss = atof(value) / 100;
+            else if (arg == "--delay")
+                config.impairment.delayMs = (uint32_t)atoi(value);
+            else if (arg == "--jitter")
+                config.impairment.jitterMs = (uint32_t)atoi(value);
+            else if (arg == "--budget")
+            {
+                if (!parseSize(value, config.bufferBudget))
+                    return false;
+            }
+            else
+                return false;
+
+            if (takesValue)
+                i++;
+        }
+        if (config.modes.empty())
+            for (const Mode &mode : kModes)
+                config.modes.push_back(&mode);
+        return config.repeat > 0 && !config.chunks.empty() && !config.sizes.empty();
+    }
+
+    bool createSource(const std::string &path, uint64_t size, bool randomData)
+    {
+        int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+        bool ok = ftruncate(fd, (off_t)size) == 0;
+        if (ok && randomData)
+        {
+            std::vector<uint64_t> block(1 << 17);
+            uint64_t state = 0x9E3779B97F4A7C15ULL ^ size;
+            for (uint64_t offset = 0; ok && offset < size;)
+            {
+                for (uint64_t &word : block)
+                {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    word = state;
+                }
+                size_t want = block.size() * sizeof(uint64_t);
+                if (want > size - offset)
+                    want = (size_t)(size - offset);
+                ok = pwrite(fd, block.data(), want, (off_t)offset) == (ssize_t)want;
+                offset += want;
+            }
+        }
+        close(fd);
+        return ok;
+    }
+
+    // Read- and write-family syscall counts of this process
+    void readProcIo(uint64_t &syscr, uint64_t &syscw)
+    {
+        syscr = syscw = 0;
+        FILE *f = fopen("/proc/self/io", "r");
+        if (!f)
+            return;
+        char key[32];
+        unsigned long long value;
+        while (fscanf(f, "%31[^:]: %llu\n", key, &value) == 2)
+        {
+            if (strcmp(key, "syscr") == 0)
+                syscr = value;
+            else if (strcmp(key, "syscw") == 0)
+                syscw = value;
+        }
+        fclose(f);
+    }
+
+    Counters sampleCounters(const TransferEngine &tx, const TransferEngine &rx)
+    {
+        Counters counters{};
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        counters.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                              usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        readProcIo(counters.syscr, counters.syscw);
+        IoStats txStats = tx.getIoStats();
+        IoStats rxStats = rx.getIoStats();
+        counters.uringSubmits = txStats.uringSubmits + rxStats.uringSubmits;
+        counters.udpRetransmits = txStats.udpRetransmits + rxStats.udpRetransmits;
+        counters.udpRecovered = txStats.udpRecovered + rxStats.udpRecovered;
+        counters.bufferWaits = txStats.bufferWaits + rxStats.bufferWaits;
+        return counters;
+    }
+
+    // Starts a new peak-RSS window (Linux 4.0+; ignored elsewhere)
+    void resetPeakRss()
+    {
+        int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            write(fd, "5", 1);
+            close(fd);
+        }
+    }
+
+    uint64_t peakRssKb()
+    {
+        FILE *f = fopen("/proc/self/status", "r");
+        uint64_t kb = 0;
+        if (f)
+        {
+            char line[256];
+            while (fgets(line, sizeof(line), f))
+                if (sscanf(line, "VmHWM: %lu kB", &kb) == 1)
+                    break;
+            fclose(f);
+        }
+        if (kb == 0)
+        {
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            kb = (uint64_t)usage.ru_maxrss;
+        }
+        return kb;
+    }
+
+    // Byte-for-byte comparison, outside the timed part of a case
+    bool sameContents(const std::string &expected, const std::string &actual)
+    {
+        int a = open(expected.c_str(), O_RDONLY | O_CLOEXEC);
+        int b = open(actual.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat sa{}, sb{};
+        bool same = a >= 0 && b >= 0 && fstat(a, &sa) == 0 && fstat(b, &sb) == 0 &&
+                    sa.st_size == sb.st_size;
+        std::vector<char> left(1 << 20), right(1 << 20);
+        for (off_t offset = 0; same && offset < sa.st_size;)
+        {
+            ssize_t n = pread(a, left.data(), left.size(), offset);
+            same = n > 0 && pread(b, right.data(), (size_t)n, offset) == n &&
+                   memcmp(left.data(), right.data(), (size_t)n) == 0;
+            offset += n;
+        }
+        if (a >= 0)
+            close(a);
+        if (b >= 0)
+            close(b);
+        return same;
+    }
+
+    // Newest receive session, 0 if none
+    uint32_t latestReceive(const TransferEngine &rx, SessionState &state)
+    {
+        uint32_t id = 0;
+        for (const SessionStats &stats : rx.listSessions())
+        {
+            if (stats.direction == SessionDirection::Receive && stats.id > id)
+            {
+                id = stats.id;
+                state = stats.state;
+            }
+        }
+        return id;
+    }
+
+    Result runCase(TransferEngine &tx, TransferEngine &rx, const std::string &source,
+                   const std::string &output, uint16_t port)
+    {
+        Result result{};
+        SessionState rxState = SessionState::Active;
+        uint32_t previousReceive = latestReceive(rx, rxState);
+
+        resetPeakRss();
+        Counters before = sampleCounters(tx, rx);
+        auto start = std::chrono::steady_clock::now();
+
+        uint32_t id = tx.startSender(source, "127.0.0.1", port);
+        if (id == 0)
+            return result;
+
+        SessionStats sent{};
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            tx.getSessionStats(id, sent);
+        } while (sent.state == SessionState::Active);
+
+        // The receiver settles a moment after the sender's last byte
+        uint32_t received = 0;
+        for (;;)
+        {
+            received = latestReceive(rx, rxState);
+            if (received > previousReceive && rxState != SessionState::Active)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        Counters after = sampleCounters(tx, rx);
+        result.used.cpuSeconds = after.cpuSeconds - before.cpuSeconds;
+        result.used.syscr = after.syscr - before.syscr;
+        result.used.syscw = after.syscw - before.syscw;
+        result.used.uringSubmits = after.uringSubmits - before.uringSubmits;
+        result.used.udpRetransmits = after.udpRetransmits - before.udpRetransmits;
+        result.used.udpRecovered = after.udpRecovered - before.udpRecovered;
+        result.used.bufferWaits = after.bufferWaits - before.bufferWaits;
+        result.peakRssKb = peakRssKb();
+        result.ok = sent.state == SessionState::Completed && rxState == SessionState::Completed &&
+                    sameContents(source, output);
+        return result;
+    }
+
+    void printResult(const Config &config, uint64_t size, uint32_t chunk, const Mode &mode,
+                     int run, const Result &result)
+    {
+        double mb = size / (1024.0 * 1024.0);
+        double gb = size / (1024.0 * 1024.0 * 1024.0);
+        double mbps = result.seconds > 0 ? mb / result.seconds : 0.0;
+        double cpuPerGb = gb > 0 ? result.used.cpuSeconds / gb : 0.0;
+
+        if (config.csv)
+        {
+            printf("%s,%llu,%u,%s,%d,%s,%.6f,%.1f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                   sizeLabel(size).c_str(), (unsigned long long)size, chunk, mode.name, run,
+                   result.ok ? "ok" : "failed", result.seconds, mbps, cpuPerGb,
+                   (unsigned long long)result.used.syscr, (unsigned long long)result.used.syscw,
+                   (unsigned long long)result.used.uringSubmits, (unsigned long long)result.peakRssKb,
+                   (unsigned long long)result.used.udpRetransmits,
+                   (unsigned long long)result.used.udpRecovered,
+                   (unsigned long long)result.used.bufferWaits);
+        }
+        else
+        {
+            printf("{\"size\":\"%s\",\"bytes\":%llu,\"chunk\":%u,\"mode\":\"%s\",\"run\":%d,"
+                   "\"ok\":%s,\"seconds\":%.6f,\"mb_per_s\":%.1f,\"cpu_s_per_gb\":%.3f,"
+                   "\"syscr\":%llu,\"syscw\":%llu,\"uring_submits\":%llu,\"peak_rss_kb\":%llu,"
+                   "\"udp_resent\":%llu,\"udp_rebuilt\":%llu,\"buffer_waits\":%llu}\n",
+                   sizeLabel(size).c_str(), (unsigned long long)size, chunk, mode.name, run,
+                   result.ok ? "true" : "false", result.seconds, mbps, cpuPerGb,
+                   (unsigned long long)result.used.syscr, (unsigned long long)result.used.syscw,
+                   (unsigned long long)result.used.uringSubmits, (unsigned long long)result.peakRssKb,
+                   (unsigned long long)result.used.udpRetransmits,
+                   (unsigned long long)result.used.udpRecovered,
+                   (unsigned long long)result.used.bufferWaits);
+        }
+        fflush(stdout);
+    }
+
+    void printTelemetry(const char *engine, const TelemetryStats &stats)
+    {
+        fprintf(stderr, "%s: short reads %llu, short writes %llu, trace %llu/%llu\n", engine,
+                (unsigned long long)stats.shortReads, (unsigned long long)stats.shortWrites,
+                (unsigned long long)stats.traceRecords, (unsigned long long)stats.traceCapacity);
+        for (size_t i = 0; i < (size_t)Probe::Count; ++i)
+        {
+            const LatencySummary &l = stats.latency[i];
+            if (l.count == 0)
+                continue;
+            fprintf(stderr, "  %-8s n=%-9llu mean=%.1fus p50<%.1fus p90<%.1fus p99<%.1fus max=%.1fus stalls=%llu\n",
+                    probeName((Probe)i), (unsigned long long)l.count, l.totalNs / 1e3 / l.count,
+                    l.p50Ns / 1e3, l.p90Ns / 1e3, l.p99Ns / 1e3, l.maxNs / 1e3,
+                    (unsigned long long)l.stalls);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Config config;
+    if (!parseArgs(argc, argv, config))
+    {
+        usage();
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    verboseLog = config.verbose;
+    setLogSink(benchLogSink);
+
+    std::string output = config.dir + "/swiftshare-bench.out";
+    TransferEngine rx;
+    TransferEngine tx;
+    rx.setPathResolver([output](const std::string &)
+                       { return output; });
+    if (config.telemetry)
+    {
+        tx.telemetry().enable(true, config.traceRecords);
+        rx.telemetry().enable(true, config.traceRecords);
+    }
+    if (!rx.startReceiver(config.port))
+    {
+        fprintf(stderr, "cannot listen on port %u\n", config.port);
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    if (config.csv)
+        printf("size,bytes,chunk,mode,run,status,seconds,mb_per_s,cpu_s_per_gb,"
+               "syscr,syscw,uring_submits,peak_rss_kb,udp_resent,udp_rebuilt,buffer_waits\n");
+
+    int failures = 0;
+    for (uint64_t size : config.sizes)
+    {
+        std::string source = config.dir + "/swiftshare-bench-" + sizeLabel(size) + ".src";
+        if (!createSource(source, size, config.randomData))
+        {
+            fprintf(stderr, "cannot create %s\n", source.c_str());
+            return 1;
+        }
+
+        for (uint32_t chunk : config.chunks)
+        {
+            for (const Mode *mode : config.modes)
+            {
+                // Fixed chunk size per case, so no auto-tuning
+                TransferOptions options;
+                options.chunkSize = chunk;
+                options.chunkDigests = config.digests;
+                options.autoTune = false;
+                options.udpImpairment = config.impairment;
+                if (config.bufferBudget > 0)
+                    options.bufferBudget = (uint32_t)config.bufferBudget;
+                mode->apply(options);
+                tx.setOptions(options);
+                rx.setOptions(options);
+
+                for (int run = 0; run < config.repeat; ++run)
+                {
+                    Result result = runCase(tx, rx, source, output, config.port);
+                    if (!result.ok)
+                        failures++;
+                    printResult(config, size, chunk, *mode, run, result);
+                    unlink(output.c_str());
+                }
+            }
+        }
+        unlink(source.c_str());
+    }
+
+    if (config.telemetry)
+    {
+        printTelemetry("sender", tx.telemetry().stats());
+        printTelemetry("receiver", rx.telemetry().stats());
+    }
+    if (config.traceRecords > 0)
+    {
+        tx.telemetry().dumpTrace(config.dir + "/swiftshare-bench-tx.trace");
+        rx.telemetry().dumpTrace(config.dir + "/swiftshare-bench-rx.trace");
+    }
+    return failures == 0 ? 0 : 1;
+}
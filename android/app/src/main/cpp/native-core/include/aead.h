@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace swiftshare
+{
+    // AEAD suites of encrypted connections (see secure_channel.h)
+    enum class AeadSuite : uint8_t
+    {
+        Aes256Gcm,        // only where the CPU has AES and carry-less multiply
+        ChaCha20Poly1305, // RFC 8439, portable
+    };
+
+    constexpr size_t kAeadKeySize = 32;
+    constexpr size_t kAeadNonceSize = 12;
+    constexpr size_t kAeadTagSize = 16;
+
+    // True if AES-256-GCM runs on AES-NI + PCLMULQDQ (x86) or the ARMv8
+    // AES + PMULL instructions (arm64) here, checked at run time and
+    // against a known answer. There is no software AES: without these
+    // instructions connections use ChaCha20-Poly1305.
+    bool aesGcmAccelerated();
+    // Suite and implementation, for logs
+    const char *aeadImplementation(AeadSuite suite);
+
+    // One key of one suite. seal() and open() work in place and keep no
+    // state between calls, so any number of threads may share an Aead.
+    class Aead
+    {
+    public:
+        // Aes256Gcm requires aesGcmAccelerated()
+        Aead(AeadSuite suite, const uint8_t key[kAeadKeySize]);
+        ~Aead();
+
+        Aead(const Aead &) = delete;
+        Aead &operator=(const Aead &) = delete;
+
+        AeadSuite suite() const { return suite_; }
+
+        // Encrypts `len` bytes at `data` and authenticates them with `aad`
+        void seal(const uint8_t nonce[kAeadNonceSize], const void *aad, size_t aadLen,
+                  uint8_t *data, size_t len, uint8_t tag[kAeadTagSize]) const;
+        // Decrypts and checks the tag; on a mismatch `data` is zeroed and
+        // false returned
+        bool open(const uint8_t nonce[kAeadNonceSize], const void *aad, size_t aadLen,
+                  uint8_t *data, size_t len, const uint8_t tag[kAeadTagSize]) const;
+
+    private:
+        // AES: 15 round keys, then H^1..H^8 for GHASH. ChaCha20: the key.
+        static constexpr size_t kScheduleSize = 23 * 16;
+
+        AeadSuite suite_;
+        alignas(16) uint8_t schedule_[kScheduleSize];
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace swiftshare
+{
+    class BufferPool;
+
+    // A buffer on loan from a BufferPool, handed back when destroyed.
+    // Empty when the pool refused it.
+    class PooledBuffer
+    {
+    public:
+        PooledBuffer() = default;
+        ~PooledBuffer() { release(); }
+
+        PooledBuffer(PooledBuffer &&other) noexcept;
+        PooledBuffer &operator=(PooledBuffer &&other) noexcept;
+        PooledBuffer(const PooledBuffer &) = delete;
+        PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+        char *data() const { return data_; }
+        // The whole size class, at least what was asked for
+        size_t size() const { return size_; }
+        explicit operator bool() const { return data_ != nullptr; }
+
+        void release();
+
+    private:
+        friend class BufferPool;
+        PooledBuffer(BufferPool *pool, char *data, size_t size, bool persistent)
+            : pool_(pool), data_(data), size_(size), persistent_(persistent) {}
+
+        BufferPool *pool_ = nullptr;
+        char *data_ = nullptr;
+        size_t size_ = 0;
+        bool persistent_ = false;
+    };
+
+    struct BufferPoolStats
+    {
+        uint64_t budget;
+        uint64_t allocated; // in use plus cached for reuse
+        uint64_t inUse;
+        uint64_t peakInUse;
+        uint64_t waits;    // acquire() calls that had to wait for a release
+        uint64_t rejected; // asked for more than the pool will ever give
+    };
+
+    // Every data-path buffer of one engine: page-aligned, in power-of-two
+    // size classes from kMinBuffer plus a page, so a chunk and the framing
+    // around it share a class with the bare chunk, and reused through a
+    // free list per class.
+    // Allocated bytes, in use or cached, never exceed the budget.
+    //
+    // acquire() is for a buffer held across one chunk or pack. When the
+    // budget is spent it frees cached buffers of other classes, then
+    // waits for a release, so a reader that cannot get a buffer stops
+    // pulling from its socket or file until another lets go of one.
+    // A thread never waits while holding an acquire()d buffer; buffers
+    // held across a whole transfer come from reserve(), which never
+    // waits and is capped at half the budget, leaving the other half
+    // for the per-chunk ones.
+    //
+    // No single buffer may exceed half the budget, which also bounds
+    // what a peer's declared chunk size can make us allocate.
+    class BufferPool
+    {
+    public:
+        static constexpr size_t kMinBuffer = 64 * 1024;
+        static constexpr size_t kDefaultBudget = 64 * 1024 * 1024;
+        static constexpr size_t kMinBudget = 4 * 1024 * 1024;
+        // Past what any phone should pin for transfers, and within the
+        // uint32_t TransferOptions carries it in
+        static constexpr size_t kMaxBudget = 1024 * 1024 * 1024;
+
+        explicit BufferPool(size_t budget = kDefaultBudget);
+        ~BufferPool();
+
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        // Clamped to kMinBudget..kMaxBudget. Takes effect as buffers come
+        // back; a smaller budget frees the cache at once
+        void setBudget(size_t budget);
+
+        // Blocks until the budget has room, or with `wait` false returns
+        // empty instead; empty if `size` can never fit or memory is
+        // exhausted
+        PooledBuffer acquire(size_t size, bool wait = true);
+        // Never waits, and empty once reserved buffers reach half the
+        // budget. The caller falls back to a path without the buffer.
+        PooledBuffer reserve(size_t size);
+
+        // Largest size acquire() hands out, less the class's page of
+        // framing room
+        size_t largest() const;
+
+        // Frees every cached buffer, for when the engine goes idle
+        void trim();
+        BufferPoolStats stats() const;
+
+    private:
+        friend class PooledBuffer;
+
+        static constexpr size_t kClasses = 16; // up to 2 GB, beyond any budget
+        static constexpr size_t kPage = 4096;
+
+        static size_t classSize(size_t cls) { return (kMinBuffer << cls) + kPage; }
+        PooledBuffer take(size_t size, bool wait, bool persistent);
+        void give(char *data, size_t size, bool persistent);
+        bool evictOther(size_t keep);
+
+        mutable std::mutex mutex_;
+        std::condition_variable released_;
+        std::vector<char *> free_[kClasses];
+        size_t budget_;
+        size_t allocated_;
+        size_t inUse_;
+        size_t persistent_;
+        size_t peakInUse_;
+        uint64_t waits_;
+        uint64_t rejected_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace swiftshare
+{
+    // Streaming XXH64, bit-compatible with the reference implementation
+    // (xxhash.h XXH64_update / XXH64_digest).
+    class Xxh64
+    {
+    public:
+        explicit Xxh64(uint64_t seed = 0);
+
+        void reset(uint64_t seed = 0);
+        void update(const void *data, size_t len);
+        uint64_t digest() const;
+
+    private:
+        uint64_t v_[4];
+        uint64_t seed_;
+        uint64_t totalLen_;
+        unsigned char buffer_[32];
+        size_t buffered_;
+    };
+
+    uint64_t xxh64(const void *data, size_t len, uint64_t seed = 0);
+
+    // Hashes `length` bytes of `fd` starting at `offset` with pread().
+    // Returns false if the file is shorter than the range.
+    bool xxh64File(int fd, uint64_t offset, uint64_t length, uint64_t &digest);
+
+    // One-shot XXH3_64bits / XXH3_64bits_withSeed, bit-compatible with the
+    // reference. Long inputs use AVX2 or SSE2 on x86 (AVX2 picked at run
+    // time) and NEON on ARM.
+    uint64_t xxh3_64(const void *data, size_t len, uint64_t seed = 0);
+
+    // Name of the XXH3 kernel in use, for logs
+    const char *xxh3Implementation();
+
+    // Order-independent digest of a file's chunks: the sum of one XXH3
+    // term per chunk keyed by its offset, so striped chunks may be added
+    // in any order.
+    struct FileDigest
+    {
+        uint64_t value = 0;
+
+        void add(uint64_t offset, uint64_t chunkDigest)
+        {
+            value += xxh3_64(&chunkDigest, sizeof(chunkDigest), offset);
+        }
+        void reset() { value = 0; }
+    };
+
+} // namespace swiftshare
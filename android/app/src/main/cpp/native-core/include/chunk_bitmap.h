@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace swiftshare
+{
+    // Tracks which fixed-size chunks of a file have been written.
+    // Safe to update from several stream threads at once.
+    class ChunkBitmap
+    {
+    public:
+        explicit ChunkBitmap(size_t chunks)
+            : words_((chunks + 63) / 64), chunks_(chunks), setCount_(0) {}
+
+        // Returns true only for the call that first marks `index`.
+        bool set(size_t index)
+        {
+            if (index >= chunks_)
+                return false;
+            uint64_t bit = 1ULL << (index % 64);
+            uint64_t prev = words_[index / 64].fetch_or(bit, std::memory_order_acq_rel);
+            if (prev & bit)
+                return false;
+            setCount_.fetch_add(1, std::memory_order_acq_rel);
+            return true;
+        }
+
+        bool test(size_t index) const
+        {
+            if (index >= chunks_)
+                return false;
+            return (words_[index / 64].load(std::memory_order_acquire) >> (index % 64)) & 1;
+        }
+
+        size_t count() const { return setCount_.load(std::memory_order_acquire); }
+        size_t size() const { return chunks_; }
+        bool complete() const { return count() == chunks_; }
+
+    private:
+        std::vector<std::atomic<uint64_t>> words_;
+        size_t chunks_;
+        std::atomic<size_t> setCount_;
+    };
+
+} // namespace swiftshare
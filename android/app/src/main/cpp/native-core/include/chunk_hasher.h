@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "checksum.h"
+
+namespace swiftshare
+{
+    struct IoCounters;
+
+    // Per-chunk XXH3 digests computed beside the data path. The zero-copy
+    // paths never see file bytes in user space, so a worker thread reads
+    // each chunk back through the page cache, right after (receiver) or
+    // while (sender) it moves, and hashes it while the caller moves the
+    // next one. Jobs run in submission order.
+    //
+    // Sender: request() chunks ahead of sending them and next() collects
+    // each digest once its payload is out.
+    // Receiver: verify() each chunk once its payload is written; drain()
+    // settles the outstanding checks.
+    class ChunkHasher
+    {
+    public:
+        explicit ChunkHasher(IoCounters &counters);
+        ~ChunkHasher();
+
+        ChunkHasher(const ChunkHasher &) = delete;
+        ChunkHasher &operator=(const ChunkHasher &) = delete;
+
+        // Starts on a file at `offset`, dropping anything still queued
+        void reset(int fd, uint64_t offset);
+
+        void request(uint64_t offset, uint32_t length);
+        // Digest of the oldest request; false if the file could not be read
+        bool next(uint64_t &digest);
+        // Requests not yet collected by next()
+        size_t pending() const;
+
+        // Blocks while kMaxQueued checks are outstanding
+        void verify(uint64_t offset, uint32_t length, uint64_t expected);
+        // Waits for every queued check; false if any failed
+        bool drain();
+        bool failed() const { return failed_; }
+        // End of the contiguous run of verified chunks
+        uint64_t verifiedEnd() const { return verifiedEnd_; }
+        // Stream digest (see protocol.h) over the verified chunks
+        uint64_t fileDigest() const;
+
+    private:
+        static constexpr size_t kMaxQueued = 8;
+
+        struct Job
+        {
+            uint64_t offset;
+            uint32_t length;
+            uint64_t expected;
+            bool check; // verify() job; request() otherwise
+        };
+
+        struct Result
+        {
+            bool ok;
+            uint64_t digest;
+        };
+
+        void workerLoop();
+        void waitIdle(std::unique_lock<std::mutex> &lock);
+
+        IoCounters &counters_;
+        mutable std::mutex mutex_;
+        std::condition_variable workReady_;
+        std::condition_variable progress_;
+        std::deque<Job> jobs_;
+        std::deque<Result> results_;
+        size_t requested_; // request() jobs queued or waiting in results_
+        bool busy_;        // worker is hashing a job outside the lock
+        bool stop_;
+        int fd_;
+        std::atomic<bool> failed_;
+        std::atomic<uint64_t> verifiedEnd_;
+        FileDigest fileDigest_;
+        std::thread worker_;
+    };
+
+} // namespace swiftshare
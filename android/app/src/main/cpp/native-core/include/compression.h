@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace swiftshare
+{
+    // LZ4 block format (no frame header), self-contained so the NDK build
+    // needs no extra library. Favors speed over ratio: one hash probe per
+    // position and a skip that grows over incompressible stretches.
+
+    // Compresses `length` bytes into `dst`. Returns the compressed size,
+    // or 0 as soon as the output would exceed `capacity` -- callers pass
+    // the most they are willing to send and fall back to raw.
+    size_t lz4Compress(const void *src, size_t length, void *dst, size_t capacity);
+
+    // Decodes exactly `rawLength` bytes. Returns false on malformed input
+    // instead of reading or writing out of bounds.
+    bool lz4Decompress(const void *src, size_t length, void *dst, size_t rawLength);
+
+    // Order-0 Shannon entropy, in bits per byte, of a few windows spread
+    // across the buffer. Costs a few microseconds per chunk whatever its
+    // size; JPEG, MP4 or ZIP payloads come out close to 8.
+    double sampleEntropy(const void *data, size_t length);
+
+    // Whether a chunk looks compressible enough to spend CPU on
+    bool worthCompressing(const void *data, size_t length);
+
+} // namespace swiftshare
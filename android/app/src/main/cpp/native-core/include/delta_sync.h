@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace swiftshare
+{
+    // Content-defined chunking for delta sync. Block boundaries come from
+    // a gear rolling hash over the last 64 bytes, so an insertion or
+    // deletion only moves the boundaries next to it and every other block
+    // still matches. Sender and receiver must cut with the same
+    // parameters; they are part of the protocol.
+    constexpr uint32_t kDeltaMinBlock = 16 * 1024;
+    constexpr uint32_t kDeltaAvgBlock = 64 * 1024;
+    constexpr uint32_t kDeltaMaxBlock = 256 * 1024;
+
+    // Smaller files are simply sent again
+    constexpr uint64_t kDeltaMinFileSize = 4 * 1024 * 1024;
+
+    struct DeltaBlock
+    {
+        uint64_t offset;
+        uint32_t length;
+        uint64_t hash; // XXH3-64 of the block
+    };
+
+    // Cuts [0, size) of `fd` into blocks and hands them to `onBlock` in
+    // file order. Returns false on a read error or once `onBlock` returns
+    // false to stop the scan.
+    bool scanBlocks(int fd, uint64_t size,
+                    const std::function<bool(const DeltaBlock &)> &onBlock);
+
+    // Basis blocks by hash, for the sender to look its own blocks up in.
+    // A block matches only if its length matches too.
+    class DeltaIndex
+    {
+    public:
+        void add(uint64_t hash, uint32_t length, uint64_t offset);
+        bool find(uint64_t hash, uint32_t length, uint64_t &offset) const;
+        size_t size() const { return blocks_.size(); }
+
+    private:
+        struct Entry
+        {
+            uint64_t offset;
+            uint32_t length;
+        };
+        std::unordered_map<uint64_t, Entry> blocks_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+namespace swiftshare
+{
+    enum class PeerRole : uint8_t
+    {
+        Send,
+        Receive
+    };
+
+    const char *peerRoleName(PeerRole role);
+
+    // One entry of the peer table
+    struct DiscoveredPeer
+    {
+        uint64_t deviceId;
+        std::string name;
+        std::string address; // IPv4 the newest beacon came from
+        PeerRole role;
+        uint16_t transferPort;
+        uint16_t capabilities; // CAP_*, see protocol.h
+    };
+
+    // Pairing messages between two devices
+    enum class PeerMessage : uint8_t
+    {
+        Lock,
+        Bye,
+        Cancel
+    };
+
+    const char *peerMessageName(PeerMessage message);
+
+    struct DiscoverySettings
+    {
+        PeerRole role = PeerRole::Send;
+        std::string name; // cut to MAX_BEACON_NAME bytes
+        uint16_t transferPort = 0;
+        uint16_t capabilities = 0;
+    };
+
+    // The whole table, after every change to it
+    using PeersCallback = std::function<void(const std::vector<DiscoveredPeer> &peers)>;
+    using PeerMessageCallback =
+        std::function<void(PeerMessage message, const DiscoveredPeer &peer, uint64_t sessionId)>;
+
+    // Finds other devices on the local network (see Discovery in
+    // protocol.h). A thread of its own announces this device with an
+    // interval that backs off from 250 ms to 3 s -- and starts over when
+    // the local interfaces change -- and keeps a table of the devices it
+    // hears, deduplicated by device ID across broadcast, multicast and
+    // interfaces. Devices silent for DISCOVERY_TIMEOUT_MS are dropped.
+    // Callbacks run on that thread and only when something changed; they
+    // must not call back into the engine.
+    class DiscoveryEngine
+    {
+    public:
+        DiscoveryEngine();
+        // stop()
+        ~DiscoveryEngine();
+
+        DiscoveryEngine(const DiscoveryEngine &) = delete;
+        DiscoveryEngine &operator=(const DiscoveryEngine &) = delete;
+
+        // Binds DISCOVERY_PORT and starts announcing, restarting if
+        // already running. False if the port cannot be bound.
+        bool start(const DiscoverySettings &settings, PeersCallback onPeers,
+                   PeerMessageCallback onMessage);
+        // Sends what is still queued and a LEAVE, then stops
+        void stop();
+
+        // Random, fixed for the life of the engine
+        uint64_t deviceId() const { return deviceId_; }
+        std::vector<DiscoveredPeer> peers() const;
+
+        // Sends `message` to a peer in the table, repeated a few times
+        // since UDP may drop it. False if the peer is unknown or
+        // discovery is stopped.
+        bool send(PeerMessage message, uint64_t peerId, uint64_t sessionId);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Peer
+        {
+            DiscoveredPeer info;
+            sockaddr_in source; // replies and pairing messages go here
+            Clock::time_point lastSeen;
+            Clock::time_point lastReply;
+            uint32_t lastMessage; // sequence of the newest pairing message
+        };
+
+        struct Outgoing
+        {
+            std::vector<uint8_t> datagram;
+            sockaddr_in to;
+            Clock::time_point due;
+        };
+
+        struct Delivery
+        {
+            PeerMessage message;
+            DiscoveredPeer peer;
+            uint64_t sessionId;
+        };
+
+        void run();
+        // The rest run on the engine's thread with the lock held
+        void receive(Clock::time_point now, bool &changed, std::vector<Delivery> &deliveries);
+        void handle(const uint8_t *data, size_t len, const sockaddr_in &from, Clock::time_point now,
+                    bool &changed, std::vector<Delivery> &deliveries);
+        // Expires peers and sends what is due; returns the next deadline
+        Clock::time_point tick(Clock::time_point now, bool &changed);
+        // Broadcast addresses and group of the local interfaces, joining
+        // the group on new ones; restarts the backoff when they change
+        std::vector<sockaddr_in> announceTargets();
+        std::vector<uint8_t> beacon(uint8_t type, uint8_t flags, uint64_t sessionId, uint32_t sequence) const;
+        void transmit(const std::vector<uint8_t> &datagram, const sockaddr_in &to) const;
+
+        const uint64_t deviceId_;
+        int wakeFd_;
+        std::thread thread_;
+
+        mutable std::mutex mutex_;
+        int sock_;
+        bool running_;
+        DiscoverySettings settings_;
+        PeersCallback onPeers_;
+        PeerMessageCallback onMessage_;
+        std::vector<Peer> peers_;
+        std::vector<Outgoing> outbox_;
+        std::vector<in_addr_t> joined_;     // interfaces the group was joined on
+        std::vector<in_addr_t> broadcasts_; // interface broadcast addresses
+        Clock::time_point nextAnnounce_;
+        Clock::duration announceInterval_;
+        uint32_t announces_; // since start or an interface change
+        uint32_t sequence_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace swiftshare
+{
+    // Single-threaded epoll reactor. Handlers run on the thread that
+    // calls run(); the loop sleeps in epoll_wait() with no timeout, so
+    // an idle receiver costs no CPU and wakes only on real events.
+    class EventLoop
+    {
+    public:
+        using Handler = std::function<void(uint32_t events)>;
+
+        EventLoop();
+        ~EventLoop();
+
+        EventLoop(const EventLoop &) = delete;
+        EventLoop &operator=(const EventLoop &) = delete;
+
+        bool valid() const { return epollFd_ >= 0; }
+
+        // Watches `fd` for `events` (EPOLLIN, EPOLLONESHOT, ...). The loop
+        // does not own `fd`; remove() it before closing.
+        bool add(int fd, uint32_t events, Handler handler);
+        void remove(int fd);
+
+        // Dispatches events until `keepRunning` returns false. It is
+        // checked after every wakeup, so pair it with a wake fd.
+        void run(const std::function<bool()> &keepRunning);
+
+    private:
+        int epollFd_;
+        std::unordered_map<int, Handler> handlers_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "buffer_pool.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace swiftshare
+{
+    struct IoCounters;
+    struct FileDigest;
+    class ChunkHasher;
+
+    // Minimal io_uring ring driven by the raw syscalls, so no liburing is
+    // needed. init() fails cleanly when the kernel or a seccomp policy
+    // (Android apps before 12 included) refuses io_uring.
+    class IoUring
+    {
+    public:
+        IoUring() = default;
+        ~IoUring();
+
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        bool init(unsigned entries);
+
+        // Next free submission entry, zeroed; nullptr when the queue is full
+        io_uring_sqe *getSqe();
+        // Hands every prepared entry to the kernel in one io_uring_enter().
+        // Returns the number submitted or -errno.
+        int submit();
+        // Blocks until a completion is available; call seen() after use
+        io_uring_cqe *waitCqe();
+        void seen();
+
+        bool registerBuffers(const void *base, size_t length);
+        // Registers `fds` as fixed files 0..count-1, replacing any earlier set
+        bool setFiles(const int *fds, unsigned count);
+        void unregisterFiles();
+
+        // Every opcode used by the data plane is implemented
+        bool supportsDataPlane() const { return dataPlane_; }
+        // Linked send/recv with MSG_WAITALL retry short transfers and break
+        // the link on failure, so several chunks may be chained at once
+        bool supportsWaitAll() const { return waitAll_; }
+
+    private:
+        void probe();
+
+        int fd_ = -1;
+        void *sqRing_ = nullptr;
+        void *cqRing_ = nullptr;
+        size_t sqRingSize_ = 0;
+        size_t cqRingSize_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        size_t sqesSize_ = 0;
+
+        unsigned *sqHead_ = nullptr;
+        unsigned *sqTail_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned sqEntries_ = 0;
+        unsigned sqeTail_ = 0; // prepared but not yet published
+        unsigned *cqHead_ = nullptr;
+        unsigned *cqTail_ = nullptr;
+        unsigned cqMask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+
+        bool filesRegistered_ = false;
+        bool dataPlane_ = false;
+        bool waitAll_ = false;
+    };
+
+    // io_uring sender: each chunk is a READ_FIXED into a registered
+    // buffer linked to a SEND of header + payload. Files spanning more
+    // than one batch also use registered descriptors. A whole batch of
+    // chunks is chained and submitted with one io_uring_enter() when the
+    // kernel supports MSG_WAITALL sends; older kernels get one linked
+    // read->send pair per submission. The kernel reads the payload, so
+    // chunk digests come from a ChunkHasher running one batch ahead.
+    class UringSender
+    {
+    public:
+        // Returns nullptr when io_uring is unavailable; callers fall back
+        // to the POSIX path
+        static std::unique_ptr<UringSender> create(size_t batch, uint32_t chunkSize,
+                                                   IoCounters &counters);
+        ~UringSender();
+
+        UringSender(const UringSender &) = delete;
+        UringSender &operator=(const UringSender &) = delete;
+
+        // Same contract as SendPipeline::run, except that chunks always go
+        // raw so `onChunk` gets only their size; digests are on with a `hasher`
+        bool run(int sock, int fd, uint64_t &offset, uint64_t end,
+                 const std::atomic<bool> &cancelled,
+                 const std::function<void(uint32_t)> &onChunk,
+                 ChunkHasher *hasher = nullptr, FileDigest *digest = nullptr);
+
+    private:
+        UringSender(size_t batch, uint32_t chunkSize, IoCounters &counters);
+
+        IoUring ring_;
+        size_t batch_;
+        uint32_t chunkSize_;
+        size_t frameSize_;
+        PooledBuffer memory_; // registered with the ring for its lifetime
+        char *buffers_;       // batch_ frames of DataChunkHeader + chunkSize + ChunkDigest
+        std::vector<uint32_t> lengths_;
+        std::vector<uint64_t> digests_;
+        std::vector<int32_t> results_;
+        IoCounters &counters_;
+    };
+
+    // io_uring receiver: a RECV with MSG_WAITALL linked to a WRITE_FIXED
+    // from one registered buffer, so each buffer-full costs a single
+    // io_uring_enter(). Without MSG_WAITALL support the two are submitted
+    // separately, since a short recv would not break the link.
+    // Descriptors are not registered: the receiver cannot tell which chunk
+    // is a socket's last, and a registered socket stays open after close().
+    class UringReceiver
+    {
+    public:
+        static std::unique_ptr<UringReceiver> create(IoCounters &counters);
+        ~UringReceiver();
+
+        UringReceiver(const UringReceiver &) = delete;
+        UringReceiver &operator=(const UringReceiver &) = delete;
+
+        // Same contract as SocketReceiver::receiveRange
+        bool receiveRange(int sock, int fd, uint64_t offset, size_t length);
+
+    private:
+        explicit UringReceiver(IoCounters &counters);
+
+        bool receiveLinked(int sock, int fd, size_t want, uint64_t offset);
+        bool receiveUnlinked(int sock, int fd, size_t want, uint64_t offset);
+
+        static constexpr size_t kBufferSize = 256 * 1024;
+
+        IoUring ring_;
+        PooledBuffer memory_;
+        char *buffer_;
+        IoCounters &counters_;
+    };
+
+} // namespace swiftshare
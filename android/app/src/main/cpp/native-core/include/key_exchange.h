@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace swiftshare
+{
+    // ===============================
+    // SHA-256, HMAC, HKDF
+    // ===============================
+
+    constexpr size_t kSha256Size = 32;
+
+    // Streaming SHA-256 (FIPS 180-4)
+    class Sha256
+    {
+    public:
+        Sha256();
+
+        void update(const void *data, size_t len);
+        // Finishes the hash; the object must be reset before reuse
+        void digest(uint8_t out[kSha256Size]);
+        void reset();
+
+    private:
+        void compress(const uint8_t *block);
+
+        uint32_t state_[8];
+        uint64_t totalLen_;
+        uint8_t buffer_[64];
+        size_t buffered_;
+    };
+
+    void hmacSha256(const void *key, size_t keyLen, const void *data, size_t len,
+                    uint8_t out[kSha256Size]);
+
+    // HKDF-SHA256 (RFC 5869). An empty salt stands for HashLen zeros.
+    void hkdfExtract(const void *salt, size_t saltLen, const void *ikm, size_t ikmLen,
+                     uint8_t prk[kSha256Size]);
+    // `outLen` is at most 255 * kSha256Size
+    void hkdfExpand(const uint8_t prk[kSha256Size], const void *info, size_t infoLen,
+                    uint8_t *out, size_t outLen);
+
+    // ===============================
+    // X25519 (RFC 7748)
+    // ===============================
+
+    constexpr size_t kX25519KeySize = 32;
+
+    // A fresh private key from the system RNG and its public key on
+    // `basePoint`, by default the curve's (u = 9). False if the RNG cannot
+    // be read or the base point has small order.
+    bool x25519Keypair(uint8_t privateKey[kX25519KeySize], uint8_t publicKey[kX25519KeySize],
+                       const uint8_t *basePoint = nullptr);
+    // Shared secret with a peer's public key. False for peer keys that
+    // force the all-zero secret (small-order points).
+    bool x25519(uint8_t shared[kX25519KeySize], const uint8_t privateKey[kX25519KeySize],
+                const uint8_t peerPublicKey[kX25519KeySize]);
+
+    // ===============================
+    // CPace (draft-irtf-cfrg-cpace)
+    // ===============================
+
+    // Base point for a password-authenticated X25519 exchange: Elligator 2
+    // (RFC 9380) of SHA-256("SWFT CPace X25519\0" | secret). Peers whose
+    // key pairs start from it share a secret only if their secrets match,
+    // and an attacker in the middle gets one guess per exchange: nothing
+    // it sees lets it test guesses offline, so a short PIN holds up.
+    void cpaceGenerator(const void *secret, size_t len, uint8_t point[kX25519KeySize]);
+
+    // Bytes from /dev/urandom, which every supported kernel has (getrandom()
+    // needs API 28)
+    bool randomBytes(void *out, size_t len);
+    // memset() the compiler may not drop, for key material
+    void wipe(void *data, size_t len);
+
+} // namespace swiftshare
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "transfer_session.h"
+
+namespace swiftshare
+{
+    // Tunes the sockets of one sending transfer from what the first
+    // seconds of it show. Handshakes run with TCP_NODELAY; the
+    // constructor switches the sockets to bulk mode -- Nagle on, so frame
+    // headers and digests share segments with payload, and
+    // TCP_NOTSENT_LOWAT, so progress and cancel track the wire instead of
+    // a deep kernel queue. A probe thread then samples TCP_INFO and, once
+    // it has seen enough, raises SO_SNDBUF to cover the bandwidth-delay
+    // product, moves links with real latency to BBR where the kernel
+    // allows it, and picks the chunk size for later transfers to the same
+    // peer. What it settled on is published on the session.
+    class LinkTuner
+    {
+    public:
+        LinkTuner(std::vector<int> socks, uint32_t chunkSize, TransferSession &session);
+        ~LinkTuner();
+
+        LinkTuner(const LinkTuner &) = delete;
+        LinkTuner &operator=(const LinkTuner &) = delete;
+
+        // Ends the probe, settling on what it measured if that was
+        // enough, and turns TCP_NODELAY back on so the end marker leaves
+        // at once. The sockets must stay open until this returns.
+        void finish();
+        LinkTuning tuning() const;
+
+    private:
+        void probe();
+        // Bytes acknowledged over all sockets, worst smoothed RTT and
+        // best minimum RTT
+        uint64_t sample(uint32_t &rttUs, uint32_t &minRttUs) const;
+        void settle(uint64_t goodputBps, uint32_t rttUs, uint32_t minRttUs);
+
+        std::vector<int> socks_;
+        TransferSession &session_;
+        mutable std::mutex mutex_;
+        std::condition_variable wake_;
+        bool finishing_;
+        LinkTuning tuning_;
+        std::thread thread_;
+    };
+
+} // namespace swiftshare
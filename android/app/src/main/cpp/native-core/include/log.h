@@ -0,0 +1,28 @@
+#pragma once
+
+// Logging for native-core. Every source file defines LOG_TAG and then
+// includes this header for LOGI / LOGE. Lines go to logcat on Android
+// and to stderr elsewhere, unless a sink has been installed.
+
+namespace swiftshare
+{
+    enum class LogLevel
+    {
+        Info,
+        Error
+    };
+
+    // Receives each formatted line, without a trailing newline. May be
+    // called from any transfer thread at once.
+    using LogSink = void (*)(LogLevel level, const char *tag, const char *message);
+
+    // Routes all further logging to `sink`; nullptr restores the default
+    void setLogSink(LogSink sink);
+
+    void logPrint(LogLevel level, const char *tag, const char *format, ...)
+        __attribute__((format(printf, 3, 4)));
+
+} // namespace swiftshare
+
+#define LOGI(...) ::swiftshare::logPrint(::swiftshare::LogLevel::Info, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) ::swiftshare::logPrint(::swiftshare::LogLevel::Error, LOG_TAG, __VA_ARGS__)
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/uio.h>
+
+namespace swiftshare
+{
+    // Fixed socket buffer size when transfers are not auto-tuned; the
+    // receiver's listening socket always uses it
+    constexpr int kDefaultSocketBuffer = 8 * 1024 * 1024;
+
+    // Read and write timeout of every transfer socket, both ends. A
+    // receiver drops a connection whose sender has gone quiet this long,
+    // so a sender must never pause longer between chunks.
+    constexpr int kSocketTimeoutSeconds = 30;
+
+    // Sets SO_RCVTIMEO and SO_SNDTIMEO to kSocketTimeoutSeconds
+    void setSocketTimeouts(int sock);
+
+    // Blocking TCP connect with the engine's standard socket setup
+    // (timeouts, TCP_NODELAY for the handshake). `socketBuffer` > 0 fixes
+    // both buffer sizes; 0 leaves them to kernel autotuning.
+    // Returns the socket or -1.
+    int connectToReceiver(const std::string &ip, uint16_t port, int socketBuffer);
+
+    // Loop until all bytes are moved. Return false on error or EOF.
+    // MSG_MORE in `flags` holds a small write back for what follows.
+    bool sendAll(int sock, const void *data, size_t len, int flags = 0);
+    bool recvAll(int sock, void *data, size_t len);
+    // sendAll() for a gather list; consumes `iov` as it goes
+    bool sendAllVectored(int sock, struct iovec *iov, int count);
+
+    // Sends a HelloPacket for the current protocol version.
+    bool sendHello(int sock, uint8_t mode, uint16_t flags = 0);
+
+} // namespace swiftshare
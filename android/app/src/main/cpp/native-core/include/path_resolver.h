@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <time.h>
+
+namespace swiftshare
+{
+    // Picks where incoming files are saved in one directory, following
+    // the rules of FilePathResolver.kt: the name is sanitized, and a
+    // name already taken becomes "base-1.ext", "base-2.ext" and so on.
+    //
+    // The directory's names are kept in memory, so a name costs a hash
+    // lookup rather than a stat() per candidate. The index is rebuilt
+    // whenever the directory's mtime says someone else changed it, and
+    // files are created with O_EXCL, so a stale index can cost a retry
+    // but never an overwrite. Names handed out are held until the
+    // directory next changes, so a batch never gets the same name twice.
+    class PathResolver
+    {
+    public:
+        PathResolver();
+
+        PathResolver(const PathResolver &) = delete;
+        PathResolver &operator=(const PathResolver &) = delete;
+
+        // Creates `directory` if needed and indexes it. Returns false if
+        // it cannot be created or read, leaving the resolver unset.
+        bool setDirectory(const std::string &directory);
+        bool ready() const;
+
+        // Full paths for `filenames`, distinct from each other and from
+        // everything in the directory. Empty if no directory is set.
+        std::vector<std::string> reserve(const std::vector<std::string> &filenames);
+        // Creates the output for `filename` at `path`, or at a freshly
+        // resolved path when `path` is empty or turns out to be taken.
+        // Returns the descriptor, with `path` set to where it was created,
+        // or -1.
+        int create(const std::string &filename, std::string &path);
+
+        // Drops ".pending-<n>-" prefixes and a leading dot; blank names
+        // become "file". Slashes are replaced so a name cannot leave the
+        // directory.
+        static std::string sanitize(const std::string &filename);
+
+    private:
+        // With mutex_ held
+        bool refresh();
+        std::string take(const std::string &filename);
+
+        mutable std::mutex mutex_;
+        std::string directory_;
+        std::unordered_set<std::string> names_;
+        // Next suffix to try per sanitized name; every lower one is taken
+        std::unordered_map<std::string, uint32_t> nextSuffix_;
+        timespec scannedMtime_;
+    };
+
+} // namespace swiftshare
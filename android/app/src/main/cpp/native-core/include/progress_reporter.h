@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "transfer_session.h"
+
+namespace swiftshare
+{
+    // One session as seen by a progress tick
+    struct ProgressEvent
+    {
+        uint32_t id;
+        SessionDirection direction;
+        SessionState state;
+        SessionPhase phase;
+        uint32_t fileIndex;
+        uint32_t fileCount;
+        uint64_t fileBytesTransferred;
+        uint64_t fileSize;
+        uint64_t bytesTransferred; // whole session
+        uint64_t totalBytes;
+        double bytesPerSecond; // smoothed, file bytes (not wire bytes)
+        int64_t etaMs;         // -1 while unknown, 0 once completed
+        uint64_t elapsedMs;
+    };
+
+    using ProgressListener = std::function<void(const std::vector<ProgressEvent> &events)>;
+
+    // Fixed block of doubles holding the newest sessions, rewritten every
+    // tick so a reader can map it (a Float64Array in JS) and poll it
+    // without calling into the engine. Layout, in doubles:
+    //
+    //   [0] layout version  [1] slot count  [2] sequence  [3] slots in use
+    //   then per slot, newest session first:
+    //   id, direction (0 send, 1 receive), state, phase, fileIndex,
+    //   fileCount, fileBytesTransferred, fileSize, bytesTransferred,
+    //   totalBytes, bytesPerSecond, etaMs
+    //
+    // State and phase are the enum values. The sequence is odd while a
+    // tick is writing; a reader that sees it odd, or changed by the time
+    // it has copied the slots, reads again.
+    class ProgressBoard
+    {
+    public:
+        static constexpr uint32_t kVersion = 1;
+        static constexpr size_t kSlots = 16;
+        static constexpr size_t kHeader = 4;
+        static constexpr size_t kSlotFields = 12;
+
+        ProgressBoard();
+
+        ProgressBoard(const ProgressBoard &) = delete;
+        ProgressBoard &operator=(const ProgressBoard &) = delete;
+
+        uint8_t *data() { return reinterpret_cast<uint8_t *>(values_.get()); }
+        size_t size() const { return kValues * sizeof(double); }
+
+        // Single writer: the reporter thread
+        void publish(const std::vector<ProgressEvent> &events);
+
+    private:
+        static constexpr size_t kValues = kHeader + kSlots * kSlotFields;
+
+        // Atomic so the reader's copy races with nothing but the sequence
+        std::unique_ptr<std::atomic<double>[]> values_;
+        uint64_t sequence_;
+    };
+
+    // Samples every session of a registry at a fixed rate on its own
+    // thread, keeps a smoothed throughput and ETA per session, and hands
+    // each tick to a listener and to the board. The listener gets the
+    // active sessions plus one final event for each session that ends.
+    // The thread starts with the first listener or board request and
+    // sleeps while nothing is active.
+    class ProgressReporter
+    {
+    public:
+        explicit ProgressReporter(const SessionRegistry &sessions);
+        ~ProgressReporter();
+
+        ProgressReporter(const ProgressReporter &) = delete;
+        ProgressReporter &operator=(const ProgressReporter &) = delete;
+
+        // `rateHz` is clamped to 1..60 and also paces the board. An empty
+        // listener stops the pushes.
+        void setListener(ProgressListener listener, double rateHz);
+        std::shared_ptr<ProgressBoard> board();
+        // A session started or finished; ends an idle wait
+        void wake();
+
+    private:
+        struct Estimate
+        {
+            uint64_t bytes; // session bytes at the last sample
+            std::chrono::steady_clock::time_point at;
+            double bytesPerSecond;
+            bool sampling;  // `bytes` and `at` belong to this transfer phase
+            bool reported;  // final event sent
+        };
+
+        void start(); // with mutex_ held
+        void run();
+        // Returns whether any session is still active
+        bool tick(std::vector<ProgressEvent> &all, std::vector<ProgressEvent> &changed);
+        ProgressEvent update(const SessionStats &stats, Estimate &estimate,
+                             std::chrono::steady_clock::time_point now);
+
+        const SessionRegistry &sessions_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        ProgressListener listener_;
+        std::chrono::microseconds interval_;
+        std::shared_ptr<ProgressBoard> board_;
+        bool woken_;
+        bool stopping_;
+        std::thread thread_;
+
+        // Reporter thread only
+        std::unordered_map<uint32_t, Estimate> estimates_;
+        bool firstTick_; // sessions already over then get no final event
+    };
+
+} // namespace swiftshare
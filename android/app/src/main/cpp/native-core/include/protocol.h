@@ -7,9 +7,10 @@ namespace swiftshare {
 /*
  * SwiftShare Transfer Protocol (SWFT)
  *
- * Transport  : TCP
+ * Transport  : TCP, or reliable UDP (see Reliable UDP below);
+ *              discovery: UDP, see Discovery below
  * Endianness : Little-endian
- * Version    : 1
+ * Version    : 2 (accepts version 1 senders, which never resume)
  */
 
 // ===============================
@@ -17,7 +18,8 @@ namespace swiftshare {
 // ===============================
 
 constexpr char MAGIC[4] = {'S', 'W', 'F', 'T'};
-constexpr uint8_t VERSION = 1;
+constexpr uint8_t VERSION = 2;
+constexpr uint8_t VERSION_RESUME = 2;     // sessions: first version with resume offers
 
 // ===============================
 // Modes
@@ -25,6 +27,11 @@ constexpr uint8_t VERSION = 1;
 
 constexpr uint8_t MODE_SEND = 1;
 constexpr uint8_t MODE_RECEIVE = 2;
+constexpr uint8_t MODE_STRIPE_OPEN = 3;   // first stream of a striped file
+constexpr uint8_t MODE_STRIPE_JOIN = 4;   // additional stream of a striped file
+constexpr uint8_t MODE_SESSION = 5;       // many files over one connection
+constexpr uint8_t MODE_TREE = 6;          // a directory tree over one connection
+constexpr uint8_t MODE_SECURE = 7;        // key exchange, then any other mode encrypted
 
 // ===============================
 // Status Codes
@@ -37,11 +44,16 @@ constexpr uint8_t STATUS_ERROR = 0x01;
 // Handshake
 // ===============================
 
+constexpr uint16_t HELLO_FLAG_DIGESTS = 0x0001;     // frames carry ChunkDigest trailers
+constexpr uint16_t HELLO_FLAG_COMPRESSION = 0x0002; // DataChunkHeader frames may be compressed
+constexpr uint16_t HELLO_FLAG_DELTA = 0x0004;       // single file: sender takes a DeltaBasis
+constexpr uint16_t HELLO_FLAG_RESUME = 0x0008;      // single file: resume exchange, echoed
+
 struct HelloPacket {
     char magic[4];        // "SWFT"
     uint8_t version;      // protocol version
     uint8_t mode;         // MODE_SEND / MODE_RECEIVE
-    uint16_t reserved;    // alignment + future use
+    uint16_t flags;       // HELLO_FLAG_*, chosen by the sender
 };
 
 // ===============================
@@ -51,10 +63,45 @@ struct HelloPacket {
 struct FileMeta {
     uint64_t fileSize;    // total file size in bytes
     uint16_t nameLen;     // filename length (UTF-8)
+    uint16_t reserved;
     uint32_t chunkSize;   // sender preferred chunk size
     // followed by `nameLen` bytes of filename
 };
 
+// ===============================
+// Resume (version 2)
+// ===============================
+
+/*
+ * HELLO(MODE_SEND, HELLO_FLAG_RESUME), FileMeta, filename
+ *   <- HELLO(MODE_SEND, HELLO_FLAG_RESUME)
+ *   -> ResumeRequest
+ *   <- ResumeOffer
+ *   -> uint64 accepted offset
+ *
+ * The receiver offers the end of the data it has journaled for this
+ * transfer ID, after re-hashing the last committed range from disk. The
+ * sender hashes the same range of its own file and accepts the offer
+ * only if the digests match; otherwise it answers 0 and the receiver
+ * starts the file over. Data then starts at the accepted offset.
+ *
+ * The receiver's HELLO echoes the flag; only then does the sender send
+ * its ResumeRequest. A version 1 receiver answers the filename with a
+ * bare uint64 0 instead, told apart from the echo by its missing MAGIC,
+ * and data starts at 0. Senders without the flag get the same bare 0.
+ */
+
+struct ResumeRequest {
+    uint64_t transferId;  // stable per file content, see resumeTransferId()
+};
+
+struct ResumeOffer {
+    uint64_t offset;      // verified bytes on disk, 0 = start over
+    uint64_t checkOffset; // range the sender must confirm,
+    uint64_t checkLength; // ending at `offset`
+    uint64_t checksum;    // XXH64 of that range
+};
+
 // ===============================
 // Data Framing
 // ===============================
@@ -64,6 +111,410 @@ struct DataChunkHeader {
     // followed by `length` bytes of raw file data
 };
 
+// ===============================
+// Compression
+// ===============================
+
+/*
+ * With HELLO_FLAG_COMPRESSION a DataChunkHeader whose length has
+ * CHUNK_COMPRESSED set is followed by a CompressedChunk and then
+ * (length & ~CHUNK_COMPRESSED) bytes of compressed payload. The sender
+ * picks raw or compressed per chunk. Chunk sizes, file offsets and
+ * digests all refer to the decompressed bytes. Striped streams are
+ * never compressed.
+ */
+
+constexpr uint32_t CHUNK_COMPRESSED = 0x80000000u;
+
+constexpr uint8_t CODEC_LZ4 = 1; // LZ4 block format
+
+struct CompressedChunk {
+    uint32_t rawLength;   // bytes after decompression
+    uint8_t codec;        // CODEC_*
+    uint8_t reserved[3];
+};
+
+// ===============================
+// Delta Sync
+// ===============================
+
+/*
+ * With HELLO_FLAG_DELTA, a single-file transfer that settles on offset 0
+ * continues with the receiver describing the older copy it already has:
+ *
+ *   <- DeltaBasis
+ *   <- DeltaSignatures + count x BlockSignature, repeated,
+ *      ended by a batch with count 0 (only when basis size > 0)
+ *
+ * Blocks are cut by the content-defined chunker in delta_sync.h and are
+ * listed in file order, so each one starts where the previous ended.
+ * The sender cuts its own file the same way. A block the basis also has
+ * becomes a copy frame, DataChunkHeader{CHUNK_COPY | length} followed by
+ * DeltaCopy; everything else is sent as ordinary frames. With
+ * HELLO_FLAG_DIGESTS a copy frame is followed by the ChunkDigest of the
+ * block and counts towards the stream digest like any other chunk.
+ */
+
+constexpr uint32_t CHUNK_COPY = 0x40000000u;
+
+constexpr uint32_t MAX_SIGNATURE_BATCH = 4096;
+
+struct DeltaBasis {
+    uint64_t size;        // bytes of the receiver's copy, 0 = none
+};
+
+struct DeltaSignatures {
+    uint32_t count;       // 0..MAX_SIGNATURE_BATCH signatures follow
+};
+
+struct BlockSignature {
+    uint64_t xxh3;        // XXH3-64 of the block
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct DeltaCopy {
+    uint64_t basisOffset; // where the block starts in the receiver's copy
+};
+
+// ===============================
+// Integrity
+// ===============================
+
+/*
+ * With HELLO_FLAG_DIGESTS every data frame (DataChunkHeader or
+ * OffsetChunkHeader) is followed, after its payload, by a ChunkDigest
+ * holding the XXH3-64 of that payload. The zero-length frame that ends a
+ * file or stripe is followed by one more ChunkDigest: the sum, wrapping
+ * at 2^64, of XXH3-64(chunk digest, seed = chunk offset) over every chunk
+ * that stream carried. The sum does not depend on chunk order.
+ *
+ * A receiver that finds a mismatch drops the connection; nothing after
+ * the last verified chunk is kept as received.
+ */
+
+struct ChunkDigest {
+    uint64_t xxh3;
+};
+
+// ===============================
+// Striped Transfer
+// ===============================
+
+/*
+ * One file split across several TCP streams.
+ *
+ * Stream 0 : HELLO(MODE_STRIPE_OPEN), FileMeta, filename, StripeOpen
+ *            <- uint64 resume offset (always 0)
+ * Stream k : HELLO(MODE_STRIPE_JOIN), StripeJoin
+ *            <- uint8 STATUS_OK / STATUS_ERROR
+ *
+ * Every stream then carries OffsetChunkHeader frames. Each chunk starts
+ * at a multiple of chunkSize and is chunkSize long except the last one.
+ * A zero-length header ends that stream.
+ */
+
+constexpr uint16_t MAX_STREAMS = 8;
+
+struct StripeOpen {
+    uint64_t transferId;  // random, shared by all streams of one file
+    uint16_t streamCount; // 1..MAX_STREAMS, including this one
+    uint16_t reserved[3];
+};
+
+struct StripeJoin {
+    uint64_t transferId;
+};
+
+struct OffsetChunkHeader {
+    uint64_t offset;      // byte offset of this chunk in the file
+    uint32_t length;      // number of bytes that follow
+    uint32_t reserved;
+};
+
+// ===============================
+// Multi-file Session
+// ===============================
+
+/*
+ * HELLO(MODE_SESSION), SessionManifest, fileCount x (ManifestEntry, name)
+ *   <- fileCount x uint64 resume offset
+ *
+ * From version 2 every name is followed by a uint64 transfer ID and the
+ * reply is the resume handshake above, once per file:
+ *   <- fileCount x ResumeOffer
+ *   -> fileCount x uint64 accepted offset
+ *
+ * Files then follow in manifest order, each as DataChunkHeader frames
+ * starting at its resume offset and ended by a zero-length header.
+ */
+
+constexpr uint32_t MAX_SESSION_FILES = 100000;
+
+struct SessionManifest {
+    uint32_t fileCount;
+    uint32_t chunkSize;   // sender preferred chunk size, all files
+    uint64_t totalBytes;  // sum of all file sizes
+};
+
+struct ManifestEntry {
+    uint64_t fileSize;
+    uint16_t nameLen;     // filename length (UTF-8), name follows
+    uint16_t reserved[3];
+};
+
+// ===============================
+// Directory Tree
+// ===============================
+
+/*
+ * HELLO(MODE_TREE), TreeManifest, root name,
+ *   directoryCount x (uint16 length, path),
+ *   fileCount x (TreeFileEntry, path)
+ *   <- uint8 STATUS_OK / STATUS_ERROR (root and directories created)
+ *
+ * Paths are relative to the root and '/'-separated. A receiver refuses
+ * any that is absolute or has an empty, "." or ".." component. Parents
+ * are listed before their subdirectories.
+ *
+ * Files then follow in manifest order. A file of at most packLimit
+ * bytes travels in a pack: PackHeader, then the bytes of the next
+ * fileCount files back to back, all of them no larger than packLimit.
+ * With HELLO_FLAG_DIGESTS the payload is followed by a ChunkDigest of
+ * it. Every other file is sent like a session file, as DataChunkHeader
+ * frames ended by a zero-length header. Senders list the small files
+ * first so they pack densely. Trees are never resumed.
+ */
+
+constexpr uint32_t MAX_TREE_DIRECTORIES = 1000000;
+constexpr uint32_t MAX_TREE_FILES = 1000000;
+constexpr uint32_t MAX_PACK_BYTES = 4 * 1024 * 1024;
+constexpr uint32_t MAX_PACK_FILES = 4096;
+
+struct TreeManifest {
+    uint32_t directoryCount;
+    uint32_t fileCount;
+    uint64_t totalBytes;  // sum of all file sizes
+    uint32_t chunkSize;   // sender preferred chunk size, unpacked files
+    uint32_t packLimit;   // largest file sent in a pack, <= MAX_PACK_BYTES
+    uint16_t rootNameLen; // root directory name follows the manifest
+    uint16_t reserved[3];
+};
+
+struct TreeFileEntry {
+    uint64_t fileSize;
+    int64_t mtimeNs;      // modification time, ns since the epoch
+    uint16_t pathLen;     // relative path follows
+    uint16_t reserved[3];
+};
+
+struct PackHeader {
+    uint32_t fileCount;   // 1..MAX_PACK_FILES, the next files in order
+    uint32_t length;      // their sizes summed, <= MAX_PACK_BYTES
+};
+
+// ===============================
+// Encryption
+// ===============================
+
+/*
+ * HELLO(MODE_SECURE), KeyShare
+ *   <- KeyShare
+ *
+ * Each side sends an ephemeral X25519 public key. With a pairing secret
+ * both key pairs start from the CPace base point for it, Elligator 2 of
+ * SHA-256("SWFT CPace X25519\0" | secret), instead of u = 9; without one
+ * the exchange encrypts but authenticates nobody. The sender offers the
+ * suites it can run; the receiver answers with the one it picked, or
+ * with none to refuse. Both sides then derive
+ *
+ *   PRK = HKDF-Extract(salt = empty, X25519 secret)
+ *   HKDF-Expand(PRK, "SWFT records" | sender KeyShare | receiver KeyShare)
+ *     -> sender key (32), sender IV (12), receiver key (32), receiver IV (12)
+ *
+ * so a changed KeyShare or a different pairing secret yields keys that
+ * fail on the first record. A failed record tells an attacker in the
+ * middle only that its one guess at the secret was wrong. From then on each direction is a run of
+ *
+ *   RecordHeader, length bytes of ciphertext, 16-byte tag
+ *
+ * sealed with that direction's key. Record n (from 0) uses the IV with
+ * its last 8 bytes XORed with n big-endian, and the RecordHeader as
+ * associated data. The records carry a whole connection of another
+ * mode, from its HELLO on; a clean end of records ends it.
+ */
+
+constexpr uint8_t SUITE_AES_256_GCM = 0x01;
+constexpr uint8_t SUITE_CHACHA20_POLY1305 = 0x02;
+
+constexpr uint32_t MAX_RECORD = 256 * 1024;
+
+struct KeyShare {
+    uint8_t publicKey[32]; // X25519
+    uint8_t suites;        // SUITE_*: offered by the sender, picked by the receiver
+    uint8_t reserved[7];
+};
+
+struct RecordHeader {
+    uint32_t length;       // 1..MAX_RECORD bytes of ciphertext, tag not counted
+};
+
+// ===============================
+// Reliable UDP
+// ===============================
+
+/*
+ * A connection may travel over UDP instead of TCP, to the same port
+ * number as the TCP listener. Its datagrams carry one byte stream each
+ * way, and those streams carry a whole connection of any mode above,
+ * HELLO first, exactly as a TCP connection would. Every datagram starts
+ * with a UdpHeader:
+ *
+ *   SYN       UdpSyn, to the receiver's port, repeated until answered.
+ *             The sender picks the connection ID.
+ *   SYN_ACK   UdpSynAck, from the receiver's port, naming the port of a
+ *             socket opened for this connection alone; every later
+ *             datagram goes to and from that socket. The timestamp
+ *             echoes the SYN's.
+ *   DATA      up to MAX_UDP_DATA bytes of stream. Sequence numbers count
+ *             packets from 0 in each direction; UDP_FLAG_FIN marks the
+ *             empty packet that ends a stream.
+ *   PARITY    UdpParity, then the XOR of the payloads, zero-padded to the
+ *             longest, of DATA packets [sequence, sequence + count). One
+ *             lost packet of the group can be rebuilt from the others.
+ *   ACK       UdpAck: every packet below `cumulative` has arrived, plus
+ *             a bitmap of those past it. Also sent as a keepalive.
+ *   RESET     the connection is gone.
+ *
+ * The sender paces at its estimate of the path's delivery rate and keeps
+ * about two of its bandwidth-delay products in flight. Loss alone does
+ * not slow it down, so random Wi-Fi loss costs only the packets lost;
+ * they are resent once a packet sent after them is acknowledged, or
+ * when the retransmission timer runs out.
+ */
+
+constexpr uint8_t UDP_VERSION = 1;
+
+constexpr uint8_t UDP_SYN = 1;
+constexpr uint8_t UDP_SYN_ACK = 2;
+constexpr uint8_t UDP_DATA = 3;
+constexpr uint8_t UDP_PARITY = 4;
+constexpr uint8_t UDP_ACK = 5;
+constexpr uint8_t UDP_RESET = 6;
+
+constexpr uint8_t UDP_FLAG_FIN = 0x01;
+
+constexpr uint16_t MAX_UDP_DATAGRAM = 1472; // one 1500-byte frame
+constexpr uint32_t UDP_SACK_PACKETS = 1024; // packets an ACK bitmap covers
+
+struct UdpHeader {
+    uint8_t type;          // UDP_*
+    uint8_t flags;         // UDP_FLAG_*
+    uint16_t length;       // payload bytes after the header
+    uint32_t connection;   // picked by the sender, never 0
+    uint32_t sequence;     // DATA: packet number; PARITY: first packet covered
+    uint32_t timestamp;    // microseconds on the sender's clock; ACK echoes it
+};
+
+struct UdpSyn {
+    uint8_t version;       // UDP_VERSION
+    uint8_t reserved[7];
+};
+
+struct UdpSynAck {
+    uint16_t port;         // of the connection's socket
+    uint8_t reserved[6];
+};
+
+struct UdpParity {
+    uint16_t count;        // DATA packets covered
+    uint16_t lengths;      // their lengths XORed
+    uint8_t flags;         // their flags XORed
+    uint8_t reserved[3];
+};
+
+struct UdpAck {
+    uint32_t cumulative;   // next packet expected in order
+    uint32_t window;       // the sender may send packets below cumulative + window
+    uint32_t echo;         // timestamp of the newest DATA received
+    uint32_t reserved;
+    uint8_t sack[UDP_SACK_PACKETS / 8]; // bit i: packet cumulative + 1 + i arrived
+};
+
+// DATA payloads stay small enough that a PARITY of full packets fits
+constexpr uint16_t MAX_UDP_DATA = MAX_UDP_DATAGRAM - sizeof(UdpHeader) - sizeof(UdpParity);
+
+// ===============================
+// Discovery
+// ===============================
+
+/*
+ * Peers find each other over UDP on DISCOVERY_PORT, outside the TCP
+ * protocol above. Every datagram is one Beacon followed by nameLen bytes
+ * of UTF-8 device name:
+ *
+ *   ANNOUNCE  sent to the limited broadcast address, each interface's
+ *             broadcast address and DISCOVERY_GROUP; first every 250 ms,
+ *             backing off to every 3 s. A receiver that sees a device for
+ *             the first time, or an ANNOUNCE flagged BEACON_FLAG_REPLY,
+ *             answers with an ANNOUNCE to the datagram's source.
+ *   LEAVE     the device stops discovery; peers drop it at once rather
+ *             than after DISCOVERY_TIMEOUT_MS without a beacon.
+ *   LOCK / BYE / CANCEL
+ *             pairing of two devices, sent to the peer a few times with
+ *             the same sequence number.
+ *
+ * Every beacon carries the full device record, so any of them adds or
+ * updates the sender in the receiver's peer table.
+ */
+
+constexpr uint16_t DISCOVERY_PORT = 41234;
+constexpr char DISCOVERY_GROUP[] = "239.255.41.234"; // administratively scoped
+constexpr char BEACON_MAGIC[4] = {'S', 'W', 'F', 'D'};
+constexpr uint8_t BEACON_VERSION = 1;
+constexpr uint32_t DISCOVERY_TIMEOUT_MS = 10000;
+
+constexpr uint8_t BEACON_ANNOUNCE = 1;
+constexpr uint8_t BEACON_LEAVE = 2;
+constexpr uint8_t BEACON_LOCK = 3;
+constexpr uint8_t BEACON_BYE = 4;
+constexpr uint8_t BEACON_CANCEL = 5;
+
+constexpr uint8_t BEACON_FLAG_REPLY = 0x01; // sender has just started: answer it
+
+constexpr uint8_t ROLE_SEND = 0;
+constexpr uint8_t ROLE_RECEIVE = 1;
+
+// What the device's receiver accepts
+constexpr uint16_t CAP_STRIPED = 0x0001;
+constexpr uint16_t CAP_SESSION = 0x0002;
+constexpr uint16_t CAP_TREE = 0x0004;
+constexpr uint16_t CAP_DELTA = 0x0008;
+constexpr uint16_t CAP_COMPRESSION = 0x0010;
+constexpr uint16_t CAP_DIGESTS = 0x0020;
+constexpr uint16_t CAP_RESUME = 0x0040;
+constexpr uint16_t CAP_ENCRYPTION = 0x0080;          // MODE_SECURE
+constexpr uint16_t CAP_ENCRYPTION_REQUIRED = 0x0100; // plaintext is refused
+constexpr uint16_t CAP_AES_GCM = 0x0200;             // runs AES-256-GCM in hardware
+constexpr uint16_t CAP_RELIABLE_UDP = 0x0400;        // accepts reliable-UDP connections
+
+constexpr uint8_t MAX_BEACON_NAME = 64;
+
+struct Beacon {
+    char magic[4];         // "SWFD"
+    uint8_t version;       // BEACON_VERSION
+    uint8_t type;          // BEACON_*
+    uint8_t role;          // ROLE_*
+    uint8_t flags;         // BEACON_FLAG_*
+    uint64_t deviceId;     // random per app run, never 0
+    uint64_t sessionId;    // LOCK / BYE / CANCEL, else 0
+    uint32_t sequence;     // per device; repeats of a message share it
+    uint16_t transferPort; // TCP and reliable-UDP port of the device's receiver
+    uint16_t capabilities; // CAP_*
+    uint8_t nameLen;       // up to MAX_BEACON_NAME
+    uint8_t reserved[7];
+};
+
 // ===============================
 // Completion Marker
 // ===============================
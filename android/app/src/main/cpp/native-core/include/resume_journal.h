@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "protocol.h"
+
+namespace swiftshare
+{
+    // Stable ID of one file as the sender sees it, from its name, size and
+    // a hash of its first megabyte. Sending the same content again yields
+    // the same ID, so a reconnect finds the receiver's journal for it.
+    // The mtime is left out: the app sends fresh cache copies of picked
+    // files, which would get a new ID on every pick.
+    uint64_t resumeTransferId(int fd, const std::string &name, uint64_t fileSize);
+
+    // Sender side of the resume handshake: hashes the offered check range
+    // of `fd` and returns the offset to continue from, offer.offset if it
+    // matches and 0 otherwise.
+    uint64_t acceptResumeOffer(int fd, uint64_t fileSize, const ResumeOffer &offer);
+
+    // Receiver-side record of how much of one incoming file is safely on
+    // disk. It lives in a sidecar file named after the transfer ID and
+    // lists committed ranges with their XXH64. A range is recorded only
+    // after its data has been flushed, so every journaled byte survives a
+    // crash; at worst the tail since the last commit is received again.
+    class ResumeJournal
+    {
+    public:
+        // Smaller files restart from scratch; the journal would cost more
+        // than resending them.
+        static constexpr uint64_t kMinFileSize = 16ULL * 1024 * 1024;
+        // Bytes between commits (one fdatasync + one journal record each)
+        static constexpr uint64_t kCommitInterval = 32ULL * 1024 * 1024;
+
+        ResumeJournal(const std::string &directory, uint64_t transferId, uint64_t fileSize);
+        ~ResumeJournal();
+
+        ResumeJournal(const ResumeJournal &) = delete;
+        ResumeJournal &operator=(const ResumeJournal &) = delete;
+
+        // Reads an earlier journal for this transfer. Returns false if
+        // there is none or it belongs to a different file.
+        bool load();
+        // Partial file recorded by load(), empty if there was none
+        const std::string &partialPath() const { return path_; }
+
+        // Re-hashes the newest committed ranges from `fd` until one
+        // matches and offers everything up to its end
+        ResumeOffer verify(int fd);
+
+        // (Re)starts the journal for `path`, keeping ranges below `offset`
+        bool start(const std::string &path, uint64_t offset);
+        // Data is contiguous in `fd` up to `offset`; commits every
+        // kCommitInterval bytes
+        void advance(int fd, uint64_t offset);
+        // Deletes the journal once the file is complete, otherwise
+        // commits whatever arrived
+        void close(int fd, uint64_t offset);
+
+    private:
+        struct Range
+        {
+            uint64_t offset;
+            uint64_t length;
+            uint64_t checksum;
+        };
+
+        bool commit(int fd, uint64_t offset);
+        bool appendRecord(const Range &range);
+        uint64_t committedEnd() const;
+
+        std::string directory_;
+        std::string journalPath_;
+        std::string path_;
+        uint64_t transferId_;
+        uint64_t fileSize_;
+        std::vector<Range> ranges_;
+        int journalFd_;
+    };
+
+} // namespace swiftshare
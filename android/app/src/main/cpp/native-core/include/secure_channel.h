@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace swiftshare
+{
+    // Encrypted connections (MODE_SECURE, see protocol.h).
+    //
+    // After the key exchange a connection is handed to a tunnel: the
+    // caller gets one end of a local socket pair and speaks the usual
+    // protocol on it, while two tunnel threads seal what it writes into
+    // records on the TCP socket and open the records that arrive. Every
+    // mode and data path (sendfile, splice, io_uring, the frame reader)
+    // runs on the local end unchanged.
+    //
+    // The bulk direction -- outgoing on the sender, incoming on the
+    // receiver -- seals or opens records on worker threads between the
+    // thread reading them and the thread writing them out, so the crypto
+    // overlaps I/O on both sockets. The reply direction carries only
+    // handshake messages and is handled inline.
+    //
+    // Closing the returned socket ends the outgoing records; the tunnel
+    // closes the TCP socket once the peer has ended its own. A record
+    // that fails authentication tears the connection down.
+
+    // SUITE_* bits this device runs at speed: ChaCha20-Poly1305 always,
+    // AES-256-GCM where the CPU has AES instructions
+    uint8_t localSuites();
+    const char *suiteName(uint8_t suite);
+
+    // Sender: HELLO(MODE_SECURE) and the key exchange on a connected
+    // `sock`, offering `suites` (0 = localSuites()) as far as this device
+    // runs them. `pairingSecret`, if not empty, must match the
+    // receiver's: it authenticates the exchange as a PAKE (CPace, see
+    // key_exchange.h), so an attacker in the middle gets one guess per
+    // connection and nothing to test guesses on offline, and a short PIN
+    // is enough. Returns the local end, or -1; `sock` is taken over
+    // either way.
+    int connectSecure(int sock, uint8_t suites, const std::string &pairingSecret);
+
+    // Receiver: the rest of the key exchange once HELLO(MODE_SECURE) has
+    // been read from `sock`. Same return and ownership as connectSecure().
+    int acceptSecure(int sock, const std::string &pairingSecret);
+
+} // namespace swiftshare
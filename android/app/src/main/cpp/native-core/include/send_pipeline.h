@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "buffer_pool.h"
+#include "checksum.h"
+#include "telemetry.h"
+
+namespace swiftshare
+{
+    // Which stage of the pipelined sender had to wait, and for how long.
+    // Many network waits mean the disk is the bottleneck; many reader
+    // waits mean the socket is.
+    struct PipelineCounters
+    {
+        std::atomic<uint64_t> networkWaits{0}; // sender found no filled buffer
+        std::atomic<uint64_t> networkWaitNs{0};
+        std::atomic<uint64_t> readerWaits{0};  // reader found no free buffer
+        std::atomic<uint64_t> readerWaitNs{0};
+        std::atomic<uint64_t> compressWaits{0}; // next chunk read but not yet compressed
+        std::atomic<uint64_t> compressWaitNs{0};
+
+        std::atomic<uint64_t> compressedChunks{0};
+        std::atomic<uint64_t> rawChunks{0};        // passed over by the compressor
+        std::atomic<uint64_t> compressInBytes{0};  // file bytes of compressed chunks
+        std::atomic<uint64_t> compressOutBytes{0}; // their size on the wire
+    };
+
+    // Two-stage sender: a reader thread fills a ring of fixed buffers
+    // with file data while the calling thread sends them as
+    // DataChunkHeader frames. The ring depth bounds read-ahead; when it
+    // is full the reader blocks (backpressure from the socket). With
+    // digests on, the reader also hashes each buffer while it is hot in
+    // cache and appends the ChunkDigest trailer.
+    //
+    // With compression workers, chunks that sample as compressible are
+    // LZ4-compressed on those threads between the reader and the socket;
+    // the rest go out raw. Chunks still leave in file order.
+    //
+    // The ring is held for the pipeline's lifetime, so it is taken from
+    // the pool without waiting; when the pool cannot spare it, ready()
+    // is false and the caller sends without the pipeline.
+    class SendPipeline
+    {
+    public:
+        SendPipeline(size_t depth, uint32_t chunkSize, PipelineCounters &counters,
+                     Telemetry &telemetry, BufferPool &buffers, unsigned compressWorkers = 0);
+        ~SendPipeline();
+
+        SendPipeline(const SendPipeline &) = delete;
+        SendPipeline &operator=(const SendPipeline &) = delete;
+
+        bool ready() const;
+
+        // Streams [offset, end) of `fd` to `sock`, advancing `offset` as
+        // chunks leave. `onChunk` runs after every chunk sent with its
+        // file bytes and payload bytes on the wire. A non-null `digest`
+        // turns on ChunkDigest trailers and collects the chunks sent into
+        // it. Returns false on a read or send failure.
+        bool run(int sock, int fd, uint64_t &offset, uint64_t end,
+                 const std::atomic<bool> &cancelled,
+                 const std::function<void(uint32_t bytes, uint32_t wireBytes)> &onChunk,
+                 FileDigest *digest = nullptr);
+
+    private:
+        struct Slot
+        {
+            char *frame;     // DataChunkHeader, chunkSize bytes, ChunkDigest
+            char *packed;    // compressed frame: DataChunkHeader, CompressedChunk,
+                             // payload, ChunkDigest
+            uint32_t length; // payload bytes, 0 = read failed
+            uint32_t packedLength; // compressed payload bytes, 0 = send raw
+            uint64_t digest; // of the payload, when digests are on
+            bool ready;      // past the compressor; the socket may take it
+        };
+
+        void readerLoop(int fd, uint64_t offset, uint64_t end,
+                        const std::atomic<bool> &cancelled);
+        void compressLoop();
+        void compress(Slot &slot);
+
+        std::vector<Slot> slots_;
+        std::vector<PooledBuffer> memory_; // behind the slots' frames
+        uint32_t chunkSize_;
+        PipelineCounters &counters_;
+        Telemetry &telemetry_;
+        unsigned compressWorkers_;
+        bool digests_;
+        std::deque<size_t> toCompress_; // slot indexes, oldest first
+        std::condition_variable compressReady_;
+
+        std::mutex mutex_;
+        std::condition_variable notFull_;
+        std::condition_variable notEmpty_;
+        size_t head_;  // next slot to send
+        size_t count_; // filled slots
+        bool abort_;
+    };
+
+} // namespace swiftshare
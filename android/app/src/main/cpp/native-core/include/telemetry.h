@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <time.h>
+
+namespace swiftshare
+{
+    // What a latency sample measures
+    enum class Probe : uint8_t
+    {
+        Recv,    // socket -> user space or pipe
+        Send,    // user space, file or pipe -> socket
+        Read,    // file -> user space or pipe
+        Write,   // user space or pipe -> file
+        Chunk,   // one chunk end to end, as the transfer loop sees it
+        JsQueue, // progress event waiting for the JS thread
+        Count
+    };
+
+    const char *probeName(Probe probe);
+
+    struct LatencySummary
+    {
+        uint64_t count;
+        uint64_t totalNs;
+        // Upper edges of the histogram buckets holding each percentile,
+        // so at most 2x above the true value
+        uint64_t p50Ns;
+        uint64_t p90Ns;
+        uint64_t p99Ns;
+        uint64_t maxNs;
+        uint64_t stalls; // samples over Telemetry::kStallNs
+    };
+
+    struct TelemetryStats
+    {
+        bool enabled;
+        LatencySummary latency[(size_t)Probe::Count];
+        uint64_t shortReads;  // recv/read that returned less than asked
+        uint64_t shortWrites; // send/write that took less than offered
+        uint64_t traceRecords; // written since enabled, including overwritten
+        uint64_t traceCapacity;
+    };
+
+    // Latency histograms and an optional binary trace of the I/O calls
+    // on the transfer path. Off by default; while off every probe costs
+    // one relaxed load. Samples land in one of a few cache-line aligned
+    // shards picked per thread, so concurrent transfers never share a
+    // counter line and nothing takes a lock.
+    //
+    // The trace is a ring of fixed-size records, allocated the first time
+    // it is asked for and overwritten oldest first. dumpTrace() writes
+    // what it holds, oldest first, little-endian:
+    //
+    //   header: "SSTRACE\0", u32 version, u32 record size,
+    //           u64 record count, u64 CLOCK_MONOTONIC ns at dump time
+    //   record: u64 start ns, u64 duration ns, u64 bytes,
+    //           u32 thread, u8 probe, 3 bytes zero
+    class Telemetry
+    {
+    public:
+        static constexpr uint64_t kStallNs = 100 * 1000 * 1000;
+        static constexpr size_t kBuckets = 40; // log2 ns, last one open-ended
+
+        Telemetry();
+        ~Telemetry();
+
+        Telemetry(const Telemetry &) = delete;
+        Telemetry &operator=(const Telemetry &) = delete;
+
+        // `traceRecords` > 0 also records into the trace ring, 0 leaves it
+        // idle. The ring is sized by the first request and kept after.
+        void enable(bool on, size_t traceRecords = 0);
+        bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+        static uint64_t now()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        }
+
+        // Start of a sample, 0 while disabled; record() ignores a 0 start
+        uint64_t start() const { return enabled() ? now() : 0; }
+        void record(Probe probe, uint64_t startNs, uint64_t bytes = 0);
+        // Records a duration measured elsewhere, e.g. on another thread
+        void recordSpan(Probe probe, uint64_t startNs, uint64_t durationNs, uint64_t bytes = 0);
+
+        void shortRead();
+        void shortWrite();
+
+        TelemetryStats stats() const;
+        void reset();
+        // Returns false if no trace was kept or the file cannot be written
+        bool dumpTrace(const std::string &path) const;
+
+    private:
+        static constexpr size_t kShards = 16;
+        static constexpr size_t kProbes = (size_t)Probe::Count;
+
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> buckets[kProbes][kBuckets];
+            std::atomic<uint64_t> totalNs[kProbes];
+            std::atomic<uint64_t> maxNs[kProbes];
+            std::atomic<uint64_t> stalls[kProbes];
+            std::atomic<uint64_t> shortReads;
+            std::atomic<uint64_t> shortWrites;
+        };
+
+        // `sequence` is the claim number + 1, cleared while the record is
+        // written; a reader keeps a record only if it is set and still
+        // the same after the fields are copied
+        struct TraceRecord
+        {
+            std::atomic<uint64_t> sequence;
+            std::atomic<uint64_t> startNs;
+            std::atomic<uint64_t> durationNs;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> tag; // thread << 8 | probe
+        };
+
+        Shard &shard();
+        void trace(Probe probe, uint64_t startNs, uint64_t durationNs, uint64_t bytes);
+
+        std::atomic<bool> enabled_;
+        std::atomic<bool> tracing_;
+        std::unique_ptr<Shard[]> shards_;
+        std::unique_ptr<TraceRecord[]> ring_; // allocated once, kept until destruction
+        size_t ringSize_;                     // power of two, 0 until allocated
+        std::atomic<uint64_t> head_;
+        mutable std::mutex mutex_;            // everything but the probes
+    };
+
+} // namespace swiftshare
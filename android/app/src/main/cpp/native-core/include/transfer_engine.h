@@ -2,47 +2,350 @@
 
 #include <string>
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "zero_copy.h"
+#include "send_pipeline.h"
+#include "io_uring_backend.h"
+#include "transfer_session.h"
+#include "progress_reporter.h"
+#include "resume_journal.h"
+#include "chunk_hasher.h"
+#include "path_resolver.h"
+#include "write_scheduler.h"
+#include "transfer_scheduler.h"
+#include "wire_codec.h"
+#include "udp_transport.h"
 
 namespace swiftshare
 {
+    struct FileMeta;
+    struct HelloPacket;
+    struct ChunkDigest;
+    class ChunkBitmap;
+    class EventLoop;
+
     using PathResolverCallback = std::function<std::string(const std::string &filename)>;
 
+    // Tunables applied to transfers started after setOptions()
+    struct TransferOptions
+    {
+        bool zeroCopySend = true;    // sendfile/splice instead of read+send
+        bool zeroCopyReceive = true; // splice socket -> file instead of recv+write
+        uint32_t chunkSize = 256 * 1024;
+        uint16_t streams = 1;        // parallel TCP connections per file (striping)
+        uint16_t pipelineDepth = 0;  // >0: read-ahead ring of this many chunks
+                                     // replaces the zero-copy send path
+        bool ioUring = false;        // io_uring data plane for send and receive,
+                                     // POSIX paths when the kernel refuses it
+        bool chunkDigests = true;    // XXH3 per chunk and per file, checked by
+                                     // the receiver (sender side decides)
+        bool compression = false;    // LZ4 for files that sample as compressible;
+                                     // never used by striped sends
+        uint16_t compressionWorkers = 2;
+        bool deltaSync = false;      // single files the receiver already has an
+                                     // older copy of: send only changed blocks
+        bool autoTune = true;        // probe each send and tune its sockets;
+                                     // chunkSize is then only the first guess
+                                     // for a peer not seen before
+        // Page cache kept behind a transfer on either side (see
+        // WriteScheduler); 0 leaves it to the kernel
+        uint32_t cacheWindow = 8 * 1024 * 1024;
+        bool directWrite = false;    // receive with O_DIRECT unless chunk digests
+                                     // read the file back; no io_uring receive
+        bool encryption = false;     // sender: encrypt every connection;
+                                     // receiver: refuse plaintext ones
+        uint8_t encryptionSuites = 0; // SUITE_* bits to offer, 0 = all this
+                                      // device runs at speed
+        // Authenticates the key exchange (CPace); both ends must agree,
+        // and a short PIN is enough. Empty encrypts without
+        // authenticating the peer.
+        std::string pairingSecret;
+        uint16_t maxActiveSends = 4; // sends running at once, the rest
+                                     // queue by priority; 0 = no limit
+        uint64_t sendRateLimit = 0;  // bytes/s across all sends, 0 = none
+        bool reliableUdp = false;    // sender: connect over reliable UDP
+                                     // instead of TCP (see udp_transport.h)
+        uint16_t udpFecGroup = 0;    // one parity packet per this many UDP
+                                     // packets sent, 0 = none
+        // Applied to this engine's own UDP datagrams, for trying the
+        // transport against a bad link; TCP is never impaired
+        LinkImpairment udpImpairment;
+        // Cap on copy, decode, hash and read-ahead buffers across every
+        // transfer (see BufferPool); readers wait for room past it. Sends
+        // use chunks of at most a quarter of it.
+        uint32_t bufferBudget = BufferPool::kDefaultBudget;
+    };
+
+    struct IoStats
+    {
+        uint64_t zeroCopyBytes; // moved without touching user space
+        uint64_t copiedBytes;   // bounced through a user-space buffer
+        uint64_t pipelineNetworkWaits; // pipelined sender waited on disk
+        uint64_t pipelineNetworkWaitNs;
+        uint64_t pipelineReaderWaits;  // pipelined sender waited on socket
+        uint64_t pipelineReaderWaitNs;
+        uint64_t pipelineCompressWaits; // socket waited on a compressor
+        uint64_t pipelineCompressWaitNs;
+        uint64_t uringBytes;   // moved by the io_uring backend
+        uint64_t uringSubmits; // io_uring_enter() submissions
+        uint64_t hashedBytes;  // covered by chunk digests, both directions
+        uint64_t digestFailures;
+        uint64_t compressedChunks;
+        uint64_t rawChunks;        // passed over by the compressor
+        uint64_t compressInBytes;  // file bytes sent compressed
+        uint64_t compressOutBytes; // what they took on the wire
+        uint64_t deltaReusedBytes; // taken from the receiver's older copy
+        uint64_t udpPackets;       // reliable UDP, first transmissions
+        uint64_t udpRetransmits;
+        uint64_t udpParityPackets;
+        uint64_t udpRecovered;     // rebuilt from parity, no resend needed
+        uint64_t bufferBytes;      // held by the buffer pool, in use or cached
+        uint64_t bufferPeakBytes;  // most ever in use at once
+        uint64_t bufferWaits;      // readers held back by the budget
+        uint64_t bufferRejects;    // buffers larger than the budget allows,
+                                   // e.g. a peer's oversized chunks
+    };
+
     class TransferEngine
     {
     public:
         TransferEngine();
         ~TransferEngine();
 
-        // Receiver
+        // Receiver; every incoming connection gets its own session
         bool startReceiver(uint16_t port);
         void setPathResolver(PathResolverCallback resolver);
-        // Sender (implemented later)
-        bool startSender(const std::string &filePath,
-                         const std::string &ip,
-                         uint16_t port);
+        // Saves incoming files in `directory` with names picked natively
+        // (see PathResolver), in place of the resolver callback. Returns
+        // false if the directory cannot be created or read.
+        bool setReceiveDirectory(const std::string &directory);
+        // Where resume journals of partial files are kept; without one
+        // every incoming file starts from scratch
+        void setResumeDirectory(const std::string &directory);
+        // Sender. All return the new session's ID, 0 on failure. Sends
+        // are queued by TransferScheduler under `job`'s priority and cap.
+        uint32_t startSender(const std::string &filePath,
+                             const std::string &ip,
+                             uint16_t port,
+                             const SendJob &job = {});
+        // Sends many files back-to-back over one connection
+        uint32_t startSenderSession(const std::vector<std::string> &filePaths,
+                                    const std::string &ip,
+                                    uint16_t port,
+                                    const SendJob &job = {});
+        // Sends everything below `directory`, which the receiver recreates
+        // under a directory of the same name
+        uint32_t startSenderTree(const std::string &directory,
+                                 const std::string &ip,
+                                 uint16_t port,
+                                 const SendJob &job = {});
+        // Reorders or re-caps a send that has not finished; a send pushed
+        // out of the active set is held where it is, not restarted, for
+        // up to TransferScheduler::kMaxHold
+        bool setSessionPriority(uint32_t sessionId, int priority);
+        bool setSessionRateLimit(uint32_t sessionId, uint64_t bytesPerSecond);
+
+        // Session ID 0 means the newest session still in flight
+        double getProgress(uint32_t sessionId = 0) const;
+        SessionProgress getSessionProgress(uint32_t sessionId = 0) const;
+        std::string getCurrentFileName(uint32_t sessionId = 0) const;
+        uint64_t getCurrentFileSize(uint32_t sessionId = 0) const;
+        bool getSessionStats(uint32_t sessionId, SessionStats &stats) const;
+        std::vector<SessionStats> listSessions() const;
+
+        // Pushes batches of progress events, with smoothed throughput and
+        // ETA, from a reporter thread at up to `rateHz`. The listener must
+        // not block; an empty one stops the pushes.
+        void setProgressListener(ProgressListener listener, double rateHz = 10.0);
+        // The same ticks as a shared block of doubles, for readers that
+        // poll without calling in
+        std::shared_ptr<ProgressBoard> progressBoard();
 
-        double getProgress() const;
+        // cancel() stops the receiver and every session
         void cancel();
-        std::string getCurrentFileName() const;
-        uint64_t getCurrentFileSize() const;
+        bool cancelSession(uint32_t sessionId);
+        void setOptions(const TransferOptions &options);
+        TransferOptions getOptions() const;
+        IoStats getIoStats() const;
+        // CAP_* bits of what this engine receives, for discovery beacons
+        uint16_t capabilities() const;
+        // Latency histograms and trace of the I/O path, off by default
+        Telemetry &telemetry() { return ioCounters_.telemetry; }
 
     private:
         void receiverThread(uint16_t port);
-        void senderThread(const std::string &filePath,
+        // Creates a sending session under the scheduler and runs `send`
+        // on a thread of its own once the scheduler admits it
+        uint32_t launchSend(const SendJob &job, std::function<void(TransferSession &)> send);
+        void senderThread(TransferSession &session,
+                          const std::string &filePath,
                           const std::string &ip,
                           uint16_t port);
 
-        std::atomic<uint64_t> bytesTransferred_;
-        std::atomic<uint64_t> totalBytes_;
-        std::atomic<bool> cancelled_;
+        // Connections are accepted by an epoll loop on the receiver thread
+        // and each one is served on its own thread
+        void acceptConnections(int server, EventLoop &loop);
+        // Waits in `loop` for the first bytes of `client`, TCP or the
+        // local end of a reliable-UDP connection, then serves it
+        void watchConnection(int client, EventLoop &loop);
+        void serveConnection(int client);
+
+        // Per-connection receive paths; handleConnection closes `client`.
+        // `secured`: `client` is the inner end of an encrypted connection.
+        bool handleConnection(int client, SocketReceiver &socketReceiver, bool secured = false);
+        bool readFileMeta(int client, FileMeta &meta, std::string &filename);
+        int openIncomingFile(TransferSession &session, int client,
+                             FileMeta &meta, std::string &filename);
+        // `outPath` may already hold a path reserved by receivePaths_
+        int openOutputFile(const std::string &filename, std::string &outPath);
+        bool receiveFile(TransferSession &session, int client, const HelloPacket &hello,
+                         SocketReceiver &socketReceiver);
+        bool receiveChunks(TransferSession &session, int client, int fd,
+                           uint64_t &offset, uint64_t fileSize, uint32_t chunkSize,
+                           SocketReceiver &socketReceiver, ResumeJournal *journal,
+                           ChunkHasher *hasher, int basisFd, bool mayCompress);
+        // Waits for `hasher` and checks the stream digest sent with the end
+        // frame, if one arrived; fails the session on any mismatch
+        bool settleDigests(TransferSession &session, ChunkHasher &hasher,
+                           const ChunkDigest *streamDigest);
+
+        // Output file of one incoming transfer and its resume state
+        struct IncomingFile
+        {
+            int fd = -1;
+            std::string path;
+            std::unique_ptr<ResumeJournal> journal;
+            ResumeOffer offer{};
+        };
+        // Looks for a journaled partial file and fills in the offer
+        void offerResume(uint64_t transferId, uint64_t fileSize, IncomingFile &file);
+        // Opens the output once the sender has answered with `offset`
+        int openResumable(IncomingFile &file, const std::string &filename, uint64_t offset);
+
+        // Data-plane objects of one sending thread, picked from the options:
+        // io_uring if requested and available, else the read-ahead pipeline
+        // if enabled, else FileSender alone. With compression on, files
+        // that sample as compressible take the compressing pipeline instead.
+        struct SendContext
+        {
+            SendContext(const TransferOptions &options, IoCounters &ioCounters,
+                        PipelineCounters &pipelineCounters);
+            const char *pathName() const;
+
+            uint16_t helloFlags() const;
+
+            FileSender fileSender;
+            std::unique_ptr<SendPipeline> pipeline;
+            std::unique_ptr<UringSender> uring;
+            std::unique_ptr<SendPipeline> compressor;
+            bool compressing; // the current file goes through `compressor`
+            // Chunk digests: the pipeline hashes its own buffers, the
+            // other paths read chunks back through `hasher`
+            bool digests;
+            std::unique_ptr<ChunkHasher> hasher;
+            FileDigest fileDigest; // chunks of the current file sent so far
+            uint32_t cacheWindow;
+        };
+        bool sendChunks(TransferSession &session, int sock, int fd,
+                        uint64_t &offset, uint64_t end,
+                        uint32_t chunkSize, SendContext &sendContext);
+        // Zero-length frame, plus the file digest when digests are on
+        bool sendEndOfFile(int sock, SendContext &sendContext);
+
+        // Connection to the receiver for one send, over reliable UDP and
+        // encrypted if the options say so; -1 on failure
+        int connectPeer(const std::string &ip, uint16_t port, int socketBuffer,
+                        const TransferOptions &options);
+
+        // Options for a new send to `ip`: with auto-tuning, the chunk size
+        // the last tuned transfer to that peer settled on
+        TransferOptions sendOptions(const std::string &ip) const;
+        void rememberLink(const TransferSession &session, const std::string &ip,
+                          const LinkTuning &tuning);
+
+        std::shared_ptr<TransferSession> resolveSession(uint32_t sessionId) const;
+        void completeSession(TransferSession &session);
+
+        // Striped transfer (striped_transfer.cpp)
+        bool receiveStriped(TransferSession &session, int client, const HelloPacket &hello);
+        void joinStripe(int client);
+        bool receiveStripe(TransferSession &session, int sock, int fd,
+                           const FileMeta &meta, ChunkBitmap &bitmap, bool digests);
+        void stripedSenderThread(TransferSession &session,
+                                 const std::string &filePath,
+                                 const std::string &ip,
+                                 uint16_t port,
+                                 uint16_t streams);
+
+        // Delta sync (delta_transfer.cpp). The receiver opens the older copy
+        // next to `outPath`, if any, into `basisFd` and streams its block
+        // signatures; the sender answers with copy frames and literal data.
+        bool offerDeltaBasis(TransferSession &session, int client,
+                             const std::string &outPath, const std::string &filename,
+                             int &basisFd);
+        bool sendDelta(TransferSession &session, int sock, int fd,
+                       uint64_t &offset, uint64_t fileSize,
+                       uint32_t chunkSize, SendContext &sendContext);
+
+        // Multi-file session (session_transfer.cpp)
+        bool receiveSession(TransferSession &session, int client, const HelloPacket &hello,
+                            SocketReceiver &socketReceiver);
+        void sessionSenderThread(TransferSession &session,
+                                 const std::vector<std::string> &filePaths,
+                                 const std::string &ip,
+                                 uint16_t port);
+
+        // Directory tree (tree_transfer.cpp). Small files travel packed
+        // many to a frame; see protocol.h.
+        bool receiveTree(TransferSession &session, int client, const HelloPacket &hello,
+                         SocketReceiver &socketReceiver);
+        // Creates the tree's root directory for `name`; empty on failure
+        std::string createTreeRoot(const std::string &name);
+        void treeSenderThread(TransferSession &session,
+                              const std::string &directory,
+                              const std::string &ip,
+                              uint16_t port);
+
+        SessionRegistry sessions_;
+        TransferScheduler scheduler_;
+        ProgressReporter progress_; // after sessions_, which it reads
+        std::atomic<bool> cancelled_; // stops the receiver
         std::atomic<bool> receiving_;
         PathResolverCallback pathResolver_;
-        mutable std::mutex fileInfoMutex_;
-        std::string currentFileName_;
-        uint64_t currentFileSize_;
+        PathResolver receivePaths_; // used over pathResolver_ once set
+        mutable std::mutex optionsMutex_;
+        TransferOptions options_;
+        std::string resumeDirectory_;
+        IoCounters ioCounters_;
+        PipelineCounters pipelineCounters_;
+        std::shared_ptr<UdpCounters> udpCounters_; // outlives connections' threads
+        mutable std::mutex linksMutex_;
+        std::unordered_map<std::string, uint32_t> linkChunkSizes_; // by receiver IP
+
+        int wakeFd_; // eventfd; cancel() wakes the receiver's event loop
+        std::thread receiver_;
+        std::mutex connectionsMutex_;
+        std::condition_variable connectionsDone_;
+        uint32_t activeConnections_;
+        // Send threads still running, which the destructor waits out;
+        // `stopping_` cuts every session's closing linger short
+        std::mutex sendsMutex_;
+        std::condition_variable sendsChanged_;
+        uint32_t activeSends_;
+        bool stopping_;
+
+        // Stripe joins accepted by the event loop, waiting for the
+        // receiveStriped call that owns their transfer ID
+        std::mutex stripeMutex_;
+        std::condition_variable stripeJoined_;
+        std::unordered_map<uint64_t, std::vector<int>> stripeJoins_;
     };
 
 } // namespace swiftshare
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "transfer_session.h"
+
+namespace swiftshare
+{
+    // How one send is scheduled; see TransferScheduler
+    struct SendJob
+    {
+        int priority = 0;           // higher sends first
+        uint64_t bytesPerSecond = 0; // cap of this send alone, 0 = none
+    };
+
+    // Bytes per second with a burst of up to 100 ms. Senders charge what
+    // they already sent and wait off any debt, so a chunk larger than the
+    // burst is still let through whole.
+    class TokenBucket
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit TokenBucket(uint64_t bytesPerSecond = 0);
+
+        // 0 = unlimited; the debt so far is kept
+        void setRate(uint64_t bytesPerSecond);
+        uint64_t rate() const { return rate_; }
+
+        // Charges `bytes` and returns how long to wait before sending more
+        Clock::duration take(uint64_t bytes, Clock::time_point now);
+
+    private:
+        void refill(Clock::time_point now);
+
+        uint64_t rate_;
+        double tokens_; // negative while in debt
+        Clock::time_point refilled_;
+    };
+
+    // Queue of a TransferEngine's sends. Each send is a job with a
+    // priority; at most `maxActive` jobs send at a time, picked by
+    // priority and then by age. Everything else waits: jobs that have not
+    // started wait before they connect, and a running job that a higher
+    // priority one pushes out of the active set (or that loses its slot
+    // when the limit drops) is held at its next chunk, connection open,
+    // and carries on from there once it is picked again. Changing a
+    // job's priority reorders the queue the same way.
+    //
+    // A held job keeps its receiver waiting on a silent connection, so
+    // the hold lasts at most kMaxHold, short of the receiver's read
+    // timeout. A job held that long is released: it sends alongside the
+    // active set until it finishes, without taking a slot.
+    //
+    // Sending threads report every chunk through pace(), which also
+    // charges the job's own bucket and the one shared by all sends and
+    // waits until both allow more. Receives are not scheduled.
+    class TransferScheduler
+    {
+    public:
+        static constexpr std::chrono::seconds kMaxHold{20};
+
+        TransferScheduler();
+
+        TransferScheduler(const TransferScheduler &) = delete;
+        TransferScheduler &operator=(const TransferScheduler &) = delete;
+
+        // 0 = no limit, for either
+        void setLimits(uint16_t maxActive, uint64_t bytesPerSecond);
+
+        void add(TransferSession &session, const SendJob &job);
+        // Drops a finished job, passing its slot on
+        void remove(TransferSession &session);
+
+        // Waits until the job may start; false if it was cancelled first
+        bool admit(TransferSession &session);
+        // `wireBytes` of the job just went out: waits while the job is
+        // held and until the rate caps allow more
+        void pace(TransferSession &session, uint64_t wireBytes);
+
+        bool setPriority(uint32_t sessionId, int priority);
+        bool setRateLimit(uint32_t sessionId, uint64_t bytesPerSecond);
+        // True once the job has waited on a cap or been held, so its
+        // throughput says nothing about the link
+        bool throttled(uint32_t sessionId) const;
+
+        // Lets waiting jobs see a cancel
+        void wake();
+
+    private:
+        struct Job
+        {
+            TransferSession *session;
+            int priority;
+            uint64_t order; // submission order, breaks priority ties
+            TokenBucket bucket;
+            bool active;   // in the set allowed to send
+            bool started;  // admitted at least once
+            bool released; // held for kMaxHold, now active regardless
+            bool throttled;
+        };
+
+        Job *find(uint32_t sessionId) const;
+        // Recomputes the active set; called with the lock held
+        void reschedule();
+        // Waits until `job` is active; false if cancelled
+        bool waitActive(std::unique_lock<std::mutex> &lock, Job &job);
+
+        mutable std::mutex mutex_;
+        std::condition_variable changed_;
+        std::vector<std::unique_ptr<Job>> jobs_;
+        uint64_t nextOrder_;
+        uint16_t maxActive_;
+        TokenBucket global_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace swiftshare
+{
+    // Aggregate progress across the files of one send or receive.
+    // Single-file transfers report a session of one file.
+    struct SessionProgress
+    {
+        uint32_t fileIndex; // file currently transferring, 0-based
+        uint32_t fileCount;
+        uint64_t bytesTransferred;
+        uint64_t totalBytes;
+    };
+
+    enum class SessionDirection : uint8_t
+    {
+        Send,
+        Receive
+    };
+
+    enum class SessionState : uint8_t
+    {
+        Active,
+        Completed,
+        Failed,
+        Cancelled
+    };
+
+    // What an active session is doing; Done once it has settled
+    enum class SessionPhase : uint8_t
+    {
+        Connecting,
+        Negotiating,  // hello, resume offer, delta signatures
+        Transferring,
+        Verifying,    // receiver waiting on the last chunk digests
+        Done,
+        Queued        // send waiting for a slot, before it starts or
+                      // held for a higher priority one
+    };
+
+    const char *sessionDirectionName(SessionDirection direction);
+    const char *sessionStateName(SessionState state);
+    const char *sessionPhaseName(SessionPhase phase);
+
+    // Socket and chunk settings of a sending session, as picked by the
+    // link tuner. Zero fields were left to the kernel or not measured.
+    struct LinkTuning
+    {
+        uint32_t chunkSize;          // used by this transfer
+        uint32_t preferredChunkSize; // for the next transfer to this peer
+        uint32_t sendBuffer;         // SO_SNDBUF set, 0 = kernel autotuning
+        uint32_t notSentLowat;       // TCP_NOTSENT_LOWAT
+        char congestion[16];         // TCP_CONGESTION in effect
+        uint32_t rttUs;              // smoothed RTT when the probe ended
+        uint32_t minRttUs;
+        uint64_t goodputBps;         // best 100 ms delivery rate seen
+        bool settled;                // probe finished and applied
+    };
+
+    // Point-in-time copy of one session, safe to hand across threads
+    struct SessionStats
+    {
+        uint32_t id;
+        SessionDirection direction;
+        SessionState state;
+        SessionPhase phase;
+        SessionProgress progress;
+        std::string fileName; // current file
+        uint64_t fileSize;
+        uint64_t fileBytesTransferred;
+        uint64_t wireBytes; // payload bytes as sent, after compression
+        uint64_t elapsedMs;
+        LinkTuning tuning; // sending sessions with auto-tuning only
+    };
+
+    // Called with the wire bytes of every chunk a sending session reports;
+    // may block to hold the sender back (see TransferScheduler)
+    using SessionPacer = std::function<void(uint64_t wireBytes)>;
+
+    // Progress and cancellation of one send or one incoming connection.
+    // The transfer thread(s) write it; JS polls it from another thread.
+    class TransferSession
+    {
+    public:
+        TransferSession(uint32_t id, SessionDirection direction);
+
+        TransferSession(const TransferSession &) = delete;
+        TransferSession &operator=(const TransferSession &) = delete;
+
+        uint32_t id() const { return id_; }
+        SessionDirection direction() const { return direction_; }
+
+        // Transfer side
+        void begin(uint32_t fileCount, uint64_t totalBytes);
+        void beginFile(uint32_t index, const std::string &filename, uint64_t fileSize);
+        void addProgress(uint64_t bytes) { addProgress(bytes, bytes); }
+        // `bytes` of file data that took `wireBytes` on the wire
+        void addProgress(uint64_t bytes, uint64_t wireBytes);
+        // Set before the transfer starts
+        void setPacer(SessionPacer pacer) { pacer_ = std::move(pacer); }
+        // Marks data already counted as bad, e.g. a digest mismatch
+        void fail() { failed_ = true; }
+        void setTuning(const LinkTuning &tuning);
+        void setPhase(SessionPhase phase) { phase_ = phase; }
+        // Settles the final state from the byte counts and the cancel and
+        // fail flags
+        void finish();
+
+        // Cancellation is polled between chunks
+        void cancel() { cancelled_ = true; }
+        bool cancelled() const { return cancelled_; }
+        const std::atomic<bool> &cancelFlag() const { return cancelled_; }
+
+        // Reader side
+        double fileProgress() const;
+        SessionProgress progress() const;
+        std::string fileName() const;
+        uint64_t fileSize() const { return fileSize_; }
+        SessionState state() const { return state_; }
+        SessionPhase phase() const { return phase_; }
+        SessionStats stats() const;
+
+    private:
+        friend class SessionRegistry;
+
+        // Each group sits on its own cache line: the per-chunk counters
+        // are written constantly, the rest only when a file starts, and
+        // the cancel flag is read by every chunk loop.
+        alignas(64) std::atomic<uint64_t> fileBytes_;
+        std::atomic<uint64_t> sessionBytes_;
+        std::atomic<uint64_t> wireBytes_;
+
+        alignas(64) std::atomic<uint64_t> fileSize_;
+        std::atomic<uint64_t> totalBytes_;
+        std::atomic<uint32_t> fileIndex_;
+        std::atomic<uint32_t> fileCount_;
+        std::atomic<SessionState> state_;
+        std::atomic<SessionPhase> phase_;
+        std::atomic<bool> retired_; // hidden from the id-less legacy getters
+        std::atomic<bool> failed_;
+
+        alignas(64) std::atomic<bool> cancelled_;
+
+        const uint32_t id_;
+        const SessionDirection direction_;
+        const std::chrono::steady_clock::time_point started_;
+        std::atomic<int64_t> finishedMs_; // -1 while active
+        mutable std::mutex nameMutex_; // also guards tuning_
+        std::string fileName_;
+        LinkTuning tuning_;
+        SessionPacer pacer_;
+    };
+
+    // Hands out session IDs and keeps recent sessions queryable after
+    // they finish. IDs start at 1; 0 means "no session".
+    class SessionRegistry
+    {
+    public:
+        std::shared_ptr<TransferSession> create(SessionDirection direction);
+        std::shared_ptr<TransferSession> find(uint32_t id) const;
+        // Newest session not yet retired, for callers without an ID
+        std::shared_ptr<TransferSession> latest() const;
+        std::vector<SessionStats> list() const;
+
+        // Drops a finished session from latest(); it stays in find() and
+        // list() until kRetained newer sessions have retired
+        void retire(TransferSession &session);
+        void cancelAll();
+
+    private:
+        static constexpr size_t kRetained = 32;
+
+        mutable std::mutex mutex_;
+        std::vector<std::shared_ptr<TransferSession>> sessions_; // oldest first
+        uint32_t nextId_ = 1;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace swiftshare
+{
+    // One regular file under a walked root. Paths are relative to the
+    // root, '/'-separated, without a leading slash.
+    struct TreeFile
+    {
+        std::string path;
+        uint64_t size;
+        int64_t mtimeNs; // since the epoch
+    };
+
+    struct TreeListing
+    {
+        std::vector<std::string> directories; // sorted, so parents come first
+        std::vector<TreeFile> files;          // sorted by path
+        uint64_t totalBytes = 0;
+    };
+
+    // Lists every directory and regular file below `root` with `workers`
+    // threads taking directories from a shared queue. Symlinks, devices
+    // and unreadable entries are skipped. Returns false only if `root`
+    // itself cannot be read.
+    bool walkTree(const std::string &root, TreeListing &listing, unsigned workers);
+
+} // namespace swiftshare
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+namespace swiftshare
+{
+    // Reliable UDP connections (see Reliable UDP in protocol.h).
+    //
+    // Like an encrypted connection, a reliable-UDP connection is handed
+    // to its caller as one end of a local socket pair, so every mode and
+    // data path runs on it unchanged, and MODE_SECURE can run on top of
+    // it. A thread of the connection's own moves bytes between the pair
+    // and a UDP socket: it paces packets out, resends what the peer's
+    // selective ACKs report missing, rebuilds single losses from parity
+    // packets where the sender adds them, and hands the caller the
+    // incoming stream in order.
+    //
+    // Closing the returned socket ends the outgoing stream; the peer's
+    // end arrives as a clean end of the incoming one. A peer silent for
+    // 15 seconds, or a RESET, drops the connection on both.
+
+    // Loss and delay the connection applies to its own outgoing
+    // datagrams, so the transport can be tried against a bad link on
+    // loopback. Zero everywhere = a clean link.
+    struct LinkImpairment
+    {
+        double loss = 0;       // share of datagrams dropped, 0..1
+        uint32_t delayMs = 0;  // added to every datagram kept
+        uint32_t jitterMs = 0; // up to this much more, uniformly; reorders
+    };
+
+    struct UdpSettings
+    {
+        uint16_t fecGroup = 0; // one PARITY per this many DATA packets, 0 = none
+        LinkImpairment impairment;
+    };
+
+    // Totals over every connection that shares them
+    struct UdpCounters
+    {
+        std::atomic<uint64_t> packetsSent{0};  // DATA, first transmissions
+        std::atomic<uint64_t> retransmits{0};  // DATA sent again
+        std::atomic<uint64_t> paritySent{0};
+        std::atomic<uint64_t> recovered{0};    // rebuilt from parity
+        std::atomic<uint64_t> impairedDrops{0};
+    };
+
+    // Sender: the handshake with a receiver at ip:port. Returns the local
+    // end, or -1 when no reliable-UDP receiver answers. The local end
+    // times out like connectToReceiver()'s sockets.
+    int connectUdp(const std::string &ip, uint16_t port, const UdpSettings &settings,
+                   std::shared_ptr<UdpCounters> counters);
+
+    // Receiver: the socket SYNs arrive on
+    class UdpListener
+    {
+    public:
+        UdpListener();
+        ~UdpListener();
+
+        UdpListener(const UdpListener &) = delete;
+        UdpListener &operator=(const UdpListener &) = delete;
+
+        // Non-blocking, for the receiver's event loop; false if the port
+        // cannot be bound
+        bool open(uint16_t port);
+        int fd() const { return sock_; }
+
+        // Answers every SYN waiting on the socket. A new connection is
+        // started and its local end passed to `onConnection`; a repeated
+        // SYN gets the same answer again.
+        void accept(const UdpSettings &settings, const std::shared_ptr<UdpCounters> &counters,
+                    const std::function<void(int local)> &onConnection);
+
+    private:
+        struct Accepted
+        {
+            sockaddr_in peer;
+            uint32_t connection;
+            uint16_t port;
+            std::weak_ptr<void> alive; // the connection, while it runs
+        };
+
+        int sock_;
+        std::vector<Accepted> accepted_;
+    };
+
+} // namespace swiftshare
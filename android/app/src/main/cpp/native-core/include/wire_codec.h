@@ -0,0 +1,146 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "protocol.h"
+
+namespace swiftshare
+{
+    class Telemetry;
+
+    // ===============================
+    // Wire layouts
+    // ===============================
+
+    // The protocol.h structs go on the wire as they are laid out in
+    // memory, so their layout is the protocol. Every field sits at its
+    // natural alignment with padding spelled out as reserved fields,
+    // which gives the same bytes on every ABI, including 32-bit x86
+    // where uint64_t aligns to 4. The sizes and offsets here are checked
+    // against the structs, so a field added in the wrong place fails the
+    // build instead of a transfer.
+    namespace wire
+    {
+        static_assert(std::endian::native == std::endian::little,
+                      "the protocol is little-endian and sent as raw structs");
+
+        constexpr size_t kHello = 8;
+        constexpr size_t kFileMeta = 16;
+        constexpr size_t kResumeRequest = 8;
+        constexpr size_t kResumeOffer = 32;
+        constexpr size_t kDataChunkHeader = 4;
+        constexpr size_t kCompressedChunk = 8;
+        constexpr size_t kDeltaBasis = 8;
+        constexpr size_t kDeltaSignatures = 4;
+        constexpr size_t kBlockSignature = 16;
+        constexpr size_t kDeltaCopy = 8;
+        constexpr size_t kChunkDigest = 8;
+        constexpr size_t kStripeOpen = 16;
+        constexpr size_t kStripeJoin = 8;
+        constexpr size_t kOffsetChunkHeader = 16;
+        constexpr size_t kSessionManifest = 16;
+        constexpr size_t kManifestEntry = 16;
+        constexpr size_t kTreeManifest = 32;
+        constexpr size_t kTreeFileEntry = 24;
+        constexpr size_t kPackHeader = 8;
+        constexpr size_t kKeyShare = 40;
+        constexpr size_t kRecordHeader = 4;
+        constexpr size_t kUdpHeader = 16;
+        constexpr size_t kUdpSyn = 8;
+        constexpr size_t kUdpSynAck = 8;
+        constexpr size_t kUdpParity = 8;
+        constexpr size_t kUdpAck = 16 + UDP_SACK_PACKETS / 8;
+        constexpr size_t kBeacon = 40;
+
+        // Largest run of framing between two payloads: a chunk digest,
+        // then the next header and its compressed-chunk or copy record
+        constexpr size_t kMaxFraming = kChunkDigest + kDataChunkHeader + kCompressedChunk;
+
+        static_assert(sizeof(HelloPacket) == kHello && offsetof(HelloPacket, flags) == 6);
+        static_assert(sizeof(FileMeta) == kFileMeta && offsetof(FileMeta, nameLen) == 8 &&
+                      offsetof(FileMeta, chunkSize) == 12);
+        static_assert(sizeof(ResumeRequest) == kResumeRequest);
+        static_assert(sizeof(ResumeOffer) == kResumeOffer && offsetof(ResumeOffer, checksum) == 24);
+        static_assert(sizeof(DataChunkHeader) == kDataChunkHeader);
+        static_assert(sizeof(CompressedChunk) == kCompressedChunk && offsetof(CompressedChunk, codec) == 4);
+        static_assert(sizeof(DeltaBasis) == kDeltaBasis);
+        static_assert(sizeof(DeltaSignatures) == kDeltaSignatures);
+        static_assert(sizeof(BlockSignature) == kBlockSignature && offsetof(BlockSignature, length) == 8);
+        static_assert(sizeof(DeltaCopy) == kDeltaCopy);
+        static_assert(sizeof(ChunkDigest) == kChunkDigest);
+        static_assert(sizeof(StripeOpen) == kStripeOpen && offsetof(StripeOpen, streamCount) == 8);
+        static_assert(sizeof(StripeJoin) == kStripeJoin);
+        static_assert(sizeof(OffsetChunkHeader) == kOffsetChunkHeader && offsetof(OffsetChunkHeader, length) == 8);
+        static_assert(sizeof(SessionManifest) == kSessionManifest && offsetof(SessionManifest, totalBytes) == 8);
+        static_assert(sizeof(ManifestEntry) == kManifestEntry && offsetof(ManifestEntry, nameLen) == 8);
+        static_assert(sizeof(TreeManifest) == kTreeManifest && offsetof(TreeManifest, totalBytes) == 8 &&
+                      offsetof(TreeManifest, rootNameLen) == 24);
+        static_assert(sizeof(TreeFileEntry) == kTreeFileEntry && offsetof(TreeFileEntry, pathLen) == 16);
+        static_assert(sizeof(PackHeader) == kPackHeader);
+        static_assert(sizeof(KeyShare) == kKeyShare && offsetof(KeyShare, suites) == 32);
+        static_assert(sizeof(RecordHeader) == kRecordHeader);
+        static_assert(sizeof(UdpHeader) == kUdpHeader && offsetof(UdpHeader, timestamp) == 12);
+        static_assert(sizeof(UdpSyn) == kUdpSyn);
+        static_assert(sizeof(UdpSynAck) == kUdpSynAck);
+        static_assert(sizeof(UdpParity) == kUdpParity && offsetof(UdpParity, flags) == 4);
+        static_assert(sizeof(UdpAck) == kUdpAck && offsetof(UdpAck, sack) == 16);
+        static_assert(sizeof(Beacon) == kBeacon && offsetof(Beacon, deviceId) == 8 &&
+                      offsetof(Beacon, nameLen) == 32);
+    }
+
+    // ===============================
+    // Buffered frame reader
+    // ===============================
+
+    // Reads one file's DataChunkHeader stream (see protocol.h) with as
+    // few recv() calls as the stream allows.
+    //
+    // Buffered: each refill takes as much as the socket has, up to the
+    // buffer size, so the headers, payloads and digests of many frames
+    // come out of one recv(). The reader never takes more than setBound()
+    // allows, so bytes of whatever follows the file stay in the socket.
+    // Payloads then arrive through the buffer, which rules out splice.
+    //
+    // Exact: for zero-copy and io_uring receives, which take payloads
+    // straight off the socket. Only framing is read, but the framing
+    // known to follow is read with it.
+    class FrameReader
+    {
+    public:
+        FrameReader(int sock, bool buffered, Telemetry &telemetry);
+        ~FrameReader();
+
+        FrameReader(const FrameReader &) = delete;
+        FrameReader &operator=(const FrameReader &) = delete;
+
+        bool buffered() const { return buffered_; }
+        // At least `streamBytes` more bytes of this stream follow,
+        // counting the ones already buffered
+        void setBound(uint64_t streamBytes);
+
+        // Exactly `len` bytes. A refill also asks for `ahead` bytes the
+        // caller knows come next.
+        bool read(void *data, size_t len, size_t ahead = 0);
+        // Up to `max` bytes in place, refilling first unless a quarter
+        // of the buffer (or `max`) is already there, so payloads are
+        // written in large pieces; nullptr on a closed or broken socket
+        const char *take(size_t max, size_t &len);
+        size_t pending() const { return end_ - start_; }
+
+    private:
+        bool fill(size_t need, size_t ahead);
+
+        static constexpr size_t kBufferSize = 1024 * 1024;
+
+        int sock_;
+        bool buffered_;
+        char *buffer_;
+        size_t capacity_;
+        size_t start_; // unread bytes are [start_, end_)
+        size_t end_;
+        uint64_t bound_; // bytes the socket may still give up
+        Telemetry &telemetry_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace swiftshare
+{
+    // Reserves [offset, end) of `fd` on disk without changing its size,
+    // so a file written front to back does not fragment. Returns false
+    // when the disk is too full; a filesystem that cannot preallocate
+    // counts as success.
+    bool preallocate(int fd, uint64_t offset, uint64_t end);
+
+    // Paces the page cache behind a file received front to back. Every
+    // `window` bytes, writeback of the newest window is started and the
+    // window before it is waited for and dropped from the cache, so at
+    // most about two windows are dirty at a time instead of the kernel
+    // flushing gigabytes at once near the end of the file.
+    //
+    // In direct mode the file is switched to O_DIRECT and there is
+    // nothing to pace; writes that are not block aligned still go
+    // through the cache (see SocketReceiver).
+    class WriteScheduler
+    {
+    public:
+        // Preallocates [offset, fileSize). A window of 0 leaves the page
+        // cache to the kernel.
+        WriteScheduler(int fd, uint64_t offset, uint64_t fileSize, uint32_t window, bool direct);
+        // Starts writeback of whatever is left, without waiting
+        ~WriteScheduler();
+
+        WriteScheduler(const WriteScheduler &) = delete;
+        WriteScheduler &operator=(const WriteScheduler &) = delete;
+
+        // Everything below `end` is written and will not be read back
+        // (with digests: verified)
+        void advance(uint64_t end);
+
+        bool direct() const { return direct_; }
+
+    private:
+        int fd_;
+        uint64_t started_; // writeback started below this
+        uint64_t dropped_; // written back and dropped from the cache below this
+        uint32_t window_;
+        bool direct_;
+    };
+
+    // The sender's side of the same: drops a file's pages from the cache
+    // once they are `window` bytes behind the transfer, so a large send
+    // does not push everything else out of memory.
+    class ReadScheduler
+    {
+    public:
+        ReadScheduler(int fd, uint64_t offset, uint32_t window);
+
+        ReadScheduler(const ReadScheduler &) = delete;
+        ReadScheduler &operator=(const ReadScheduler &) = delete;
+
+        // Everything below `end` has been sent
+        void advance(uint64_t end);
+
+    private:
+        int fd_;
+        uint64_t dropped_;
+        uint32_t window_;
+    };
+
+} // namespace swiftshare
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "buffer_pool.h"
+#include "telemetry.h"
+
+namespace swiftshare
+{
+    class UringReceiver;
+
+    // How file bytes reach the socket, best first.
+    enum class SendPath
+    {
+        Sendfile, // file pages -> socket, no user-space copy
+        Splice,   // file -> pipe -> socket, no user-space copy
+        Copy      // pread() into a buffer, then send()
+    };
+
+    const char *sendPathName(SendPath path);
+
+    // Bytes moved by the kernel alone versus bounced through user space,
+    // shared by every sender and receiver of one engine.
+    struct IoCounters
+    {
+        std::atomic<uint64_t> zeroCopyBytes{0};
+        std::atomic<uint64_t> copiedBytes{0};
+        std::atomic<uint64_t> uringBytes{0};   // moved by the io_uring backend
+        std::atomic<uint64_t> uringSubmits{0}; // io_uring_enter() submissions
+        std::atomic<uint64_t> hashedBytes{0};  // covered by chunk digests
+        std::atomic<uint64_t> digestFailures{0};
+        std::atomic<uint64_t> deltaReusedBytes{0}; // copied from a delta basis
+        Telemetry telemetry; // off until asked for
+        BufferPool buffers;  // copy, decode, hash and read-ahead buffers
+    };
+
+    // Pushes byte ranges of a file to a socket, falling back from
+    // sendfile() to splice() to a plain copy loop the first time the
+    // kernel refuses a faster path. One instance per sending thread.
+    class FileSender
+    {
+    public:
+        FileSender(bool zeroCopy, size_t copyBufferSize, IoCounters &counters);
+        ~FileSender();
+
+        FileSender(const FileSender &) = delete;
+        FileSender &operator=(const FileSender &) = delete;
+
+        // Sends exactly `length` bytes of `fd` starting at `offset`,
+        // preceded by `headLength` bytes of framing at `head`, which share
+        // the payload's first segment. Does not move the file offset.
+        // Returns false on socket error or if the file ends early.
+        bool sendRange(int sock, int fd, uint64_t offset, size_t length,
+                       const void *head = nullptr, size_t headLength = 0);
+
+        SendPath path() const { return path_; }
+
+    private:
+        bool sendWithSendfile(int sock, int fd, uint64_t &offset, size_t &remaining);
+        bool sendWithSplice(int sock, int fd, uint64_t &offset, size_t &remaining);
+        bool sendWithCopy(int sock, int fd, uint64_t &offset, size_t &remaining,
+                          const void *head, size_t headLength);
+        bool openPipe();
+
+        SendPath path_;
+        int pipe_[2];
+        size_t copyBufferSize_;
+        IoCounters &counters_;
+    };
+
+    // Moves chunk payloads from a socket into a file. Uses io_uring when
+    // asked for and available, else splice() through a reusable pipe pair
+    // when possible, otherwise a page-aligned buffer taken from the
+    // engine's pool for each chunk.
+    class SocketReceiver
+    {
+    public:
+        SocketReceiver(bool zeroCopy, bool ioUring, IoCounters &counters);
+        ~SocketReceiver();
+
+        SocketReceiver(const SocketReceiver &) = delete;
+        SocketReceiver &operator=(const SocketReceiver &) = delete;
+
+        // Reads exactly `length` bytes from `sock` and writes them at
+        // `offset` in `fd`. Returns false on a short read or short write.
+        bool receiveRange(int sock, int fd, uint64_t offset, size_t length);
+        // Reads an LZ4 payload of `wireLength` bytes and writes the
+        // `rawLength` bytes it decodes to at `offset`. Always copies.
+        bool receiveCompressed(int sock, int fd, uint64_t offset,
+                               size_t wireLength, size_t rawLength);
+        // Copies `length` bytes at `fromOffset` in `from` to `offset` in
+        // `fd`, for delta copy frames. Fails if `from` ends early.
+        bool copyFromFile(int from, uint64_t fromOffset, int fd, uint64_t offset, size_t length);
+        // Writes payload bytes that were already read off the socket
+        bool writeRange(int fd, uint64_t offset, const char *data, size_t length);
+
+        bool usingSplice() const { return zeroCopy_; }
+        bool usingIoUring() const { return uring_ != nullptr; }
+
+    private:
+        bool receiveWithSplice(int sock, int fd, uint64_t &offset, size_t &remaining);
+        bool receiveWithCopy(int sock, int fd, uint64_t &offset, size_t &remaining);
+        bool drainPipeToFile(int fd, uint64_t &offset, size_t pending);
+        bool writeAll(int fd, const char *data, size_t len, uint64_t &offset);
+
+        static constexpr size_t kBufferSize = 256 * 1024;
+
+        bool zeroCopy_;
+        int pipe_[2];
+        std::unique_ptr<UringReceiver> uring_;
+        IoCounters &counters_;
+    };
+
+} // namespace swiftshare
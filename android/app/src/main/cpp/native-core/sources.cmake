@@ -0,0 +1,35 @@
+# Sources of the transfer engine, shared by the app build
+# (../CMakeLists.txt) and the standalone host build (CMakeLists.txt here)
+set(NATIVE_CORE_SOURCES
+    ${CMAKE_CURRENT_LIST_DIR}/src/transfer_engine.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/zero_copy.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/buffer_pool.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/net_utils.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/wire_codec.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/striped_transfer.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/session_transfer.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/tree_transfer.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/tree_walker.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/send_pipeline.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/io_uring_backend.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/event_loop.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/transfer_session.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/progress_reporter.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/telemetry.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/path_resolver.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/write_scheduler.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/transfer_scheduler.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/discovery.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/checksum.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/resume_journal.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/chunk_hasher.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/compression.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/delta_sync.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/delta_transfer.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/link_tuner.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/key_exchange.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/aead.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/secure_channel.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/udp_transport.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/src/log.cpp
+)
@@ -0,0 +1,1078 @@
+#include "aead.h"
+#include "key_exchange.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWIFTSHARE_AES_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define SWIFTSHARE_AES_ARM 1
+#endif
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    inline uint32_t load32(const uint8_t *p)
+    {
+        return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+
+    inline void store32(uint8_t *p, uint32_t v)
+    {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+        p[2] = (uint8_t)(v >> 16);
+        p[3] = (uint8_t)(v >> 24);
+    }
+
+    inline void store64(uint8_t *p, uint64_t v)
+    {
+        store32(p, (uint32_t)v);
+        store32(p + 4, (uint32_t)(v >> 32));
+    }
+
+    bool tagsEqual(const uint8_t *a, const uint8_t *b)
+    {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < kAeadTagSize; ++i)
+            diff |= a[i] ^ b[i];
+        return diff == 0;
+    }
+
+    // ===============================
+    // ChaCha20 (RFC 8439)
+    // ===============================
+
+    // One block per vector lane; the compiler maps the vector types onto
+    // SSE2 / AVX2 or NEON
+    typedef uint32_t U32x4 __attribute__((vector_size(16)));
+    typedef uint32_t U32x8 __attribute__((vector_size(32)));
+
+    constexpr size_t kChaChaBatch = 4 * 64;     // blocks of chachaXor4()
+    constexpr size_t kChaChaWideBatch = 8 * 64; // blocks of chachaXor8()
+
+    // In place: vectors wider than the baseline ISA never pass by value
+    template <typename V>
+    __attribute__((always_inline)) inline void rotl(V &v, int r)
+    {
+        v = (v << r) | (v >> (32 - r));
+    }
+
+    template <typename V>
+    __attribute__((always_inline)) inline void quarterRound(V &a, V &b, V &c, V &d)
+    {
+        a += b;
+        d ^= a;
+        rotl(d, 16);
+        c += d;
+        b ^= c;
+        rotl(b, 12);
+        a += b;
+        d ^= a;
+        rotl(d, 8);
+        c += d;
+        b ^= c;
+        rotl(b, 7);
+    }
+
+    // XORs four blocks' words i..i+3, one block per lane of a..d, into
+    // 256 bytes at `data`: a 4x4 transpose turns them back into
+    // consecutive keystream
+    __attribute__((always_inline)) inline void xorTransposed(U32x4 a, U32x4 b, U32x4 c, U32x4 d,
+                                                             uint8_t *data, int i)
+    {
+        U32x4 ab01 = __builtin_shufflevector(a, b, 0, 4, 1, 5);
+        U32x4 ab23 = __builtin_shufflevector(a, b, 2, 6, 3, 7);
+        U32x4 cd01 = __builtin_shufflevector(c, d, 0, 4, 1, 5);
+        U32x4 cd23 = __builtin_shufflevector(c, d, 2, 6, 3, 7);
+        U32x4 words[4] = {__builtin_shufflevector(ab01, cd01, 0, 1, 4, 5),
+                          __builtin_shufflevector(ab01, cd01, 2, 3, 6, 7),
+                          __builtin_shufflevector(ab23, cd23, 0, 1, 4, 5),
+                          __builtin_shufflevector(ab23, cd23, 2, 3, 6, 7)};
+        for (int block = 0; block < 4; ++block)
+        {
+            uint8_t *out = data + 64 * block + 4 * i;
+            U32x4 plain;
+            memcpy(&plain, out, sizeof(plain));
+            plain ^= words[block];
+            memcpy(out, &plain, sizeof(plain));
+        }
+    }
+
+    // Lanes 4 * part .. 4 * part + 3 of `v`
+    template <typename V>
+    __attribute__((always_inline)) inline U32x4 quarterOf(const V &v, int part)
+    {
+        U32x4 q;
+        memcpy(&q, reinterpret_cast<const uint32_t *>(&v) + 4 * part, sizeof(q));
+        return q;
+    }
+
+    // XORs the keystream of blocks state[12] .. state[12] + lanes - 1
+    // into 64 bytes per lane at `data`
+    template <typename V>
+    __attribute__((always_inline)) inline void chachaXorLanes(const uint32_t state[16], uint8_t *data)
+    {
+        constexpr int kLanes = sizeof(V) / sizeof(uint32_t);
+        V in[16];
+        V x[16];
+        for (int i = 0; i < 16; ++i)
+            in[i] = V{} + state[i];
+        for (int lane = 0; lane < kLanes; ++lane)
+            in[12][lane] += (uint32_t)lane;
+        for (int i = 0; i < 16; ++i)
+            x[i] = in[i];
+
+        for (int round = 0; round < 10; ++round)
+        {
+            quarterRound(x[0], x[4], x[8], x[12]);
+            quarterRound(x[1], x[5], x[9], x[13]);
+            quarterRound(x[2], x[6], x[10], x[14]);
+            quarterRound(x[3], x[7], x[11], x[15]);
+            quarterRound(x[0], x[5], x[10], x[15]);
+            quarterRound(x[1], x[6], x[11], x[12]);
+            quarterRound(x[2], x[7], x[8], x[13]);
+            quarterRound(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; ++i)
+            x[i] += in[i];
+        for (int part = 0; part < kLanes / 4; ++part)
+            for (int i = 0; i < 16; i += 4)
+                xorTransposed(quarterOf(x[i], part), quarterOf(x[i + 1], part), quarterOf(x[i + 2], part),
+                              quarterOf(x[i + 3], part), data + 256 * part, i);
+    }
+
+    void chachaXor4(const uint32_t state[16], uint8_t *data)
+    {
+        chachaXorLanes<U32x4>(state, data);
+    }
+
+#if defined(SWIFTSHARE_AES_X86)
+    // Eight blocks at a time where the CPU has 256-bit vectors
+    __attribute__((target("avx2"))) void chachaXor8(const uint32_t state[16], uint8_t *data)
+    {
+        chachaXorLanes<U32x8>(state, data);
+    }
+
+    bool chachaWide()
+    {
+        static const bool wide = __builtin_cpu_supports("avx2");
+        return wide;
+    }
+#else
+    void chachaXor8(const uint32_t state[16], uint8_t *data)
+    {
+        chachaXor4(state, data);
+        uint32_t next[16];
+        memcpy(next, state, sizeof(next));
+        next[12] += 4;
+        chachaXor4(next, data + kChaChaBatch);
+    }
+
+    bool chachaWide()
+    {
+        return false;
+    }
+#endif
+
+    // ===============================
+    // Poly1305 (after poly1305-donna)
+    // ===============================
+
+#if defined(__SIZEOF_INT128__)
+    inline uint64_t load64(const uint8_t *p)
+    {
+        return (uint64_t)load32(p) | (uint64_t)load32(p + 4) << 32;
+    }
+
+    // 44-bit limbs, where the target multiplies into 128 bits
+    class Poly1305
+    {
+        typedef unsigned __int128 U128;
+        static constexpr uint64_t kMask44 = 0xfffffffffff;
+        static constexpr uint64_t kMask42 = 0x3ffffffffff;
+
+    public:
+        explicit Poly1305(const uint8_t key[32])
+        {
+            uint64_t t0 = load64(key);
+            uint64_t t1 = load64(key + 8);
+            r_[0] = t0 & 0xffc0fffffff;
+            r_[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+            r_[2] = (t1 >> 24) & 0x00ffffffc0f;
+            pad_[0] = load64(key + 16);
+            pad_[1] = load64(key + 24);
+
+            // r^2 for two blocks at a time
+            memcpy(rr_, r_, sizeof(rr_));
+            multiply(rr_, r_);
+            memset(h_, 0, sizeof(h_));
+        }
+
+        ~Poly1305()
+        {
+            wipe(r_, sizeof(r_));
+            wipe(rr_, sizeof(rr_));
+            wipe(pad_, sizeof(pad_));
+        }
+
+        // Whole 16-byte blocks
+        void blocks(const uint8_t *m, size_t len)
+        {
+            // Two blocks per step as (h + m1) * r^2 + m2 * r: the six
+            // products are independent, so one carry chain waits on h
+            // per 32 bytes
+            for (; len >= 32; m += 32, len -= 32)
+            {
+                uint64_t a[3];
+                uint64_t b[3];
+                limbs(m, a);
+                limbs(m + 16, b);
+                for (int i = 0; i < 3; ++i)
+                    h_[i] += a[i];
+
+                U128 d[3];
+                products(h_, rr_, d);
+                U128 e[3];
+                products(b, r_, e);
+                for (int i = 0; i < 3; ++i)
+                    d[i] += e[i];
+                carry(d, h_);
+            }
+            if (len >= 16)
+            {
+                uint64_t a[3];
+                limbs(m, a);
+                for (int i = 0; i < 3; ++i)
+                    h_[i] += a[i];
+                multiply(h_, r_);
+            }
+        }
+
+        // Any length, zero-padded to a whole block as the AEAD construction
+        // pads each part
+        void padded(const uint8_t *m, size_t len)
+        {
+            size_t whole = len & ~(size_t)15;
+            blocks(m, whole);
+            if (whole < len)
+            {
+                uint8_t last[16] = {};
+                memcpy(last, m + whole, len - whole);
+                blocks(last, sizeof(last));
+            }
+        }
+
+        void finish(uint8_t tag[16])
+        {
+            uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2];
+
+            uint64_t c = h1 >> 44;
+            h1 &= kMask44;
+            h2 += c;
+            c = h2 >> 42;
+            h2 &= kMask42;
+            h0 += c * 5;
+            c = h0 >> 44;
+            h0 &= kMask44;
+            h1 += c;
+            c = h1 >> 44;
+            h1 &= kMask44;
+            h2 += c;
+            c = h2 >> 42;
+            h2 &= kMask42;
+            h0 += c * 5;
+            c = h0 >> 44;
+            h0 &= kMask44;
+            h1 += c;
+
+            // h - p, kept only if it did not go negative
+            uint64_t g0 = h0 + 5;
+            c = g0 >> 44;
+            g0 &= kMask44;
+            uint64_t g1 = h1 + c;
+            c = g1 >> 44;
+            g1 &= kMask44;
+            uint64_t g2 = h2 + c - (1ull << 42);
+
+            uint64_t mask = (g2 >> 63) - 1;
+            h0 = (h0 & ~mask) | (g0 & mask);
+            h1 = (h1 & ~mask) | (g1 & mask);
+            h2 = (h2 & ~mask) | (g2 & mask);
+
+            uint64_t t0 = pad_[0];
+            uint64_t t1 = pad_[1];
+            h0 += t0 & kMask44;
+            c = h0 >> 44;
+            h0 &= kMask44;
+            h1 += (((t0 >> 44) | (t1 << 20)) & kMask44) + c;
+            c = h1 >> 44;
+            h1 &= kMask44;
+            h2 += ((t1 >> 24) & kMask42) + c;
+
+            store64(tag, h0 | (h1 << 44));
+            store64(tag + 8, (h1 >> 20) | (h2 << 24));
+        }
+
+    private:
+        // One block with its 2^128 bit
+        static void limbs(const uint8_t *m, uint64_t out[3])
+        {
+            uint64_t t0 = load64(m);
+            uint64_t t1 = load64(m + 8);
+            out[0] = t0 & kMask44;
+            out[1] = ((t0 >> 44) | (t1 << 20)) & kMask44;
+            out[2] = ((t1 >> 24) & kMask42) | (1ull << 40);
+        }
+
+        // x * y mod 2^130 - 5, not yet carried
+        static void products(const uint64_t x[3], const uint64_t y[3], U128 d[3])
+        {
+            const uint64_t s1 = y[1] * (5 << 2), s2 = y[2] * (5 << 2);
+            d[0] = (U128)x[0] * y[0] + (U128)x[1] * s2 + (U128)x[2] * s1;
+            d[1] = (U128)x[0] * y[1] + (U128)x[1] * y[0] + (U128)x[2] * s2;
+            d[2] = (U128)x[0] * y[2] + (U128)x[1] * y[1] + (U128)x[2] * y[0];
+        }
+
+        static void carry(U128 d[3], uint64_t h[3])
+        {
+            uint64_t c = (uint64_t)(d[0] >> 44);
+            h[0] = (uint64_t)d[0] & kMask44;
+            d[1] += c;
+            c = (uint64_t)(d[1] >> 44);
+            h[1] = (uint64_t)d[1] & kMask44;
+            d[2] += c;
+            c = (uint64_t)(d[2] >> 42);
+            h[2] = (uint64_t)d[2] & kMask42;
+            h[0] += c * 5;
+            c = h[0] >> 44;
+            h[0] &= kMask44;
+            h[1] += c;
+        }
+
+        // h = h * y
+        static void multiply(uint64_t h[3], const uint64_t y[3])
+        {
+            U128 d[3];
+            products(h, y, d);
+            carry(d, h);
+        }
+
+        uint64_t r_[3];
+        uint64_t rr_[3]; // r^2
+        uint64_t h_[3];
+        uint64_t pad_[2];
+    };
+#else
+    // 26-bit limbs, for 32-bit targets
+    class Poly1305
+    {
+    public:
+        explicit Poly1305(const uint8_t key[32])
+        {
+            r_[0] = load32(key) & 0x3ffffff;
+            r_[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+            r_[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+            r_[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+            r_[4] = (load32(key + 12) >> 8) & 0x00fffff;
+            for (int i = 0; i < 4; ++i)
+                pad_[i] = load32(key + 16 + 4 * i);
+            memset(h_, 0, sizeof(h_));
+        }
+
+        ~Poly1305()
+        {
+            wipe(r_, sizeof(r_));
+            wipe(pad_, sizeof(pad_));
+        }
+
+        // Whole 16-byte blocks
+        void blocks(const uint8_t *m, size_t len)
+        {
+            const uint32_t r0 = r_[0], r1 = r_[1], r2 = r_[2], r3 = r_[3], r4 = r_[4];
+            const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+            uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+            for (; len >= 16; m += 16, len -= 16)
+            {
+                h0 += load32(m) & 0x3ffffff;
+                h1 += (load32(m + 3) >> 2) & 0x3ffffff;
+                h2 += (load32(m + 6) >> 4) & 0x3ffffff;
+                h3 += (load32(m + 9) >> 6) & 0x3ffffff;
+                h4 += (load32(m + 12) >> 8) | (1u << 24);
+
+                uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 +
+                              (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+                uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 +
+                              (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+                uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 +
+                              (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+                uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 +
+                              (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+                uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 +
+                              (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+                uint32_t c = (uint32_t)(d0 >> 26);
+                h0 = (uint32_t)d0 & 0x3ffffff;
+                d1 += c;
+                c = (uint32_t)(d1 >> 26);
+                h1 = (uint32_t)d1 & 0x3ffffff;
+                d2 += c;
+                c = (uint32_t)(d2 >> 26);
+                h2 = (uint32_t)d2 & 0x3ffffff;
+                d3 += c;
+                c = (uint32_t)(d3 >> 26);
+                h3 = (uint32_t)d3 & 0x3ffffff;
+                d4 += c;
+                c = (uint32_t)(d4 >> 26);
+                h4 = (uint32_t)d4 & 0x3ffffff;
+                h0 += c * 5;
+                c = h0 >> 26;
+                h0 &= 0x3ffffff;
+                h1 += c;
+            }
+
+            h_[0] = h0;
+            h_[1] = h1;
+            h_[2] = h2;
+            h_[3] = h3;
+            h_[4] = h4;
+        }
+
+        // Any length, zero-padded to a whole block as the AEAD construction
+        // pads each part
+        void padded(const uint8_t *m, size_t len)
+        {
+            size_t whole = len & ~(size_t)15;
+            blocks(m, whole);
+            if (whole < len)
+            {
+                uint8_t last[16] = {};
+                memcpy(last, m + whole, len - whole);
+                blocks(last, sizeof(last));
+            }
+        }
+
+        void finish(uint8_t tag[16])
+        {
+            uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+            uint32_t c = h1 >> 26;
+            h1 &= 0x3ffffff;
+            h2 += c;
+            c = h2 >> 26;
+            h2 &= 0x3ffffff;
+            h3 += c;
+            c = h3 >> 26;
+            h3 &= 0x3ffffff;
+            h4 += c;
+            c = h4 >> 26;
+            h4 &= 0x3ffffff;
+            h0 += c * 5;
+            c = h0 >> 26;
+            h0 &= 0x3ffffff;
+            h1 += c;
+
+            // h - p, kept only if it did not go negative
+            uint32_t g0 = h0 + 5;
+            c = g0 >> 26;
+            g0 &= 0x3ffffff;
+            uint32_t g1 = h1 + c;
+            c = g1 >> 26;
+            g1 &= 0x3ffffff;
+            uint32_t g2 = h2 + c;
+            c = g2 >> 26;
+            g2 &= 0x3ffffff;
+            uint32_t g3 = h3 + c;
+            c = g3 >> 26;
+            g3 &= 0x3ffffff;
+            uint32_t g4 = h4 + c - (1u << 26);
+
+            uint32_t mask = (g4 >> 31) - 1;
+            h0 = (h0 & ~mask) | (g0 & mask);
+            h1 = (h1 & ~mask) | (g1 & mask);
+            h2 = (h2 & ~mask) | (g2 & mask);
+            h3 = (h3 & ~mask) | (g3 & mask);
+            h4 = (h4 & ~mask) | (g4 & mask);
+
+            h0 = h0 | (h1 << 26);
+            h1 = (h1 >> 6) | (h2 << 20);
+            h2 = (h2 >> 12) | (h3 << 14);
+            h3 = (h3 >> 18) | (h4 << 8);
+
+            uint64_t f = (uint64_t)h0 + pad_[0];
+            store32(tag, (uint32_t)f);
+            f = (uint64_t)h1 + pad_[1] + (f >> 32);
+            store32(tag + 4, (uint32_t)f);
+            f = (uint64_t)h2 + pad_[2] + (f >> 32);
+            store32(tag + 8, (uint32_t)f);
+            f = (uint64_t)h3 + pad_[3] + (f >> 32);
+            store32(tag + 12, (uint32_t)f);
+        }
+
+    private:
+        uint32_t r_[5];
+        uint32_t h_[5];
+        uint32_t pad_[4];
+    };
+#endif
+
+    // Seals (encrypt) or opens `data` in place; the tag always covers
+    // the ciphertext
+    void chachaPoly(const uint8_t key[kAeadKeySize], const uint8_t nonce[kAeadNonceSize],
+                    const uint8_t *aad, size_t aadLen, uint8_t *data, size_t len,
+                    uint8_t tag[kAeadTagSize], bool encrypt)
+    {
+        uint32_t state[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+        for (int i = 0; i < 8; ++i)
+            state[4 + i] = load32(key + 4 * i);
+        state[12] = 0;
+        for (int i = 0; i < 3; ++i)
+            state[13 + i] = load32(nonce + 4 * i);
+
+        // Block 0 keys Poly1305; the data starts at block 1
+        uint8_t keystream[kChaChaBatch] = {};
+        chachaXor4(state, keystream);
+        Poly1305 mac(keystream);
+        mac.padded(aad, aadLen);
+        state[12] = 1;
+
+        // Eight blocks at a time where the CPU allows, then four
+        size_t total = len;
+        const size_t batches[] = {chachaWide() ? kChaChaWideBatch : kChaChaBatch, kChaChaBatch};
+        for (size_t batch : batches)
+        {
+            for (; len >= batch; data += batch, len -= batch)
+            {
+                if (!encrypt)
+                    mac.blocks(data, batch);
+                if (batch == kChaChaWideBatch)
+                    chachaXor8(state, data);
+                else
+                    chachaXor4(state, data);
+                if (encrypt)
+                    mac.blocks(data, batch);
+                state[12] += (uint32_t)(batch / 64);
+            }
+        }
+        if (len > 0)
+        {
+            if (!encrypt)
+                mac.padded(data, len);
+            memset(keystream, 0, sizeof(keystream));
+            memcpy(keystream, data, len);
+            chachaXor4(state, keystream);
+            memcpy(data, keystream, len);
+            if (encrypt)
+                mac.padded(data, len);
+        }
+
+        uint8_t lengths[16];
+        store64(lengths, aadLen);
+        store64(lengths + 8, total);
+        mac.blocks(lengths, sizeof(lengths));
+        mac.finish(tag);
+
+        wipe(keystream, sizeof(keystream));
+        wipe(state, sizeof(state));
+    }
+
+    // ===============================
+    // AES-256-GCM, per-ISA primitives
+    // ===============================
+
+    // GHASH works on byte-reversed blocks, where GCM's reflected bit
+    // order becomes plain carry-less multiplication followed by a
+    // one-bit shift (Gueron & Kounavis, "Intel Carry-Less Multiplication
+    // Instruction and its Usage for Computing the GCM Mode").
+#if defined(SWIFTSHARE_AES_X86)
+#define SWIFTSHARE_GCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#define SWIFTSHARE_GCM_NAME "aes-ni"
+
+    using Block = __m128i;
+
+    // Unreduced 256-bit product: lo + mid * 2^64 + hi * 2^128
+    struct Wide
+    {
+        __m128i lo, mid, hi;
+    };
+
+    SWIFTSHARE_GCM_TARGET inline Block loadBlock(const uint8_t *p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+
+    SWIFTSHARE_GCM_TARGET inline void storeBlock(uint8_t *p, Block b)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), b);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block xorBlock(Block a, Block b)
+    {
+        return _mm_xor_si128(a, b);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block zeroBlock()
+    {
+        return _mm_setzero_si128();
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block byteSwap(Block b)
+    {
+        return _mm_shuffle_epi8(b, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    }
+
+    // `base` with its last four bytes set to big-endian `n`
+    SWIFTSHARE_GCM_TARGET inline Block counterBlock(Block base, uint32_t n)
+    {
+        return _mm_xor_si128(base, _mm_set_epi32((int)__builtin_bswap32(n), 0, 0, 0));
+    }
+
+    // GCM's final length block, byte-reversed
+    SWIFTSHARE_GCM_TARGET inline Block lengthBlock(uint64_t aadBits, uint64_t dataBits)
+    {
+        return _mm_set_epi64x((long long)aadBits, (long long)dataBits);
+    }
+
+    template <int N>
+    SWIFTSHARE_GCM_TARGET inline void aesEncrypt(const Block *rk, Block *b)
+    {
+        for (int k = 0; k < N; ++k)
+            b[k] = _mm_xor_si128(b[k], rk[0]);
+#pragma GCC unroll 13
+        for (int round = 1; round < 14; ++round)
+#pragma GCC unroll 8
+            for (int k = 0; k < N; ++k)
+                b[k] = _mm_aesenc_si128(b[k], rk[round]);
+        for (int k = 0; k < N; ++k)
+            b[k] = _mm_aesenclast_si128(b[k], rk[14]);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline void gfMulAdd(Block a, Block b, Wide &acc)
+    {
+        acc.lo = _mm_xor_si128(acc.lo, _mm_clmulepi64_si128(a, b, 0x00));
+        acc.hi = _mm_xor_si128(acc.hi, _mm_clmulepi64_si128(a, b, 0x11));
+        acc.mid = _mm_xor_si128(acc.mid, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x01),
+                                                       _mm_clmulepi64_si128(a, b, 0x10)));
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block gfReduce(const Wide &acc)
+    {
+        __m128i lo = _mm_xor_si128(acc.lo, _mm_slli_si128(acc.mid, 8));
+        __m128i hi = _mm_xor_si128(acc.hi, _mm_srli_si128(acc.mid, 8));
+
+        // Shift the 256-bit product left by one
+        __m128i carryLo = _mm_srli_epi32(lo, 31);
+        __m128i carryHi = _mm_srli_epi32(hi, 31);
+        lo = _mm_slli_epi32(lo, 1);
+        hi = _mm_slli_epi32(hi, 1);
+        __m128i across = _mm_srli_si128(carryLo, 12);
+        carryHi = _mm_slli_si128(carryHi, 4);
+        carryLo = _mm_slli_si128(carryLo, 4);
+        lo = _mm_or_si128(lo, carryLo);
+        hi = _mm_or_si128(_mm_or_si128(hi, carryHi), across);
+
+        // Reduce modulo x^128 + x^7 + x^2 + x + 1
+        __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)),
+                                  _mm_slli_epi32(lo, 25));
+        __m128i b = _mm_srli_si128(a, 4);
+        lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+        __m128i c = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)),
+                                  _mm_srli_epi32(lo, 7));
+        lo = _mm_xor_si128(lo, _mm_xor_si128(c, b));
+        return _mm_xor_si128(hi, lo);
+    }
+
+    // SubWord() of the key schedule, all four columns alike so ShiftRows
+    // drops out
+    SWIFTSHARE_GCM_TARGET uint32_t subWord(uint32_t w)
+    {
+        __m128i v = _mm_aesenclast_si128(_mm_set1_epi32((int)w), _mm_setzero_si128());
+        return (uint32_t)_mm_cvtsi128_si32(v);
+    }
+
+    bool gcmInstructions()
+    {
+        return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") &&
+               __builtin_cpu_supports("ssse3");
+    }
+#elif defined(SWIFTSHARE_AES_ARM)
+#define SWIFTSHARE_GCM_TARGET __attribute__((target("aes")))
+#define SWIFTSHARE_GCM_NAME "armv8-ce"
+
+    using Block = uint8x16_t;
+
+    // Unreduced 256-bit product: lo + mid * 2^64 + hi * 2^128
+    struct Wide
+    {
+        uint64x2_t lo, mid, hi;
+    };
+
+    SWIFTSHARE_GCM_TARGET inline Block loadBlock(const uint8_t *p)
+    {
+        return vld1q_u8(p);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline void storeBlock(uint8_t *p, Block b)
+    {
+        vst1q_u8(p, b);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block xorBlock(Block a, Block b)
+    {
+        return veorq_u8(a, b);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block zeroBlock()
+    {
+        return vdupq_n_u8(0);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline Block byteSwap(Block b)
+    {
+        b = vrev64q_u8(b);
+        return vextq_u8(b, b, 8);
+    }
+
+    // `base` with its last four bytes set to big-endian `n`
+    SWIFTSHARE_GCM_TARGET inline Block counterBlock(Block base, uint32_t n)
+    {
+        return vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(n), vreinterpretq_u32_u8(base), 3));
+    }
+
+    // GCM's final length block, byte-reversed
+    SWIFTSHARE_GCM_TARGET inline Block lengthBlock(uint64_t aadBits, uint64_t dataBits)
+    {
+        return vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(dataBits), vcreate_u64(aadBits)));
+    }
+
+    // AESE is AddRoundKey + SubBytes + ShiftRows, so the round keys come
+    // one step earlier than in the x86 sequence
+    template <int N>
+    SWIFTSHARE_GCM_TARGET inline void aesEncrypt(const Block *rk, Block *b)
+    {
+#pragma GCC unroll 13
+        for (int round = 0; round < 13; ++round)
+#pragma GCC unroll 8
+            for (int k = 0; k < N; ++k)
+                b[k] = vaesmcq_u8(vaeseq_u8(b[k], rk[round]));
+        for (int k = 0; k < N; ++k)
+            b[k] = veorq_u8(vaeseq_u8(b[k], rk[13]), rk[14]);
+    }
+
+    SWIFTSHARE_GCM_TARGET inline void gfMulAdd(Block a, Block b, Wide &acc)
+    {
+        poly64x2_t pa = vreinterpretq_p64_u8(a);
+        poly64x2_t pb = vreinterpretq_p64_u8(b);
+        poly64_t a0 = vgetq_lane_p64(pa, 0);
+        poly64_t a1 = vgetq_lane_p64(pa, 1);
+        poly64_t b0 = vgetq_lane_p64(pb, 0);
+        poly64_t b1 = vgetq_lane_p64(pb, 1);
+        acc.lo = veorq_u64(acc.lo, vreinterpretq_u64_p128(vmull_p64(a0, b0)));
+        acc.hi = veorq_u64(acc.hi, vreinterpretq_u64_p128(vmull_p64(a1, b1)));
+        acc.mid = veorq_u64(acc.mid, veorq_u64(vreinterpretq_u64_p128(vmull_p64(a0, b1)),
+                                               vreinterpretq_u64_p128(vmull_p64(a1, b0))));
+    }
+
+    // The x86 sequence in 64-bit lanes
+    SWIFTSHARE_GCM_TARGET inline Block gfReduce(const Wide &acc)
+    {
+        const uint64x2_t zero = vdupq_n_u64(0);
+        uint64x2_t lo = veorq_u64(acc.lo, vextq_u64(zero, acc.mid, 1));
+        uint64x2_t hi = veorq_u64(acc.hi, vextq_u64(acc.mid, zero, 1));
+
+        // Shift the 256-bit product left by one
+        uint64x2_t carryLo = vshrq_n_u64(lo, 63);
+        uint64x2_t carryHi = vshrq_n_u64(hi, 63);
+        lo = vorrq_u64(vshlq_n_u64(lo, 1), vextq_u64(zero, carryLo, 1));
+        hi = vorrq_u64(vorrq_u64(vshlq_n_u64(hi, 1), vextq_u64(zero, carryHi, 1)),
+                       vextq_u64(carryLo, zero, 1));
+
+        // Reduce modulo x^128 + x^7 + x^2 + x + 1
+        uint64x2_t a = veorq_u64(veorq_u64(vshlq_n_u64(lo, 63), vshlq_n_u64(lo, 62)), vshlq_n_u64(lo, 57));
+        lo = veorq_u64(lo, vextq_u64(zero, a, 1));
+        uint64x2_t b = veorq_u64(veorq_u64(vshlq_n_u64(lo, 63), vshlq_n_u64(lo, 62)), vshlq_n_u64(lo, 57));
+        uint64x2_t c = veorq_u64(veorq_u64(vshrq_n_u64(lo, 1), vshrq_n_u64(lo, 2)), vshrq_n_u64(lo, 7));
+        lo = veorq_u64(lo, veorq_u64(c, vextq_u64(b, zero, 1)));
+        return vreinterpretq_u8_u64(veorq_u64(hi, lo));
+    }
+
+    // SubWord() of the key schedule, all four columns alike so ShiftRows
+    // drops out
+    SWIFTSHARE_GCM_TARGET uint32_t subWord(uint32_t w)
+    {
+        uint8x16_t v = vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0));
+        return vgetq_lane_u32(vreinterpretq_u32_u8(v), 0);
+    }
+
+    bool gcmInstructions()
+    {
+        unsigned long hwcap = getauxval(AT_HWCAP);
+        return (hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL);
+    }
+#endif
+
+    // ===============================
+    // AES-256-GCM
+    // ===============================
+
+#if defined(SWIFTSHARE_GCM_TARGET)
+    constexpr size_t kGcmBatch = 8; // blocks per AES/GHASH pass
+
+    SWIFTSHARE_GCM_TARGET inline Block gfMul(Block a, Block b)
+    {
+        Wide acc{};
+        gfMulAdd(a, b, acc);
+        return gfReduce(acc);
+    }
+
+    // Round keys at schedule[0..14], then H^1..H^8 (byte-reversed)
+    SWIFTSHARE_GCM_TARGET void gcmExpand(const uint8_t key[kAeadKeySize], uint8_t *schedule)
+    {
+        static const uint8_t kRcon[7] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40};
+        uint32_t w[60];
+        for (int i = 0; i < 8; ++i)
+            w[i] = load32(key + 4 * i);
+        for (int i = 8; i < 60; ++i)
+        {
+            uint32_t t = w[i - 1];
+            if (i % 8 == 0)
+                t = subWord((t >> 8) | (t << 24)) ^ kRcon[i / 8 - 1];
+            else if (i % 8 == 4)
+                t = subWord(t);
+            w[i] = w[i - 8] ^ t;
+        }
+        for (int i = 0; i < 60; ++i)
+            store32(schedule + 4 * i, w[i]);
+        wipe(w, sizeof(w));
+
+        Block *rk = reinterpret_cast<Block *>(schedule);
+        Block h[1] = {zeroBlock()};
+        aesEncrypt<1>(rk, h);
+        Block *powers = rk + 15;
+        powers[0] = byteSwap(h[0]);
+        for (size_t i = 1; i < kGcmBatch; ++i)
+            powers[i] = gfMul(powers[i - 1], powers[0]);
+    }
+
+    // Y = (Y + block) * H for one block already byte-reversed
+    SWIFTSHARE_GCM_TARGET inline Block ghashBlock(Block y, Block reversed, Block h)
+    {
+        return gfMul(xorBlock(y, reversed), h);
+    }
+
+    SWIFTSHARE_GCM_TARGET Block ghashPadded(Block y, const uint8_t *data, size_t len, Block h)
+    {
+        for (; len >= 16; data += 16, len -= 16)
+            y = ghashBlock(y, byteSwap(loadBlock(data)), h);
+        if (len > 0)
+        {
+            uint8_t last[16] = {};
+            memcpy(last, data, len);
+            y = ghashBlock(y, byteSwap(loadBlock(last)), h);
+        }
+        return y;
+    }
+
+    // Seals (encrypt) or opens `data` in place with a 96-bit nonce; the
+    // tag always covers the ciphertext. Eight counter blocks go through
+    // the AES units together, and their GHASH is reduced once.
+    SWIFTSHARE_GCM_TARGET void gcmCrypt(const uint8_t *schedule, const uint8_t nonce[kAeadNonceSize],
+                                        const uint8_t *aad, size_t aadLen, uint8_t *data, size_t len,
+                                        uint8_t tag[kAeadTagSize], bool encrypt)
+    {
+        const Block *rk = reinterpret_cast<const Block *>(schedule);
+        const Block *powers = rk + 15;
+
+        uint8_t iv[16] = {};
+        memcpy(iv, nonce, kAeadNonceSize);
+        const Block base = loadBlock(iv);
+
+        Block y = ghashPadded(zeroBlock(), aad, aadLen, powers[0]);
+        size_t total = len;
+        uint32_t counter = 2;
+
+        for (; len >= kGcmBatch * 16; data += kGcmBatch * 16, len -= kGcmBatch * 16)
+        {
+            Block stream[kGcmBatch];
+            for (size_t k = 0; k < kGcmBatch; ++k)
+                stream[k] = counterBlock(base, counter + (uint32_t)k);
+            counter += kGcmBatch;
+            aesEncrypt<kGcmBatch>(rk, stream);
+
+            Block cipher[kGcmBatch];
+            for (size_t k = 0; k < kGcmBatch; ++k)
+            {
+                Block in = loadBlock(data + 16 * k);
+                Block out = xorBlock(in, stream[k]);
+                storeBlock(data + 16 * k, out);
+                cipher[k] = encrypt ? out : in;
+            }
+
+            Wide acc{};
+            gfMulAdd(xorBlock(y, byteSwap(cipher[0])), powers[kGcmBatch - 1], acc);
+            for (size_t k = 1; k < kGcmBatch; ++k)
+                gfMulAdd(byteSwap(cipher[k]), powers[kGcmBatch - 1 - k], acc);
+            y = gfReduce(acc);
+        }
+
+        for (; len > 0; data += 16, len -= len < 16 ? len : 16)
+        {
+            Block stream[1] = {counterBlock(base, counter++)};
+            aesEncrypt<1>(rk, stream);
+
+            size_t n = len < 16 ? len : 16;
+            uint8_t in[16] = {};
+            uint8_t out[16] = {};
+            memcpy(in, data, n);
+            storeBlock(out, xorBlock(loadBlock(in), stream[0]));
+            memset(out + n, 0, 16 - n);
+            memcpy(data, out, n);
+            y = ghashBlock(y, byteSwap(loadBlock(encrypt ? out : in)), powers[0]);
+        }
+
+        y = ghashBlock(y, lengthBlock((uint64_t)aadLen * 8, (uint64_t)total * 8), powers[0]);
+        Block mask[1] = {counterBlock(base, 1)};
+        aesEncrypt<1>(rk, mask);
+        storeBlock(tag, xorBlock(byteSwap(y), mask[0]));
+    }
+
+    // AES-256-GCM known answer: 200 bytes cover the batched, single-block
+    // and partial-block paths
+    bool gcmKnownAnswer()
+    {
+        static const uint8_t kTag[kAeadTagSize] = {0x54, 0xe1, 0xfa, 0x39, 0x89, 0xac, 0xa9, 0x89,
+                                                   0xe6, 0x0f, 0x70, 0x14, 0xfd, 0xe7, 0xb6, 0xd9};
+        alignas(16) uint8_t schedule[23 * 16];
+        uint8_t key[kAeadKeySize];
+        uint8_t nonce[kAeadNonceSize];
+        const uint8_t aad[4] = {0x10, 0x20, 0x30, 0x40};
+        uint8_t data[200];
+        for (size_t i = 0; i < sizeof(key); ++i)
+            key[i] = (uint8_t)i;
+        for (size_t i = 0; i < sizeof(nonce); ++i)
+            nonce[i] = (uint8_t)i;
+        for (size_t i = 0; i < sizeof(data); ++i)
+            data[i] = (uint8_t)(i * 7 + 3);
+
+        uint8_t tag[kAeadTagSize];
+        gcmExpand(key, schedule);
+        gcmCrypt(schedule, nonce, aad, sizeof(aad), data, sizeof(data), tag, true);
+        if (!tagsEqual(tag, kTag))
+            return false;
+        gcmCrypt(schedule, nonce, aad, sizeof(aad), data, sizeof(data), tag, false);
+        for (size_t i = 0; i < sizeof(data); ++i)
+            if (data[i] != (uint8_t)(i * 7 + 3))
+                return false;
+        return tagsEqual(tag, kTag);
+    }
+
+    bool pickGcm()
+    {
+        if (!gcmInstructions())
+            return false;
+        if (!gcmKnownAnswer())
+        {
+            LOGE("AES-GCM (%s) failed its known-answer test, using ChaCha20-Poly1305", SWIFTSHARE_GCM_NAME);
+            return false;
+        }
+        return true;
+    }
+#else
+    bool pickGcm()
+    {
+        return false;
+    }
+#endif
+}
+
+bool swiftshare::aesGcmAccelerated()
+{
+    static const bool accelerated = pickGcm();
+    return accelerated;
+}
+
+const char *swiftshare::aeadImplementation(AeadSuite suite)
+{
+    if (suite == AeadSuite::ChaCha20Poly1305)
+        return "ChaCha20-Poly1305";
+#if defined(SWIFTSHARE_GCM_TARGET)
+    return "AES-256-GCM (" SWIFTSHARE_GCM_NAME ")";
+#else
+    return "AES-256-GCM";
+#endif
+}
+
+Aead::Aead(AeadSuite suite, const uint8_t key[kAeadKeySize])
+    : suite_(suite)
+{
+    memset(schedule_, 0, sizeof(schedule_));
+#if defined(SWIFTSHARE_GCM_TARGET)
+    if (suite_ == AeadSuite::Aes256Gcm && aesGcmAccelerated())
+    {
+        gcmExpand(key, schedule_);
+        return;
+    }
+#endif
+    if (suite_ == AeadSuite::Aes256Gcm)
+        LOGE("AES-GCM key without AES instructions; every record will fail");
+    memcpy(schedule_, key, kAeadKeySize);
+}
+
+Aead::~Aead()
+{
+    wipe(schedule_, sizeof(schedule_));
+}
+
+void Aead::seal(const uint8_t nonce[kAeadNonceSize], const void *aad, size_t aadLen,
+                uint8_t *data, size_t len, uint8_t tag[kAeadTagSize]) const
+{
+    const uint8_t *extra = static_cast<const uint8_t *>(aad);
+    if (suite_ == AeadSuite::ChaCha20Poly1305)
+    {
+        chachaPoly(schedule_, nonce, extra, aadLen, data, len, tag, true);
+        return;
+    }
+#if defined(SWIFTSHARE_GCM_TARGET)
+    if (aesGcmAccelerated())
+    {
+        gcmCrypt(schedule_, nonce, extra, aadLen, data, len, tag, true);
+        return;
+    }
+#endif
+    memset(data, 0, len);
+    memset(tag, 0, kAeadTagSize);
+}
+
+bool Aead::open(const uint8_t nonce[kAeadNonceSize], const void *aad, size_t aadLen,
+                uint8_t *data, size_t len, const uint8_t tag[kAeadTagSize]) const
+{
+    const uint8_t *extra = static_cast<const uint8_t *>(aad);
+    uint8_t expected[kAeadTagSize];
+    bool opened = false;
+    if (suite_ == AeadSuite::ChaCha20Poly1305)
+    {
+        chachaPoly(schedule_, nonce, extra, aadLen, data, len, expected, false);
+        opened = tagsEqual(expected, tag);
+    }
+#if defined(SWIFTSHARE_GCM_TARGET)
+    else if (aesGcmAccelerated())
+    {
+        gcmCrypt(schedule_, nonce, extra, aadLen, data, len, expected, false);
+        opened = tagsEqual(expected, tag);
+    }
+#endif
+
+    // An empty record may come with a null `data`
+    if (!opened && len > 0)
+        memset(data, 0, len);
+    return opened;
+}
@@ -0,0 +1,209 @@
+#include "buffer_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+// ============================================================================
+// PooledBuffer
+// ============================================================================
+
+PooledBuffer::PooledBuffer(PooledBuffer &&other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      persistent_(other.persistent_) {}
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        pool_ = std::exchange(other.pool_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        persistent_ = other.persistent_;
+    }
+    return *this;
+}
+
+void PooledBuffer::release()
+{
+    if (data_)
+        pool_->give(data_, size_, persistent_);
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// ============================================================================
+// BufferPool
+// ============================================================================
+
+BufferPool::BufferPool(size_t budget)
+    : budget_(std::clamp(budget, kMinBudget, kMaxBudget)),
+      allocated_(0),
+      inUse_(0),
+      persistent_(0),
+      peakInUse_(0),
+      waits_(0),
+      rejected_(0) {}
+
+BufferPool::~BufferPool()
+{
+    trim();
+}
+
+void BufferPool::setBudget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = std::clamp(budget, kMinBudget, kMaxBudget);
+    while (allocated_ > budget_ && evictOther(kClasses))
+    {
+    }
+    // A larger budget may let a waiting reader in
+    released_.notify_all();
+}
+
+PooledBuffer BufferPool::acquire(size_t size, bool wait)
+{
+    return take(size, wait, false);
+}
+
+PooledBuffer BufferPool::reserve(size_t size)
+{
+    return take(size, false, true);
+}
+
+PooledBuffer BufferPool::take(size_t size, bool wait, bool persistent)
+{
+    size_t cls = 0;
+    while (cls < kClasses && classSize(cls) < size)
+        cls++;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t bytes = cls < kClasses ? classSize(cls) : 0;
+    if (cls == kClasses || bytes > budget_ / 2)
+    {
+        // A reserve() caller just does without
+        if (!persistent)
+        {
+            rejected_++;
+            LOGE("Buffer of %zu bytes exceeds the pool budget of %zu", size, budget_);
+        }
+        return {};
+    }
+
+    char *data = nullptr;
+    bool waited = false;
+    while (true)
+    {
+        if (persistent && persistent_ + bytes > budget_ / 2)
+            return {};
+
+        std::vector<char *> &cached = free_[cls];
+        if (!cached.empty())
+        {
+            data = cached.back();
+            cached.pop_back();
+            break;
+        }
+
+        while (allocated_ + bytes > budget_ && evictOther(cls))
+        {
+        }
+        if (allocated_ + bytes <= budget_)
+        {
+            if (posix_memalign((void **)&data, kPage, bytes) != 0)
+            {
+                LOGE("Failed to allocate a %zu byte buffer", bytes);
+                return {};
+            }
+            allocated_ += bytes;
+            break;
+        }
+
+        if (!wait)
+            return {};
+        if (!waited)
+        {
+            waits_++;
+            waited = true;
+        }
+        released_.wait(lock);
+    }
+
+    inUse_ += bytes;
+    if (persistent)
+        persistent_ += bytes;
+    peakInUse_ = std::max(peakInUse_, inUse_);
+    return PooledBuffer(this, data, bytes, persistent);
+}
+
+void BufferPool::give(char *data, size_t size, bool persistent)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inUse_ -= size;
+        if (persistent)
+            persistent_ -= size;
+
+        if (allocated_ > budget_)
+        {
+            // Over a budget lowered since this buffer was handed out
+            free(data);
+            allocated_ -= size;
+        }
+        else
+        {
+            size_t cls = 0;
+            while (classSize(cls) < size)
+                cls++;
+            free_[cls].push_back(data);
+        }
+    }
+    released_.notify_all();
+}
+
+// Frees one cached buffer outside class `keep`, largest first. Called
+// with the mutex held; false once nothing else is cached.
+bool BufferPool::evictOther(size_t keep)
+{
+    for (size_t cls = kClasses; cls-- > 0;)
+    {
+        if (cls == keep || free_[cls].empty())
+            continue;
+        free(free_[cls].back());
+        free_[cls].pop_back();
+        allocated_ -= classSize(cls);
+        return true;
+    }
+    return false;
+}
+
+size_t BufferPool::largest() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t cls = 0;
+    while (cls + 1 < kClasses && classSize(cls + 1) <= budget_ / 2)
+        cls++;
+    return kMinBuffer << cls;
+}
+
+void BufferPool::trim()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (evictOther(kClasses))
+    {
+    }
+}
+
+BufferPoolStats BufferPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {budget_, allocated_, inUse_, peakInUse_, waits_, rejected_};
+}
@@ -0,0 +1,559 @@
+#include "checksum.h"
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWIFTSHARE_XXH3_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SWIFTSHARE_XXH3_NEON 1
+#endif
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+    // Block size for hashing file ranges back from the page cache
+    constexpr size_t kReadBlock = 1024 * 1024;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const unsigned char *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t read32(const unsigned char *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * kPrime2;
+        acc = rotl(acc, 31);
+        return acc * kPrime1;
+    }
+
+    inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= round(0, val);
+        return acc * kPrime1 + kPrime4;
+    }
+}
+
+Xxh64::Xxh64(uint64_t seed)
+{
+    reset(seed);
+}
+
+void Xxh64::reset(uint64_t seed)
+{
+    seed_ = seed;
+    v_[0] = seed + kPrime1 + kPrime2;
+    v_[1] = seed + kPrime2;
+    v_[2] = seed;
+    v_[3] = seed - kPrime1;
+    totalLen_ = 0;
+    buffered_ = 0;
+}
+
+void Xxh64::update(const void *data, size_t len)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + len;
+    totalLen_ += len;
+
+    if (buffered_ + len < 32)
+    {
+        memcpy(buffer_ + buffered_, p, len);
+        buffered_ += len;
+        return;
+    }
+
+    if (buffered_ > 0)
+    {
+        size_t fill = 32 - buffered_;
+        memcpy(buffer_ + buffered_, p, fill);
+        for (int i = 0; i < 4; ++i)
+            v_[i] = round(v_[i], read64(buffer_ + i * 8));
+        p += fill;
+        buffered_ = 0;
+    }
+
+    // Four independent lanes keep the multipliers busy
+    uint64_t v0 = v_[0], v1 = v_[1], v2 = v_[2], v3 = v_[3];
+    while (p + 32 <= end)
+    {
+        v0 = round(v0, read64(p));
+        v1 = round(v1, read64(p + 8));
+        v2 = round(v2, read64(p + 16));
+        v3 = round(v3, read64(p + 24));
+        p += 32;
+    }
+    v_[0] = v0;
+    v_[1] = v1;
+    v_[2] = v2;
+    v_[3] = v3;
+
+    buffered_ = (size_t)(end - p);
+    memcpy(buffer_, p, buffered_);
+}
+
+uint64_t Xxh64::digest() const
+{
+    uint64_t h;
+    if (totalLen_ >= 32)
+    {
+        h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = mergeRound(h, v_[i]);
+    }
+    else
+    {
+        h = seed_ + kPrime5;
+    }
+    h += totalLen_;
+
+    const unsigned char *p = buffer_;
+    const unsigned char *end = buffer_ + buffered_;
+    while (p + 8 <= end)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)read32(p) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= (*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t swiftshare::xxh64(const void *data, size_t len, uint64_t seed)
+{
+    Xxh64 state(seed);
+    state.update(data, len);
+    return state.digest();
+}
+
+bool swiftshare::xxh64File(int fd, uint64_t offset, uint64_t length, uint64_t &digest)
+{
+    std::vector<unsigned char> block(length < kReadBlock ? (size_t)length : kReadBlock);
+    Xxh64 state;
+
+    while (length > 0)
+    {
+        size_t want = length < block.size() ? (size_t)length : block.size();
+        ssize_t n = pread(fd, block.data(), want, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        state.update(block.data(), (size_t)n);
+        offset += (uint64_t)n;
+        length -= (uint64_t)n;
+    }
+
+    digest = state.digest();
+    return true;
+}
+
+// ===============================
+// XXH3
+// ===============================
+
+namespace
+{
+    constexpr size_t kSecretSize = 192;
+    constexpr size_t kStripeLen = 64;
+    constexpr size_t kSecretConsumeRate = 8;
+    constexpr size_t kStripesPerBlock = (kSecretSize - kStripeLen) / kSecretConsumeRate;
+    constexpr size_t kBlockLen = kStripeLen * kStripesPerBlock;
+    constexpr size_t kMidSizeMax = 240;
+
+    constexpr uint64_t kPrime32_1 = 0x9E3779B1U;
+    constexpr uint64_t kPrime32_2 = 0x85EBCA77U;
+    constexpr uint64_t kPrime32_3 = 0xC2B2AE3DU;
+    constexpr uint64_t kPrimeMx1 = 0x165667919E3779F9ULL;
+    constexpr uint64_t kPrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+    alignas(64) constexpr unsigned char kSecret[kSecretSize] = {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+    };
+
+    inline uint64_t mul128Fold64(uint64_t a, uint64_t b)
+    {
+#if defined(__SIZEOF_INT128__)
+        __uint128_t product = (__uint128_t)a * b;
+        return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+        // 32-bit ABIs have no 128-bit type
+        uint64_t loLo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+        uint64_t hiLo = (a >> 32) * (b & 0xFFFFFFFF);
+        uint64_t loHi = (a & 0xFFFFFFFF) * (b >> 32);
+        uint64_t hiHi = (a >> 32) * (b >> 32);
+        uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + loHi;
+        uint64_t upper = (hiLo >> 32) + (cross >> 32) + hiHi;
+        uint64_t lower = (cross << 32) | (loLo & 0xFFFFFFFF);
+        return lower ^ upper;
+#endif
+    }
+
+    inline uint64_t xxh64Avalanche(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    inline uint64_t xxh3Avalanche(uint64_t h)
+    {
+        h ^= h >> 37;
+        h *= kPrimeMx1;
+        h ^= h >> 32;
+        return h;
+    }
+
+    inline uint64_t rrmxmx(uint64_t h, uint64_t len)
+    {
+        h ^= rotl(h, 49) ^ rotl(h, 24);
+        h *= kPrimeMx2;
+        h ^= (h >> 35) + len;
+        h *= kPrimeMx2;
+        return h ^ (h >> 28);
+    }
+
+    inline uint64_t mix16B(const unsigned char *input, const unsigned char *secret, uint64_t seed)
+    {
+        return mul128Fold64(read64(input) ^ (read64(secret) + seed),
+                            read64(input + 8) ^ (read64(secret + 8) - seed));
+    }
+
+    uint64_t hashShort(const unsigned char *input, size_t len, uint64_t seed)
+    {
+        const unsigned char *secret = kSecret;
+        if (len > 8)
+        {
+            uint64_t bitflip1 = (read64(secret + 24) ^ read64(secret + 32)) + seed;
+            uint64_t bitflip2 = (read64(secret + 40) ^ read64(secret + 48)) - seed;
+            uint64_t lo = read64(input) ^ bitflip1;
+            uint64_t hi = read64(input + len - 8) ^ bitflip2;
+            uint64_t acc = len + __builtin_bswap64(lo) + hi + mul128Fold64(lo, hi);
+            return xxh3Avalanche(acc);
+        }
+        if (len >= 4)
+        {
+            seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+            uint64_t bitflip = (read64(secret + 8) ^ read64(secret + 16)) - seed;
+            uint64_t combined = read32(input + len - 4) + ((uint64_t)read32(input) << 32);
+            return rrmxmx(combined ^ bitflip, len);
+        }
+        if (len > 0)
+        {
+            uint32_t combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) |
+                                (uint32_t)input[len - 1] | ((uint32_t)len << 8);
+            uint64_t bitflip = (read32(secret) ^ read32(secret + 4)) + seed;
+            return xxh64Avalanche((uint64_t)combined ^ bitflip);
+        }
+        return xxh64Avalanche(seed ^ (read64(secret + 56) ^ read64(secret + 64)));
+    }
+
+    uint64_t hashMedium(const unsigned char *input, size_t len, uint64_t seed)
+    {
+        const unsigned char *secret = kSecret;
+        uint64_t acc = len * kPrime1;
+
+        if (len <= 128)
+        {
+            if (len > 32)
+            {
+                if (len > 64)
+                {
+                    if (len > 96)
+                    {
+                        acc += mix16B(input + 48, secret + 96, seed);
+                        acc += mix16B(input + len - 64, secret + 112, seed);
+                    }
+                    acc += mix16B(input + 32, secret + 64, seed);
+                    acc += mix16B(input + len - 48, secret + 80, seed);
+                }
+                acc += mix16B(input + 16, secret + 32, seed);
+                acc += mix16B(input + len - 32, secret + 48, seed);
+            }
+            acc += mix16B(input, secret, seed);
+            acc += mix16B(input + len - 16, secret + 16, seed);
+            return xxh3Avalanche(acc);
+        }
+
+        // 129..240 bytes
+        size_t rounds = len / 16;
+        for (size_t i = 0; i < 8; ++i)
+            acc += mix16B(input + 16 * i, secret + 16 * i, seed);
+        uint64_t accEnd = mix16B(input + len - 16, secret + 136 - 17, seed);
+        acc = xxh3Avalanche(acc);
+        for (size_t i = 8; i < rounds; ++i)
+            accEnd += mix16B(input + 16 * i, secret + 16 * (i - 8) + 3, seed);
+        return xxh3Avalanche(acc + accEnd);
+    }
+
+    // Long-input kernels: accumulate `stripes` 64-byte stripes, consuming
+    // the secret 8 bytes per stripe, and scramble the accumulators
+    using AccumulateFn = void (*)(uint64_t *acc, const unsigned char *input,
+                                  const unsigned char *secret, size_t stripes);
+    using ScrambleFn = void (*)(uint64_t *acc, const unsigned char *secret);
+
+    [[maybe_unused]] void accumulateScalar(uint64_t *acc, const unsigned char *input,
+                                           const unsigned char *secret, size_t stripes)
+    {
+        for (size_t n = 0; n < stripes; ++n)
+        {
+            const unsigned char *in = input + n * kStripeLen;
+            const unsigned char *key = secret + n * kSecretConsumeRate;
+            for (size_t i = 0; i < 8; ++i)
+            {
+                uint64_t data = read64(in + 8 * i);
+                uint64_t dataKey = data ^ read64(key + 8 * i);
+                acc[i ^ 1] += data;
+                acc[i] += (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+            }
+        }
+    }
+
+    [[maybe_unused]] void scrambleScalar(uint64_t *acc, const unsigned char *secret)
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= read64(secret + 8 * i);
+            acc[i] = a * kPrime32_1;
+        }
+    }
+
+#if defined(SWIFTSHARE_XXH3_X86)
+    void accumulateSse2(uint64_t *acc, const unsigned char *input,
+                        const unsigned char *secret, size_t stripes)
+    {
+        __m128i *xacc = reinterpret_cast<__m128i *>(acc);
+        for (size_t n = 0; n < stripes; ++n)
+        {
+            const unsigned char *in = input + n * kStripeLen;
+            const unsigned char *key = secret + n * kSecretConsumeRate;
+            for (size_t i = 0; i < 4; ++i)
+            {
+                __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in) + i);
+                __m128i dataKey = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key) + i));
+                __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i product = _mm_mul_epu32(dataKey, dataKeyHi);
+                __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                xacc[i] = _mm_add_epi64(product, _mm_add_epi64(xacc[i], swapped));
+            }
+        }
+    }
+
+    void scrambleSse2(uint64_t *acc, const unsigned char *secret)
+    {
+        __m128i *xacc = reinterpret_cast<__m128i *>(acc);
+        const __m128i prime = _mm_set1_epi32((int)kPrime32_1);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            __m128i a = _mm_xor_si128(xacc[i], _mm_srli_epi64(xacc[i], 47));
+            __m128i dataKey = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret) + i));
+            __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i productLo = _mm_mul_epu32(dataKey, prime);
+            __m128i productHi = _mm_mul_epu32(dataKeyHi, prime);
+            xacc[i] = _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32));
+        }
+    }
+
+    __attribute__((target("avx2"))) void accumulateAvx2(uint64_t *acc, const unsigned char *input,
+                                                        const unsigned char *secret, size_t stripes)
+    {
+        __m256i *xacc = reinterpret_cast<__m256i *>(acc);
+        for (size_t n = 0; n < stripes; ++n)
+        {
+            const unsigned char *in = input + n * kStripeLen;
+            const unsigned char *key = secret + n * kSecretConsumeRate;
+            for (size_t i = 0; i < 2; ++i)
+            {
+                __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in) + i);
+                __m256i dataKey = _mm256_xor_si256(data, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key) + i));
+                __m256i dataKeyHi = _mm256_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+                __m256i product = _mm256_mul_epu32(dataKey, dataKeyHi);
+                __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                xacc[i] = _mm256_add_epi64(product, _mm256_add_epi64(xacc[i], swapped));
+            }
+        }
+    }
+
+    __attribute__((target("avx2"))) void scrambleAvx2(uint64_t *acc, const unsigned char *secret)
+    {
+        __m256i *xacc = reinterpret_cast<__m256i *>(acc);
+        const __m256i prime = _mm256_set1_epi32((int)kPrime32_1);
+        for (size_t i = 0; i < 2; ++i)
+        {
+            __m256i a = _mm256_xor_si256(xacc[i], _mm256_srli_epi64(xacc[i], 47));
+            __m256i dataKey = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret) + i));
+            __m256i dataKeyHi = _mm256_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+            __m256i productLo = _mm256_mul_epu32(dataKey, prime);
+            __m256i productHi = _mm256_mul_epu32(dataKeyHi, prime);
+            xacc[i] = _mm256_add_epi64(productLo, _mm256_slli_epi64(productHi, 32));
+        }
+    }
+#elif defined(SWIFTSHARE_XXH3_NEON)
+    void accumulateNeon(uint64_t *acc, const unsigned char *input,
+                        const unsigned char *secret, size_t stripes)
+    {
+        for (size_t n = 0; n < stripes; ++n)
+        {
+            const unsigned char *in = input + n * kStripeLen;
+            const unsigned char *key = secret + n * kSecretConsumeRate;
+            for (size_t i = 0; i < 4; ++i)
+            {
+                uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(in + 16 * i));
+                uint64x2_t dataKey = veorq_u64(data, vreinterpretq_u64_u8(vld1q_u8(key + 16 * i)));
+                uint64x2_t swapped = vextq_u64(data, data, 1);
+                uint64x2_t sum = vaddq_u64(vld1q_u64(acc + 2 * i), swapped);
+                sum = vmlal_u32(sum, vmovn_u64(dataKey), vshrn_n_u64(dataKey, 32));
+                vst1q_u64(acc + 2 * i, sum);
+            }
+        }
+    }
+
+    void scrambleNeon(uint64_t *acc, const unsigned char *secret)
+    {
+        const uint32x2_t prime = vdup_n_u32((uint32_t)kPrime32_1);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            uint64x2_t a = vld1q_u64(acc + 2 * i);
+            a = veorq_u64(a, vshrq_n_u64(a, 47));
+            uint64x2_t dataKey = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+            uint64x2_t productHi = vshlq_n_u64(vmull_u32(vshrn_n_u64(dataKey, 32), prime), 32);
+            vst1q_u64(acc + 2 * i, vmlal_u32(productHi, vmovn_u64(dataKey), prime));
+        }
+    }
+#endif
+
+    struct Xxh3Kernel
+    {
+        AccumulateFn accumulate;
+        ScrambleFn scramble;
+        const char *name;
+    };
+
+    Xxh3Kernel pickKernel()
+    {
+#if defined(SWIFTSHARE_XXH3_X86)
+        if (__builtin_cpu_supports("avx2"))
+            return {accumulateAvx2, scrambleAvx2, "avx2"};
+        return {accumulateSse2, scrambleSse2, "sse2"};
+#elif defined(SWIFTSHARE_XXH3_NEON)
+        return {accumulateNeon, scrambleNeon, "neon"};
+#else
+        return {accumulateScalar, scrambleScalar, "scalar"};
+#endif
+    }
+
+    const Xxh3Kernel &kernel()
+    {
+        static const Xxh3Kernel picked = pickKernel();
+        return picked;
+    }
+
+    uint64_t hashLong(const unsigned char *input, size_t len, const unsigned char *secret)
+    {
+        const Xxh3Kernel &k = kernel();
+        alignas(64) uint64_t acc[8] = {kPrime32_3, kPrime1, kPrime2, kPrime3,
+                                       kPrime4, kPrime32_2, kPrime5, kPrime32_1};
+
+        size_t blocks = (len - 1) / kBlockLen;
+        for (size_t n = 0; n < blocks; ++n)
+        {
+            k.accumulate(acc, input + n * kBlockLen, secret, kStripesPerBlock);
+            k.scramble(acc, secret + kSecretSize - kStripeLen);
+        }
+
+        // Partial last block, then the final stripe ending at `len`
+        size_t stripes = ((len - 1) - kBlockLen * blocks) / kStripeLen;
+        k.accumulate(acc, input + blocks * kBlockLen, secret, stripes);
+        k.accumulate(acc, input + len - kStripeLen, secret + kSecretSize - kStripeLen - 7, 1);
+
+        uint64_t result = len * kPrime1;
+        for (size_t i = 0; i < 4; ++i)
+            result += mul128Fold64(acc[2 * i] ^ read64(secret + 11 + 16 * i),
+                                   acc[2 * i + 1] ^ read64(secret + 11 + 16 * i + 8));
+        return xxh3Avalanche(result);
+    }
+}
+
+uint64_t swiftshare::xxh3_64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *input = static_cast<const unsigned char *>(data);
+    if (len <= 16)
+        return hashShort(input, len, seed);
+    if (len <= kMidSizeMax)
+        return hashMedium(input, len, seed);
+    if (seed == 0)
+        return hashLong(input, len, kSecret);
+
+    // Seeded long inputs hash with a secret derived from the seed
+    alignas(64) unsigned char secret[kSecretSize];
+    for (size_t i = 0; i < kSecretSize / 16; ++i)
+    {
+        uint64_t lo = read64(kSecret + 16 * i) + seed;
+        uint64_t hi = read64(kSecret + 16 * i + 8) - seed;
+        memcpy(secret + 16 * i, &lo, sizeof(lo));
+        memcpy(secret + 16 * i + 8, &hi, sizeof(hi));
+    }
+    return hashLong(input, len, secret);
+}
+
+const char *swiftshare::xxh3Implementation()
+{
+    return kernel().name;
+}
@@ -0,0 +1,166 @@
+#include "chunk_hasher.h"
+#include "zero_copy.h"
+#include <unistd.h>
+#include <errno.h>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+ChunkHasher::ChunkHasher(IoCounters &counters)
+    : counters_(counters),
+      requested_(0),
+      busy_(false),
+      stop_(false),
+      fd_(-1),
+      failed_(false),
+      verifiedEnd_(0),
+      worker_(&ChunkHasher::workerLoop, this) {}
+
+ChunkHasher::~ChunkHasher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    workReady_.notify_one();
+    worker_.join();
+}
+
+void ChunkHasher::waitIdle(std::unique_lock<std::mutex> &lock)
+{
+    progress_.wait(lock, [this]
+                   { return jobs_.empty() && !busy_; });
+}
+
+void ChunkHasher::reset(int fd, uint64_t offset)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.clear();
+    waitIdle(lock);
+    results_.clear();
+    requested_ = 0;
+    fd_ = fd;
+    failed_ = false;
+    verifiedEnd_ = offset;
+    fileDigest_.reset();
+}
+
+void ChunkHasher::request(uint64_t offset, uint32_t length)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back({offset, length, 0, false});
+        requested_++;
+    }
+    workReady_.notify_one();
+}
+
+bool ChunkHasher::next(uint64_t &digest)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (requested_ == 0)
+        return false;
+    progress_.wait(lock, [this]
+                   { return !results_.empty(); });
+
+    Result result = results_.front();
+    results_.pop_front();
+    requested_--;
+    digest = result.digest;
+    return result.ok;
+}
+
+size_t ChunkHasher::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requested_;
+}
+
+void ChunkHasher::verify(uint64_t offset, uint32_t length, uint64_t expected)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Bound how far verification may trail the data
+        progress_.wait(lock, [this]
+                       { return jobs_.size() < kMaxQueued; });
+        jobs_.push_back({offset, length, expected, true});
+    }
+    workReady_.notify_one();
+}
+
+bool ChunkHasher::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    waitIdle(lock);
+    return !failed_;
+}
+
+uint64_t ChunkHasher::fileDigest() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fileDigest_.value;
+}
+
+void ChunkHasher::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        workReady_.wait(lock, [this]
+                        { return stop_ || !jobs_.empty(); });
+        if (stop_)
+            return;
+
+        Job job = jobs_.front();
+        jobs_.pop_front();
+        busy_ = true;
+        int fd = fd_;
+        lock.unlock();
+        progress_.notify_all(); // a queue slot opened up
+
+        // The pages were just written or are about to be sent, so this
+        // read is served from the page cache
+        PooledBuffer buffer = counters_.buffers.acquire(job.length);
+        uint32_t got = 0;
+        while (buffer && got < job.length)
+        {
+            uint64_t t0 = counters_.telemetry.start();
+            ssize_t n = pread(fd, buffer.data() + got, job.length - got, (off_t)(job.offset + got));
+            counters_.telemetry.record(Probe::Read, t0, n > 0 ? (uint64_t)n : 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            got += (uint32_t)n;
+        }
+        bool ok = got == job.length;
+        uint64_t digest = ok ? xxh3_64(buffer.data(), job.length) : 0;
+        counters_.hashedBytes += got;
+        buffer.release();
+
+        lock.lock();
+        busy_ = false;
+        if (!job.check)
+        {
+            results_.push_back({ok, digest});
+        }
+        else if (!failed_)
+        {
+            if (ok && digest == job.expected)
+            {
+                fileDigest_.add(job.offset, digest);
+                verifiedEnd_ = job.offset + job.length;
+            }
+            else
+            {
+                LOGE("Chunk digest mismatch at offset %llu (%u bytes)",
+                     (unsigned long long)job.offset, job.length);
+                counters_.digestFailures++;
+                failed_ = true;
+            }
+        }
+        progress_.notify_all();
+    }
+}
@@ -0,0 +1,267 @@
+#include "compression.h"
+#include <cmath>
+#include <cstring>
+
+using namespace swiftshare;
+
+namespace
+{
+    // LZ4 block format constants
+    constexpr size_t kMinMatch = 4;
+    constexpr size_t kLastLiterals = 5; // a block always ends in literals
+    constexpr size_t kMatchStartLimit = 12; // no match starts this close to the end
+    constexpr size_t kMaxOffset = 65535;
+    constexpr int kHashLog = 12;
+
+    // Compression is skipped above this many bits per byte. Text and
+    // binaries sample at 4-6.5, already-compressed data at 7.9 or more.
+    constexpr double kMaxEntropy = 7.5;
+    constexpr size_t kSampleWindows = 16;
+    constexpr size_t kSampleWindow = 256;
+
+    inline uint32_t read32(const unsigned char *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t read64(const unsigned char *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t hash4(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - kHashLog);
+    }
+
+    // Length continuation bytes after a 15 in the token nibble
+    inline unsigned char *putLength(unsigned char *op, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+            *op++ = 255;
+        *op++ = (unsigned char)length;
+        return op;
+    }
+
+    inline bool getLength(const unsigned char *&ip, const unsigned char *end, size_t &length)
+    {
+        unsigned char b;
+        do
+        {
+            if (ip >= end)
+                return false;
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    }
+}
+
+size_t swiftshare::lz4Compress(const void *src, size_t length, void *dst, size_t capacity)
+{
+    const unsigned char *in = static_cast<const unsigned char *>(src);
+    unsigned char *op = static_cast<unsigned char *>(dst);
+    unsigned char *const opEnd = op + capacity;
+
+    size_t anchor = 0;
+    if (length > kMatchStartLimit)
+    {
+        uint32_t table[1 << kHashLog] = {};
+        const size_t matchStartEnd = length - kMatchStartLimit;
+        const size_t matchEnd = length - kLastLiterals;
+        size_t ip = 1;
+
+        while (ip < matchStartEnd)
+        {
+            uint32_t sequence = read32(in + ip);
+            uint32_t &slot = table[hash4(sequence)];
+            size_t ref = slot;
+            slot = (uint32_t)ip;
+
+            if (ip - ref > kMaxOffset || ref >= ip || read32(in + ref) != sequence)
+            {
+                // Step further the longer nothing has matched
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1])
+            {
+                ip--;
+                ref--;
+            }
+            // Eight bytes per compare; the first differing byte of a
+            // little-endian word is its lowest set bit
+            size_t matchLength = kMinMatch;
+            while (ip + matchLength + 8 <= matchEnd)
+            {
+                uint64_t diff = read64(in + ip + matchLength) ^ read64(in + ref + matchLength);
+                if (diff != 0)
+                {
+                    matchLength += __builtin_ctzll(diff) >> 3;
+                    break;
+                }
+                matchLength += 8;
+            }
+            if (ip + matchLength + 8 > matchEnd)
+            {
+                while (ip + matchLength < matchEnd && in[ip + matchLength] == in[ref + matchLength])
+                    matchLength++;
+            }
+
+            size_t literals = ip - anchor;
+            size_t extra = matchLength - kMinMatch;
+            size_t worstCase = 1 + literals / 255 + 1 + literals + 2 + extra / 255 + 1;
+            if (worstCase > (size_t)(opEnd - op))
+                return 0;
+
+            unsigned char *token = op++;
+            *token = (unsigned char)((literals < 15 ? literals : 15) << 4);
+            if (literals >= 15)
+                op = putLength(op, literals - 15);
+            memcpy(op, in + anchor, literals);
+            op += literals;
+
+            size_t offset = ip - ref;
+            *op++ = (unsigned char)offset;
+            *op++ = (unsigned char)(offset >> 8);
+            *token |= (unsigned char)(extra < 15 ? extra : 15);
+            if (extra >= 15)
+                op = putLength(op, extra - 15);
+
+            ip += matchLength;
+            anchor = ip;
+            // Keep the table warm for the next match
+            if (ip - 2 < matchStartEnd)
+                table[hash4(read32(in + ip - 2))] = (uint32_t)(ip - 2);
+        }
+    }
+
+    size_t literals = length - anchor;
+    if (1 + literals / 255 + 1 + literals > (size_t)(opEnd - op))
+        return 0;
+    unsigned char *token = op++;
+    *token = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+        op = putLength(op, literals - 15);
+    memcpy(op, in + anchor, literals);
+    op += literals;
+
+    return (size_t)(op - static_cast<unsigned char *>(dst));
+}
+
+bool swiftshare::lz4Decompress(const void *src, size_t length, void *dst, size_t rawLength)
+{
+    const unsigned char *ip = static_cast<const unsigned char *>(src);
+    const unsigned char *const ipEnd = ip + length;
+    unsigned char *const out = static_cast<unsigned char *>(dst);
+    size_t op = 0;
+
+    while (ip < ipEnd)
+    {
+        unsigned char token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !getLength(ip, ipEnd, literals))
+            return false;
+        if (literals > (size_t)(ipEnd - ip) || literals > rawLength - op)
+            return false;
+        // Short runs, the common case, copy a fixed 16 bytes when both
+        // buffers have the room
+        if (literals <= 16 && ipEnd - ip >= 16 && rawLength - op >= 16)
+            memcpy(out + op, ip, 16);
+        else
+            memcpy(out + op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == ipEnd)
+            break; // the last sequence has no match
+
+        if (ipEnd - ip < 2)
+            return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(ip, ipEnd, matchLength))
+            return false;
+        matchLength += kMinMatch;
+        if (matchLength > rawLength - op)
+            return false;
+
+        unsigned char *target = out + op;
+        const unsigned char *from = target - offset;
+        if (offset >= 8 && matchLength + 8 <= rawLength - op)
+        {
+            // Whole words, overshooting by up to 7 bytes the next
+            // sequence overwrites anyway
+            for (size_t i = 0; i < matchLength; i += 8)
+                memcpy(target + i, from + i, 8);
+        }
+        else
+        {
+            // An overlapping match repeats the last `offset` bytes; copying
+            // whole periods from the pattern start doubles the run each step
+            size_t copied = 0;
+            while (copied < matchLength)
+            {
+                size_t step = matchLength - copied;
+                if (step > offset + copied)
+                    step = offset + copied;
+                memcpy(target + copied, from, step);
+                copied += step;
+            }
+        }
+        op += matchLength;
+    }
+    return op == rawLength;
+}
+
+double swiftshare::sampleEntropy(const void *data, size_t length)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    uint32_t counts[256] = {};
+    size_t sampled = 0;
+
+    if (length <= kSampleWindows * kSampleWindow)
+    {
+        for (size_t i = 0; i < length; ++i)
+            counts[p[i]]++;
+        sampled = length;
+    }
+    else
+    {
+        size_t stride = (length - kSampleWindow) / (kSampleWindows - 1);
+        for (size_t w = 0; w < kSampleWindows; ++w)
+        {
+            const unsigned char *window = p + w * stride;
+            for (size_t i = 0; i < kSampleWindow; ++i)
+                counts[window[i]]++;
+        }
+        sampled = kSampleWindows * kSampleWindow;
+    }
+
+    if (sampled == 0)
+        return 0.0;
+    double entropy = 0.0;
+    for (uint32_t count : counts)
+    {
+        if (count == 0)
+            continue;
+        double share = (double)count / sampled;
+        entropy -= share * std::log2(share);
+    }
+    return entropy;
+}
+
+bool swiftshare::worthCompressing(const void *data, size_t length)
+{
+    return length >= 1024 && sampleEntropy(data, length) < kMaxEntropy;
+}
@@ -0,0 +1,123 @@
+#include "delta_sync.h"
+#include "checksum.h"
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <vector>
+
+using namespace swiftshare;
+
+namespace
+{
+    // Normalized chunking: a stricter mask before the average size and a
+    // looser one after it pull block sizes towards the average. Both test
+    // high bits, which depend on all of the last 64 bytes.
+    constexpr uint64_t kMaskSmall = 0xFFFFC00000000000ULL; // 18 bits
+    constexpr uint64_t kMaskLarge = 0xFFFC000000000000ULL; // 14 bits
+
+    // Bytes read per pass; always holds at least one maximum block
+    constexpr size_t kScanBuffer = 8 * 1024 * 1024;
+
+    struct GearTable
+    {
+        uint64_t values[256];
+
+        GearTable()
+        {
+            // splitmix64 from a fixed seed: the same table on every device
+            uint64_t state = 0x5357465444454C54ULL;
+            for (uint64_t &value : values)
+            {
+                uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                value = z ^ (z >> 31);
+            }
+        }
+    };
+
+    const GearTable kGear;
+
+    // Length of the block starting at `data`, at most `length`
+    size_t cutPoint(const unsigned char *data, size_t length)
+    {
+        if (length <= kDeltaMinBlock)
+            return length;
+
+        size_t normal = length < kDeltaAvgBlock ? length : kDeltaAvgBlock;
+        size_t limit = length < kDeltaMaxBlock ? length : kDeltaMaxBlock;
+        uint64_t fingerprint = 0;
+        size_t i = kDeltaMinBlock;
+
+        for (; i < normal; ++i)
+        {
+            fingerprint = (fingerprint << 1) + kGear.values[data[i]];
+            if ((fingerprint & kMaskSmall) == 0)
+                return i;
+        }
+        for (; i < limit; ++i)
+        {
+            fingerprint = (fingerprint << 1) + kGear.values[data[i]];
+            if ((fingerprint & kMaskLarge) == 0)
+                return i;
+        }
+        return limit;
+    }
+}
+
+bool swiftshare::scanBlocks(int fd, uint64_t size,
+                           const std::function<bool(const DeltaBlock &)> &onBlock)
+{
+    std::vector<unsigned char> buffer(kScanBuffer);
+    uint64_t bufferOffset = 0; // file offset of buffer[0]
+    size_t filled = 0;
+
+    while (bufferOffset + filled < size || filled > 0)
+    {
+        // Top the buffer up; the tail of the file may take several reads
+        while (filled < buffer.size() && bufferOffset + filled < size)
+        {
+            uint64_t left = size - (bufferOffset + filled);
+            size_t want = buffer.size() - filled;
+            if (want > left)
+                want = (size_t)left;
+            ssize_t n = pread(fd, buffer.data() + filled, want, (off_t)(bufferOffset + filled));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            filled += (size_t)n;
+        }
+
+        // Only cut where a whole maximum block is visible, or at the end
+        bool atEnd = bufferOffset + filled == size;
+        size_t pos = 0;
+        while (pos < filled && (atEnd || filled - pos >= kDeltaMaxBlock))
+        {
+            size_t length = cutPoint(buffer.data() + pos, filled - pos);
+            if (!onBlock({bufferOffset + pos, (uint32_t)length, xxh3_64(buffer.data() + pos, length)}))
+                return false;
+            pos += length;
+        }
+
+        memmove(buffer.data(), buffer.data() + pos, filled - pos);
+        bufferOffset += pos;
+        filled -= pos;
+    }
+    return true;
+}
+
+void DeltaIndex::add(uint64_t hash, uint32_t length, uint64_t offset)
+{
+    // The first copy of a repeated block is as good as any other
+    blocks_.emplace(hash, Entry{offset, length});
+}
+
+bool DeltaIndex::find(uint64_t hash, uint32_t length, uint64_t &offset) const
+{
+    auto it = blocks_.find(hash);
+    if (it == blocks_.end() || it->second.length != length)
+        return false;
+    offset = it->second.offset;
+    return true;
+}
@@ -0,0 +1,248 @@
+#include "transfer_engine.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "protocol.h"
+#include "net_utils.h"
+#include "delta_sync.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Copy frames are queued and sent together up to this many bytes
+    constexpr size_t kCopyFrameBatch = 64 * 1024;
+
+    // Reads signature batches up to the empty one into `index`. Each
+    // block starts where the previous one ended in the basis.
+    bool receiveSignatures(int sock, uint64_t basisSize, DeltaIndex &index)
+    {
+        std::vector<BlockSignature> batch;
+        uint64_t basisOffset = 0;
+        while (true)
+        {
+            DeltaSignatures header{};
+            if (!recvAll(sock, &header, sizeof(header)))
+                return false;
+            if (header.count == 0)
+                return true;
+            if (header.count > MAX_SIGNATURE_BATCH)
+            {
+                LOGE("Signature batch of %u entries is too large", header.count);
+                return false;
+            }
+
+            batch.resize(header.count);
+            if (!recvAll(sock, batch.data(), batch.size() * sizeof(BlockSignature)))
+                return false;
+            for (const BlockSignature &signature : batch)
+            {
+                if (signature.length == 0 || signature.length > kDeltaMaxBlock ||
+                    signature.length > basisSize - basisOffset)
+                {
+                    LOGE("Block signature overruns the basis at offset %llu",
+                         (unsigned long long)basisOffset);
+                    return false;
+                }
+                index.add(signature.xxh3, signature.length, basisOffset);
+                basisOffset += signature.length;
+            }
+        }
+    }
+}
+
+// ===============================
+// Receiver
+// ===============================
+
+bool TransferEngine::offerDeltaBasis(TransferSession &session, int client,
+                                     const std::string &outPath, const std::string &filename,
+                                     int &basisFd)
+{
+    basisFd = -1;
+
+    // The path resolver never reuses a name, so an older copy of the file
+    // sits next to the new output under the name the sender gave
+    std::string basisPath = outPath.substr(0, outPath.find_last_of('/') + 1) +
+                            PathResolver::sanitize(filename.substr(filename.find_last_of('/') + 1));
+    DeltaBasis basis{};
+    if (basisPath != outPath)
+    {
+        int fd = open(basisPath.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st{};
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            (uint64_t)st.st_size >= kDeltaMinFileSize)
+        {
+            basisFd = fd;
+            basis.size = (uint64_t)st.st_size;
+        }
+        else if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    if (!sendAll(client, &basis, sizeof(basis)))
+    {
+        LOGE("Failed to send delta basis");
+        if (basisFd >= 0)
+            close(basisFd);
+        basisFd = -1;
+        return false;
+    }
+    if (basis.size == 0)
+        return true;
+
+    LOGI("Offering %s (%.1f MB) as delta basis", basisPath.c_str(),
+         basis.size / (1024.0 * 1024.0));
+
+    // Signatures leave in batches while the rest of the basis is still
+    // being read, so the sender can index them as they come
+    std::vector<BlockSignature> batch;
+    batch.reserve(MAX_SIGNATURE_BATCH);
+    bool sent = true;
+    auto flush = [&]()
+    {
+        DeltaSignatures header{(uint32_t)batch.size()};
+        sent = sendAll(client, &header, sizeof(header)) &&
+               (batch.empty() || sendAll(client, batch.data(), batch.size() * sizeof(BlockSignature)));
+        batch.clear();
+        return sent;
+    };
+
+    uint64_t blocks = 0;
+    bool scanned = scanBlocks(basisFd, basis.size, [&](const DeltaBlock &block)
+                              {
+                                  batch.push_back(BlockSignature{block.hash, block.length, 0});
+                                  blocks++;
+                                  if (batch.size() == MAX_SIGNATURE_BATCH && !flush())
+                                      return false;
+                                  return !session.cancelled(); });
+    if (!scanned && sent)
+        LOGE("Basis scan stopped after %llu blocks", (unsigned long long)blocks);
+
+    // A partial list still ends normally; the sender only copies blocks it got
+    if (sent && !batch.empty())
+        flush();
+    if (!sent || !flush())
+    {
+        LOGE("Failed to send block signatures");
+        close(basisFd);
+        basisFd = -1;
+        return false;
+    }
+    return true;
+}
+
+// ===============================
+// Sender
+// ===============================
+
+// Sends [0, fileSize) of `fd` against the receiver's basis: blocks it
+// already holds as copy frames, the gaps between them through
+// sendChunks(). Without a basis the whole file goes through sendChunks().
+bool TransferEngine::sendDelta(TransferSession &session, int sock, int fd,
+                               uint64_t &offset, uint64_t fileSize,
+                               uint32_t chunkSize, SendContext &sendContext)
+{
+    DeltaBasis basis{};
+    if (!recvAll(sock, &basis, sizeof(basis)))
+    {
+        LOGE("Failed to receive delta basis");
+        return false;
+    }
+    if (basis.size == 0)
+        return sendChunks(session, sock, fd, offset, fileSize, chunkSize, sendContext);
+
+    // Cut our own file while the receiver's signatures stream in
+    std::vector<DeltaBlock> blocks;
+    std::atomic<bool> stop{false};
+    bool scanned = false;
+    std::thread scanner([&]()
+                        { scanned = scanBlocks(fd, fileSize, [&](const DeltaBlock &block)
+                                               {
+                                                   blocks.push_back(block);
+                                                   return !stop && !session.cancelled(); }); });
+
+    DeltaIndex index;
+    bool received = receiveSignatures(sock, basis.size, index);
+    if (!received)
+        stop = true;
+    scanner.join();
+    if (!received)
+    {
+        LOGE("Failed to receive block signatures");
+        return false;
+    }
+    if (!scanned)
+    {
+        if (!session.cancelled())
+            LOGE("File read failed while cutting delta blocks");
+        return session.cancelled();
+    }
+
+    FileDigest *digest = sendContext.digests ? &sendContext.fileDigest : nullptr;
+    std::vector<char> frames;
+    frames.reserve(kCopyFrameBatch);
+    auto flushFrames = [&]()
+    {
+        bool ok = frames.empty() || sendAll(sock, frames.data(), frames.size());
+        frames.clear();
+        return ok;
+    };
+
+    uint64_t reused = 0;
+    size_t matched = 0;
+    for (const DeltaBlock &block : blocks)
+    {
+        uint64_t basisOffset = 0;
+        if (session.cancelled() || !index.find(block.hash, block.length, basisOffset))
+            continue;
+
+        // Changed data before this block goes out as ordinary frames
+        if (offset < block.offset)
+        {
+            if (!flushFrames() ||
+                !sendChunks(session, sock, fd, offset, block.offset, chunkSize, sendContext))
+                return false;
+            if (offset != block.offset)
+                break; // cancelled
+        }
+
+        DataChunkHeader hdr{CHUNK_COPY | block.length};
+        DeltaCopy copy{basisOffset};
+        ChunkDigest chunkDigest{block.hash};
+        frames.insert(frames.end(), (const char *)&hdr, (const char *)&hdr + sizeof(hdr));
+        frames.insert(frames.end(), (const char *)&copy, (const char *)&copy + sizeof(copy));
+        if (digest)
+        {
+            frames.insert(frames.end(), (const char *)&chunkDigest,
+                          (const char *)&chunkDigest + sizeof(chunkDigest));
+            digest->add(offset, block.hash);
+        }
+        if (frames.size() >= kCopyFrameBatch && !flushFrames())
+            return false;
+
+        offset += block.length;
+        session.addProgress(block.length, 0);
+        reused += block.length;
+        matched++;
+    }
+
+    if (!flushFrames())
+        return false;
+    ioCounters_.deltaReusedBytes += reused;
+    LOGI("Delta: %zu of %zu blocks (%.1f MB) reused from the receiver's copy",
+         matched, blocks.size(), reused / (1024.0 * 1024.0));
+
+    if (session.cancelled() || offset >= fileSize)
+        return true;
+    return sendChunks(session, sock, fd, offset, fileSize, chunkSize, sendContext);
+}
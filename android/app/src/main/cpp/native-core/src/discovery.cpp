@@ -0,0 +1,481 @@
+#include "discovery.h"
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+#include "key_exchange.h"
+#include "protocol.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+using namespace std::chrono;
+
+namespace
+{
+    constexpr milliseconds kFirstInterval{250};
+    constexpr milliseconds kMaxInterval{3000};
+    constexpr milliseconds kTimeout{DISCOVERY_TIMEOUT_MS};
+    // Announces after a start that ask every peer to answer
+    constexpr uint32_t kReplyAnnounces = 3;
+    // A peer is answered at most this often
+    constexpr milliseconds kReplyGap{1000};
+    // Pairing messages go out at these offsets, same sequence each time
+    constexpr milliseconds kMessageRepeats[] = {milliseconds(0), milliseconds(150), milliseconds(450)};
+
+    uint64_t newDeviceId()
+    {
+        uint64_t id = 0;
+        if (!randomBytes(&id, sizeof(id)) || id == 0)
+            id = (uint64_t)steady_clock::now().time_since_epoch().count() | 1;
+        return id;
+    }
+
+    sockaddr_in ipv4(in_addr_t address, uint16_t port)
+    {
+        sockaddr_in to{};
+        to.sin_family = AF_INET;
+        to.sin_addr.s_addr = address;
+        to.sin_port = htons(port);
+        return to;
+    }
+
+    // Cut to MAX_BEACON_NAME bytes without splitting a UTF-8 sequence
+    std::string beaconName(const std::string &name)
+    {
+        if (name.size() <= MAX_BEACON_NAME)
+            return name;
+        size_t end = MAX_BEACON_NAME;
+        while (end > 0 && ((uint8_t)name[end] & 0xC0) == 0x80)
+            end--;
+        return name.substr(0, end);
+    }
+
+    bool sameInfo(const DiscoveredPeer &a, const DiscoveredPeer &b)
+    {
+        return a.name == b.name && a.address == b.address && a.role == b.role &&
+               a.transferPort == b.transferPort && a.capabilities == b.capabilities;
+    }
+}
+
+const char *swiftshare::peerRoleName(PeerRole role)
+{
+    return role == PeerRole::Receive ? "receive" : "send";
+}
+
+const char *swiftshare::peerMessageName(PeerMessage message)
+{
+    switch (message)
+    {
+    case PeerMessage::Lock:
+        return "lock";
+    case PeerMessage::Bye:
+        return "bye";
+    case PeerMessage::Cancel:
+        return "cancel";
+    }
+    return "unknown";
+}
+
+DiscoveryEngine::DiscoveryEngine()
+    : deviceId_(newDeviceId()),
+      wakeFd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      sock_(-1),
+      running_(false),
+      announceInterval_(kFirstInterval),
+      announces_(0),
+      sequence_(0) {}
+
+DiscoveryEngine::~DiscoveryEngine()
+{
+    stop();
+    if (wakeFd_ >= 0)
+        close(wakeFd_);
+}
+
+bool DiscoveryEngine::start(const DiscoverySettings &settings, PeersCallback onPeers,
+                            PeerMessageCallback onMessage)
+{
+    stop();
+    if (wakeFd_ < 0)
+        return false;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        LOGE("Discovery socket failed (errno=%d)", errno);
+        return false;
+    }
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    sockaddr_in local = ipv4(htonl(INADDR_ANY), DISCOVERY_PORT);
+    if (bind(sock, (sockaddr *)&local, sizeof(local)) != 0)
+    {
+        LOGE("Discovery bind to port %u failed (errno=%d)", DISCOVERY_PORT, errno);
+        close(sock);
+        return false;
+    }
+    // Multicast stays on the link and does not come back to us
+    int ttl = 1;
+    int loop = 0;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    ip_mreq group{};
+    inet_pton(AF_INET, DISCOVERY_GROUP, &group.imr_multiaddr);
+    group.imr_interface.s_addr = htonl(INADDR_ANY);
+    setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sock_ = sock;
+        running_ = true;
+        settings_ = settings;
+        settings_.name = beaconName(settings.name);
+        onPeers_ = std::move(onPeers);
+        onMessage_ = std::move(onMessage);
+        peers_.clear();
+        outbox_.clear();
+        joined_.clear();
+        broadcasts_.clear();
+        nextAnnounce_ = Clock::now();
+        announceInterval_ = kFirstInterval;
+        announces_ = 0;
+    }
+    thread_ = std::thread([this]()
+                          { run(); });
+    LOGI("Discovery started as %016llx (%s)", (unsigned long long)deviceId_, peerRoleName(settings.role));
+    return true;
+}
+
+void DiscoveryEngine::stop()
+{
+    if (!thread_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    uint64_t one = 1;
+    write(wakeFd_, &one, sizeof(one));
+    thread_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Pairing messages still waiting for a repeat leave now, then the
+    // LEAVE so peers drop us without waiting for the timeout
+    for (const Outgoing &outgoing : outbox_)
+        transmit(outgoing.datagram, outgoing.to);
+    std::vector<uint8_t> leave = beacon(BEACON_LEAVE, 0, 0, ++sequence_);
+    for (const sockaddr_in &to : announceTargets())
+        transmit(leave, to);
+
+    close(sock_);
+    sock_ = -1;
+    peers_.clear();
+    outbox_.clear();
+    onPeers_ = nullptr;
+    onMessage_ = nullptr;
+    LOGI("Discovery stopped");
+}
+
+std::vector<DiscoveredPeer> DiscoveryEngine::peers() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<DiscoveredPeer> result;
+    result.reserve(peers_.size());
+    for (const Peer &peer : peers_)
+        result.push_back(peer.info);
+    return result;
+}
+
+bool DiscoveryEngine::send(PeerMessage message, uint64_t peerId, uint64_t sessionId)
+{
+    static constexpr uint8_t kTypes[] = {BEACON_LOCK, BEACON_BYE, BEACON_CANCEL};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+            return false;
+        auto peer = std::find_if(peers_.begin(), peers_.end(), [peerId](const Peer &p)
+                                 { return p.info.deviceId == peerId; });
+        if (peer == peers_.end())
+            return false;
+
+        std::vector<uint8_t> datagram = beacon(kTypes[(size_t)message], 0, sessionId, ++sequence_);
+        Clock::time_point now = Clock::now();
+        for (milliseconds offset : kMessageRepeats)
+            outbox_.push_back({datagram, peer->source, now + offset});
+    }
+    uint64_t one = 1;
+    write(wakeFd_, &one, sizeof(one));
+    return true;
+}
+
+// ===============================
+// Engine thread
+// ===============================
+
+void DiscoveryEngine::run()
+{
+    pollfd fds[2] = {{sock_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+    Clock::time_point deadline = Clock::now();
+    for (;;)
+    {
+        int timeoutMs = (int)std::max<int64_t>(
+            0, ceil<milliseconds>(deadline - Clock::now()).count());
+        if (poll(fds, 2, timeoutMs) < 0 && errno != EINTR)
+        {
+            LOGE("Discovery poll failed (errno=%d)", errno);
+            return;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t count;
+            read(wakeFd_, &count, sizeof(count));
+        }
+
+        bool changed = false;
+        std::vector<Delivery> deliveries;
+        std::vector<DiscoveredPeer> snapshot;
+        PeersCallback onPeers;
+        PeerMessageCallback onMessage;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_)
+                return;
+            Clock::time_point now = Clock::now();
+            if (fds[0].revents & POLLIN)
+                receive(now, changed, deliveries);
+            deadline = tick(now, changed);
+            if (changed)
+            {
+                for (const Peer &peer : peers_)
+                    snapshot.push_back(peer.info);
+                onPeers = onPeers_;
+            }
+            if (!deliveries.empty())
+                onMessage = onMessage_;
+        }
+
+        // Outside the lock, so a callback may read peers()
+        if (changed && onPeers)
+            onPeers(snapshot);
+        if (onMessage)
+            for (const Delivery &delivery : deliveries)
+                onMessage(delivery.message, delivery.peer, delivery.sessionId);
+    }
+}
+
+void DiscoveryEngine::receive(Clock::time_point now, bool &changed, std::vector<Delivery> &deliveries)
+{
+    uint8_t buffer[sizeof(Beacon) + MAX_BEACON_NAME];
+    for (;;)
+    {
+        sockaddr_in from{};
+        socklen_t fromLen = sizeof(from);
+        ssize_t n = recvfrom(sock_, buffer, sizeof(buffer), 0, (sockaddr *)&from, &fromLen);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOGE("Discovery receive failed (errno=%d)", errno);
+            return;
+        }
+        if (from.sin_family == AF_INET)
+            handle(buffer, (size_t)n, from, now, changed, deliveries);
+    }
+}
+
+void DiscoveryEngine::handle(const uint8_t *data, size_t len, const sockaddr_in &from, Clock::time_point now,
+                             bool &changed, std::vector<Delivery> &deliveries)
+{
+    Beacon header{};
+    if (len < sizeof(header))
+        return;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, BEACON_MAGIC, sizeof(BEACON_MAGIC)) != 0 || header.version != BEACON_VERSION ||
+        header.deviceId == 0 || header.deviceId == deviceId_ || header.role > ROLE_RECEIVE ||
+        header.type < BEACON_ANNOUNCE || header.type > BEACON_CANCEL ||
+        header.nameLen > MAX_BEACON_NAME || len < sizeof(header) + header.nameLen)
+        return;
+
+    auto peer = std::find_if(peers_.begin(), peers_.end(), [&header](const Peer &p)
+                             { return p.info.deviceId == header.deviceId; });
+    if (header.type == BEACON_LEAVE)
+    {
+        if (peer != peers_.end())
+        {
+            peers_.erase(peer);
+            changed = true;
+        }
+        return;
+    }
+
+    DiscoveredPeer info;
+    info.deviceId = header.deviceId;
+    info.name.assign((const char *)data + sizeof(header), header.nameLen);
+    char address[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+    info.address = address;
+    info.role = header.role == ROLE_RECEIVE ? PeerRole::Receive : PeerRole::Send;
+    info.transferPort = header.transferPort;
+    info.capabilities = header.capabilities;
+
+    bool fresh = peer == peers_.end();
+    if (fresh)
+    {
+        peers_.push_back({info, from, now, Clock::time_point(), 0});
+        peer = peers_.end() - 1;
+        changed = true;
+        LOGI("Found %s at %s", info.name.c_str(), info.address.c_str());
+    }
+    else if (!sameInfo(peer->info, info))
+    {
+        peer->info = info;
+        changed = true;
+    }
+    peer->source = from;
+    peer->lastSeen = now;
+
+    // Lets a device that has just appeared (or just started) hear of us
+    // without waiting for our next announce
+    if ((fresh || (header.flags & BEACON_FLAG_REPLY)) && now - peer->lastReply >= kReplyGap)
+    {
+        peer->lastReply = now;
+        outbox_.push_back({beacon(BEACON_ANNOUNCE, 0, 0, ++sequence_), from, now});
+    }
+
+    if (header.type != BEACON_ANNOUNCE && header.sequence != peer->lastMessage)
+    {
+        peer->lastMessage = header.sequence;
+        PeerMessage message = header.type == BEACON_LOCK  ? PeerMessage::Lock
+                              : header.type == BEACON_BYE ? PeerMessage::Bye
+                                                          : PeerMessage::Cancel;
+        deliveries.push_back({message, peer->info, header.sessionId});
+    }
+}
+
+DiscoveryEngine::Clock::time_point DiscoveryEngine::tick(Clock::time_point now, bool &changed)
+{
+    size_t before = peers_.size();
+    peers_.erase(std::remove_if(peers_.begin(), peers_.end(), [now](const Peer &peer)
+                                { return now - peer.lastSeen > kTimeout; }),
+                 peers_.end());
+    if (peers_.size() != before)
+        changed = true;
+
+    if (now >= nextAnnounce_)
+    {
+        std::vector<sockaddr_in> targets = announceTargets();
+        uint8_t flags = announces_ < kReplyAnnounces ? BEACON_FLAG_REPLY : 0;
+        std::vector<uint8_t> announce = beacon(BEACON_ANNOUNCE, flags, 0, ++sequence_);
+        for (const sockaddr_in &to : targets)
+            transmit(announce, to);
+        announces_++;
+        nextAnnounce_ = now + announceInterval_;
+        announceInterval_ = std::min<Clock::duration>(announceInterval_ * 2, kMaxInterval);
+    }
+
+    Clock::time_point deadline = nextAnnounce_;
+    auto due = std::partition(outbox_.begin(), outbox_.end(), [now](const Outgoing &outgoing)
+                              { return outgoing.due > now; });
+    for (auto it = due; it != outbox_.end(); ++it)
+        transmit(it->datagram, it->to);
+    outbox_.erase(due, outbox_.end());
+    for (const Outgoing &outgoing : outbox_)
+        deadline = std::min(deadline, outgoing.due);
+    for (const Peer &peer : peers_)
+        deadline = std::min(deadline, peer.lastSeen + kTimeout + milliseconds(1));
+    return deadline;
+}
+
+std::vector<sockaddr_in> DiscoveryEngine::announceTargets()
+{
+    std::vector<in_addr_t> broadcasts;
+    ifaddrs *list = nullptr;
+    if (getifaddrs(&list) == 0)
+    {
+        for (ifaddrs *ifa = list; ifa; ifa = ifa->ifa_next)
+        {
+            if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET ||
+                !(ifa->ifa_flags & IFF_UP) || (ifa->ifa_flags & IFF_LOOPBACK))
+                continue;
+
+            in_addr_t address = ((sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+            if (std::find(joined_.begin(), joined_.end(), address) == joined_.end())
+            {
+                // Hotspot and Wi-Fi interfaces each get the group
+                ip_mreq group{};
+                inet_pton(AF_INET, DISCOVERY_GROUP, &group.imr_multiaddr);
+                group.imr_interface.s_addr = address;
+                setsockopt(sock_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group));
+                joined_.push_back(address);
+            }
+            if ((ifa->ifa_flags & IFF_BROADCAST) && ifa->ifa_broadaddr &&
+                ifa->ifa_broadaddr->sa_family == AF_INET)
+            {
+                in_addr_t broadcast = ((sockaddr_in *)ifa->ifa_broadaddr)->sin_addr.s_addr;
+                if (std::find(broadcasts.begin(), broadcasts.end(), broadcast) == broadcasts.end())
+                    broadcasts.push_back(broadcast);
+            }
+        }
+        freeifaddrs(list);
+    }
+
+    // A new network (a hotspot coming up, Wi-Fi joining) gets the fast
+    // announces of a fresh start
+    std::sort(broadcasts.begin(), broadcasts.end());
+    if (broadcasts != broadcasts_)
+    {
+        if (!broadcasts_.empty() || announces_ > 0)
+        {
+            LOGI("Discovery interfaces changed, announcing again");
+            announceInterval_ = kFirstInterval;
+            announces_ = 0;
+        }
+        broadcasts_ = broadcasts;
+    }
+
+    std::vector<sockaddr_in> targets{ipv4(htonl(INADDR_BROADCAST), DISCOVERY_PORT)};
+    for (in_addr_t broadcast : broadcasts_)
+        targets.push_back(ipv4(broadcast, DISCOVERY_PORT));
+    in_addr group{};
+    inet_pton(AF_INET, DISCOVERY_GROUP, &group);
+    targets.push_back(ipv4(group.s_addr, DISCOVERY_PORT));
+    return targets;
+}
+
+std::vector<uint8_t> DiscoveryEngine::beacon(uint8_t type, uint8_t flags, uint64_t sessionId,
+                                             uint32_t sequence) const
+{
+    Beacon header{};
+    memcpy(header.magic, BEACON_MAGIC, sizeof(BEACON_MAGIC));
+    header.version = BEACON_VERSION;
+    header.type = type;
+    header.role = settings_.role == PeerRole::Receive ? ROLE_RECEIVE : ROLE_SEND;
+    header.flags = flags;
+    header.deviceId = deviceId_;
+    header.sessionId = sessionId;
+    header.sequence = sequence;
+    header.transferPort = settings_.transferPort;
+    header.capabilities = settings_.capabilities;
+    header.nameLen = (uint8_t)settings_.name.size();
+
+    std::vector<uint8_t> datagram(sizeof(header) + header.nameLen);
+    memcpy(datagram.data(), &header, sizeof(header));
+    memcpy(datagram.data() + sizeof(header), settings_.name.data(), header.nameLen);
+    return datagram;
+}
+
+void DiscoveryEngine::transmit(const std::vector<uint8_t> &datagram, const sockaddr_in &to) const
+{
+    // Best effort: a target without a route (no Wi-Fi yet) just fails
+    sendto(sock_, datagram.data(), datagram.size(), MSG_DONTWAIT, (const sockaddr *)&to, sizeof(to));
+}
@@ -0,0 +1,74 @@
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr int kMaxEvents = 32;
+}
+
+EventLoop::EventLoop()
+    : epollFd_(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (epollFd_ < 0)
+        LOGE("epoll_create1 failed (errno=%d)", errno);
+}
+
+EventLoop::~EventLoop()
+{
+    if (epollFd_ >= 0)
+        close(epollFd_);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler)
+{
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        LOGE("epoll_ctl add failed (errno=%d)", errno);
+        return false;
+    }
+    handlers_[fd] = std::move(handler);
+    return true;
+}
+
+void EventLoop::remove(int fd)
+{
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    handlers_.erase(fd);
+}
+
+void EventLoop::run(const std::function<bool()> &keepRunning)
+{
+    epoll_event events[kMaxEvents];
+
+    while (keepRunning())
+    {
+        int n = epoll_wait(epollFd_, events, kMaxEvents, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOGE("epoll_wait failed (errno=%d)", errno);
+            return;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            // A handler may have removed this fd earlier in the batch
+            auto it = handlers_.find(events[i].data.fd);
+            if (it == handlers_.end())
+                continue;
+            Handler handler = it->second; // survives remove() inside itself
+            handler(events[i].events);
+        }
+    }
+}
@@ -0,0 +1,637 @@
+#include "io_uring_backend.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "protocol.h"
+#include "net_utils.h"
+#include "zero_copy.h"
+#include "chunk_hasher.h"
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define SWIFTSHARE_HAVE_IO_URING 1
+#endif
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+#ifdef SWIFTSHARE_HAVE_IO_URING
+
+namespace
+{
+    int ioUringSetup(unsigned entries, io_uring_params *params)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    int ioUringRegister(int fd, unsigned opcode, const void *arg, unsigned nrArgs)
+    {
+        return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+    }
+
+    void *mapRing(int fd, size_t size, off_t offset)
+    {
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    // Largest batch chained in one submission; two entries per chunk
+    constexpr size_t kMaxBatch = 64;
+}
+
+// ===============================
+// Ring
+// ===============================
+
+IoUring::~IoUring()
+{
+    if (sqes_)
+        munmap(sqes_, sqesSize_);
+    if (cqRing_ && cqRing_ != sqRing_)
+        munmap(cqRing_, cqRingSize_);
+    if (sqRing_)
+        munmap(sqRing_, sqRingSize_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool IoUring::init(unsigned entries)
+{
+    io_uring_params params{};
+    fd_ = ioUringSetup(entries, &params);
+    if (fd_ < 0)
+    {
+        LOGI("io_uring_setup failed (errno=%d)", errno);
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+        sqRingSize_ = cqRingSize_ = sqRingSize_ > cqRingSize_ ? sqRingSize_ : cqRingSize_;
+
+    sqRing_ = mapRing(fd_, sqRingSize_, IORING_OFF_SQ_RING);
+    if (!sqRing_)
+        return false;
+    cqRing_ = singleMap ? sqRing_ : mapRing(fd_, cqRingSize_, IORING_OFF_CQ_RING);
+    if (!cqRing_)
+        return false;
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(mapRing(fd_, sqesSize_, IORING_OFF_SQES));
+    if (!sqes_)
+        return false;
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqeTail_ = *sqTail_;
+
+    // Entry i always lives in slot i, so the index array is set once
+    unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries_; ++i)
+        array[i] = i;
+
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    probe();
+    return true;
+}
+
+void IoUring::probe()
+{
+    constexpr unsigned kOps = 256;
+    std::vector<char> mem(sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op), 0);
+    auto *p = reinterpret_cast<io_uring_probe *>(mem.data());
+    if (ioUringRegister(fd_, IORING_REGISTER_PROBE, p, kOps) < 0)
+        return; // pre-5.6 kernel: no SEND/RECV either
+
+    auto has = [p](unsigned op)
+    {
+        return op <= p->last_op && (p->ops[op].flags & IO_URING_OP_SUPPORTED);
+    };
+    dataPlane_ = has(IORING_OP_READ_FIXED) && has(IORING_OP_WRITE_FIXED) &&
+                 has(IORING_OP_SEND) && has(IORING_OP_RECV);
+    // MSG_WAITALL retries landed in 5.18; IORING_OP_SOCKET (5.19) is the
+    // nearest opcode the probe can see
+    waitAll_ = dataPlane_ && has(IORING_OP_SOCKET);
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_)
+        return nullptr;
+    io_uring_sqe *sqe = &sqes_[sqeTail_ & sqMask_];
+    sqeTail_++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit()
+{
+    unsigned pending = sqeTail_ - *sqTail_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+    for (;;)
+    {
+        int ret = ioUringEnter(fd_, pending, 0, 0);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        return ret < 0 ? -errno : ret;
+    }
+}
+
+io_uring_cqe *IoUring::waitCqe()
+{
+    for (;;)
+    {
+        unsigned head = *cqHead_;
+        if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE))
+            return &cqes_[head & cqMask_];
+
+        if (ioUringEnter(fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            LOGE("io_uring_enter failed (errno=%d)", errno);
+            return nullptr;
+        }
+    }
+}
+
+void IoUring::seen()
+{
+    __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::registerBuffers(const void *base, size_t length)
+{
+    iovec iov{const_cast<void *>(base), length};
+    if (ioUringRegister(fd_, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        LOGI("io_uring buffer registration failed (errno=%d)", errno);
+        return false;
+    }
+    return true;
+}
+
+bool IoUring::setFiles(const int *fds, unsigned count)
+{
+    if (filesRegistered_)
+    {
+        io_uring_files_update update{};
+        update.fds = (uint64_t)(uintptr_t)fds;
+        if (ioUringRegister(fd_, IORING_REGISTER_FILES_UPDATE, &update, count) == (int)count)
+            return true;
+        unregisterFiles();
+    }
+
+    filesRegistered_ = ioUringRegister(fd_, IORING_REGISTER_FILES, fds, count) == 0;
+    return filesRegistered_;
+}
+
+void IoUring::unregisterFiles()
+{
+    if (filesRegistered_)
+        ioUringRegister(fd_, IORING_UNREGISTER_FILES, nullptr, 0);
+    filesRegistered_ = false;
+}
+
+// ===============================
+// Sender
+// ===============================
+
+UringSender::UringSender(size_t batch, uint32_t chunkSize, IoCounters &counters)
+    : batch_(batch < 1 ? 1 : batch > kMaxBatch ? kMaxBatch : batch),
+      chunkSize_(chunkSize),
+      frameSize_((sizeof(DataChunkHeader) + chunkSize + sizeof(ChunkDigest) + 4095) & ~(size_t)4095),
+      buffers_(nullptr),
+      lengths_(batch_),
+      digests_(batch_),
+      results_(batch_ * 2),
+      counters_(counters)
+{
+    // Held while the sender lives, so it is not waited for
+    memory_ = counters_.buffers.reserve(batch_ * frameSize_);
+    buffers_ = memory_.data();
+}
+
+UringSender::~UringSender() = default;
+
+std::unique_ptr<UringSender> UringSender::create(size_t batch, uint32_t chunkSize,
+                                                 IoCounters &counters)
+{
+    std::unique_ptr<UringSender> sender(new UringSender(batch, chunkSize, counters));
+    if (!sender->buffers_)
+    {
+        LOGI("Buffer pool full, using POSIX sender");
+        return nullptr;
+    }
+    if (!sender->ring_.init((unsigned)(sender->batch_ * 2)) ||
+        !sender->ring_.supportsDataPlane() ||
+        !sender->ring_.registerBuffers(sender->buffers_, sender->batch_ * sender->frameSize_))
+    {
+        LOGI("io_uring unavailable, using POSIX sender");
+        return nullptr;
+    }
+    return sender;
+}
+
+bool UringSender::run(int sock, int fd, uint64_t &offset, uint64_t end,
+                      const std::atomic<bool> &cancelled,
+                      const std::function<void(uint32_t)> &onChunk,
+                      ChunkHasher *hasher, FileDigest *digest)
+{
+    // Registration costs more than it saves on a file that fits one batch
+    bool fixed = end - offset > batch_ * chunkSize_;
+    if (fixed)
+    {
+        int files[2] = {fd, sock};
+        fixed = ring_.setFiles(files, 2);
+    }
+    int fileFd = fixed ? 0 : fd;
+    int sockFd = fixed ? 1 : sock;
+    uint8_t sqeFlags = fixed ? IOSQE_FIXED_FILE : 0;
+
+    // Without MSG_WAITALL a short send would not stop the next one
+    size_t chain = ring_.supportsWaitAll() ? batch_ : 1;
+    size_t trailer = hasher ? sizeof(ChunkDigest) : 0;
+
+    // Digests are requested from hashFront up to hashEnd, in chunk order
+    uint64_t hashFront = offset;
+    uint64_t hashEnd = offset;
+    auto requestHashes = [&](uint64_t upTo)
+    {
+        for (; hashEnd < upTo; hashEnd += chunkSize_)
+        {
+            uint64_t left = end - hashEnd;
+            hasher->request(hashEnd, left < chunkSize_ ? (uint32_t)left : chunkSize_);
+        }
+    };
+    if (hasher)
+        hasher->reset(fd, offset);
+
+    bool ok = true;
+    while (ok && offset < end && !cancelled)
+    {
+        uint64_t chunksLeft = (end - offset + chunkSize_ - 1) / chunkSize_;
+        size_t count = chunksLeft < chain ? (size_t)chunksLeft : chain;
+        uint64_t batchEnd = std::min(end, offset + (uint64_t)count * chunkSize_);
+
+        if (hasher)
+        {
+            // A short send ended the last batch early; drop its lookahead
+            if (hashFront != offset)
+            {
+                hasher->reset(fd, offset);
+                hashFront = hashEnd = offset;
+            }
+            requestHashes(batchEnd);
+
+            // Collected before any entry is prepared, so a failure here
+            // leaves nothing half-queued in the ring
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!hasher->next(digests_[i]))
+                {
+                    LOGE("File read failed at offset %llu", (unsigned long long)hashFront);
+                    ok = false;
+                    break;
+                }
+                uint64_t left = end - hashFront;
+                hashFront += left < chunkSize_ ? left : chunkSize_;
+            }
+            if (!ok)
+                break;
+        }
+
+        uint64_t pos = offset;
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t left = end - pos;
+            uint32_t len = left < chunkSize_ ? (uint32_t)left : chunkSize_;
+            char *frame = buffers_ + i * frameSize_;
+
+            DataChunkHeader hdr{};
+            hdr.length = len;
+            memcpy(frame, &hdr, sizeof(hdr));
+
+            if (hasher)
+            {
+                ChunkDigest chunkDigest{digests_[i]};
+                memcpy(frame + sizeof(hdr) + len, &chunkDigest, sizeof(chunkDigest));
+            }
+
+            // read_i -> send_i -> read_i+1 ...: one chain keeps frames in order
+            io_uring_sqe *rd = ring_.getSqe();
+            rd->opcode = IORING_OP_READ_FIXED;
+            rd->fd = fileFd;
+            rd->flags = sqeFlags | IOSQE_IO_LINK;
+            rd->addr = (uint64_t)(uintptr_t)(frame + sizeof(hdr));
+            rd->len = len;
+            rd->off = pos;
+            rd->buf_index = 0;
+            rd->user_data = i * 2;
+
+            io_uring_sqe *snd = ring_.getSqe();
+            snd->opcode = IORING_OP_SEND;
+            snd->fd = sockFd;
+            snd->flags = sqeFlags | (i + 1 < count ? IOSQE_IO_LINK : 0);
+            snd->addr = (uint64_t)(uintptr_t)frame;
+            snd->len = sizeof(hdr) + len + trailer;
+            snd->msg_flags = MSG_WAITALL;
+            snd->user_data = i * 2 + 1;
+
+            lengths_[i] = len;
+            pos += len;
+        }
+
+        // Hash the next batch while the kernel moves this one
+        if (hasher)
+            requestHashes(std::min(end, batchEnd + (uint64_t)chain * chunkSize_));
+
+        // One sample per batch, covering its chained reads and sends
+        uint64_t t0 = counters_.telemetry.start();
+        int submitted = ring_.submit();
+        counters_.uringSubmits++;
+        if (submitted != (int)(count * 2))
+        {
+            LOGE("io_uring submit failed (%d)", submitted);
+            ok = false;
+            break;
+        }
+
+        for (size_t i = 0; i < count * 2; ++i)
+        {
+            io_uring_cqe *cqe = ring_.waitCqe();
+            if (!cqe)
+                return false; // ring is unusable; in-flight entries die with it
+            results_[cqe->user_data] = cqe->res;
+            ring_.seen();
+        }
+        counters_.telemetry.record(Probe::Send, t0, batchEnd - offset);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t len = lengths_[i];
+            int32_t readRes = results_[i * 2];
+            int32_t sendRes = results_[i * 2 + 1];
+            size_t frameLen = sizeof(DataChunkHeader) + len + trailer;
+
+            if (readRes != (int32_t)len)
+            {
+                LOGE("File read failed at offset %llu (%d)", (unsigned long long)offset, readRes);
+                ok = false;
+                break;
+            }
+            if (sendRes < 0)
+            {
+                LOGE("io_uring send failed (errno=%d)", -sendRes);
+                ok = false;
+                break;
+            }
+
+            // A short send breaks the chain; finish the frame here and
+            // resubmit the cancelled rest of the batch
+            bool shortSend = (size_t)sendRes < frameLen;
+            if (shortSend && !sendAll(sock, buffers_ + i * frameSize_ + sendRes, frameLen - sendRes))
+            {
+                LOGE("send() failed during data transfer");
+                ok = false;
+                break;
+            }
+
+            if (digest)
+                digest->add(offset, digests_[i]);
+            offset += len;
+            counters_.uringBytes += len;
+            onChunk(len);
+            if (shortSend)
+                break;
+        }
+    }
+
+    // A registered socket would otherwise outlive the caller's close()
+    if (fixed)
+        ring_.unregisterFiles();
+    return ok;
+}
+
+// ===============================
+// Receiver
+// ===============================
+
+UringReceiver::UringReceiver(IoCounters &counters)
+    : memory_(counters.buffers.reserve(kBufferSize)),
+      buffer_(memory_.data()),
+      counters_(counters) {}
+
+UringReceiver::~UringReceiver() = default;
+
+std::unique_ptr<UringReceiver> UringReceiver::create(IoCounters &counters)
+{
+    std::unique_ptr<UringReceiver> receiver(new UringReceiver(counters));
+    if (!receiver->buffer_)
+    {
+        LOGI("Buffer pool full, using POSIX receiver");
+        return nullptr;
+    }
+    if (!receiver->ring_.init(4) ||
+        !receiver->ring_.supportsDataPlane() ||
+        !receiver->ring_.registerBuffers(receiver->buffer_, kBufferSize))
+    {
+        LOGI("io_uring unavailable, using POSIX receiver");
+        return nullptr;
+    }
+    return receiver;
+}
+
+bool UringReceiver::receiveRange(int sock, int fd, uint64_t offset, size_t length)
+{
+    while (length > 0)
+    {
+        size_t want = length < kBufferSize ? length : kBufferSize;
+        bool ok = ring_.supportsWaitAll() ? receiveLinked(sock, fd, want, offset)
+                                          : receiveUnlinked(sock, fd, want, offset);
+        if (!ok)
+            return false;
+        offset += want;
+        length -= want;
+        counters_.uringBytes += want;
+    }
+    return true;
+}
+
+bool UringReceiver::receiveLinked(int sock, int fd, size_t want, uint64_t offset)
+{
+    io_uring_sqe *rcv = ring_.getSqe();
+    rcv->opcode = IORING_OP_RECV;
+    rcv->fd = sock;
+    rcv->flags = IOSQE_IO_LINK;
+    rcv->addr = (uint64_t)(uintptr_t)buffer_;
+    rcv->len = (uint32_t)want;
+    rcv->msg_flags = MSG_WAITALL;
+    rcv->user_data = 0;
+
+    io_uring_sqe *wr = ring_.getSqe();
+    wr->opcode = IORING_OP_WRITE_FIXED;
+    wr->fd = fd;
+    wr->addr = (uint64_t)(uintptr_t)buffer_;
+    wr->len = (uint32_t)want;
+    wr->off = offset;
+    wr->buf_index = 0;
+    wr->user_data = 1;
+
+    // The linked pair is one sample: the write cannot be told apart
+    uint64_t t0 = counters_.telemetry.start();
+    int submitted = ring_.submit();
+    counters_.uringSubmits++;
+    if (submitted != 2)
+    {
+        LOGE("io_uring submit failed (%d)", submitted);
+        return false;
+    }
+
+    int32_t res[2] = {0, 0};
+    for (int i = 0; i < 2; ++i)
+    {
+        io_uring_cqe *cqe = ring_.waitCqe();
+        if (!cqe)
+            return false;
+        res[cqe->user_data] = cqe->res;
+        ring_.seen();
+    }
+    counters_.telemetry.record(Probe::Recv, t0, want);
+
+    if (res[0] != (int32_t)want)
+    {
+        LOGE("Short read from socket (%d of %zu)", res[0], want);
+        return false;
+    }
+    if (res[1] != (int32_t)want)
+    {
+        LOGE("Short write to file (%d of %zu)", res[1], want);
+        return false;
+    }
+    return true;
+}
+
+bool UringReceiver::receiveUnlinked(int sock, int fd, size_t want, uint64_t offset)
+{
+    size_t got = 0;
+    while (got < want)
+    {
+        io_uring_sqe *rcv = ring_.getSqe();
+        rcv->opcode = IORING_OP_RECV;
+        rcv->fd = sock;
+        rcv->addr = (uint64_t)(uintptr_t)(buffer_ + got);
+        rcv->len = (uint32_t)(want - got);
+        rcv->msg_flags = MSG_WAITALL;
+
+        counters_.uringSubmits++;
+        uint64_t t0 = counters_.telemetry.start();
+        io_uring_cqe *cqe = ring_.submit() == 1 ? ring_.waitCqe() : nullptr;
+        if (!cqe)
+            return false;
+        int32_t n = cqe->res;
+        ring_.seen();
+        counters_.telemetry.record(Probe::Recv, t0, n > 0 ? (uint64_t)n : 0);
+        if (n == -EINTR || n == -EAGAIN)
+            continue;
+        if (n <= 0)
+        {
+            LOGE("Short read from socket (%zu of %zu)", got, want);
+            return false;
+        }
+        if ((size_t)n < want - got)
+            counters_.telemetry.shortRead();
+        got += (size_t)n;
+    }
+
+    size_t written = 0;
+    while (written < want)
+    {
+        io_uring_sqe *wr = ring_.getSqe();
+        wr->opcode = IORING_OP_WRITE_FIXED;
+        wr->fd = fd;
+        wr->addr = (uint64_t)(uintptr_t)(buffer_ + written);
+        wr->len = (uint32_t)(want - written);
+        wr->off = offset + written;
+        wr->buf_index = 0;
+
+        counters_.uringSubmits++;
+        uint64_t t0 = counters_.telemetry.start();
+        io_uring_cqe *cqe = ring_.submit() == 1 ? ring_.waitCqe() : nullptr;
+        if (!cqe)
+            return false;
+        int32_t n = cqe->res;
+        ring_.seen();
+        counters_.telemetry.record(Probe::Write, t0, n > 0 ? (uint64_t)n : 0);
+        if (n <= 0)
+        {
+            LOGE("Short write to file (errno=%d)", -n);
+            return false;
+        }
+        written += (size_t)n;
+    }
+    return true;
+}
+
+#else // !SWIFTSHARE_HAVE_IO_URING
+
+// Headers without io_uring: every factory reports it unavailable
+
+IoUring::~IoUring() {}
+bool IoUring::init(unsigned) { return false; }
+void IoUring::probe() {}
+io_uring_sqe *IoUring::getSqe() { return nullptr; }
+int IoUring::submit() { return -ENOSYS; }
+io_uring_cqe *IoUring::waitCqe() { return nullptr; }
+void IoUring::seen() {}
+bool IoUring::registerBuffers(const void *, size_t) { return false; }
+bool IoUring::setFiles(const int *, unsigned) { return false; }
+void IoUring::unregisterFiles() {}
+
+UringSender::~UringSender() {}
+
+std::unique_ptr<UringSender> UringSender::create(size_t, uint32_t, IoCounters &)
+{
+    LOGI("io_uring not built in, using POSIX sender");
+    return nullptr;
+}
+
+bool UringSender::run(int, int, uint64_t &, uint64_t, const std::atomic<bool> &,
+                      const std::function<void(uint32_t)> &, ChunkHasher *, FileDigest *)
+{
+    return false;
+}
+
+UringReceiver::~UringReceiver() {}
+
+std::unique_ptr<UringReceiver> UringReceiver::create(IoCounters &)
+{
+    LOGI("io_uring not built in, using POSIX receiver");
+    return nullptr;
+}
+
+bool UringReceiver::receiveRange(int, int, uint64_t, size_t) { return false; }
+
+#endif
@@ -0,0 +1,547 @@
+#include "key_exchange.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // ===============================
+    // SHA-256
+    // ===============================
+
+    constexpr uint32_t kRoundConstants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    inline uint32_t rotr(uint32_t x, int r)
+    {
+        return (x >> r) | (x << (32 - r));
+    }
+
+    inline uint32_t loadBe32(const uint8_t *p)
+    {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+
+    inline void storeBe32(uint8_t *p, uint32_t v)
+    {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+    // HMAC-SHA256 in pieces, for HKDF-Expand's T(i-1) | info | i input
+    class Hmac
+    {
+    public:
+        Hmac(const void *key, size_t keyLen)
+        {
+            uint8_t block[64] = {};
+            if (keyLen > sizeof(block))
+            {
+                Sha256 hash;
+                hash.update(key, keyLen);
+                hash.digest(block);
+            }
+            else if (keyLen > 0)
+            {
+                memcpy(block, key, keyLen);
+            }
+            for (size_t i = 0; i < sizeof(block); ++i)
+            {
+                outerPad_[i] = block[i] ^ 0x5c;
+                block[i] ^= 0x36;
+            }
+            inner_.update(block, sizeof(block));
+            wipe(block, sizeof(block));
+        }
+
+        ~Hmac()
+        {
+            wipe(outerPad_, sizeof(outerPad_));
+        }
+
+        void update(const void *data, size_t len)
+        {
+            inner_.update(data, len);
+        }
+
+        void digest(uint8_t out[kSha256Size])
+        {
+            uint8_t innerDigest[kSha256Size];
+            inner_.digest(innerDigest);
+            Sha256 outer;
+            outer.update(outerPad_, sizeof(outerPad_));
+            outer.update(innerDigest, sizeof(innerDigest));
+            outer.digest(out);
+        }
+
+    private:
+        Sha256 inner_;
+        uint8_t outerPad_[64];
+    };
+
+    // ===============================
+    // Curve25519 field arithmetic
+    // ===============================
+
+    // GF(2^255 - 19) as 16 limbs of 16 bits in int64_t, the TweetNaCl
+    // representation: every operation runs in constant time, and the
+    // 32-bit ABIs need nothing wider than a 64-bit multiply
+    using Fe = int64_t[16];
+
+    void carry(Fe o)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            o[i] += (int64_t)1 << 16;
+            int64_t c = o[i] >> 16;
+            if (i < 15)
+                o[i + 1] += c - 1;
+            else
+                o[0] += 38 * (c - 1);
+            o[i] -= c * ((int64_t)1 << 16);
+        }
+    }
+
+    // Swaps p and q when b is 1, without branching on it
+    void select(Fe p, Fe q, int64_t b)
+    {
+        int64_t mask = ~(b - 1);
+        for (int i = 0; i < 16; ++i)
+        {
+            int64_t t = mask & (p[i] ^ q[i]);
+            p[i] ^= t;
+            q[i] ^= t;
+        }
+    }
+
+    void pack(uint8_t out[32], const Fe n)
+    {
+        Fe t;
+        Fe m;
+        for (int i = 0; i < 16; ++i)
+            t[i] = n[i];
+        carry(t);
+        carry(t);
+        carry(t);
+        // Subtract p at most twice to reach the canonical value
+        for (int j = 0; j < 2; ++j)
+        {
+            m[0] = t[0] - 0xffed;
+            for (int i = 1; i < 15; ++i)
+            {
+                m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+                m[i - 1] &= 0xffff;
+            }
+            m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+            int64_t borrow = (m[15] >> 16) & 1;
+            m[14] &= 0xffff;
+            select(t, m, 1 - borrow);
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            out[2 * i] = (uint8_t)(t[i] & 0xff);
+            out[2 * i + 1] = (uint8_t)(t[i] >> 8);
+        }
+    }
+
+    void unpack(Fe o, const uint8_t in[32])
+    {
+        for (int i = 0; i < 16; ++i)
+            o[i] = in[2 * i] + ((int64_t)in[2 * i + 1] << 8);
+        o[15] &= 0x7fff;
+    }
+
+    void add(Fe o, const Fe a, const Fe b)
+    {
+        for (int i = 0; i < 16; ++i)
+            o[i] = a[i] + b[i];
+    }
+
+    void sub(Fe o, const Fe a, const Fe b)
+    {
+        for (int i = 0; i < 16; ++i)
+            o[i] = a[i] - b[i];
+    }
+
+    void mul(Fe o, const Fe a, const Fe b)
+    {
+        int64_t t[31] = {};
+        for (int i = 0; i < 16; ++i)
+            for (int j = 0; j < 16; ++j)
+                t[i + j] += a[i] * b[j];
+        // 2^256 = 38 mod p
+        for (int i = 0; i < 15; ++i)
+            t[i] += 38 * t[i + 16];
+        for (int i = 0; i < 16; ++i)
+            o[i] = t[i];
+        carry(o);
+        carry(o);
+    }
+
+    void square(Fe o, const Fe a)
+    {
+        mul(o, a, a);
+    }
+
+    // a^(p-2)
+    void invert(Fe o, const Fe in)
+    {
+        Fe c;
+        for (int i = 0; i < 16; ++i)
+            c[i] = in[i];
+        for (int a = 253; a >= 0; --a)
+        {
+            square(c, c);
+            if (a != 2 && a != 4)
+                mul(c, c, in);
+        }
+        for (int i = 0; i < 16; ++i)
+            o[i] = c[i];
+    }
+
+    // a^((p-1)/2): 1 for a non-zero square, p - 1 for a non-square
+    void legendre(Fe o, const Fe in)
+    {
+        Fe c;
+        for (int i = 0; i < 16; ++i)
+            c[i] = in[i];
+        for (int a = 252; a >= 0; --a)
+        {
+            square(c, c);
+            if (a != 3 && a != 0)
+                mul(c, c, in);
+        }
+        for (int i = 0; i < 16; ++i)
+            o[i] = c[i];
+    }
+
+    // Elligator 2 onto the u-coordinate (RFC 9380 section 6.7.1, Z = 2):
+    // x1 = -A / (1 + 2 r^2), kept if x1^3 + A x1^2 + x1 is a square,
+    // otherwise -x1 - A. Constant time in `r`.
+    void elligator2(uint8_t out[32], const Fe r)
+    {
+        static const Fe kA = {0x6D06, 7}; // 486662
+        static const Fe kOne = {1};
+        static const Fe kZero = {};
+
+        Fe t;
+        square(t, r);
+        add(t, t, t);
+        add(t, t, kOne);
+        invert(t, t);
+        Fe x1;
+        mul(x1, kA, t);
+        sub(x1, kZero, x1);
+
+        // Never 0: 1 + 2 r^2 has no root, and x^2 + A x + 1 none either
+        Fe g;
+        add(g, x1, kA);
+        mul(g, g, x1);
+        add(g, g, kOne);
+        mul(g, g, x1);
+        Fe chi;
+        legendre(chi, g);
+        uint8_t packed[32];
+        pack(packed, chi);
+        uint32_t diff = packed[0] ^ 1;
+        for (int i = 1; i < 32; ++i)
+            diff |= packed[i];
+        int64_t nonSquare = (int64_t)((0u - diff) >> 31);
+
+        Fe x2;
+        sub(x2, kZero, x1);
+        sub(x2, x2, kA);
+        select(x1, x2, nonSquare);
+        pack(out, x1);
+    }
+
+    // Montgomery ladder over the u-coordinate (RFC 7748 section 5)
+    void scalarMult(uint8_t out[32], const uint8_t scalar[32], const uint8_t point[32])
+    {
+        static const Fe k121665 = {0xDB41, 1};
+
+        uint8_t z[32];
+        memcpy(z, scalar, 32);
+        z[31] = (uint8_t)((z[31] & 127) | 64);
+        z[0] &= 248;
+
+        Fe x;
+        unpack(x, point);
+        Fe a = {1};
+        Fe b;
+        Fe c = {};
+        Fe d = {1};
+        Fe e;
+        Fe f;
+        for (int i = 0; i < 16; ++i)
+            b[i] = x[i];
+
+        for (int i = 254; i >= 0; --i)
+        {
+            int64_t bit = (z[i >> 3] >> (i & 7)) & 1;
+            select(a, b, bit);
+            select(c, d, bit);
+            add(e, a, c);
+            sub(a, a, c);
+            add(c, b, d);
+            sub(b, b, d);
+            square(d, e);
+            square(f, a);
+            mul(a, c, a);
+            mul(c, b, e);
+            add(e, a, c);
+            sub(a, a, c);
+            square(b, a);
+            sub(c, d, f);
+            mul(a, c, k121665);
+            add(a, a, d);
+            mul(c, c, a);
+            mul(a, d, f);
+            mul(d, b, x);
+            square(b, e);
+            select(a, b, bit);
+            select(c, d, bit);
+        }
+
+        invert(c, c);
+        mul(a, a, c);
+        pack(out, a);
+        wipe(z, sizeof(z));
+    }
+}
+
+// ===============================
+// SHA-256
+// ===============================
+
+Sha256::Sha256()
+{
+    reset();
+}
+
+void Sha256::reset()
+{
+    static const uint32_t kInitial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state_, kInitial, sizeof(state_));
+    totalLen_ = 0;
+    buffered_ = 0;
+}
+
+void Sha256::compress(const uint8_t *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = loadBe32(block + 4 * i);
+    for (int i = 16; i < 64; ++i)
+    {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                      kRoundConstants[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+    state_[5] += f;
+    state_[6] += g;
+    state_[7] += h;
+}
+
+void Sha256::update(const void *data, size_t len)
+{
+    // An empty update may come with a null `data`
+    if (len == 0)
+        return;
+
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    totalLen_ += len;
+    if (buffered_ > 0)
+    {
+        size_t take = len < 64 - buffered_ ? len : 64 - buffered_;
+        memcpy(buffer_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        len -= take;
+        if (buffered_ < 64)
+            return;
+        compress(buffer_);
+        buffered_ = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64)
+        compress(p);
+    memcpy(buffer_, p, len);
+    buffered_ = len;
+}
+
+void Sha256::digest(uint8_t out[kSha256Size])
+{
+    uint64_t bits = totalLen_ * 8;
+    buffer_[buffered_++] = 0x80;
+    if (buffered_ > 56)
+    {
+        memset(buffer_ + buffered_, 0, 64 - buffered_);
+        compress(buffer_);
+        buffered_ = 0;
+    }
+    memset(buffer_ + buffered_, 0, 56 - buffered_);
+    storeBe32(buffer_ + 56, (uint32_t)(bits >> 32));
+    storeBe32(buffer_ + 60, (uint32_t)bits);
+    compress(buffer_);
+    for (int i = 0; i < 8; ++i)
+        storeBe32(out + 4 * i, state_[i]);
+    wipe(buffer_, sizeof(buffer_));
+}
+
+void swiftshare::hmacSha256(const void *key, size_t keyLen, const void *data, size_t len,
+                            uint8_t out[kSha256Size])
+{
+    Hmac mac(key, keyLen);
+    mac.update(data, len);
+    mac.digest(out);
+}
+
+void swiftshare::hkdfExtract(const void *salt, size_t saltLen, const void *ikm, size_t ikmLen,
+                             uint8_t prk[kSha256Size])
+{
+    static const uint8_t kZeroSalt[kSha256Size] = {};
+    if (saltLen == 0)
+    {
+        salt = kZeroSalt;
+        saltLen = sizeof(kZeroSalt);
+    }
+    hmacSha256(salt, saltLen, ikm, ikmLen, prk);
+}
+
+void swiftshare::hkdfExpand(const uint8_t prk[kSha256Size], const void *info, size_t infoLen,
+                            uint8_t *out, size_t outLen)
+{
+    uint8_t block[kSha256Size];
+    for (uint8_t counter = 1; outLen > 0; ++counter)
+    {
+        Hmac mac(prk, kSha256Size);
+        if (counter > 1)
+            mac.update(block, sizeof(block));
+        mac.update(info, infoLen);
+        mac.update(&counter, 1);
+        mac.digest(block);
+
+        size_t take = outLen < sizeof(block) ? outLen : sizeof(block);
+        memcpy(out, block, take);
+        out += take;
+        outLen -= take;
+    }
+    wipe(block, sizeof(block));
+}
+
+// ===============================
+// X25519
+// ===============================
+
+bool swiftshare::x25519Keypair(uint8_t privateKey[kX25519KeySize], uint8_t publicKey[kX25519KeySize],
+                               const uint8_t *basePoint)
+{
+    static const uint8_t kBasePoint[kX25519KeySize] = {9};
+    if (!randomBytes(privateKey, kX25519KeySize))
+        return false;
+    // A small-order base point would give away the all-zero public key
+    return x25519(publicKey, privateKey, basePoint ? basePoint : kBasePoint);
+}
+
+bool swiftshare::x25519(uint8_t shared[kX25519KeySize], const uint8_t privateKey[kX25519KeySize],
+                        const uint8_t peerPublicKey[kX25519KeySize])
+{
+    scalarMult(shared, privateKey, peerPublicKey);
+    uint8_t any = 0;
+    for (size_t i = 0; i < kX25519KeySize; ++i)
+        any |= shared[i];
+    return any != 0;
+}
+
+// ===============================
+// CPace
+// ===============================
+
+void swiftshare::cpaceGenerator(const void *secret, size_t len, uint8_t point[kX25519KeySize])
+{
+    // The label's terminating zero separates it from the secret
+    static const char kLabel[] = "SWFT CPace X25519";
+    uint8_t digest[kSha256Size];
+    Sha256 sha;
+    sha.update(kLabel, sizeof(kLabel));
+    sha.update(secret, len);
+    sha.digest(digest);
+
+    Fe r;
+    unpack(r, digest);
+    elligator2(point, r);
+    wipe(digest, sizeof(digest));
+    wipe(r, sizeof(r));
+}
+
+bool swiftshare::randomBytes(void *out, size_t len)
+{
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOGE("Cannot open /dev/urandom (errno=%d)", errno);
+        return false;
+    }
+    uint8_t *p = static_cast<uint8_t *>(out);
+    while (len > 0)
+    {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            LOGE("Reading /dev/urandom failed (errno=%d)", errno);
+            close(fd);
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    close(fd);
+    return true;
+}
+
+void swiftshare::wipe(void *data, size_t len)
+{
+    volatile uint8_t *p = static_cast<volatile uint8_t *>(data);
+    while (len-- > 0)
+        *p++ = 0;
+}
@@ -0,0 +1,238 @@
+#include "link_tuner.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr auto kSampleInterval = std::chrono::milliseconds(100);
+    // The probe ends after kProbeTime, or earlier once kProbeBytes have
+    // been acknowledged; it settles only if it saw at least the minimums
+    constexpr auto kProbeTime = std::chrono::milliseconds(2000);
+    constexpr auto kMinProbeTime = std::chrono::milliseconds(300);
+    constexpr uint64_t kProbeBytes = 128ull * 1024 * 1024;
+    constexpr uint64_t kMinProbeBytes = 1024 * 1024;
+
+    constexpr uint32_t kMinSendBuffer = 512 * 1024;
+    constexpr uint32_t kMaxSendBuffer = 16 * 1024 * 1024;
+    constexpr uint32_t kMinLowat = 256 * 1024;
+
+    // Below this the peer is on the same host or a wired LAN, where the
+    // default congestion control has nothing to lose
+    constexpr uint32_t kLocalRttUs = 1000;
+
+    // Chunks of about this much transfer time keep per-chunk costs small
+    // without coarsening progress and resume
+    constexpr uint64_t kChunkTimeUs = 2000;
+    constexpr uint32_t kMinChunk = 128 * 1024;
+    constexpr uint32_t kMaxChunk = 1024 * 1024;
+
+    uint32_t preferredChunk(uint64_t goodputBps)
+    {
+        uint64_t target = goodputBps * kChunkTimeUs / 1000000;
+        uint32_t chunk = kMinChunk;
+        while (chunk < kMaxChunk && (uint64_t)chunk * 2 <= target)
+            chunk *= 2;
+        return chunk;
+    }
+
+    void readCongestion(int sock, char (&name)[16])
+    {
+        socklen_t len = sizeof(name);
+        memset(name, 0, sizeof(name));
+        if (getsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, name, &len) != 0)
+            name[0] = '\0';
+        name[sizeof(name) - 1] = '\0';
+    }
+}
+
+LinkTuner::LinkTuner(std::vector<int> socks, uint32_t chunkSize, TransferSession &session)
+    : socks_(std::move(socks)),
+      session_(session),
+      finishing_(false),
+      tuning_{}
+{
+    tuning_.chunkSize = chunkSize;
+    // Two chunks queued keep the socket busy while the next is prepared
+    tuning_.notSentLowat = chunkSize * 2 > kMinLowat ? chunkSize * 2 : kMinLowat;
+
+    int off = 0;
+    int lowat = (int)tuning_.notSentLowat;
+    for (int sock : socks_)
+    {
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &off, sizeof(off));
+        if (setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) != 0)
+            tuning_.notSentLowat = 0;
+    }
+    if (!socks_.empty())
+        readCongestion(socks_[0], tuning_.congestion);
+    session_.setTuning(tuning_);
+
+    thread_ = std::thread(&LinkTuner::probe, this);
+}
+
+LinkTuner::~LinkTuner()
+{
+    finish();
+}
+
+void LinkTuner::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (finishing_)
+            return;
+        finishing_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+
+    // Also pushes out anything Nagle is still holding back
+    int on = 1;
+    for (int sock : socks_)
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+LinkTuning LinkTuner::tuning() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tuning_;
+}
+
+void LinkTuner::probe()
+{
+    uint32_t rttUs = 0;
+    uint32_t minRttUs = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    uint64_t firstAcked = sample(rttUs, minRttUs);
+    uint64_t lastAcked = firstAcked;
+    uint64_t bestRate = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        wake_.wait_for(lock, kSampleInterval, [this]
+                       { return finishing_; });
+        bool finishing = finishing_;
+        lock.unlock();
+
+        auto now = std::chrono::steady_clock::now();
+        uint64_t acked = sample(rttUs, minRttUs);
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+        // The best interval, not the average, so slow start does not
+        // drag the estimate down
+        if (us > 0 && acked > lastAcked)
+        {
+            uint64_t rate = (acked - lastAcked) * 1000000 / us;
+            if (rate > bestRate)
+                bestRate = rate;
+        }
+        last = now;
+        lastAcked = acked;
+
+        auto elapsed = now - start;
+        bool enough = elapsed >= kMinProbeTime && acked - firstAcked >= kMinProbeBytes;
+        if (finishing || elapsed >= kProbeTime || (enough && acked - firstAcked >= kProbeBytes))
+        {
+            if (enough)
+                settle(bestRate, rttUs, minRttUs);
+            return;
+        }
+        lock.lock();
+    }
+}
+
+uint64_t LinkTuner::sample(uint32_t &rttUs, uint32_t &minRttUs) const
+{
+    uint64_t acked = 0;
+    bool ackedKnown = true;
+    rttUs = 0;
+    minRttUs = 0;
+    for (int sock : socks_)
+    {
+        tcp_info info{};
+        socklen_t len = sizeof(info);
+        if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+        {
+            ackedKnown = false;
+            continue;
+        }
+
+        // Older kernels fill in a shorter struct
+        if (len >= offsetof(tcp_info, tcpi_bytes_acked) + sizeof(info.tcpi_bytes_acked))
+            acked += info.tcpi_bytes_acked;
+        else
+            ackedKnown = false;
+
+        uint32_t minRtt = info.tcpi_rtt;
+        if (len >= offsetof(tcp_info, tcpi_min_rtt) + sizeof(info.tcpi_min_rtt) && info.tcpi_min_rtt > 0)
+            minRtt = info.tcpi_min_rtt;
+        if (info.tcpi_rtt > rttUs)
+            rttUs = info.tcpi_rtt;
+        if (minRtt > 0 && (minRttUs == 0 || minRtt < minRttUs))
+            minRttUs = minRtt;
+    }
+    // Without TCP_INFO byte counts, bytes handed to the kernel will do
+    return ackedKnown ? acked : session_.progress().bytesTransferred;
+}
+
+void LinkTuner::settle(uint64_t goodputBps, uint32_t rttUs, uint32_t minRttUs)
+{
+    LinkTuning tuning = this->tuning();
+    tuning.goodputBps = goodputBps;
+    tuning.rttUs = rttUs;
+    tuning.minRttUs = minRttUs;
+
+    // A full window in flight plus the unsent allowance. Never shrinks
+    // what kernel autotuning already gave the socket.
+    uint64_t bdp = goodputBps * (minRttUs > 0 ? minRttUs : rttUs) / 1000000;
+    uint64_t wanted = 2 * bdp + tuning.notSentLowat;
+    if (wanted < kMinSendBuffer)
+        wanted = kMinSendBuffer;
+    if (wanted > kMaxSendBuffer)
+        wanted = kMaxSendBuffer;
+
+    bool wantBbr = minRttUs >= kLocalRttUs;
+    for (int sock : socks_)
+    {
+        int current = 0;
+        socklen_t len = sizeof(current);
+        getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &current, &len);
+        // The kernel reports twice the size it was given
+        if ((uint64_t)current / 2 < wanted)
+        {
+            int size = (int)wanted;
+            if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0)
+                tuning.sendBuffer = (uint32_t)wanted;
+        }
+
+        // Refused unless the kernel has BBR and lets apps pick it
+        if (wantBbr)
+            setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, "bbr", 3);
+    }
+    if (!socks_.empty())
+        readCongestion(socks_[0], tuning.congestion);
+
+    tuning.preferredChunkSize = preferredChunk(goodputBps);
+    tuning.settled = true;
+
+    LOGI("Link tuned: %.1f MB/s, RTT %u us (min %u), sndbuf %u, lowat %u, %s, next chunk %u KB",
+         goodputBps / (1024.0 * 1024.0), rttUs, minRttUs, tuning.sendBuffer,
+         tuning.notSentLowat, tuning.congestion, tuning.preferredChunkSize / 1024);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tuning_ = tuning;
+    }
+    session_.setTuning(tuning);
+}
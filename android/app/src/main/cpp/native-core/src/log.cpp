@@ -0,0 +1,43 @@
+#include "log.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
+
+using namespace swiftshare;
+
+namespace
+{
+    std::atomic<LogSink> sink{nullptr};
+
+    void defaultSink(LogLevel level, const char *tag, const char *message)
+    {
+#ifdef __ANDROID__
+        __android_log_write(level == LogLevel::Error ? ANDROID_LOG_ERROR : ANDROID_LOG_INFO,
+                            tag, message);
+#else
+        fprintf(stderr, "%c/%s: %s\n", level == LogLevel::Error ? 'E' : 'I', tag, message);
+#endif
+    }
+}
+
+void swiftshare::setLogSink(LogSink newSink)
+{
+    sink.store(newSink, std::memory_order_release);
+}
+
+void swiftshare::logPrint(LogLevel level, const char *tag, const char *format, ...)
+{
+    // Longer lines are cut, as logcat would do anyway
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    LogSink current = sink.load(std::memory_order_acquire);
+    (current ? current : defaultSink)(level, tag, message);
+}
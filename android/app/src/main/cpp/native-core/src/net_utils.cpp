@@ -0,0 +1,134 @@
+#include "net_utils.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include "protocol.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+void swiftshare::setSocketTimeouts(int sock)
+{
+    timeval timeout{kSocketTimeoutSeconds, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+int swiftshare::connectToReceiver(const std::string &ip, uint16_t port, int socketBuffer)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        LOGE("socket() failed");
+        return -1;
+    }
+
+    // Disable Nagle so handshake round trips are not held back; a
+    // LinkTuner turns it back on for the bulk data
+    int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (socketBuffer > 0)
+    {
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &socketBuffer, sizeof(socketBuffer));
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &socketBuffer, sizeof(socketBuffer));
+    }
+
+    // Set socket timeouts to prevent indefinite blocking
+    setSocketTimeouts(sock);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
+    {
+        LOGE("Invalid IP address");
+        close(sock);
+        return -1;
+    }
+
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOGE("connect() failed");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+bool swiftshare::sendAll(int sock, const void *data, size_t len, int flags)
+{
+    const char *p = static_cast<const char *>(data);
+    while (len > 0)
+    {
+        ssize_t s = send(sock, p, len, flags);
+        if (s < 0 && errno == EINTR)
+            continue;
+        if (s <= 0)
+            return false;
+        p += s;
+        len -= (size_t)s;
+    }
+    return true;
+}
+
+bool swiftshare::sendAllVectored(int sock, struct iovec *iov, int count)
+{
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    while (msg.msg_iovlen > 0)
+    {
+        ssize_t s = sendmsg(sock, &msg, 0);
+        if (s < 0 && errno == EINTR)
+            continue;
+        if (s <= 0)
+            return false;
+
+        // Skip what went out, trimming a partly sent entry
+        size_t left = (size_t)s;
+        while (msg.msg_iovlen > 0 && left >= msg.msg_iov->iov_len)
+        {
+            left -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov->iov_base = static_cast<char *>(msg.msg_iov->iov_base) + left;
+            msg.msg_iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+bool swiftshare::recvAll(int sock, void *data, size_t len)
+{
+    char *p = static_cast<char *>(data);
+    while (len > 0)
+    {
+        ssize_t r = recv(sock, p, len, MSG_WAITALL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        len -= (size_t)r;
+    }
+    return true;
+}
+
+bool swiftshare::sendHello(int sock, uint8_t mode, uint16_t flags)
+{
+    HelloPacket hello{};
+    memcpy(hello.magic, MAGIC, 4);
+    hello.version = VERSION;
+    hello.mode = mode;
+    hello.flags = flags;
+    return sendAll(sock, &hello, sizeof(hello));
+}
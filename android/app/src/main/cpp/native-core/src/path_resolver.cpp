@@ -0,0 +1,209 @@
+#include "path_resolver.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cctype>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr char kPendingPrefix[] = ".pending-";
+    constexpr size_t kPendingPrefixLen = sizeof(kPendingPrefix) - 1;
+
+    // A create that keeps finding its name taken gives up after this many
+    constexpr int kCreateAttempts = 8;
+
+    bool startsWith(const std::string &s, const char *prefix, size_t len)
+    {
+        return s.compare(0, len, prefix) == 0;
+    }
+
+    // mkdir -p
+    bool makeDirectories(const std::string &path)
+    {
+        for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+        {
+            std::string part = path.substr(0, slash);
+            if (mkdir(part.c_str(), 0775) != 0 && errno != EEXIST)
+            {
+                LOGE("Cannot create %s (errno=%d)", part.c_str(), errno);
+                return false;
+            }
+            if (slash == std::string::npos)
+                return true;
+        }
+    }
+
+    bool directoryMtime(const std::string &directory, timespec &mtime)
+    {
+        struct stat st{};
+        if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+            return false;
+        mtime = st.st_mtim;
+        return true;
+    }
+}
+
+PathResolver::PathResolver()
+    : scannedMtime_{} {}
+
+bool PathResolver::setDirectory(const std::string &directory)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_.clear();
+    names_.clear();
+    nextSuffix_.clear();
+
+    std::string dir = directory;
+    while (dir.size() > 1 && dir.back() == '/')
+        dir.pop_back();
+    if (dir.empty() || !makeDirectories(dir))
+        return false;
+
+    directory_ = dir;
+    scannedMtime_ = {};
+    if (!refresh())
+    {
+        directory_.clear();
+        return false;
+    }
+    LOGI("Receiving into %s (%zu names indexed)", directory_.c_str(), names_.size());
+    return true;
+}
+
+bool PathResolver::ready() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !directory_.empty();
+}
+
+// Rescans the directory if it changed since the last scan
+bool PathResolver::refresh()
+{
+    timespec mtime{};
+    if (!directoryMtime(directory_, mtime))
+    {
+        LOGE("Receive directory %s is gone", directory_.c_str());
+        return false;
+    }
+    if (mtime.tv_sec == scannedMtime_.tv_sec && mtime.tv_nsec == scannedMtime_.tv_nsec)
+        return true;
+
+    DIR *dir = opendir(directory_.c_str());
+    if (!dir)
+    {
+        LOGE("Cannot read %s (errno=%d)", directory_.c_str(), errno);
+        return false;
+    }
+    names_.clear();
+    nextSuffix_.clear();
+    while (dirent *entry = readdir(dir))
+        names_.insert(entry->d_name);
+    closedir(dir);
+    scannedMtime_ = mtime;
+    return true;
+}
+
+std::string PathResolver::sanitize(const std::string &filename)
+{
+    std::string name = filename;
+
+    // "^\.pending-\d+-", then a bare ".pending-", then one leading dot
+    if (startsWith(name, kPendingPrefix, kPendingPrefixLen))
+    {
+        size_t end = kPendingPrefixLen;
+        while (end < name.size() && isdigit((unsigned char)name[end]))
+            end++;
+        if (end > kPendingPrefixLen && end < name.size() && name[end] == '-')
+            name.erase(0, end + 1);
+    }
+    if (startsWith(name, kPendingPrefix, kPendingPrefixLen))
+        name.erase(0, kPendingPrefixLen);
+    if (!name.empty() && name[0] == '.')
+        name.erase(0, 1);
+
+    for (char &c : name)
+    {
+        if (c == '/' || c == '\0')
+            c = '_';
+    }
+
+    bool blank = true;
+    for (char c : name)
+        blank = blank && isspace((unsigned char)c);
+    if (blank)
+        name = "file";
+    return name;
+}
+
+// Picks the first free name for `filename` and marks it taken
+std::string PathResolver::take(const std::string &filename)
+{
+    std::string clean = sanitize(filename);
+    if (names_.insert(clean).second)
+        return clean;
+
+    size_t dot = clean.find_last_of('.');
+    bool hasExt = dot != std::string::npos && dot > 0;
+    std::string base = hasExt ? clean.substr(0, dot) : clean;
+    std::string ext = hasExt ? clean.substr(dot) : std::string();
+
+    uint32_t &suffix = nextSuffix_.try_emplace(clean, 1).first->second;
+    for (;; ++suffix)
+    {
+        std::string candidate = base + "-" + std::to_string(suffix) + ext;
+        if (names_.insert(candidate).second)
+        {
+            ++suffix;
+            return candidate;
+        }
+    }
+}
+
+std::vector<std::string> PathResolver::reserve(const std::vector<std::string> &filenames)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> paths;
+    if (directory_.empty() || !refresh())
+        return paths;
+
+    paths.reserve(filenames.size());
+    for (const std::string &filename : filenames)
+        paths.push_back(directory_ + "/" + take(filename));
+    return paths;
+}
+
+int PathResolver::create(const std::string &filename, std::string &path)
+{
+    for (int attempt = 0; attempt < kCreateAttempts; ++attempt)
+    {
+        if (path.empty())
+        {
+            std::vector<std::string> paths = reserve({filename});
+            if (paths.empty())
+                return -1;
+            path = paths[0];
+        }
+
+        int fd = open(path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+        if (fd >= 0)
+            return fd;
+        if (errno != EEXIST)
+        {
+            LOGE("file open failed: %s (errno=%d)", path.c_str(), errno);
+            return -1;
+        }
+
+        // Created behind the index's back; the next reserve rescans
+        LOGI("%s appeared since the last scan, picking another name", path.c_str());
+        path.clear();
+    }
+    LOGE("No free name found for %s", filename.c_str());
+    return -1;
+}
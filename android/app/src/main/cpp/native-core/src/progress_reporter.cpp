@@ -0,0 +1,253 @@
+#include "progress_reporter.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace swiftshare;
+
+namespace
+{
+    static_assert(sizeof(std::atomic<double>) == sizeof(double) &&
+                      std::atomic<double>::is_always_lock_free,
+                  "the board is shared as plain doubles");
+
+    // Time constant of the throughput average: long enough to ride out
+    // a stalled chunk, short enough to follow a change of link
+    constexpr double kSmoothingSeconds = 2.0;
+
+    constexpr double kDefaultRateHz = 10.0;
+}
+
+// ===============================
+// Board
+// ===============================
+
+ProgressBoard::ProgressBoard()
+    : values_(new std::atomic<double>[kValues]),
+      sequence_(0)
+{
+    for (size_t i = 0; i < kValues; ++i)
+        values_[i].store(0.0, std::memory_order_relaxed);
+    values_[0].store(kVersion, std::memory_order_relaxed);
+    values_[1].store((double)kSlots, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ProgressBoard::publish(const std::vector<ProgressEvent> &events)
+{
+    values_[2].store((double)++sequence_, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t used = std::min(events.size(), kSlots);
+    values_[3].store((double)used, std::memory_order_relaxed);
+    for (size_t slot = 0; slot < used; ++slot)
+    {
+        const ProgressEvent &e = events[slot];
+        const double fields[kSlotFields] = {(double)e.id,
+                                           e.direction == SessionDirection::Send ? 0.0 : 1.0,
+                                           (double)e.state,
+                                           (double)e.phase,
+                                           (double)e.fileIndex,
+                                           (double)e.fileCount,
+                                           (double)e.fileBytesTransferred,
+                                           (double)e.fileSize,
+                                           (double)e.bytesTransferred,
+                                           (double)e.totalBytes,
+                                           e.bytesPerSecond,
+                                           (double)e.etaMs};
+        std::atomic<double> *out = &values_[kHeader + slot * kSlotFields];
+        for (size_t i = 0; i < kSlotFields; ++i)
+            out[i].store(fields[i], std::memory_order_relaxed);
+    }
+
+    values_[2].store((double)++sequence_, std::memory_order_release);
+}
+
+// ===============================
+// Reporter
+// ===============================
+
+ProgressReporter::ProgressReporter(const SessionRegistry &sessions)
+    : sessions_(sessions),
+      interval_(std::chrono::microseconds((int64_t)(1e6 / kDefaultRateHz))),
+      woken_(false),
+      stopping_(false),
+      firstTick_(true) {}
+
+ProgressReporter::~ProgressReporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void ProgressReporter::setListener(ProgressListener listener, double rateHz)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    double hz = std::clamp(rateHz > 0 ? rateHz : kDefaultRateHz, 1.0, 60.0);
+    interval_ = std::chrono::microseconds((int64_t)(1e6 / hz));
+    listener_ = std::move(listener);
+    if (listener_)
+        start();
+}
+
+std::shared_ptr<ProgressBoard> ProgressReporter::board()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!board_)
+        board_ = std::make_shared<ProgressBoard>();
+    start();
+    return board_;
+}
+
+void ProgressReporter::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        woken_ = true;
+    }
+    wake_.notify_all();
+}
+
+void ProgressReporter::start()
+{
+    if (!thread_.joinable())
+        thread_ = std::thread(&ProgressReporter::run, this);
+    woken_ = true;
+    wake_.notify_all();
+}
+
+void ProgressReporter::run()
+{
+    std::vector<ProgressEvent> all;
+    std::vector<ProgressEvent> changed;
+    bool active = false;
+
+    for (;;)
+    {
+        ProgressListener listener;
+        std::shared_ptr<ProgressBoard> board;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // Ticks keep their pace while anything moves; an idle
+            // reporter waits for the next session instead of polling
+            if (active)
+                wake_.wait_for(lock, interval_, [this]
+                               { return stopping_; });
+            else
+                wake_.wait(lock, [this]
+                           { return stopping_ || woken_; });
+            if (stopping_)
+                return;
+            woken_ = false;
+            listener = listener_;
+            board = board_;
+        }
+
+        active = tick(all, changed);
+        if (board)
+            board->publish(all);
+        if (listener && !changed.empty())
+            listener(changed);
+    }
+}
+
+bool ProgressReporter::tick(std::vector<ProgressEvent> &all, std::vector<ProgressEvent> &changed)
+{
+    all.clear();
+    changed.clear();
+    auto now = std::chrono::steady_clock::now();
+    std::vector<SessionStats> sessions = sessions_.list();
+
+    // Forget sessions the registry no longer keeps
+    for (auto it = estimates_.begin(); it != estimates_.end();)
+    {
+        bool kept = std::any_of(sessions.begin(), sessions.end(), [&](const SessionStats &s)
+                                { return s.id == it->first; });
+        it = kept ? std::next(it) : estimates_.erase(it);
+    }
+
+    bool active = false;
+    for (auto it = sessions.rbegin(); it != sessions.rend(); ++it)
+    {
+        auto [entry, added] = estimates_.try_emplace(it->id, Estimate{});
+        Estimate &estimate = entry->second;
+        if (added && firstTick_ && it->state != SessionState::Active)
+            estimate.reported = true;
+
+        ProgressEvent event = update(*it, estimate, now);
+        all.push_back(event);
+
+        if (it->state == SessionState::Active)
+        {
+            active = true;
+            changed.push_back(event);
+        }
+        else if (!estimate.reported)
+        {
+            // Also covers sessions that started and ended between ticks
+            estimate.reported = true;
+            changed.push_back(event);
+        }
+    }
+    firstTick_ = false;
+    return active;
+}
+
+ProgressEvent ProgressReporter::update(const SessionStats &stats, Estimate &estimate,
+                                       std::chrono::steady_clock::time_point now)
+{
+    uint64_t bytes = stats.progress.bytesTransferred;
+    bool transferring = stats.state == SessionState::Active &&
+                        stats.phase == SessionPhase::Transferring;
+
+    // Only the transfer phase is timed, so bytes a resume skipped or a
+    // handshake waited for do not count as throughput
+    if (!transferring)
+    {
+        estimate.sampling = false;
+    }
+    else if (!estimate.sampling)
+    {
+        estimate.bytes = bytes;
+        estimate.at = now;
+        estimate.sampling = true;
+    }
+    else
+    {
+        double seconds = std::chrono::duration<double>(now - estimate.at).count();
+        if (seconds > 0 && bytes >= estimate.bytes)
+        {
+            double rate = (bytes - estimate.bytes) / seconds;
+            double alpha = 1.0 - std::exp(-seconds / kSmoothingSeconds);
+            estimate.bytesPerSecond = estimate.bytesPerSecond > 0
+                                          ? estimate.bytesPerSecond + alpha * (rate - estimate.bytesPerSecond)
+                                          : rate;
+            estimate.bytes = bytes;
+            estimate.at = now;
+        }
+    }
+
+    int64_t etaMs = -1;
+    if (stats.state == SessionState::Completed)
+        etaMs = 0;
+    else if (transferring && estimate.bytesPerSecond > 0 && stats.progress.totalBytes >= bytes)
+        etaMs = (int64_t)((stats.progress.totalBytes - bytes) * 1000.0 / estimate.bytesPerSecond);
+
+    return ProgressEvent{stats.id,
+                         stats.direction,
+                         stats.state,
+                         stats.phase,
+                         stats.progress.fileIndex,
+                         stats.progress.fileCount,
+                         stats.fileBytesTransferred,
+                         stats.fileSize,
+                         bytes,
+                         stats.progress.totalBytes,
+                         estimate.bytesPerSecond,
+                         etaMs,
+                         stats.elapsedMs};
+}
@@ -0,0 +1,310 @@
+#include "resume_journal.h"
+#include "checksum.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr char kJournalMagic[4] = {'S', 'W', 'R', 'J'};
+    constexpr uint32_t kJournalVersion = 1;
+
+    // Prefix of the file folded into its transfer ID
+    constexpr uint64_t kIdSampleBytes = 1024 * 1024;
+
+    // Newest ranges re-hashed before giving up on a partial file
+    constexpr int kVerifyRanges = 4;
+
+    /*
+     * Journal file:
+     *   JournalHeader, pathLen bytes of partial-file path,
+     *   then one JournalRecord per commit, appended in offset order.
+     * A torn or corrupt trailing record fails its check and is ignored.
+     */
+    struct JournalHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t transferId;
+        uint64_t fileSize;
+        uint32_t pathLen;
+        uint32_t reserved;
+    };
+
+    struct JournalRecord
+    {
+        uint64_t offset;
+        uint64_t length;
+        uint64_t checksum; // XXH64 of the file range
+        uint64_t check;    // XXH64 of the three fields above
+    };
+
+    uint64_t recordCheck(const JournalRecord &record, uint64_t transferId)
+    {
+        return xxh64(&record, offsetof(JournalRecord, check), transferId);
+    }
+
+    bool writeAll(int fd, const void *data, size_t len)
+    {
+        const char *p = static_cast<const char *>(data);
+        while (len > 0)
+        {
+            ssize_t n = write(fd, p, len);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+}
+
+uint64_t swiftshare::resumeTransferId(int fd, const std::string &name, uint64_t fileSize)
+{
+    Xxh64 state;
+    state.update(name.data(), name.size());
+    state.update(&fileSize, sizeof(fileSize));
+
+    uint64_t sample = 0;
+    uint64_t sampleLen = fileSize < kIdSampleBytes ? fileSize : kIdSampleBytes;
+    if (sampleLen > 0 && xxh64File(fd, 0, sampleLen, sample))
+        state.update(&sample, sizeof(sample));
+    return state.digest();
+}
+
+uint64_t swiftshare::acceptResumeOffer(int fd, uint64_t fileSize, const ResumeOffer &offer)
+{
+    if (offer.offset == 0)
+        return 0;
+
+    if (offer.offset > fileSize || offer.checkLength == 0 ||
+        offer.checkLength > offer.offset ||
+        offer.checkOffset != offer.offset - offer.checkLength)
+    {
+        LOGE("Ignoring malformed resume offer at %" PRIu64, offer.offset);
+        return 0;
+    }
+
+    uint64_t digest = 0;
+    if (!xxh64File(fd, offer.checkOffset, offer.checkLength, digest) || digest != offer.checksum)
+    {
+        LOGI("Resume offer at %" PRIu64 " does not match local data, starting over", offer.offset);
+        return 0;
+    }
+    return offer.offset;
+}
+
+ResumeJournal::ResumeJournal(const std::string &directory, uint64_t transferId, uint64_t fileSize)
+    : directory_(directory),
+      transferId_(transferId),
+      fileSize_(fileSize),
+      journalFd_(-1)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016" PRIx64 ".journal", transferId);
+    journalPath_ = directory + name;
+}
+
+ResumeJournal::~ResumeJournal()
+{
+    if (journalFd_ >= 0)
+        ::close(journalFd_);
+}
+
+uint64_t ResumeJournal::committedEnd() const
+{
+    return ranges_.empty() ? 0 : ranges_.back().offset + ranges_.back().length;
+}
+
+bool ResumeJournal::load()
+{
+    int fd = open(journalPath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st{};
+    std::vector<char> data;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(JournalHeader))
+    {
+        data.resize((size_t)st.st_size);
+        if (pread(fd, data.data(), data.size(), 0) != (ssize_t)data.size())
+            data.clear();
+    }
+    ::close(fd);
+
+    if (data.empty())
+        return false;
+
+    JournalHeader header{};
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, kJournalMagic, sizeof(kJournalMagic)) != 0 ||
+        header.version != kJournalVersion ||
+        header.transferId != transferId_ || header.fileSize != fileSize_ ||
+        header.pathLen == 0 || sizeof(header) + header.pathLen > data.size())
+    {
+        LOGE("Discarding unusable resume journal %s", journalPath_.c_str());
+        return false;
+    }
+
+    path_.assign(data.data() + sizeof(header), header.pathLen);
+
+    // Keep the contiguous run of valid records from offset 0
+    ranges_.clear();
+    for (size_t pos = sizeof(header) + header.pathLen;
+         pos + sizeof(JournalRecord) <= data.size();
+         pos += sizeof(JournalRecord))
+    {
+        JournalRecord record{};
+        memcpy(&record, data.data() + pos, sizeof(record));
+        if (record.check != recordCheck(record, transferId_) ||
+            record.offset != committedEnd() ||
+            record.length > fileSize_ - record.offset)
+            break;
+        ranges_.push_back({record.offset, record.length, record.checksum});
+    }
+    return true;
+}
+
+ResumeOffer ResumeJournal::verify(int fd)
+{
+    struct stat st{};
+    uint64_t onDisk = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+
+    for (int tries = 0; tries < kVerifyRanges && !ranges_.empty(); ++tries)
+    {
+        const Range &range = ranges_.back();
+        uint64_t digest = 0;
+        if (range.offset + range.length <= onDisk &&
+            xxh64File(fd, range.offset, range.length, digest) &&
+            digest == range.checksum)
+        {
+            LOGI("Resume journal verified %" PRIu64 " of %" PRIu64 " bytes",
+                 committedEnd(), fileSize_);
+            return ResumeOffer{committedEnd(), range.offset, range.length, range.checksum};
+        }
+        ranges_.pop_back();
+    }
+
+    ranges_.clear();
+    return ResumeOffer{};
+}
+
+bool ResumeJournal::start(const std::string &path, uint64_t offset)
+{
+    path_ = path;
+    while (!ranges_.empty() && committedEnd() > offset)
+        ranges_.pop_back();
+
+    if (journalFd_ >= 0)
+    {
+        ::close(journalFd_);
+        journalFd_ = -1;
+    }
+
+    if (mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST)
+    {
+        LOGE("Cannot create resume directory %s", directory_.c_str());
+        return false;
+    }
+
+    // Rewrite through a temporary file so a crash never leaves half a header
+    std::string tmpPath = journalPath_ + ".tmp";
+    int fd = open(tmpPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        LOGE("Cannot create resume journal %s", tmpPath.c_str());
+        return false;
+    }
+
+    JournalHeader header{};
+    memcpy(header.magic, kJournalMagic, sizeof(kJournalMagic));
+    header.version = kJournalVersion;
+    header.transferId = transferId_;
+    header.fileSize = fileSize_;
+    header.pathLen = (uint32_t)path_.size();
+
+    bool ok = writeAll(fd, &header, sizeof(header)) &&
+              writeAll(fd, path_.data(), path_.size());
+    for (const Range &range : ranges_)
+    {
+        JournalRecord record{range.offset, range.length, range.checksum, 0};
+        record.check = recordCheck(record, transferId_);
+        ok = ok && writeAll(fd, &record, sizeof(record));
+    }
+
+    if (!ok || rename(tmpPath.c_str(), journalPath_.c_str()) != 0)
+    {
+        LOGE("Cannot write resume journal %s", journalPath_.c_str());
+        ::close(fd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    journalFd_ = fd;
+    return true;
+}
+
+void ResumeJournal::advance(int fd, uint64_t offset)
+{
+    if (journalFd_ >= 0 && offset - committedEnd() >= kCommitInterval)
+        commit(fd, offset);
+}
+
+void ResumeJournal::close(int fd, uint64_t offset)
+{
+    if (journalFd_ < 0)
+        return;
+
+    if (offset >= fileSize_)
+    {
+        unlink(journalPath_.c_str());
+    }
+    else if (commit(fd, offset))
+    {
+        LOGI("Resume journal holds %" PRIu64 " of %" PRIu64 " bytes",
+             committedEnd(), fileSize_);
+    }
+
+    ::close(journalFd_);
+    journalFd_ = -1;
+}
+
+// Flushes the file data first, so a record never points at bytes that
+// a crash could still lose.
+bool ResumeJournal::commit(int fd, uint64_t offset)
+{
+    uint64_t end = committedEnd();
+    if (offset <= end)
+        return true;
+
+    Range range{end, offset - end, 0};
+    if (fdatasync(fd) != 0 ||
+        !xxh64File(fd, range.offset, range.length, range.checksum) ||
+        !appendRecord(range))
+    {
+        LOGE("Resume commit failed at %" PRIu64, offset);
+        return false;
+    }
+
+    ranges_.push_back(range);
+    return true;
+}
+
+bool ResumeJournal::appendRecord(const Range &range)
+{
+    JournalRecord record{range.offset, range.length, range.checksum, 0};
+    record.check = recordCheck(record, transferId_);
+    return writeAll(journalFd_, &record, sizeof(record));
+}
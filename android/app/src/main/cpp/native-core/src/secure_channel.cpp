@@ -0,0 +1,555 @@
+#include "secure_channel.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <bit>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "aead.h"
+#include "key_exchange.h"
+#include "net_utils.h"
+#include "protocol.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Seal/open workers of the bulk direction, at most; more than two
+    // help ChaCha20 on the slow cores of phones without AES instructions
+    constexpr unsigned kMaxCryptoWorkers = 4;
+    // Either end of the local socket pair may queue this much, so a
+    // sendfile() into it moves a large piece at a time
+    constexpr int kLocalBuffer = 2 * 1024 * 1024;
+
+    constexpr char kRecordLabel[] = "SWFT records";
+
+    // Half the cores, leaving the rest to the engine and the other
+    // direction. A single core seals inline: handing records between
+    // threads there only adds switches.
+    unsigned cryptoWorkers()
+    {
+        unsigned cpus = std::thread::hardware_concurrency();
+        if (cpus <= 1)
+            return 0;
+        return std::clamp(cpus / 2, 1u, kMaxCryptoWorkers);
+    }
+
+    // Keys and IV of one direction
+    struct DirectionKeys
+    {
+        uint8_t key[kAeadKeySize];
+        uint8_t iv[kAeadNonceSize];
+    };
+
+    // One record in flight: RecordHeader, payload, tag
+    struct Record
+    {
+        enum class State
+        {
+            Free,
+            Read,   // waiting for a worker
+            Sealed, // sealed or opened, waiting for the writer
+        };
+
+        std::vector<uint8_t> buffer;
+        size_t length = 0; // payload bytes
+        uint64_t sequence = 0;
+        State state = State::Free;
+        bool ok = false;
+
+        Record() : buffer(sizeof(RecordHeader) + MAX_RECORD + kAeadTagSize) {}
+
+        uint8_t *payload() { return buffer.data() + sizeof(RecordHeader); }
+        uint8_t *tag() { return payload() + length; }
+    };
+
+    // Moves one direction of a tunnel: reads records from `from`, seals
+    // or opens them, writes them to `to`
+    class RecordPump
+    {
+    public:
+        RecordPump(int from, int to, bool seal, AeadSuite suite, const DirectionKeys &keys,
+                   const std::atomic<bool> &peerDone)
+            : from_(from),
+              to_(to),
+              seal_(seal),
+              aead_(suite, keys.key),
+              peerDone_(peerDone)
+        {
+            memcpy(iv_, keys.iv, sizeof(iv_));
+        }
+
+        ~RecordPump()
+        {
+            wipe(iv_, sizeof(iv_));
+        }
+
+        // Until `from` ends (true) or anything fails (false). With no
+        // workers the calling thread does everything.
+        bool run(unsigned workers)
+        {
+            if (workers == 0)
+            {
+                Record record;
+                for (uint64_t sequence = 0;; ++sequence)
+                {
+                    int got = read(record);
+                    if (got <= 0)
+                        return got == 0;
+                    record.sequence = sequence;
+                    if (!crypt(record) || !write(record))
+                        return false;
+                }
+            }
+            return runPipelined(workers);
+        }
+
+    private:
+        bool runPipelined(unsigned workers)
+        {
+            std::vector<Record> ring(workers + 2);
+            std::mutex mutex;
+            std::condition_variable changed;
+            uint64_t readCount = 0;
+            uint64_t cryptNext = 0;
+            uint64_t writeCount = 0;
+            bool ended = false;
+            bool failed = false;
+
+            auto fail = [&]()
+            {
+                failed = true;
+                changed.notify_all();
+                // Unblocks the reader if it sits in recv()
+                shutdown(from_, SHUT_RDWR);
+            };
+
+            std::vector<std::thread> threads;
+            for (unsigned i = 0; i < workers; ++i)
+            {
+                threads.emplace_back([&]()
+                                     {
+                                         std::unique_lock<std::mutex> lock(mutex);
+                                         for (;;)
+                                         {
+                                             changed.wait(lock, [&]
+                                                          { return failed || ended || cryptNext < readCount; });
+                                             if (failed || cryptNext == readCount)
+                                                 return;
+                                             Record &record = ring[cryptNext++ % ring.size()];
+                                             lock.unlock();
+                                             bool ok = crypt(record);
+                                             lock.lock();
+                                             record.ok = ok;
+                                             record.state = Record::State::Sealed;
+                                             changed.notify_all();
+                                         } });
+            }
+
+            // Writes records out in order as they are sealed
+            threads.emplace_back([&]()
+                                 {
+                                     std::unique_lock<std::mutex> lock(mutex);
+                                     for (;;)
+                                     {
+                                         Record &record = ring[writeCount % ring.size()];
+                                         changed.wait(lock, [&]
+                                                      { return failed || record.state == Record::State::Sealed ||
+                                                               (ended && writeCount == readCount); });
+                                         if (failed || record.state != Record::State::Sealed)
+                                             return;
+                                         lock.unlock();
+                                         bool ok = record.ok && write(record);
+                                         lock.lock();
+                                         if (!ok)
+                                         {
+                                             fail();
+                                             return;
+                                         }
+                                         record.state = Record::State::Free;
+                                         writeCount++;
+                                         changed.notify_all();
+                                     } });
+
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                Record &record = ring[readCount % ring.size()];
+                changed.wait(lock, [&]
+                             { return failed || record.state == Record::State::Free; });
+                if (failed)
+                    break;
+                lock.unlock();
+                int got = read(record);
+                lock.lock();
+                if (got <= 0)
+                {
+                    ended = true;
+                    if (got < 0)
+                        fail();
+                    changed.notify_all();
+                    break;
+                }
+                record.sequence = readCount++;
+                record.state = Record::State::Read;
+                changed.notify_all();
+            }
+            lock.unlock();
+
+            for (auto &thread : threads)
+                thread.join();
+            return !failed;
+        }
+
+        // 1 with a record, 0 at a clean end, -1 on error
+        int read(Record &record)
+        {
+            return seal_ ? readPlain(record) : readSealed(record);
+        }
+
+        // As much as the local end has, up to a full record
+        int readPlain(Record &record)
+        {
+            ssize_t n;
+            do
+                n = recv(from_, record.payload(), MAX_RECORD, 0);
+            while (n < 0 && errno == EINTR);
+            if (n <= 0)
+                return n == 0 ? 0 : -1;
+
+            record.length = (size_t)n;
+            while (record.length < MAX_RECORD)
+            {
+                n = recv(from_, record.payload() + record.length, MAX_RECORD - record.length, MSG_DONTWAIT);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                record.length += (size_t)n;
+            }
+            return 1;
+        }
+
+        int readSealed(Record &record)
+        {
+            RecordHeader header{};
+            int got = recvWire(&header, sizeof(header), true);
+            if (got <= 0)
+                return got;
+            if (header.length == 0 || header.length > MAX_RECORD)
+            {
+                LOGE("Bad record length %u", header.length);
+                return -1;
+            }
+            record.length = header.length;
+            memcpy(record.buffer.data(), &header, sizeof(header));
+            return recvWire(record.payload(), record.length + kAeadTagSize, false) > 0 ? 1 : -1;
+        }
+
+        // recvAll() that waits out receive timeouts while our own side
+        // still has the connection open: the peer may have nothing to say
+        // for a long time. 0 if the stream ends before the first byte
+        // where `mayEnd`.
+        int recvWire(void *data, size_t len, bool mayEnd)
+        {
+            char *p = static_cast<char *>(data);
+            size_t got = 0;
+            while (got < len)
+            {
+                ssize_t n = recv(from_, p + got, len - got, MSG_WAITALL);
+                if (n > 0)
+                {
+                    got += (size_t)n;
+                    continue;
+                }
+                if (n == 0)
+                {
+                    if (got == 0 && mayEnd)
+                        return 0;
+                    LOGE("Connection ended inside a record");
+                    return -1;
+                }
+                if (errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && !peerDone_))
+                    continue;
+                return -1;
+            }
+            return 1;
+        }
+
+        void nonce(uint64_t sequence, uint8_t out[kAeadNonceSize]) const
+        {
+            memcpy(out, iv_, kAeadNonceSize);
+            for (int i = 0; i < 8; ++i)
+                out[kAeadNonceSize - 1 - i] ^= (uint8_t)(sequence >> (8 * i));
+        }
+
+        bool crypt(Record &record)
+        {
+            uint8_t n[kAeadNonceSize];
+            nonce(record.sequence, n);
+            if (seal_)
+            {
+                RecordHeader header{(uint32_t)record.length};
+                memcpy(record.buffer.data(), &header, sizeof(header));
+                aead_.seal(n, &header, sizeof(header), record.payload(), record.length, record.tag());
+                return true;
+            }
+            if (!aead_.open(n, record.buffer.data(), sizeof(RecordHeader), record.payload(),
+                            record.length, record.tag()))
+            {
+                LOGE("Record %llu failed authentication, closing connection",
+                     (unsigned long long)record.sequence);
+                return false;
+            }
+            return true;
+        }
+
+        bool write(Record &record)
+        {
+            if (seal_)
+                return sendAll(to_, record.buffer.data(),
+                               sizeof(RecordHeader) + record.length + kAeadTagSize, MSG_NOSIGNAL);
+            return sendAll(to_, record.payload(), record.length, MSG_NOSIGNAL);
+        }
+
+        int from_;
+        int to_;
+        bool seal_;
+        Aead aead_;
+        uint8_t iv_[kAeadNonceSize];
+        const std::atomic<bool> &peerDone_;
+    };
+
+    // The two pumps of one connection. Each runs on a detached thread
+    // holding the tunnel; the sockets close when both have finished.
+    class Tunnel : public std::enable_shared_from_this<Tunnel>
+    {
+    public:
+        Tunnel(int wire, int local)
+            : wire_(wire),
+              local_(local),
+              outgoingDone_(false),
+              incomingDone_(false) {}
+
+        ~Tunnel()
+        {
+            close(wire_);
+            close(local_);
+        }
+
+        void start(AeadSuite suite, const DirectionKeys &outgoing, const DirectionKeys &incoming,
+                   bool bulkOutgoing)
+        {
+            unsigned workers = cryptoWorkers();
+            auto out = std::make_shared<RecordPump>(local_, wire_, true, suite, outgoing, incomingDone_);
+            auto in = std::make_shared<RecordPump>(wire_, local_, false, suite, incoming, outgoingDone_);
+
+            std::thread([self = shared_from_this(), out, workers = bulkOutgoing ? workers : 0]()
+                        {
+                            bool ended = out->run(workers);
+                            self->outgoingDone_ = true;
+                            if (ended)
+                                shutdown(self->wire_, SHUT_WR);
+                            else
+                                self->abort(); })
+                .detach();
+            std::thread([self = shared_from_this(), in, workers = bulkOutgoing ? 0 : workers]()
+                        {
+                            bool ended = in->run(workers);
+                            self->incomingDone_ = true;
+                            if (ended)
+                                shutdown(self->local_, SHUT_WR);
+                            else
+                                self->abort(); })
+                .detach();
+        }
+
+    private:
+        // Both directions fail: the local side sees the connection drop
+        void abort()
+        {
+            shutdown(wire_, SHUT_RDWR);
+            shutdown(local_, SHUT_RDWR);
+        }
+
+        int wire_;
+        int local_;
+        std::atomic<bool> outgoingDone_;
+        std::atomic<bool> incomingDone_;
+    };
+
+    uint8_t pickSuite(uint8_t offered)
+    {
+        uint8_t usable = offered & localSuites();
+        if (usable & SUITE_AES_256_GCM)
+            return SUITE_AES_256_GCM;
+        if (usable & SUITE_CHACHA20_POLY1305)
+            return SUITE_CHACHA20_POLY1305;
+        return 0;
+    }
+
+    // An ephemeral key pair; with a pairing secret it starts from the
+    // CPace base point, so only a peer holding the same secret gets the
+    // same X25519 secret
+    bool ephemeralKeypair(const std::string &pairingSecret, uint8_t privateKey[kX25519KeySize],
+                          uint8_t publicKey[kX25519KeySize])
+    {
+        if (pairingSecret.empty())
+            return x25519Keypair(privateKey, publicKey);
+        uint8_t generator[kX25519KeySize];
+        cpaceGenerator(pairingSecret.data(), pairingSecret.size(), generator);
+        bool keyed = x25519Keypair(privateKey, publicKey, generator);
+        wipe(generator, sizeof(generator));
+        return keyed;
+    }
+
+    // Derives both directions' keys and starts the tunnel; returns the
+    // local end
+    int openTunnel(int sock, bool sender, const uint8_t privateKey[kX25519KeySize],
+                   const KeyShare &senderShare, const KeyShare &receiverShare, uint8_t suite)
+    {
+        const KeyShare &peer = sender ? receiverShare : senderShare;
+        uint8_t shared[kX25519KeySize];
+        if (!x25519(shared, privateKey, peer.publicKey))
+        {
+            LOGE("Peer sent an invalid public key");
+            close(sock);
+            return -1;
+        }
+
+        uint8_t prk[kSha256Size];
+        hkdfExtract(nullptr, 0, shared, sizeof(shared), prk);
+        uint8_t info[sizeof(kRecordLabel) - 1 + 2 * sizeof(KeyShare)];
+        memcpy(info, kRecordLabel, sizeof(kRecordLabel) - 1);
+        memcpy(info + sizeof(kRecordLabel) - 1, &senderShare, sizeof(KeyShare));
+        memcpy(info + sizeof(kRecordLabel) - 1 + sizeof(KeyShare), &receiverShare, sizeof(KeyShare));
+        DirectionKeys keys[2];
+        static_assert(sizeof(keys) == 2 * (kAeadKeySize + kAeadNonceSize));
+        hkdfExpand(prk, info, sizeof(info), reinterpret_cast<uint8_t *>(keys), sizeof(keys));
+        wipe(shared, sizeof(shared));
+        wipe(prk, sizeof(prk));
+
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0)
+        {
+            LOGE("socketpair failed (errno=%d)", errno);
+            wipe(keys, sizeof(keys));
+            close(sock);
+            return -1;
+        }
+        int buffer = kLocalBuffer;
+        for (int end : pair)
+            setsockopt(end, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        // The caller's end times out like the TCP socket would have
+        for (int option : {SO_RCVTIMEO, SO_SNDTIMEO})
+        {
+            timeval timeout{};
+            socklen_t len = sizeof(timeout);
+            if (getsockopt(sock, SOL_SOCKET, option, &timeout, &len) == 0)
+                setsockopt(pair[0], SOL_SOCKET, option, &timeout, len);
+        }
+
+        AeadSuite aead = suite == SUITE_AES_256_GCM ? AeadSuite::Aes256Gcm : AeadSuite::ChaCha20Poly1305;
+        const DirectionKeys &outgoing = sender ? keys[0] : keys[1];
+        const DirectionKeys &incoming = sender ? keys[1] : keys[0];
+        std::make_shared<Tunnel>(sock, pair[1])->start(aead, outgoing, incoming, sender);
+        wipe(keys, sizeof(keys));
+
+        LOGI("Encrypted connection: %s", aeadImplementation(aead));
+        return pair[0];
+    }
+}
+
+uint8_t swiftshare::localSuites()
+{
+    return SUITE_CHACHA20_POLY1305 | (aesGcmAccelerated() ? SUITE_AES_256_GCM : 0);
+}
+
+const char *swiftshare::suiteName(uint8_t suite)
+{
+    switch (suite)
+    {
+    case SUITE_AES_256_GCM:
+        return "AES-256-GCM";
+    case SUITE_CHACHA20_POLY1305:
+        return "ChaCha20-Poly1305";
+    default:
+        return "none";
+    }
+}
+
+int swiftshare::connectSecure(int sock, uint8_t suites, const std::string &pairingSecret)
+{
+    KeyShare mine{};
+    mine.suites = (suites ? suites : localSuites()) & localSuites();
+    uint8_t privateKey[kX25519KeySize];
+    if (mine.suites == 0 || !ephemeralKeypair(pairingSecret, privateKey, mine.publicKey))
+    {
+        LOGE("No cipher suite or key to offer");
+        close(sock);
+        return -1;
+    }
+
+    KeyShare theirs{};
+    if (!sendHello(sock, MODE_SECURE) || !sendAll(sock, &mine, sizeof(mine)) ||
+        !recvAll(sock, &theirs, sizeof(theirs)))
+    {
+        LOGE("Key exchange failed");
+        wipe(privateKey, sizeof(privateKey));
+        close(sock);
+        return -1;
+    }
+
+    // Exactly one of the suites offered
+    if ((theirs.suites & mine.suites) != theirs.suites || !std::has_single_bit(theirs.suites))
+    {
+        LOGE("Receiver refused encryption (suites %#x)", theirs.suites);
+        wipe(privateKey, sizeof(privateKey));
+        close(sock);
+        return -1;
+    }
+
+    int local = openTunnel(sock, true, privateKey, mine, theirs, theirs.suites);
+    wipe(privateKey, sizeof(privateKey));
+    return local;
+}
+
+int swiftshare::acceptSecure(int sock, const std::string &pairingSecret)
+{
+    KeyShare theirs{};
+    if (!recvAll(sock, &theirs, sizeof(theirs)))
+    {
+        LOGE("Key share read failed");
+        close(sock);
+        return -1;
+    }
+
+    KeyShare mine{};
+    mine.suites = pickSuite(theirs.suites);
+    uint8_t privateKey[kX25519KeySize];
+    bool keyed = ephemeralKeypair(pairingSecret, privateKey, mine.publicKey);
+    if (!keyed)
+        mine.suites = 0;
+    // A zero answer tells the sender why the connection goes away
+    if (!sendAll(sock, &mine, sizeof(mine)) || mine.suites == 0)
+    {
+        LOGE("Key exchange failed (offered suites %#x)", theirs.suites);
+        wipe(privateKey, sizeof(privateKey));
+        close(sock);
+        return -1;
+    }
+
+    int local = openTunnel(sock, false, privateKey, theirs, mine, mine.suites);
+    wipe(privateKey, sizeof(privateKey));
+    return local;
+}
@@ -0,0 +1,301 @@
+#include "send_pipeline.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "protocol.h"
+#include "net_utils.h"
+#include "compression.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    uint64_t elapsedNs(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - since)
+            .count();
+    }
+}
+
+SendPipeline::SendPipeline(size_t depth, uint32_t chunkSize, PipelineCounters &counters,
+                           Telemetry &telemetry, BufferPool &buffers, unsigned compressWorkers)
+    : slots_(depth < 2 ? 2 : depth),
+      chunkSize_(chunkSize),
+      counters_(counters),
+      telemetry_(telemetry),
+      compressWorkers_(compressWorkers),
+      digests_(false),
+      head_(0),
+      count_(0),
+      abort_(false)
+{
+    size_t frameSize = sizeof(DataChunkHeader) + chunkSize_ + sizeof(ChunkDigest);
+    for (auto &slot : slots_)
+    {
+        memory_.push_back(buffers.reserve(frameSize));
+        slot.frame = memory_.back().data();
+        // Compressed output is capped below chunkSize, so the same size fits
+        slot.packed = nullptr;
+        if (compressWorkers_ > 0)
+        {
+            memory_.push_back(buffers.reserve(frameSize + sizeof(CompressedChunk)));
+            slot.packed = memory_.back().data();
+        }
+        slot.length = 0;
+        slot.packedLength = 0;
+        slot.digest = 0;
+        slot.ready = false;
+    }
+}
+
+SendPipeline::~SendPipeline() = default;
+
+bool SendPipeline::ready() const
+{
+    for (const auto &slot : slots_)
+    {
+        if (!slot.frame || (compressWorkers_ > 0 && !slot.packed))
+            return false;
+    }
+    return true;
+}
+
+void SendPipeline::readerLoop(int fd, uint64_t offset, uint64_t end,
+                              const std::atomic<bool> &cancelled)
+{
+    while (offset < end)
+    {
+        size_t tail;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (count_ == slots_.size() && !abort_)
+            {
+                // Ring full: the socket is the slow side
+                auto start = std::chrono::steady_clock::now();
+                notFull_.wait(lock, [this]
+                              { return count_ < slots_.size() || abort_; });
+                counters_.readerWaits++;
+                counters_.readerWaitNs += elapsedNs(start);
+            }
+            if (abort_)
+                return;
+            tail = (head_ + count_) % slots_.size();
+        }
+
+        Slot &slot = slots_[tail];
+        uint64_t left = end - offset;
+        uint32_t want = left < chunkSize_ ? (uint32_t)left : chunkSize_;
+        char *payload = slot.frame + sizeof(DataChunkHeader);
+
+        uint32_t got = 0;
+        while (got < want && !cancelled)
+        {
+            uint64_t t0 = telemetry_.start();
+            ssize_t n = pread(fd, payload + got, want - got, (off_t)(offset + got));
+            telemetry_.record(Probe::Read, t0, n > 0 ? (uint64_t)n : 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            got += (uint32_t)n;
+        }
+
+        slot.length = got == want ? want : 0;
+        DataChunkHeader hdr{};
+        hdr.length = slot.length;
+        memcpy(slot.frame, &hdr, sizeof(hdr));
+        if (digests_ && slot.length > 0)
+        {
+            // Hash while the payload is still in cache from the read
+            ChunkDigest trailer{xxh3_64(payload, slot.length)};
+            memcpy(payload + slot.length, &trailer, sizeof(trailer));
+            slot.digest = trailer.xxh3;
+        }
+
+        bool compress = compressWorkers_ > 0 && slot.length > 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slot.ready = !compress;
+            if (compress)
+                toCompress_.push_back(tail);
+            count_++;
+        }
+        if (compress)
+            compressReady_.notify_one();
+        else
+            notEmpty_.notify_one();
+
+        if (slot.length == 0)
+            return; // read failed; the sender stops at this slot
+        offset += want;
+    }
+}
+
+void SendPipeline::compressLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        compressReady_.wait(lock, [this]
+                            { return abort_ || !toCompress_.empty(); });
+        if (abort_)
+            return;
+
+        size_t index = toCompress_.front();
+        toCompress_.pop_front();
+        lock.unlock();
+        compress(slots_[index]);
+        lock.lock();
+
+        slots_[index].ready = true;
+        // The socket only waits on the head slot, so wake it for any
+        notEmpty_.notify_one();
+    }
+}
+
+void SendPipeline::compress(Slot &slot)
+{
+    slot.packedLength = 0;
+    const char *payload = slot.frame + sizeof(DataChunkHeader);
+    if (!worthCompressing(payload, slot.length))
+    {
+        counters_.rawChunks++;
+        return;
+    }
+
+    // Not worth the receiver's time unless it saves a sixteenth
+    char *out = slot.packed + sizeof(DataChunkHeader) + sizeof(CompressedChunk);
+    size_t packed = lz4Compress(payload, slot.length, out, slot.length - slot.length / 16);
+    if (packed == 0)
+    {
+        counters_.rawChunks++;
+        return;
+    }
+
+    DataChunkHeader hdr{};
+    hdr.length = CHUNK_COMPRESSED | (uint32_t)packed;
+    CompressedChunk info{};
+    info.rawLength = slot.length;
+    info.codec = CODEC_LZ4;
+    memcpy(slot.packed, &hdr, sizeof(hdr));
+    memcpy(slot.packed + sizeof(hdr), &info, sizeof(info));
+    if (digests_)
+    {
+        ChunkDigest trailer{slot.digest};
+        memcpy(out + packed, &trailer, sizeof(trailer));
+    }
+
+    slot.packedLength = (uint32_t)packed;
+    counters_.compressedChunks++;
+    counters_.compressInBytes += slot.length;
+    counters_.compressOutBytes += packed;
+}
+
+bool SendPipeline::run(int sock, int fd, uint64_t &offset, uint64_t end,
+                       const std::atomic<bool> &cancelled,
+                       const std::function<void(uint32_t, uint32_t)> &onChunk,
+                       FileDigest *digest)
+{
+    if (!ready())
+    {
+        LOGE("Pipeline buffers unavailable");
+        return false;
+    }
+
+    head_ = 0;
+    count_ = 0;
+    abort_ = false;
+    toCompress_.clear();
+    digests_ = digest != nullptr;
+    size_t trailer = digests_ ? sizeof(ChunkDigest) : 0;
+
+    std::thread reader(&SendPipeline::readerLoop, this, fd, offset, end, std::cref(cancelled));
+    std::vector<std::thread> compressors;
+    for (unsigned i = 0; i < compressWorkers_; ++i)
+        compressors.emplace_back(&SendPipeline::compressLoop, this);
+    bool ok = true;
+
+    while (offset < end && !cancelled)
+    {
+        Slot *slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (count_ == 0)
+            {
+                // Nothing read yet: the disk is the slow side
+                auto start = std::chrono::steady_clock::now();
+                notEmpty_.wait(lock, [this, &cancelled]
+                               { return count_ > 0 || cancelled; });
+                counters_.networkWaits++;
+                counters_.networkWaitNs += elapsedNs(start);
+            }
+            if (count_ > 0 && !slots_[head_].ready)
+            {
+                // Read but still compressing: the workers are the slow side
+                auto start = std::chrono::steady_clock::now();
+                notEmpty_.wait(lock, [this, &cancelled]
+                               { return slots_[head_].ready || cancelled; });
+                counters_.compressWaits++;
+                counters_.compressWaitNs += elapsedNs(start);
+            }
+            if (count_ == 0 || !slots_[head_].ready)
+                break;
+            slot = &slots_[head_];
+        }
+
+        if (slot->length == 0)
+        {
+            // The reader also gives up when cancelled; that is not an error
+            if (!cancelled)
+            {
+                LOGE("File read failed at offset %llu", (unsigned long long)offset);
+                ok = false;
+            }
+            break;
+        }
+
+        // Header, payload and digest leave in one send
+        bool packed = slot->packedLength > 0;
+        uint32_t wireBytes = packed ? slot->packedLength : slot->length;
+        size_t headers = sizeof(DataChunkHeader) + (packed ? sizeof(CompressedChunk) : 0);
+        uint64_t t0 = telemetry_.start();
+        bool sent = sendAll(sock, packed ? slot->packed : slot->frame, headers + wireBytes + trailer);
+        telemetry_.record(Probe::Send, t0, headers + wireBytes + trailer);
+        if (!sent)
+        {
+            LOGE("send() failed during data transfer");
+            ok = false;
+            break;
+        }
+
+        if (digest)
+            digest->add(offset, slot->digest);
+        offset += slot->length;
+        onChunk(slot->length, wireBytes);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            head_ = (head_ + 1) % slots_.size();
+            count_--;
+        }
+        notFull_.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_ = true;
+    }
+    notFull_.notify_one();
+    compressReady_.notify_all();
+    reader.join();
+    for (auto &compressor : compressors)
+        compressor.join();
+    return ok;
+}
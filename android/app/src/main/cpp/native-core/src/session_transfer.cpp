@@ -0,0 +1,410 @@
+#include "transfer_engine.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <future>
+#include <memory>
+#include "protocol.h"
+#include "net_utils.h"
+#include "link_tuner.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    struct SessionEntry
+    {
+        std::string path; // sender only
+        std::string name;
+        uint64_t size;
+        uint64_t transferId;
+    };
+
+    // Transfer ID for the resume handshake. Files too small to be
+    // journaled by the receiver skip the hashing and send 0.
+    uint64_t sessionTransferId(const SessionEntry &entry)
+    {
+        if (entry.size < ResumeJournal::kMinFileSize)
+            return 0;
+        int fd = open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return 0;
+        uint64_t id = resumeTransferId(fd, entry.name, entry.size);
+        close(fd);
+        return id;
+    }
+
+    // Confirms the receiver's offer against the local file, 0 if it fails
+    uint64_t acceptSessionOffer(const SessionEntry &entry, const ResumeOffer &offer)
+    {
+        if (offer.offset == 0)
+            return 0;
+        int fd = open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return 0;
+        uint64_t offset = acceptResumeOffer(fd, entry.size, offer);
+        close(fd);
+        return offset;
+    }
+
+    // Opens a file to send and asks the kernel to start reading it, so
+    // the first chunk is warm by the time the previous file has drained.
+    int openForSending(const std::string &path, uint32_t chunkSize)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return -1;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd, 0, chunkSize, POSIX_FADV_WILLNEED);
+        return fd;
+    }
+}
+
+// ===============================
+// Receiver
+// ===============================
+
+bool TransferEngine::receiveSession(TransferSession &session, int client, const HelloPacket &hello,
+                                    SocketReceiver &socketReceiver)
+{
+    uint8_t version = hello.version;
+    SessionManifest manifest{};
+    if (!recvAll(client, &manifest, sizeof(manifest)) ||
+        manifest.fileCount == 0 || manifest.fileCount > MAX_SESSION_FILES ||
+        manifest.chunkSize == 0)
+    {
+        LOGE("Invalid session manifest");
+        return false;
+    }
+
+    std::vector<SessionEntry> entries(manifest.fileCount);
+    uint64_t totalBytes = 0;
+    for (auto &entry : entries)
+    {
+        ManifestEntry me{};
+        if (!recvAll(client, &me, sizeof(me)))
+        {
+            LOGE("manifest entry read failed");
+            return false;
+        }
+        entry.name.resize(me.nameLen);
+        if (me.nameLen > 0 && !recvAll(client, entry.name.data(), me.nameLen))
+        {
+            LOGE("manifest filename read failed");
+            return false;
+        }
+        entry.transferId = 0;
+        if (version >= VERSION_RESUME &&
+            !recvAll(client, &entry.transferId, sizeof(entry.transferId)))
+        {
+            LOGE("manifest transfer ID read failed");
+            return false;
+        }
+        entry.size = me.fileSize;
+        totalBytes += me.fileSize;
+    }
+
+    // Offer what earlier attempts left on disk; the sender confirms each
+    // file's offer or answers 0
+    std::vector<IncomingFile> files(entries.size());
+    std::vector<uint64_t> resumeOffsets(entries.size(), 0);
+    std::vector<ResumeOffer> offers(entries.size());
+    if (version >= VERSION_RESUME)
+    {
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            offerResume(entries[i].transferId, entries[i].size, files[i]);
+            offers[i] = files[i].offer;
+        }
+    }
+
+    // Names for the new outputs are picked while the handshake is on the
+    // wire; a partial file keeps the name it has
+    std::vector<size_t> unnamed;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (files[i].fd < 0)
+        {
+            unnamed.push_back(i);
+            names.push_back(entries[i].name);
+        }
+    }
+    std::future<std::vector<std::string>> reserved;
+    if (receivePaths_.ready() && !names.empty())
+        reserved = std::async(std::launch::async, [this, names = std::move(names)]()
+                              { return receivePaths_.reserve(names); });
+
+    bool handshakeOk;
+    if (version >= VERSION_RESUME)
+    {
+        handshakeOk = sendAll(client, offers.data(), offers.size() * sizeof(ResumeOffer)) &&
+                      recvAll(client, resumeOffsets.data(), resumeOffsets.size() * sizeof(uint64_t));
+    }
+    else
+    {
+        handshakeOk = sendAll(client, resumeOffsets.data(), resumeOffsets.size() * sizeof(uint64_t));
+    }
+
+    if (reserved.valid())
+    {
+        std::vector<std::string> paths = reserved.get();
+        for (size_t k = 0; k < paths.size(); ++k)
+            files[unnamed[k]].path = paths[k];
+    }
+
+    if (!handshakeOk)
+    {
+        LOGE("Session resume handshake failed");
+        for (auto &file : files)
+        {
+            if (file.fd >= 0)
+                close(file.fd);
+        }
+        return false;
+    }
+
+    LOGI("Session: receiving %zu files, %llu bytes",
+         entries.size(), (unsigned long long)totalBytes);
+    session.begin(manifest.fileCount, totalBytes);
+
+    // Resolve and create the next file while the current one drains
+    auto prefetch = [this, &entries, &files, &resumeOffsets](size_t i)
+    {
+        return std::async(std::launch::async, [this, &entries, &files, &resumeOffsets, i]()
+                          { return openResumable(files[i], entries[i].name, resumeOffsets[i]); });
+    };
+
+    std::unique_ptr<ChunkHasher> hasher;
+    if (hello.flags & HELLO_FLAG_DIGESTS)
+        hasher = std::make_unique<ChunkHasher>(ioCounters_);
+
+    std::future<int> next = prefetch(0);
+    uint32_t completed = 0;
+
+    for (size_t i = 0; i < entries.size() && !session.cancelled(); ++i)
+    {
+        int fd = next.get();
+        if (i + 1 < entries.size())
+            next = prefetch(i + 1);
+        if (fd < 0)
+            break;
+
+        const SessionEntry &entry = entries[i];
+        session.beginFile((uint32_t)i, entry.name, entry.size);
+        uint64_t offset = resumeOffsets[i];
+        session.addProgress(offset, 0);
+        session.setPhase(SessionPhase::Transferring);
+
+        ResumeJournal *journal = files[i].journal.get();
+        bool streamOk = receiveChunks(session, client, fd, offset, entry.size,
+                                      manifest.chunkSize, socketReceiver, journal, hasher.get(), -1,
+                                      hello.flags & HELLO_FLAG_COMPRESSION);
+        if (journal)
+            journal->close(fd, offset);
+        close(fd);
+        files[i].fd = -1;
+
+        if (offset == entry.size)
+            completed++;
+        else
+            LOGE("Session file %s incomplete (%llu of %llu bytes)", entry.name.c_str(),
+                 (unsigned long long)offset, (unsigned long long)entry.size);
+
+        if (!streamOk)
+            break;
+    }
+
+    if (next.valid())
+        next.get();
+
+    // Outputs opened by the handshake or the prefetch but never reached
+    for (auto &file : files)
+    {
+        if (file.fd >= 0)
+            close(file.fd);
+    }
+
+    LOGI("Session finished: %u of %zu files complete", completed, entries.size());
+    return true;
+}
+
+// ===============================
+// Sender
+// ===============================
+
+uint32_t TransferEngine::startSenderSession(const std::vector<std::string> &filePaths,
+                                            const std::string &ip,
+                                            uint16_t port,
+                                            const SendJob &job)
+{
+    if (filePaths.empty() || filePaths.size() > MAX_SESSION_FILES)
+        return 0;
+
+    return launchSend(job, [=, this](TransferSession &session)
+                      { sessionSenderThread(session, filePaths, ip, port); });
+}
+
+void TransferEngine::sessionSenderThread(TransferSession &session,
+                                         const std::vector<std::string> &filePaths,
+                                         const std::string &ip,
+                                         uint16_t port)
+{
+    TransferOptions options = sendOptions(ip);
+
+    // Sizes go in the manifest, so stat everything up front
+    std::vector<SessionEntry> entries;
+    uint64_t totalBytes = 0;
+    for (const auto &path : filePaths)
+    {
+        struct stat st{};
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            LOGE("Skipping unreadable file: %s", path.c_str());
+            continue;
+        }
+        entries.push_back({path, path.substr(path.find_last_of('/') + 1), (uint64_t)st.st_size, 0});
+        entries.back().transferId = sessionTransferId(entries.back());
+        totalBytes += st.st_size;
+    }
+
+    if (entries.empty())
+    {
+        LOGE("Session has no readable files");
+        return;
+    }
+
+    int sock = connectPeer(ip, port, options.autoTune ? 0 : kDefaultSocketBuffer, options);
+    if (sock < 0)
+        return;
+    session.setPhase(SessionPhase::Negotiating);
+
+    SendContext sendContext(options, ioCounters_, pipelineCounters_);
+
+    // HELLO + manifest leave in one write
+    std::vector<char> header;
+    auto append = [&header](const void *data, size_t len)
+    {
+        const char *p = static_cast<const char *>(data);
+        header.insert(header.end(), p, p + len);
+    };
+
+    HelloPacket hello{};
+    memcpy(hello.magic, MAGIC, 4);
+    hello.version = VERSION;
+    hello.mode = MODE_SESSION;
+    hello.flags = sendContext.helloFlags();
+    append(&hello, sizeof(hello));
+
+    SessionManifest manifest{};
+    manifest.fileCount = (uint32_t)entries.size();
+    manifest.chunkSize = options.chunkSize;
+    manifest.totalBytes = totalBytes;
+    append(&manifest, sizeof(manifest));
+
+    for (const auto &entry : entries)
+    {
+        ManifestEntry me{};
+        me.fileSize = entry.size;
+        me.nameLen = (uint16_t)entry.name.size();
+        append(&me, sizeof(me));
+        append(entry.name.data(), me.nameLen);
+        append(&entry.transferId, sizeof(entry.transferId));
+    }
+
+    std::vector<ResumeOffer> offers(entries.size());
+    if (!sendAll(sock, header.data(), header.size()) ||
+        !recvAll(sock, offers.data(), offers.size() * sizeof(ResumeOffer)))
+    {
+        LOGE("Session handshake failed");
+        close(sock);
+        return;
+    }
+
+    std::vector<uint64_t> resumeOffsets(entries.size(), 0);
+    for (size_t i = 0; i < entries.size(); ++i)
+        resumeOffsets[i] = acceptSessionOffer(entries[i], offers[i]);
+    if (!sendAll(sock, resumeOffsets.data(), resumeOffsets.size() * sizeof(uint64_t)))
+    {
+        LOGE("Failed to confirm resume offsets");
+        close(sock);
+        return;
+    }
+
+    LOGI("Session: sending %zu files, %llu bytes",
+         entries.size(), (unsigned long long)totalBytes);
+    session.begin(manifest.fileCount, totalBytes);
+
+    auto prefetch = [&entries, &options](size_t i)
+    {
+        return std::async(std::launch::async, [&entries, &options, i]()
+                          { return openForSending(entries[i].path, options.chunkSize); });
+    };
+
+    std::future<int> next = prefetch(0);
+    auto start = std::chrono::steady_clock::now();
+    size_t sent = 0;
+
+    std::unique_ptr<LinkTuner> tuner;
+    if (options.autoTune)
+        tuner = std::make_unique<LinkTuner>(std::vector<int>{sock}, options.chunkSize, session);
+
+    for (size_t i = 0; i < entries.size() && !session.cancelled(); ++i)
+    {
+        int fd = next.get();
+        if (i + 1 < entries.size())
+            next = prefetch(i + 1);
+
+        const SessionEntry &entry = entries[i];
+        session.beginFile((uint32_t)i, entry.name, entry.size);
+        uint64_t offset = resumeOffsets[i];
+        session.addProgress(offset, 0);
+        session.setPhase(SessionPhase::Transferring);
+
+        // An unreadable file is sent as empty; the receiver sees it short
+        bool ok = true;
+        if (fd >= 0)
+        {
+            ok = sendChunks(session, sock, fd, offset, entry.size, options.chunkSize, sendContext);
+            close(fd);
+        }
+        else
+        {
+            LOGE("Failed to open file: %s", entry.path.c_str());
+        }
+
+        if (!ok || session.cancelled() || !sendEndOfFile(sock, sendContext))
+        {
+            LOGE("Session aborted at file %zu", i);
+            break;
+        }
+        if (offset == entry.size)
+            sent++;
+    }
+
+    if (next.valid())
+    {
+        int fd = next.get();
+        if (fd >= 0)
+            close(fd);
+    }
+    if (tuner)
+    {
+        tuner->finish();
+        rememberLink(session, ip, tuner->tuning());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOGI("Session sent %zu of %zu files (%.1f MB) in %.2f s",
+         sent, entries.size(), session.progress().bytesTransferred / (1024.0 * 1024.0), seconds);
+
+    close(sock);
+}
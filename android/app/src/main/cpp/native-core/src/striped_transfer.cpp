@@ -0,0 +1,409 @@
+#include "transfer_engine.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include "protocol.h"
+#include "chunk_bitmap.h"
+#include "net_utils.h"
+#include "link_tuner.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // How long the receiver waits for the remaining streams to join
+    constexpr int kJoinTimeoutMs = 10000;
+}
+
+// ===============================
+// Receiver
+// ===============================
+
+bool TransferEngine::receiveStriped(TransferSession &session, int client, const HelloPacket &hello)
+{
+    FileMeta meta{};
+    std::string filename;
+    int fd = openIncomingFile(session, client, meta, filename);
+    if (fd < 0)
+        return false;
+
+    StripeOpen stripe{};
+    if (!recvAll(client, &stripe, sizeof(stripe)) ||
+        stripe.streamCount == 0 || stripe.streamCount > MAX_STREAMS ||
+        meta.chunkSize == 0)
+    {
+        LOGE("Invalid StripeOpen");
+        close(fd);
+        return false;
+    }
+
+    // Size the file up front so every stream can pwrite at its offset;
+    // the blocks are reserved too, as streams fill it in any order
+    if (ftruncate(fd, (off_t)meta.fileSize) < 0 || !preallocate(fd, 0, meta.fileSize))
+    {
+        LOGE("Failed to size output file");
+        close(fd);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stripeMutex_);
+        if (!stripeJoins_.emplace(stripe.transferId, std::vector<int>()).second)
+        {
+            LOGE("Duplicate stripe transfer ID");
+            close(fd);
+            return false;
+        }
+    }
+
+    // Striped transfers always start from scratch
+    uint64_t resumeOffset = 0;
+    if (!sendAll(client, &resumeOffset, sizeof(resumeOffset)))
+    {
+        LOGE("Failed to send resume offset");
+        std::lock_guard<std::mutex> lock(stripeMutex_);
+        stripeJoins_.erase(stripe.transferId);
+        close(fd);
+        return false;
+    }
+
+    // Joins arrive through the event loop and are parked in stripeJoins_
+    std::vector<int> streams{client};
+    {
+        std::unique_lock<std::mutex> lock(stripeMutex_);
+        std::vector<int> &joined = stripeJoins_[stripe.transferId];
+        stripeJoined_.wait_for(lock, std::chrono::milliseconds(kJoinTimeoutMs), [&]
+                               { return (int)joined.size() + 1 >= stripe.streamCount || session.cancelled(); });
+        streams.insert(streams.end(), joined.begin(), joined.end());
+        stripeJoins_.erase(stripe.transferId);
+    }
+
+    LOGI("Striped receive of %s over %zu/%u streams",
+         filename.c_str(), streams.size(), stripe.streamCount);
+
+    size_t chunkCount = (meta.fileSize + meta.chunkSize - 1) / meta.chunkSize;
+    ChunkBitmap bitmap(chunkCount);
+
+    session.setPhase(SessionPhase::Transferring);
+    bool digests = hello.flags & HELLO_FLAG_DIGESTS;
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < streams.size(); ++i)
+    {
+        workers.emplace_back([this, &session, sock = streams[i], fd, &meta, &bitmap, digests]()
+                             { receiveStripe(session, sock, fd, meta, bitmap, digests); });
+    }
+    receiveStripe(session, client, fd, meta, bitmap, digests);
+
+    for (auto &worker : workers)
+        worker.join();
+    for (size_t i = 1; i < streams.size(); ++i)
+        close(streams[i]);
+    close(fd);
+
+    if (bitmap.complete())
+        LOGI("Striped receive complete: %zu chunks", chunkCount);
+    else
+        LOGE("Striped receive incomplete: %zu of %zu chunks", bitmap.count(), chunkCount);
+
+    return true;
+}
+
+// Hands a MODE_STRIPE_JOIN connection to the receiveStriped waiting for
+// its transfer ID, or rejects it.
+void TransferEngine::joinStripe(int client)
+{
+    StripeJoin join{};
+    bool ok = recvAll(client, &join, sizeof(join));
+
+    std::lock_guard<std::mutex> lock(stripeMutex_);
+    auto it = ok ? stripeJoins_.find(join.transferId) : stripeJoins_.end();
+    ok = it != stripeJoins_.end();
+
+    uint8_t status = ok ? STATUS_OK : STATUS_ERROR;
+    if (!sendAll(client, &status, sizeof(status)) || !ok)
+    {
+        LOGE("Rejected stream that is not part of this transfer");
+        close(client);
+        return;
+    }
+    it->second.push_back(client);
+    stripeJoined_.notify_all();
+}
+
+bool TransferEngine::receiveStripe(TransferSession &session, int sock, int fd,
+                                   const FileMeta &meta, ChunkBitmap &bitmap, bool digests)
+{
+    TransferOptions options = getOptions();
+    SocketReceiver socketReceiver(options.zeroCopyReceive, options.ioUring && !options.directWrite,
+                                  ioCounters_);
+
+    // Each stream checks the chunks it carried; one bad chunk fails the file
+    std::unique_ptr<ChunkHasher> hasher;
+    if (digests)
+    {
+        hasher = std::make_unique<ChunkHasher>(ioCounters_);
+        hasher->reset(fd, 0);
+    }
+
+    bool streamOk = false;
+    bool ended = false;
+    ChunkDigest digest{};
+    Telemetry &telemetry = ioCounters_.telemetry;
+    // Payloads come straight off the socket; only framing is buffered
+    FrameReader frames(sock, false, telemetry);
+    while (!session.cancelled())
+    {
+        uint64_t chunkStart = telemetry.start();
+        OffsetChunkHeader hdr{};
+        if (!frames.read(&hdr, sizeof(hdr)))
+            break;
+
+        if (hdr.length == 0)
+        {
+            ended = !hasher || frames.read(&digest, sizeof(digest));
+            streamOk = ended;
+            break;
+        }
+
+        // Chunks must line up with the bitmap and stay inside the file
+        uint64_t expected = meta.fileSize - hdr.offset < meta.chunkSize
+                                ? meta.fileSize - hdr.offset
+                                : meta.chunkSize;
+        if (hdr.offset % meta.chunkSize != 0 ||
+            hdr.offset >= meta.fileSize ||
+            hdr.length != expected)
+        {
+            LOGE("Bad chunk header: offset=%llu length=%u",
+                 (unsigned long long)hdr.offset, hdr.length);
+            break;
+        }
+
+        if (!socketReceiver.receiveRange(sock, fd, hdr.offset, hdr.length))
+            break;
+
+        if (hasher)
+        {
+            // The next header or the end marker follows
+            if (!frames.read(&digest, sizeof(digest), sizeof(OffsetChunkHeader)))
+                break;
+            hasher->verify(hdr.offset, hdr.length, digest.xxh3);
+            if (hasher->failed())
+                break;
+        }
+
+        // A chunk resent after a stream failure is only counted once
+        if (bitmap.set(hdr.offset / meta.chunkSize))
+            session.addProgress(hdr.length);
+        telemetry.record(Probe::Chunk, chunkStart, hdr.length);
+    }
+
+    if (!hasher)
+        return streamOk;
+    bool verified = settleDigests(session, *hasher, ended ? &digest : nullptr);
+    return streamOk && verified;
+}
+
+// ===============================
+// Sender
+// ===============================
+
+void TransferEngine::stripedSenderThread(TransferSession &session,
+                                         const std::string &filePath,
+                                         const std::string &ip,
+                                         uint16_t port,
+                                         uint16_t streamCount)
+{
+    TransferOptions options = sendOptions(ip);
+
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        LOGE("Failed to open file: %s", filePath.c_str());
+        return;
+    }
+
+    struct stat st{};
+    fstat(fd, &st);
+    uint64_t fileSize = st.st_size;
+
+    std::string filename =
+        filePath.substr(filePath.find_last_of('/') + 1);
+
+    session.begin(1, fileSize);
+    session.beginFile(0, filename, fileSize);
+
+    int socketBuffer = options.autoTune ? 0 : kDefaultSocketBuffer;
+    int primary = connectPeer(ip, port, socketBuffer, options);
+    if (primary < 0)
+    {
+        close(fd);
+        return;
+    }
+    session.setPhase(SessionPhase::Negotiating);
+
+    FileMeta meta{};
+    meta.fileSize = fileSize;
+    meta.nameLen = filename.size();
+    meta.chunkSize = options.chunkSize;
+
+    StripeOpen stripe{};
+    stripe.transferId = std::random_device{}() | ((uint64_t)std::random_device{}() << 32);
+    stripe.streamCount = streamCount;
+
+    uint64_t resumeOffset = 0;
+    uint16_t helloFlags = options.chunkDigests ? HELLO_FLAG_DIGESTS : 0;
+    if (!sendHello(primary, MODE_STRIPE_OPEN, helloFlags) ||
+        !sendAll(primary, &meta, sizeof(meta)) ||
+        !sendAll(primary, filename.data(), filename.size()) ||
+        !sendAll(primary, &stripe, sizeof(stripe)) ||
+        !recvAll(primary, &resumeOffset, sizeof(resumeOffset)))
+    {
+        LOGE("Striped handshake failed");
+        close(primary);
+        close(fd);
+        return;
+    }
+
+    // Streams that fail to join are skipped; the rest share their chunks
+    std::vector<int> socks{primary};
+    for (uint16_t i = 1; i < streamCount; ++i)
+    {
+        int sock = connectPeer(ip, port, socketBuffer, options);
+        if (sock < 0)
+            continue;
+
+        StripeJoin join{stripe.transferId};
+        uint8_t status = STATUS_ERROR;
+        if (!sendHello(sock, MODE_STRIPE_JOIN) ||
+            !sendAll(sock, &join, sizeof(join)) ||
+            !recvAll(sock, &status, sizeof(status)) ||
+            status != STATUS_OK)
+        {
+            LOGE("Stream %u failed to join", i);
+            close(sock);
+            continue;
+        }
+        socks.push_back(sock);
+    }
+
+    LOGI("Striping %s over %zu streams", filename.c_str(), socks.size());
+    session.setPhase(SessionPhase::Transferring);
+
+    // Streams pull the next chunk index as they become free, so a slow
+    // stream simply carries fewer chunks. Chunks from a failed stream go
+    // back on the retry list for the survivors.
+    uint64_t chunkCount = (fileSize + meta.chunkSize - 1) / meta.chunkSize;
+    std::atomic<uint64_t> nextChunk{0};
+    std::mutex retryMutex;
+    std::vector<uint64_t> retry;
+
+    auto takeChunk = [&](uint64_t &index) -> bool
+    {
+        {
+            std::lock_guard<std::mutex> lock(retryMutex);
+            if (!retry.empty())
+            {
+                index = retry.back();
+                retry.pop_back();
+                return true;
+            }
+        }
+        index = nextChunk.fetch_add(1);
+        return index < chunkCount;
+    };
+
+    auto streamLoop = [&](int sock)
+    {
+        FileSender fileSender(options.zeroCopySend, meta.chunkSize, ioCounters_);
+        std::unique_ptr<ChunkHasher> hasher;
+        if (options.chunkDigests)
+        {
+            hasher = std::make_unique<ChunkHasher>(ioCounters_);
+            hasher->reset(fd, 0);
+        }
+        FileDigest streamDigest;
+        uint64_t index = 0;
+        bool failed = false;
+
+        while (!session.cancelled() && takeChunk(index))
+        {
+            uint64_t chunkStart = ioCounters_.telemetry.start();
+            OffsetChunkHeader hdr{};
+            hdr.offset = index * meta.chunkSize;
+            uint64_t left = fileSize - hdr.offset;
+            hdr.length = left < meta.chunkSize ? (uint32_t)left : meta.chunkSize;
+
+            // Hashed on the hasher's thread while the payload goes out
+            if (hasher)
+                hasher->request(hdr.offset, hdr.length);
+
+            // The header leaves with the payload and the digest is held
+            // back for the next header, which always follows
+            ChunkDigest digest{};
+            if (!fileSender.sendRange(sock, fd, hdr.offset, hdr.length, &hdr, sizeof(hdr)) ||
+                (hasher && (!hasher->next(digest.xxh3) ||
+                            !sendAll(sock, &digest, sizeof(digest), MSG_MORE))))
+            {
+                LOGE("Stream failed at offset %llu", (unsigned long long)hdr.offset);
+                std::lock_guard<std::mutex> lock(retryMutex);
+                retry.push_back(index);
+                failed = true;
+                break;
+            }
+            if (hasher)
+                streamDigest.add(hdr.offset, digest.xxh3);
+            session.addProgress(hdr.length);
+            ioCounters_.telemetry.record(Probe::Chunk, chunkStart, hdr.length);
+        }
+
+        if (!failed)
+        {
+            char frame[sizeof(OffsetChunkHeader) + sizeof(ChunkDigest)] = {};
+            ChunkDigest digest{streamDigest.value};
+            memcpy(frame + sizeof(OffsetChunkHeader), &digest, sizeof(digest));
+            sendAll(sock, frame, hasher ? sizeof(frame) : sizeof(OffsetChunkHeader));
+        }
+    };
+
+    // One probe over all streams; they share the path
+    std::unique_ptr<LinkTuner> tuner;
+    if (options.autoTune)
+        tuner = std::make_unique<LinkTuner>(socks, meta.chunkSize, session);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < socks.size(); ++i)
+        workers.emplace_back(streamLoop, socks[i]);
+    streamLoop(primary);
+    for (auto &worker : workers)
+        worker.join();
+    if (tuner)
+    {
+        tuner->finish();
+        rememberLink(session, ip, tuner->tuning());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (retry.empty() && !session.cancelled())
+    {
+        LOGI("Striped send completed: %.1f MB in %.2f s over %zu streams",
+             fileSize / (1024.0 * 1024.0), seconds, socks.size());
+    }
+    else
+    {
+        LOGE("Striped send incomplete: %zu chunks undelivered", retry.size());
+    }
+
+    for (int sock : socks)
+        close(sock);
+    close(fd);
+}
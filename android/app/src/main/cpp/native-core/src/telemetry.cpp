@@ -0,0 +1,291 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr uint32_t kTraceVersion = 1;
+    constexpr uint32_t kTraceRecordSize = 32;
+    constexpr size_t kMaxTraceRecords = 1 << 22; // 128 MB on disk
+
+    // Small per-thread number: picks the shard and tags trace records
+    uint32_t threadIndex()
+    {
+        static std::atomic<uint32_t> next{0};
+        thread_local uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    size_t bucketOf(uint64_t ns, size_t buckets)
+    {
+        size_t bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+        return bucket < buckets ? bucket : buckets - 1;
+    }
+
+    // Smallest value above everything bucket `b` holds
+    uint64_t bucketLimit(size_t b)
+    {
+        return b >= 63 ? UINT64_MAX : (1ull << b);
+    }
+
+    void put32(std::vector<uint8_t> &out, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+            out.push_back((uint8_t)(v >> (8 * i)));
+    }
+
+    void put64(std::vector<uint8_t> &out, uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+            out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+const char *swiftshare::probeName(Probe probe)
+{
+    switch (probe)
+    {
+    case Probe::Recv:
+        return "recv";
+    case Probe::Send:
+        return "send";
+    case Probe::Read:
+        return "read";
+    case Probe::Write:
+        return "write";
+    case Probe::Chunk:
+        return "chunk";
+    case Probe::JsQueue:
+        return "jsQueue";
+    case Probe::Count:
+        break;
+    }
+    return "unknown";
+}
+
+Telemetry::Telemetry()
+    : enabled_(false),
+      tracing_(false),
+      shards_(new Shard[kShards]),
+      ringSize_(0),
+      head_(0)
+{
+    reset();
+}
+
+Telemetry::~Telemetry() = default;
+
+void Telemetry::enable(bool on, size_t traceRecords)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (on && traceRecords > 0 && !ring_)
+    {
+        size_t size = 1;
+        while (size < std::min(traceRecords, kMaxTraceRecords))
+            size <<= 1;
+        ring_.reset(new TraceRecord[size]);
+        for (size_t i = 0; i < size; ++i)
+            ring_[i].sequence.store(0, std::memory_order_relaxed);
+        ringSize_ = size;
+        head_.store(0, std::memory_order_relaxed);
+    }
+    // Released so a writer that sees tracing_ also sees the ring
+    tracing_.store(on && traceRecords > 0 && ring_, std::memory_order_release);
+    enabled_.store(on, std::memory_order_release);
+}
+
+Telemetry::Shard &Telemetry::shard()
+{
+    return shards_[threadIndex() % kShards];
+}
+
+void Telemetry::record(Probe probe, uint64_t startNs, uint64_t bytes)
+{
+    if (startNs == 0)
+        return;
+    recordSpan(probe, startNs, now() - startNs, bytes);
+}
+
+void Telemetry::recordSpan(Probe probe, uint64_t startNs, uint64_t durationNs, uint64_t bytes)
+{
+    if (startNs == 0 || !enabled())
+        return;
+
+    size_t p = (size_t)probe;
+    Shard &s = shard();
+    s.buckets[p][bucketOf(durationNs, kBuckets)].fetch_add(1, std::memory_order_relaxed);
+    s.totalNs[p].fetch_add(durationNs, std::memory_order_relaxed);
+    uint64_t seen = s.maxNs[p].load(std::memory_order_relaxed);
+    while (durationNs > seen &&
+           !s.maxNs[p].compare_exchange_weak(seen, durationNs, std::memory_order_relaxed))
+    {
+    }
+    if (durationNs > kStallNs)
+        s.stalls[p].fetch_add(1, std::memory_order_relaxed);
+
+    if (tracing_.load(std::memory_order_acquire))
+        trace(probe, startNs, durationNs, bytes);
+}
+
+void Telemetry::trace(Probe probe, uint64_t startNs, uint64_t durationNs, uint64_t bytes)
+{
+    uint64_t claim = head_.fetch_add(1, std::memory_order_relaxed);
+    TraceRecord &r = ring_[claim & (ringSize_ - 1)];
+
+    r.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.startNs.store(startNs, std::memory_order_relaxed);
+    r.durationNs.store(durationNs, std::memory_order_relaxed);
+    r.bytes.store(bytes, std::memory_order_relaxed);
+    r.tag.store((uint64_t)threadIndex() << 8 | (uint64_t)probe, std::memory_order_relaxed);
+    r.sequence.store(claim + 1, std::memory_order_release);
+}
+
+void Telemetry::shortRead()
+{
+    if (enabled())
+        shard().shortReads.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::shortWrite()
+{
+    if (enabled())
+        shard().shortWrites.fetch_add(1, std::memory_order_relaxed);
+}
+
+TelemetryStats Telemetry::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    TelemetryStats out{};
+    out.enabled = enabled();
+
+    for (size_t p = 0; p < kProbes; ++p)
+    {
+        uint64_t buckets[kBuckets] = {};
+        LatencySummary &l = out.latency[p];
+        for (size_t i = 0; i < kShards; ++i)
+        {
+            const Shard &s = shards_[i];
+            for (size_t b = 0; b < kBuckets; ++b)
+                buckets[b] += s.buckets[p][b].load(std::memory_order_relaxed);
+            l.totalNs += s.totalNs[p].load(std::memory_order_relaxed);
+            l.maxNs = std::max(l.maxNs, s.maxNs[p].load(std::memory_order_relaxed));
+            l.stalls += s.stalls[p].load(std::memory_order_relaxed);
+        }
+        for (size_t b = 0; b < kBuckets; ++b)
+            l.count += buckets[b];
+        if (l.count == 0)
+            continue;
+
+        // The open-ended top bucket reports the real maximum instead
+        auto percentile = [&](double q)
+        {
+            uint64_t rank = (uint64_t)(q * (l.count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t b = 0; b < kBuckets; ++b)
+            {
+                seen += buckets[b];
+                if (seen >= rank)
+                    return b + 1 < kBuckets ? std::min(bucketLimit(b), l.maxNs) : l.maxNs;
+            }
+            return l.maxNs;
+        };
+        l.p50Ns = percentile(0.50);
+        l.p90Ns = percentile(0.90);
+        l.p99Ns = percentile(0.99);
+    }
+
+    for (size_t i = 0; i < kShards; ++i)
+    {
+        out.shortReads += shards_[i].shortReads.load(std::memory_order_relaxed);
+        out.shortWrites += shards_[i].shortWrites.load(std::memory_order_relaxed);
+    }
+    out.traceRecords = ring_ ? head_.load(std::memory_order_relaxed) : 0;
+    out.traceCapacity = ringSize_;
+    return out;
+}
+
+void Telemetry::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < kShards; ++i)
+    {
+        Shard &s = shards_[i];
+        for (size_t p = 0; p < kProbes; ++p)
+        {
+            for (size_t b = 0; b < kBuckets; ++b)
+                s.buckets[p][b].store(0, std::memory_order_relaxed);
+            s.totalNs[p].store(0, std::memory_order_relaxed);
+            s.maxNs[p].store(0, std::memory_order_relaxed);
+            s.stalls[p].store(0, std::memory_order_relaxed);
+        }
+        s.shortReads.store(0, std::memory_order_relaxed);
+        s.shortWrites.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool Telemetry::dumpTrace(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ring_)
+        return false;
+
+    // Only the last ringSize_ claims can still be in the ring
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t first = head > ringSize_ ? head - ringSize_ : 0;
+
+    std::vector<uint8_t> records;
+    records.reserve((head - first) * kTraceRecordSize);
+    uint64_t count = 0;
+    for (uint64_t claim = first; claim < head; ++claim)
+    {
+        const TraceRecord &r = ring_[claim & (ringSize_ - 1)];
+        uint64_t sequence = r.sequence.load(std::memory_order_acquire);
+        if (sequence != claim + 1)
+            continue; // not written yet, or already overwritten
+        uint64_t startNs = r.startNs.load(std::memory_order_relaxed);
+        uint64_t durationNs = r.durationNs.load(std::memory_order_relaxed);
+        uint64_t bytes = r.bytes.load(std::memory_order_relaxed);
+        uint64_t tag = r.tag.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (r.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        put64(records, startNs);
+        put64(records, durationNs);
+        put64(records, bytes);
+        put32(records, (uint32_t)(tag >> 8));
+        put32(records, (uint32_t)(tag & 0xff));
+        count++;
+    }
+
+    std::vector<uint8_t> header;
+    const char magic[8] = {'S', 'S', 'T', 'R', 'A', 'C', 'E', '\0'};
+    header.insert(header.end(), magic, magic + sizeof(magic));
+    put32(header, kTraceVersion);
+    put32(header, kTraceRecordSize);
+    put64(header, count);
+    put64(header, now());
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        LOGE("Cannot write trace to %s", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), f) == header.size() &&
+              fwrite(records.data(), 1, records.size(), f) == records.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        LOGE("Trace write to %s failed", path.c_str());
+    else
+        LOGI("Trace: %llu records written to %s", (unsigned long long)count, path.c_str());
+    return ok;
+}
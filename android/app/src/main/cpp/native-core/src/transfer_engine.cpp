@@ -6,32 +6,136 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <cstring>
 #include <vector>
 #include <thread>
 #include <chrono>
 #include <errno.h>
+#include <time.h>
+#include <memory>
+#include <algorithm>
 #include "protocol.h"
+#include "zero_copy.h"
+#include "net_utils.h"
+#include "event_loop.h"
+#include "compression.h"
+#include "delta_sync.h"
+#include "link_tuner.h"
+#include "secure_channel.h"
 
 #define LOG_TAG "SwiftShare"
-#include <android/log.h>
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#include "log.h"
 
 using namespace swiftshare;
 
+namespace
+{
+    double threadCpuSeconds()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    // Chunks chained per io_uring submission when no pipeline depth is set
+    constexpr size_t kUringBatch = 8;
+
+    // Chunk digests the sendfile path asks for ahead of the socket
+    constexpr size_t kHashAhead = 4;
+
+    // Minimum ring depth of the compressing pipeline, so every worker has
+    // a chunk while the socket drains another
+    constexpr size_t kCompressDepth = 8;
+
+    // Reads a few windows spread over [offset, end) and asks the entropy
+    // estimate whether compressing the file is likely to pay off. Media
+    // and archives fail here and keep the zero-copy path.
+    bool sampleCompressible(int fd, uint64_t offset, uint64_t end)
+    {
+        constexpr uint64_t kWindows = 4;
+        constexpr size_t kWindow = 16 * 1024;
+
+        std::vector<char> sample(kWindows * kWindow);
+        size_t sampled = 0;
+        for (uint64_t w = 0; w < kWindows; ++w)
+        {
+            uint64_t pos = offset + (end - offset) * w / kWindows;
+            size_t want = end - pos < kWindow ? (size_t)(end - pos) : kWindow;
+            ssize_t n = pread(fd, sample.data() + sampled, want, (off_t)pos);
+            if (n > 0)
+                sampled += (size_t)n;
+        }
+        return worthCompressing(sample.data(), sampled);
+    }
+
+    // Writes a payload of `length` bytes that comes through `frames`
+    bool receiveBuffered(FrameReader &frames, SocketReceiver &socketReceiver, int fd,
+                         uint64_t offset, size_t length)
+    {
+        while (length > 0)
+        {
+            size_t n = 0;
+            const char *data = frames.take(length, n);
+            if (!data)
+            {
+                LOGE("Peer closed connection mid-chunk");
+                return false;
+            }
+            if (!socketReceiver.writeRange(fd, offset, data, n))
+                return false;
+            offset += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    // Room for a full set of stripe joins plus a few independent senders
+    constexpr int kListenBacklog = 16;
+}
+
 TransferEngine::TransferEngine()
-    : bytesTransferred_(0),
-      totalBytes_(0),
+    : progress_(sessions_),
       cancelled_(false),
       receiving_(false),
       pathResolver_(nullptr),
-      currentFileName_(""),
-      currentFileSize_(0) {}
+      udpCounters_(std::make_shared<UdpCounters>()),
+      wakeFd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      activeConnections_(0),
+      activeSends_(0),
+      stopping_(false)
+{
+    scheduler_.setLimits(options_.maxActiveSends, options_.sendRateLimit);
+}
 
 TransferEngine::~TransferEngine()
 {
+    {
+        std::lock_guard<std::mutex> lock(sendsMutex_);
+        stopping_ = true;
+    }
+    sendsChanged_.notify_all();
     cancel();
+
+    // Every thread of the engine uses its members to the end, so all of
+    // them finish before any member goes. The receiver waits for its
+    // connections itself; UDP connections it handed out run on after it.
+    if (receiver_.joinable())
+        receiver_.join();
+    {
+        std::unique_lock<std::mutex> lock(connectionsMutex_);
+        connectionsDone_.wait(lock, [this]
+                              { return activeConnections_ == 0; });
+    }
+    {
+        std::unique_lock<std::mutex> lock(sendsMutex_);
+        sendsChanged_.wait(lock, [this]
+                           { return activeSends_ == 0; });
+    }
+
+    if (wakeFd_ >= 0)
+        close(wakeFd_);
 }
 
 void TransferEngine::setPathResolver(PathResolverCallback resolver)
@@ -39,9 +143,110 @@ void TransferEngine::setPathResolver(PathResolverCallback resolver)
     pathResolver_ = resolver;
 }
 
+bool TransferEngine::setReceiveDirectory(const std::string &directory)
+{
+    return receivePaths_.setDirectory(directory);
+}
+
+void TransferEngine::setResumeDirectory(const std::string &directory)
+{
+    std::lock_guard<std::mutex> lock(optionsMutex_);
+    resumeDirectory_ = directory;
+}
+
 void TransferEngine::cancel()
 {
     cancelled_ = true;
+    sessions_.cancelAll();
+    scheduler_.wake();
+
+    // Wake the receiver's event loop and any stripe waiting for joins
+    uint64_t one = 1;
+    if (wakeFd_ >= 0)
+        write(wakeFd_, &one, sizeof(one));
+    std::lock_guard<std::mutex> lock(stripeMutex_);
+    stripeJoined_.notify_all();
+}
+
+bool TransferEngine::cancelSession(uint32_t sessionId)
+{
+    std::shared_ptr<TransferSession> session = sessions_.find(sessionId);
+    if (!session)
+        return false;
+    session->cancel();
+    scheduler_.wake();
+
+    // A striped receive may still be waiting for its joins
+    std::lock_guard<std::mutex> lock(stripeMutex_);
+    stripeJoined_.notify_all();
+    return true;
+}
+
+void TransferEngine::setOptions(const TransferOptions &options)
+{
+    {
+        std::lock_guard<std::mutex> lock(optionsMutex_);
+        options_ = options;
+    }
+    scheduler_.setLimits(options.maxActiveSends, options.sendRateLimit);
+    ioCounters_.buffers.setBudget(options.bufferBudget);
+}
+
+bool TransferEngine::setSessionPriority(uint32_t sessionId, int priority)
+{
+    return scheduler_.setPriority(sessionId, priority);
+}
+
+bool TransferEngine::setSessionRateLimit(uint32_t sessionId, uint64_t bytesPerSecond)
+{
+    return scheduler_.setRateLimit(sessionId, bytesPerSecond);
+}
+
+TransferOptions TransferEngine::getOptions() const
+{
+    std::lock_guard<std::mutex> lock(optionsMutex_);
+    return options_;
+}
+
+uint16_t TransferEngine::capabilities() const
+{
+    uint16_t caps = CAP_STRIPED | CAP_SESSION | CAP_TREE | CAP_DELTA | CAP_COMPRESSION |
+                    CAP_DIGESTS | CAP_RESUME | CAP_ENCRYPTION | CAP_RELIABLE_UDP;
+    if (getOptions().encryption)
+        caps |= CAP_ENCRYPTION_REQUIRED;
+    if (localSuites() & SUITE_AES_256_GCM)
+        caps |= CAP_AES_GCM;
+    return caps;
+}
+
+IoStats TransferEngine::getIoStats() const
+{
+    BufferPoolStats buffers = ioCounters_.buffers.stats();
+    return IoStats{ioCounters_.zeroCopyBytes.load(),
+                   ioCounters_.copiedBytes.load(),
+                   pipelineCounters_.networkWaits.load(),
+                   pipelineCounters_.networkWaitNs.load(),
+                   pipelineCounters_.readerWaits.load(),
+                   pipelineCounters_.readerWaitNs.load(),
+                   pipelineCounters_.compressWaits.load(),
+                   pipelineCounters_.compressWaitNs.load(),
+                   ioCounters_.uringBytes.load(),
+                   ioCounters_.uringSubmits.load(),
+                   ioCounters_.hashedBytes.load(),
+                   ioCounters_.digestFailures.load(),
+                   pipelineCounters_.compressedChunks.load(),
+                   pipelineCounters_.rawChunks.load(),
+                   pipelineCounters_.compressInBytes.load(),
+                   pipelineCounters_.compressOutBytes.load(),
+                   ioCounters_.deltaReusedBytes.load(),
+                   udpCounters_->packetsSent.load(),
+                   udpCounters_->retransmits.load(),
+                   udpCounters_->paritySent.load(),
+                   udpCounters_->recovered.load(),
+                   buffers.allocated,
+                   buffers.peakInUse,
+                   buffers.waits,
+                   buffers.rejected};
 }
 
 bool TransferEngine::startReceiver(uint16_t port)
@@ -54,10 +259,10 @@ bool TransferEngine::startReceiver(uint16_t port)
         return true; // already running
     }
 
-    bytesTransferred_ = 0;
-    totalBytes_ = 0;
-
-    std::thread(&TransferEngine::receiverThread, this, port).detach();
+    // A receiver stopped by cancel() has finished or is about to
+    if (receiver_.joinable())
+        receiver_.join();
+    receiver_ = std::thread(&TransferEngine::receiverThread, this, port);
     return true;
 }
 
@@ -74,6 +279,11 @@ void TransferEngine::receiverThread(uint16_t port)
     int yes = 1;
     setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
 
+    // Accepted sockets inherit the buffer, and setting it before listen()
+    // lets the window scale offered in the SYN-ACK cover all of it
+    int receiveBuffer = kDefaultSocketBuffer;
+    setsockopt(server, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
@@ -87,7 +297,7 @@ void TransferEngine::receiverThread(uint16_t port)
         return;
     }
 
-    if (listen(server, 4) < 0)
+    if (listen(server, kListenBacklog) < 0)
     {
         LOGE("listen failed");
         close(server);
@@ -95,191 +305,736 @@ void TransferEngine::receiverThread(uint16_t port)
         return;
     }
 
-    // Make server socket non-blocking to allow cancel
+    // Accepts are driven by epoll; the socket must never block the loop
     int flags = fcntl(server, F_GETFL, 0);
     fcntl(server, F_SETFL, flags | O_NONBLOCK);
 
-    while (!cancelled_)
+    EventLoop loop;
+    if (!loop.valid())
+    {
+        close(server);
+        receiving_ = false;
+        return;
+    }
+
+    // cancel() writes to wakeFd_; draining it lets the loop re-check
+    loop.add(wakeFd_, EPOLLIN, [this](uint32_t)
+             {
+                 uint64_t count;
+                 while (read(wakeFd_, &count, sizeof(count)) > 0)
+                 {
+                 } });
+    loop.add(server, EPOLLIN, [this, server, &loop](uint32_t)
+             { acceptConnections(server, loop); });
+
+    // Reliable UDP on the same port number; TCP alone if it is taken
+    UdpListener udp;
+    if (udp.open(port))
+        loop.add(udp.fd(), EPOLLIN, [this, &udp, &loop](uint32_t)
+                 {
+                     TransferOptions options = getOptions();
+                     udp.accept(UdpSettings{options.udpFecGroup, options.udpImpairment}, udpCounters_,
+                                [this, &loop](int local)
+                                { watchConnection(local, loop); }); });
+
+    LOGI("Receiver listening on port %u", port);
+    loop.run([this]
+             { return !cancelled_; });
+
+    loop.remove(server);
+    close(server);
+    if (udp.fd() >= 0)
+        loop.remove(udp.fd());
+
+    // Connections notice the cancel between chunks
+    {
+        std::unique_lock<std::mutex> lock(connectionsMutex_);
+        connectionsDone_.wait(lock, [this]
+                              { return activeConnections_ == 0; });
+    }
+    receiving_ = false;
+}
+
+// Accepts everything pending on the listening socket. Each connection
+// is watched until its HELLO arrives, so an idle peer holds no thread.
+void TransferEngine::acceptConnections(int server, EventLoop &loop)
+{
+    for (;;)
     {
-        int client = accept(server, nullptr, nullptr);
+        int client = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
         if (client < 0)
         {
-            // EAGAIN/EWOULDBLOCK -> no pending connections
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (errno == EINTR)
                 continue;
-            }
-            LOGE("accept failed");
-            break;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOGE("accept failed (errno=%d)", errno);
+            return;
         }
 
         // Disable Nagle to reduce latency for control + data mixing
         int nodelay = 1;
         setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
+        watchConnection(client, loop);
+    }
+}
+
+void TransferEngine::watchConnection(int client, EventLoop &loop)
+{
+    bool watched = loop.add(client, EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+                            [this, client, &loop](uint32_t)
+                            {
+                                loop.remove(client);
+                                serveConnection(client);
+                            });
+    if (!watched)
+        close(client);
+}
+
+// Runs one connection on its own thread; the blocking data plane stays
+// as it is while other senders connect in parallel. A sender that goes
+// quiet for kSocketTimeoutSeconds is dropped, so a vanished or stalled
+// peer does not hold the thread and its buffers for good.
+void TransferEngine::serveConnection(int client)
+{
+    setSocketTimeouts(client);
+
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        activeConnections_++;
+    }
+
+    std::thread([this, client]()
+                {
+                    {
+                        // One pipe pair / ring reused for every chunk of every file
+                        TransferOptions options = getOptions();
+                        SocketReceiver socketReceiver(options.zeroCopyReceive,
+                                                      options.ioUring && !options.directWrite, ioCounters_);
+                        handleConnection(client, socketReceiver);
+                    }
+
+                    // Nothing of the engine is touched past this point
+                    std::lock_guard<std::mutex> lock(connectionsMutex_);
+                    activeConnections_--;
+                    connectionsDone_.notify_all(); })
+        .detach();
+}
+
+// Returns true if a file transfer took place on this connection.
+bool TransferEngine::handleConnection(int client, SocketReceiver &socketReceiver, bool secured)
+{
+    HelloPacket hello{};
+    if (!recvAll(client, &hello, sizeof(hello)))
+    {
+        LOGE("hello read failed");
+        close(client);
+        return false;
+    }
+
+    if (memcmp(hello.magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        LOGE("Bad HELLO magic, dropping connection");
+        close(client);
+        return false;
+    }
+
+    TransferOptions options = getOptions();
+    if (hello.mode == MODE_SECURE && !secured)
+    {
+        int inner = acceptSecure(client, options.pairingSecret);
+        if (inner < 0)
+            return false;
+        return handleConnection(inner, socketReceiver, true);
+    }
+    if (options.encryption && !secured)
+    {
+        LOGE("Plaintext connection refused (encryption required)");
+        close(client);
+        return false;
+    }
+
+    if (hello.mode == MODE_STRIPE_JOIN)
+    {
+        // The stripe owner takes the socket over
+        joinStripe(client);
+        return false;
+    }
+
+    // Every other mode is a receive with its own session
+    std::shared_ptr<TransferSession> session = sessions_.create(SessionDirection::Receive);
+    session->setPhase(SessionPhase::Negotiating);
+    progress_.wake();
+
+    bool handled = false;
+    switch (hello.mode)
+    {
+    case MODE_SEND:
         // Handle a single file transfer per connection
-        HelloPacket hello{};
-        if (recv(client, &hello, sizeof(hello), MSG_WAITALL) != sizeof(hello))
+        handled = receiveFile(*session, client, hello, socketReceiver);
+        break;
+    case MODE_STRIPE_OPEN:
+        handled = receiveStriped(*session, client, hello);
+        break;
+    case MODE_SESSION:
+        handled = receiveSession(*session, client, hello, socketReceiver);
+        break;
+    case MODE_TREE:
+        handled = receiveTree(*session, client, hello, socketReceiver);
+        break;
+    default:
+        LOGE("Unexpected HELLO mode %u", hello.mode);
+        break;
+    }
+
+    close(client);
+    completeSession(*session);
+    return handled;
+}
+
+// Settles a finished session. Callers polling without a session ID get
+// a moment to see progress = 1.0 before the session stops being latest().
+void TransferEngine::completeSession(TransferSession &session)
+{
+    session.finish();
+    progress_.wake();
+    LOGI("Session %u (%s) %s", session.id(),
+         sessionDirectionName(session.direction()), sessionStateName(session.state()));
+
+    if (session.state() == SessionState::Completed)
+    {
+        std::unique_lock<std::mutex> lock(sendsMutex_);
+        sendsChanged_.wait_for(lock, std::chrono::milliseconds(1000), [this]
+                               { return stopping_; });
+    }
+    sessions_.retire(session);
+    // Nothing left running: give the cached buffers back to the system
+    if (!sessions_.latest())
+        ioCounters_.buffers.trim();
+}
+
+// Reads FileMeta + filename.
+bool TransferEngine::readFileMeta(int client, FileMeta &meta, std::string &filename)
+{
+    if (!recvAll(client, &meta, sizeof(meta)))
+    {
+        LOGE("meta read failed");
+        return false;
+    }
+
+    // Read filename with proper UTF-8 handling
+    std::vector<char> filenameBuf(meta.nameLen + 1, '\0');
+    if (!recvAll(client, filenameBuf.data(), meta.nameLen))
+    {
+        LOGE("filename read failed");
+        return false;
+    }
+    filenameBuf[meta.nameLen] = '\0'; // Ensure null-termination
+    filename = filenameBuf.data();
+
+    LOGI("Received file metadata: %s (%llu bytes, nameLen=%u)", filename.c_str(), (unsigned long long)meta.fileSize, meta.nameLen);
+    return true;
+}
+
+// Reads FileMeta + filename, resolves the output path and opens it.
+// Returns the file descriptor or -1.
+int TransferEngine::openIncomingFile(TransferSession &session, int client,
+                                     FileMeta &meta, std::string &filename)
+{
+    if (!readFileMeta(client, meta, filename))
+        return -1;
+
+    std::string outPath;
+    int fd = openOutputFile(filename, outPath);
+    if (fd < 0)
+        return -1;
+
+    session.begin(1, meta.fileSize);
+    session.beginFile(0, filename, meta.fileSize);
+    return fd;
+}
+
+// Resolves where `filename` should be saved and creates it.
+int TransferEngine::openOutputFile(const std::string &filename, std::string &outPath)
+{
+    // Native names are created exclusively, so a name taken since the
+    // directory was indexed is skipped rather than overwritten
+    if (receivePaths_.ready())
+    {
+        int fd = receivePaths_.create(filename, outPath);
+        if (fd >= 0)
+            LOGI("Saving to: %s", outPath.c_str());
+        return fd;
+    }
+
+    if (pathResolver_)
+    {
+        outPath = pathResolver_(filename);
+    }
+    else
+    {
+        LOGE("No path resolver set!");
+        return -1;
+    }
+
+    if (outPath.empty())
+    {
+        LOGE("Failed to resolve output path");
+        return -1;
+    }
+
+    LOGI("Saving to: %s", outPath.c_str());
+
+    // Use O_TRUNC to avoid leftover bytes if a file with the same name exists
+    int fd = open(outPath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOGE("file open failed: %s", outPath.c_str());
+    }
+    return fd;
+}
+
+bool TransferEngine::receiveFile(TransferSession &session, int client, const HelloPacket &hello,
+                                 SocketReceiver &socketReceiver)
+{
+    FileMeta meta{};
+    std::string filename;
+    if (!readFileMeta(client, meta, filename))
+        return false;
+
+    // Senders that cannot confirm an offer, such as version 1, always start at 0
+    IncomingFile file;
+    uint64_t resumeOffset = 0;
+    if (hello.flags & HELLO_FLAG_RESUME)
+    {
+        ResumeRequest request{};
+        if (!sendHello(client, MODE_SEND, HELLO_FLAG_RESUME) ||
+            !recvAll(client, &request, sizeof(request)))
         {
-            LOGE("hello read failed");
-            close(client);
-            continue;
+            LOGE("resume request read failed");
+            return false;
         }
+        offerResume(request.transferId, meta.fileSize, file);
 
-        FileMeta meta{};
-        if (recv(client, &meta, sizeof(meta), MSG_WAITALL) != sizeof(meta))
+        if (!sendAll(client, &file.offer, sizeof(file.offer)) ||
+            !recvAll(client, &resumeOffset, sizeof(resumeOffset)))
         {
-            LOGE("meta read failed");
-            close(client);
-            continue;
+            LOGE("Resume handshake failed");
+            if (file.fd >= 0)
+                close(file.fd);
+            return false;
         }
+    }
+    else if (!sendAll(client, &resumeOffset, sizeof(resumeOffset)))
+    {
+        LOGE("Failed to send resume offset");
+        return false;
+    }
+
+    int fd = openResumable(file, filename, resumeOffset);
+    if (fd < 0)
+        return false;
+
+    LOGI("Resuming at offset %llu, starting to receive data...", (unsigned long long)resumeOffset);
+
+    session.begin(1, meta.fileSize);
+    session.beginFile(0, filename, meta.fileSize);
+    session.addProgress(resumeOffset, 0);
+    double cpuStart = threadCpuSeconds();
+
+    std::unique_ptr<ChunkHasher> hasher;
+    if (hello.flags & HELLO_FLAG_DIGESTS)
+        hasher = std::make_unique<ChunkHasher>(ioCounters_);
 
-        // Read filename with proper UTF-8 handling
-        std::vector<char> filenameBuf(meta.nameLen + 1, '\0');
-        if (recv(client, filenameBuf.data(), meta.nameLen, MSG_WAITALL) != meta.nameLen)
+    // A fresh start may rebuild the file from an older copy of it
+    int basisFd = -1;
+    if ((hello.flags & HELLO_FLAG_DELTA) && resumeOffset == 0 &&
+        !offerDeltaBasis(session, client, file.path, filename, basisFd))
+    {
+        close(fd);
+        return false;
+    }
+
+    session.setPhase(SessionPhase::Transferring);
+    uint64_t offset = resumeOffset;
+    bool received = receiveChunks(session, client, fd, offset, meta.fileSize, meta.chunkSize,
+                                  socketReceiver, file.journal.get(), hasher.get(), basisFd,
+                                  hello.flags & HELLO_FLAG_COMPRESSION);
+    if (file.journal)
+        file.journal->close(fd, offset);
+    if (basisFd >= 0)
+        close(basisFd);
+
+    uint64_t receivedBytes = offset - resumeOffset;
+    if (receivedBytes > 0)
+    {
+        LOGI("Received %.1f MB via %s, CPU %.3f s/GB (%llu zero-copy / %llu copied total)",
+             receivedBytes / (1024.0 * 1024.0),
+             socketReceiver.usingIoUring() ? "io_uring" : socketReceiver.usingSplice() ? "splice" : "copy",
+             (threadCpuSeconds() - cpuStart) * (1024.0 * 1024.0 * 1024.0) / receivedBytes,
+             (unsigned long long)ioCounters_.zeroCopyBytes.load(),
+             (unsigned long long)ioCounters_.copiedBytes.load());
+    }
+
+    close(fd);
+    // The journal keeps what arrived for a later resume
+    if (!received)
+    {
+        session.fail();
+        return false;
+    }
+    return true;
+}
+
+// Finds the journal of an earlier, interrupted receive of this transfer
+// and reopens its partial file. Without one the offer stays at 0 and the
+// output is created later by openResumable().
+void TransferEngine::offerResume(uint64_t transferId, uint64_t fileSize, IncomingFile &file)
+{
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(optionsMutex_);
+        directory = resumeDirectory_;
+    }
+    if (directory.empty() || fileSize < ResumeJournal::kMinFileSize)
+        return;
+
+    file.journal = std::make_unique<ResumeJournal>(directory, transferId, fileSize);
+    if (!file.journal->load())
+        return;
+
+    // The partial file keeps the name it got on the first attempt
+    file.fd = open(file.journal->partialPath().c_str(), O_RDWR | O_CLOEXEC);
+    if (file.fd < 0)
+    {
+        LOGI("Partial file %s is gone, starting over", file.journal->partialPath().c_str());
+        return;
+    }
+    file.path = file.journal->partialPath();
+    file.offer = file.journal->verify(file.fd);
+}
+
+// Opens the output for data starting at `offset`, which is either the
+// offer made by offerResume() or 0. Returns the file descriptor or -1.
+int TransferEngine::openResumable(IncomingFile &file, const std::string &filename, uint64_t offset)
+{
+    if (offset != 0 && offset != file.offer.offset)
+    {
+        LOGE("Sender accepted offset %llu that was never offered", (unsigned long long)offset);
+        if (file.fd >= 0)
+            close(file.fd);
+        file.fd = -1;
+        return -1;
+    }
+
+    if (file.fd >= 0 && offset == 0)
+    {
+        // Sender's data differs from the partial file; reuse its name
+        if (ftruncate(file.fd, 0) != 0)
         {
-            LOGE("filename read failed");
-            close(client);
-            continue;
+            close(file.fd);
+            file.fd = -1;
         }
-        filenameBuf[meta.nameLen] = '\0'; // Ensure null-termination
-        std::string filename(filenameBuf.data());
+    }
 
-        LOGI("Received file metadata: %s (%llu bytes, nameLen=%u)", filename.c_str(), (unsigned long long)meta.fileSize, meta.nameLen);
+    if (file.fd < 0)
+        file.fd = openOutputFile(filename, file.path);
+
+    if (file.fd >= 0 && file.journal && !file.journal->start(file.path, offset))
+        file.journal.reset();
+    return file.fd;
+}
+
+// Receives DataChunkHeader frames into `fd` starting at `offset` until
+// the zero-length end marker. `offset` is advanced past every byte
+// written; the file is complete when it reaches `fileSize`. Returns false
+// if the stream itself broke and the connection cannot be reused.
+// `journal`, if any, commits the received prefix as it grows.
+// With a `hasher` the frames carry digests (see protocol.h) and `offset`
+// only covers chunks that verified; a mismatch fails the session.
+// Copy frames are served from `basisFd`, and refused without one.
+// `mayCompress` says whether the sender's hello allowed compressed frames.
+bool TransferEngine::receiveChunks(TransferSession &session, int client, int fd,
+                                   uint64_t &offset, uint64_t fileSize, uint32_t chunkSize,
+                                   SocketReceiver &socketReceiver, ResumeJournal *journal,
+                                   ChunkHasher *hasher, int basisFd, bool mayCompress)
+{
+    if (hasher)
+        hasher->reset(fd, offset);
+
+    uint64_t written = offset;
+    bool streamOk = false;
+    bool ended = false;
+    ChunkDigest digest{};
+    Telemetry &telemetry = ioCounters_.telemetry;
+
+    // Chunks read back for verification stay cached until they are
+    TransferOptions options = getOptions();
+    WriteScheduler writes(fd, offset, fileSize, options.cacheWindow, options.directWrite && !hasher);
+
+    // Where payloads are copied through user space anyway, they come
+    // through the frame reader's buffer with the framing around them.
+    // That needs a stream whose length is known from the file size, so
+    // no compressed or copy frames, and unaligned buffers rule out
+    // O_DIRECT.
+    bool buffered = !mayCompress && basisFd < 0 && !writes.direct() &&
+                    !socketReceiver.usingSplice() && !socketReceiver.usingIoUring();
+    FrameReader frames(client, buffered, telemetry);
+    size_t endFrame = sizeof(DataChunkHeader) + (hasher ? sizeof(ChunkDigest) : 0);
+
+    while (!session.cancelled())
+    {
+        // Turnaround includes the wait for the header, so it shows the
+        // sender's pace as well as our own
+        uint64_t chunkStart = telemetry.start();
+        DataChunkHeader hdr{};
 
-        std::string outPath;
-        if (pathResolver_)
+        // Read full header; zero length signals transfer end
+        frames.setBound(fileSize - written + endFrame);
+        if (!frames.read(&hdr, sizeof(hdr)))
+            break;
+
+        if (hdr.length == 0)
         {
-            outPath = pathResolver_(filename);
+            ended = !hasher || frames.read(&digest, sizeof(digest));
+            streamOk = ended;
+            break;
         }
-        else
+
+        // Compressed frames carry their decompressed size separately;
+        // copy frames carry no payload at all
+        uint32_t length = hdr.length;
+        uint32_t wireLength = hdr.length;
+        uint32_t maxLength = chunkSize;
+        CompressedChunk info{};
+        DeltaCopy copy{};
+        bool compressed = hdr.length & CHUNK_COMPRESSED;
+        bool copied = !compressed && (hdr.length & CHUNK_COPY);
+        if (compressed)
         {
-            LOGE("No path resolver set!");
-            close(client);
-            continue;
+            if (!frames.read(&info, sizeof(info)))
+                break;
+            wireLength = hdr.length & ~CHUNK_COMPRESSED;
+            length = info.rawLength;
+            if (info.codec != CODEC_LZ4 || wireLength > chunkSize)
+            {
+                LOGE("Unsupported compressed chunk (codec %u, %u bytes)", info.codec, wireLength);
+                break;
+            }
         }
-
-        if (outPath.empty())
+        else if (copied)
         {
-            LOGE("Failed to resolve output path");
-            close(client);
-            continue;
+            if (!frames.read(&copy, sizeof(copy)))
+                break;
+            length = hdr.length & ~CHUNK_COPY;
+            wireLength = 0;
+            maxLength = kDeltaMaxBlock;
+            if (basisFd < 0)
+            {
+                LOGE("Copy frame without a delta basis");
+                break;
+            }
         }
 
-        LOGI("Saving to: %s", outPath.c_str());
-
-        // Store current file info
+        if (length == 0 || length > maxLength || length > fileSize - written)
         {
-            std::lock_guard<std::mutex> lock(fileInfoMutex_);
-            currentFileName_ = filename;
-            currentFileSize_ = meta.fileSize;
+            LOGE("Chunk of %u bytes overruns file at offset %llu",
+                 length, (unsigned long long)written);
+            break;
         }
 
-        // Use O_TRUNC to avoid leftover bytes if a file with the same name exists
-        int fd = open(outPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
-        if (fd < 0)
+        bool received = compressed ? socketReceiver.receiveCompressed(client, fd, written, wireLength, length)
+                        : copied   ? socketReceiver.copyFromFile(basisFd, copy.basisOffset, fd, written, length)
+                        : buffered ? receiveBuffered(frames, socketReceiver, fd, written, length)
+                                   : socketReceiver.receiveRange(client, fd, written, length);
+        if (!received)
         {
-            LOGE("file open failed: %s", outPath.c_str());
-            close(client);
-            continue;
+            LOGE("Chunk receive failed at offset %llu", (unsigned long long)written);
+            break;
         }
 
-        off_t existing = lseek(fd, 0, SEEK_END);
-        uint64_t resumeOffset = existing;
-
-        if (send(client, &resumeOffset, sizeof(resumeOffset), 0) != sizeof(resumeOffset))
+        if (hasher)
         {
-            LOGE("Failed to send resume offset");
-            close(fd);
-            close(client);
-            continue;
+            // Checked on the hasher's thread while the next chunk arrives.
+            // A header always follows, so it is read along.
+            if (!frames.read(&digest, sizeof(digest), sizeof(DataChunkHeader)))
+                break;
+            hasher->verify(written, length, digest.xxh3);
+            if (hasher->failed())
+                break;
         }
 
-        LOGI("Sent resume offset: %llu, starting to receive data...", (unsigned long long)resumeOffset);
-
-        bytesTransferred_ = resumeOffset;
-        totalBytes_ = meta.fileSize;
-
-        while (!cancelled_ && bytesTransferred_ < totalBytes_)
-        {
-            DataChunkHeader hdr{};
+        written += length;
+        session.addProgress(length, wireLength);
+        if (copied)
+            ioCounters_.deltaReusedBytes += length;
+        if (journal)
+            journal->advance(fd, hasher ? hasher->verifiedEnd() : written);
+        writes.advance(hasher ? hasher->verifiedEnd() : written);
+        telemetry.record(Probe::Chunk, chunkStart, length);
+    }
 
-            // Read full header; zero length signals transfer end
-            if (recv(client, &hdr, sizeof(hdr), MSG_WAITALL) != sizeof(hdr))
-                break;
+    if (!hasher)
+    {
+        offset = written;
+        return streamOk;
+    }
 
-            if (hdr.length == 0)
-                break;
+    bool verified = settleDigests(session, *hasher, ended ? &digest : nullptr);
+    offset = hasher->verifiedEnd();
+    return streamOk && verified;
+}
 
-            if (hdr.length > meta.chunkSize)
-                break;
+bool TransferEngine::settleDigests(TransferSession &session, ChunkHasher &hasher,
+                                   const ChunkDigest *streamDigest)
+{
+    session.setPhase(SessionPhase::Verifying);
+    bool verified = hasher.drain();
+    if (verified && streamDigest && streamDigest->xxh3 != hasher.fileDigest())
+    {
+        LOGE("Stream digest mismatch");
+        ioCounters_.digestFailures++;
+        verified = false;
+    }
+    if (!verified)
+        session.fail();
+    return verified;
+}
 
-            std::vector<char> buffer(hdr.length);
+int TransferEngine::connectPeer(const std::string &ip, uint16_t port, int socketBuffer,
+                                const TransferOptions &options)
+{
+    int sock = options.reliableUdp
+                   ? connectUdp(ip, port, UdpSettings{options.udpFecGroup, options.udpImpairment}, udpCounters_)
+                   : connectToReceiver(ip, port, socketBuffer);
+    if (sock < 0 || !options.encryption)
+        return sock;
+    return connectSecure(sock, options.encryptionSuites, options.pairingSecret);
+}
 
-            if (recv(client, buffer.data(), hdr.length, MSG_WAITALL) != (ssize_t)hdr.length)
-                break;
+TransferOptions TransferEngine::sendOptions(const std::string &ip) const
+{
+    TransferOptions options = getOptions();
+    if (options.autoTune)
+    {
+        std::lock_guard<std::mutex> lock(linksMutex_);
+        auto it = linkChunkSizes_.find(ip);
+        if (it != linkChunkSizes_.end())
+            options.chunkSize = it->second;
+    }
+    // A chunk has to fit one pool buffer, a compressed one together with
+    // what it decodes to
+    options.chunkSize = (uint32_t)std::min<size_t>(options.chunkSize, ioCounters_.buffers.largest() / 2);
+    return options;
+}
 
-            ssize_t written = 0;
-            while (written < (ssize_t)hdr.length)
-            {
-                ssize_t w = write(fd, buffer.data() + written, hdr.length - written);
-                if (w <= 0)
-                    break;
-                written += w;
-            }
+void TransferEngine::rememberLink(const TransferSession &session, const std::string &ip,
+                                  const LinkTuning &tuning)
+{
+    // A capped or held send measured the scheduler, not the link
+    if (!tuning.settled || scheduler_.throttled(session.id()))
+        return;
+    std::lock_guard<std::mutex> lock(linksMutex_);
+    linkChunkSizes_[ip] = tuning.preferredChunkSize;
+}
 
-            bytesTransferred_ += hdr.length;
-        }
+// Calls without a session ID read the newest session still in flight
+std::shared_ptr<TransferSession> TransferEngine::resolveSession(uint32_t sessionId) const
+{
+    return sessionId == 0 ? sessions_.latest() : sessions_.find(sessionId);
+}
 
-        close(fd);
-        close(client);
+double TransferEngine::getProgress(uint32_t sessionId) const
+{
+    std::shared_ptr<TransferSession> session = resolveSession(sessionId);
+    return session ? session->fileProgress() : 0.0;
+}
 
-        // Don't reset immediately - let JS detect completion (progress = 1.0)
-        // Wait briefly, then reset for next transfer
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        bytesTransferred_ = 0;
-        totalBytes_ = 0;
+SessionProgress TransferEngine::getSessionProgress(uint32_t sessionId) const
+{
+    std::shared_ptr<TransferSession> session = resolveSession(sessionId);
+    return session ? session->progress() : SessionProgress{0, 0, 0, 0};
+}
 
-        // Clear file info
-        {
-            std::lock_guard<std::mutex> lock(fileInfoMutex_);
-            currentFileName_.clear();
-            currentFileSize_ = 0;
-        }
-    }
+bool TransferEngine::getSessionStats(uint32_t sessionId, SessionStats &stats) const
+{
+    std::shared_ptr<TransferSession> session = sessions_.find(sessionId);
+    if (!session)
+        return false;
+    stats = session->stats();
+    return true;
+}
 
-    close(server);
-    receiving_ = false;
+std::vector<SessionStats> TransferEngine::listSessions() const
+{
+    return sessions_.list();
 }
 
-double TransferEngine::getProgress() const
+void TransferEngine::setProgressListener(ProgressListener listener, double rateHz)
 {
-    if (totalBytes_ == 0)
-        return 0.0;
-    return (double)bytesTransferred_ / (double)totalBytes_;
+    progress_.setListener(std::move(listener), rateHz);
 }
 
-bool TransferEngine::startSender(const std::string &filePath,
-                                 const std::string &ip,
-                                 uint16_t port)
+std::shared_ptr<ProgressBoard> TransferEngine::progressBoard()
 {
-    cancelled_ = false;
-    bytesTransferred_ = 0;
-    totalBytes_ = 0;
+    return progress_.board();
+}
 
-    std::thread([=]()
-                { this->senderThread(filePath, ip, port); })
+uint32_t TransferEngine::launchSend(const SendJob &job, std::function<void(TransferSession &)> send)
+{
+    std::shared_ptr<TransferSession> session = sessions_.create(SessionDirection::Send);
+    TransferSession *paced = session.get();
+    session->setPacer([this, paced](uint64_t wireBytes)
+                      { scheduler_.pace(*paced, wireBytes); });
+    scheduler_.add(*session, job);
+    progress_.wake();
+    {
+        std::lock_guard<std::mutex> lock(sendsMutex_);
+        activeSends_++;
+    }
+    std::thread([this, session, send]()
+                {
+                    if (scheduler_.admit(*session))
+                        send(*session);
+                    scheduler_.remove(*session);
+                    completeSession(*session);
+
+                    std::lock_guard<std::mutex> lock(sendsMutex_);
+                    activeSends_--;
+                    sendsChanged_.notify_all(); })
         .detach();
 
-    return true;
+    return session->id();
+}
+
+uint32_t TransferEngine::startSender(const std::string &filePath,
+                                     const std::string &ip,
+                                     uint16_t port,
+                                     const SendJob &job)
+{
+    // Stripe only when every stream gets a few chunks; otherwise the
+    // extra handshakes cost more than they win.
+    TransferOptions options = sendOptions(ip);
+    uint16_t streams = options.streams > MAX_STREAMS ? MAX_STREAMS : options.streams;
+    struct stat st{};
+    bool striped = streams > 1 &&
+                   stat(filePath.c_str(), &st) == 0 &&
+                   (uint64_t)st.st_size >= (uint64_t)streams * options.chunkSize * 4;
+
+    return launchSend(job, [=, this](TransferSession &session)
+                      {
+                          if (striped)
+                              stripedSenderThread(session, filePath, ip, port, streams);
+                          else
+                              senderThread(session, filePath, ip, port); });
 }
 
-void TransferEngine::senderThread(const std::string &filePath,
+void TransferEngine::senderThread(TransferSession &session,
+                                  const std::string &filePath,
                                   const std::string &ip,
                                   uint16_t port)
 {
-    using namespace swiftshare;
+    TransferOptions options = sendOptions(ip);
 
     // 1️⃣ Open file
     int fd = open(filePath.c_str(), O_RDONLY);
@@ -292,67 +1047,31 @@ void TransferEngine::senderThread(const std::string &filePath,
     struct stat st{};
     fstat(fd, &st);
     uint64_t fileSize = st.st_size;
-    totalBytes_ = fileSize;
 
     // Extract filename
     std::string filename =
         filePath.substr(filePath.find_last_of('/') + 1);
 
-    // 2️⃣ Create socket
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0)
-    {
-        LOGE("socket() failed");
-        close(fd);
-        return;
-    }
-
-    // Disable Nagle to reduce latency for control + data mixing
-    int nodelay = 1;
-    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    session.begin(1, fileSize);
+    session.beginFile(0, filename, fileSize);
 
-    // Optional speed tuning (safe)
-    int bufSize = 8 * 1024 * 1024;
-    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
-    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
-
-    // Set socket timeouts to prevent indefinite blocking
-    struct timeval timeout;
-    timeout.tv_sec = 30; // 30 second timeout
-    timeout.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr(ip.c_str());
-    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
-    {
-        LOGE("Invalid IP address");
-        close(sock);
-        close(fd);
-        return;
-    }
-    // 3️⃣ Connect
-    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+    // 2️⃣ Create socket and 3️⃣ connect
+    int sock = connectPeer(ip, port, options.autoTune ? 0 : kDefaultSocketBuffer, options);
+    if (sock < 0)
     {
-        LOGE("connect() failed");
-        close(sock);
         close(fd);
         return;
     }
 
     LOGI("Sender connected to receiver");
+    session.setPhase(SessionPhase::Negotiating);
 
-    // 4️⃣ Send HELLO
-    HelloPacket hello{};
-    memcpy(hello.magic, MAGIC, 4);
-    hello.version = VERSION;
-    hello.mode = MODE_SEND;
-    hello.reserved = 0;
+    SendContext sendContext(options, ioCounters_, pipelineCounters_);
 
-    if (send(sock, &hello, sizeof(hello), 0) != sizeof(hello))
+    // 4️⃣ Send HELLO
+    uint16_t helloFlags = sendContext.helloFlags() | HELLO_FLAG_RESUME |
+                          (options.deltaSync ? HELLO_FLAG_DELTA : 0);
+    if (!sendHello(sock, MODE_SEND, helloFlags))
     {
         LOGE("Failed to send HELLO packet");
         close(sock);
@@ -363,7 +1082,7 @@ void TransferEngine::senderThread(const std::string &filePath,
     FileMeta meta{};
     meta.fileSize = fileSize;
     meta.nameLen = filename.size();
-    meta.chunkSize = 256 * 1024; // 256 KB
+    meta.chunkSize = options.chunkSize;
 
     if (send(sock, &meta, sizeof(meta), 0) != sizeof(meta))
     {
@@ -381,84 +1100,303 @@ void TransferEngine::senderThread(const std::string &filePath,
         return;
     }
 
-    LOGI("Sent file metadata, waiting for resume offset...");
+    LOGI("Sent file metadata, waiting for resume offer...");
 
-    uint64_t resumeOffset = 0;
-    if (recv(sock, &resumeOffset, sizeof(resumeOffset), MSG_WAITALL) != sizeof(resumeOffset))
+    // The receiver echoes HELLO_FLAG_RESUME in a HELLO of its own; a
+    // version 1 receiver sends the same 8 bytes as a bare offset of 0
+    static_assert(sizeof(HelloPacket) == sizeof(uint64_t));
+    HelloPacket echo{};
+    if (!recvAll(sock, &echo, sizeof(echo)))
     {
-        LOGE("Failed to receive resume offset");
+        LOGE("Failed to receive resume reply");
         close(sock);
         close(fd);
         return;
     }
 
-    LOGI("Resume offset received: %llu, starting transfer...", (unsigned long long)resumeOffset);
-
-    lseek(fd, resumeOffset, SEEK_SET);
-    bytesTransferred_ = resumeOffset;
-
-    std::vector<char> buffer(meta.chunkSize);
-
-    while (!cancelled_)
+    uint64_t resumeOffset = 0;
+    if (memcmp(echo.magic, MAGIC, sizeof(MAGIC)) == 0 && (echo.flags & HELLO_FLAG_RESUME))
     {
-        ssize_t n = read(fd, buffer.data(), buffer.size());
-        if (n <= 0)
-            break;
-
-        DataChunkHeader hdr{};
-        hdr.length = (uint32_t)n;
+        ResumeRequest request{};
+        request.transferId = resumeTransferId(fd, filename, fileSize);
+        if (!sendAll(sock, &request, sizeof(request)))
+        {
+            LOGE("Failed to send ResumeRequest");
+            close(sock);
+            close(fd);
+            return;
+        }
 
-        if (send(sock, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        // Continue only from data the receiver proved it holds
+        ResumeOffer offer{};
+        if (!recvAll(sock, &offer, sizeof(offer)))
         {
-            LOGE("Failed to send DataChunkHeader");
+            LOGE("Failed to receive resume offer");
             close(sock);
             close(fd);
             return;
         }
 
-        ssize_t sent = 0;
-        while (sent < n)
+        resumeOffset = acceptResumeOffer(fd, fileSize, offer);
+        if (!sendAll(sock, &resumeOffset, sizeof(resumeOffset)))
         {
-            ssize_t s = send(sock, buffer.data() + sent, n - sent, 0);
-            if (s <= 0)
-            {
-                LOGE("send() failed during data transfer");
-                close(sock);
-                close(fd);
-                return;
-            }
-            sent += s;
+            LOGE("Failed to confirm resume offset");
+            close(sock);
+            close(fd);
+            return;
         }
-        bytesTransferred_ += n;
+    }
+    else if (memcmp(&echo, &resumeOffset, sizeof(resumeOffset)) != 0)
+    {
+        LOGE("Unexpected reply to file metadata");
+        close(sock);
+        close(fd);
+        return;
+    }
+
+    LOGI("Resume offset confirmed: %llu, starting transfer...", (unsigned long long)resumeOffset);
+
+    session.addProgress(resumeOffset, 0);
+
+    // File pages go straight to the socket when the kernel allows it;
+    // each chunk keeps its DataChunkHeader so the receiver is unchanged.
+    uint64_t offset = resumeOffset;
+    double cpuStart = threadCpuSeconds();
+
+    std::unique_ptr<LinkTuner> tuner;
+    if (options.autoTune)
+        tuner = std::make_unique<LinkTuner>(std::vector<int>{sock}, meta.chunkSize, session);
+
+    session.setPhase(SessionPhase::Transferring);
+    bool sent = options.deltaSync && resumeOffset == 0
+                    ? sendDelta(session, sock, fd, offset, fileSize, meta.chunkSize, sendContext)
+                    : sendChunks(session, sock, fd, offset, fileSize, meta.chunkSize, sendContext);
+    if (tuner)
+    {
+        tuner->finish();
+        rememberLink(session, ip, tuner->tuning());
+    }
+    // A cancelled or broken send ends without the END marker, so the
+    // receiver never takes the partial file for a whole one
+    if (!sent || session.cancelled())
+    {
+        close(sock);
+        close(fd);
+        return;
+    }
+
+    uint64_t sentBytes = offset - resumeOffset;
+    double cpuSeconds = threadCpuSeconds() - cpuStart;
+    if (sentBytes > 0)
+    {
+        LOGI("Sent %.1f MB via %s, CPU %.3f s/GB",
+             sentBytes / (1024.0 * 1024.0),
+             sendContext.pathName(),
+             cpuSeconds * (1024.0 * 1024.0 * 1024.0) / sentBytes);
     }
 
     // 8️⃣ Signal completion with zero-length header
-    DataChunkHeader endHdr{};
-    endHdr.length = 0;
-    if (send(sock, &endHdr, sizeof(endHdr), 0) != sizeof(endHdr))
+    if (!sendEndOfFile(sock, sendContext))
     {
         LOGE("Failed to send END marker");
+        session.fail();
     }
 
     LOGI("Sender completed transfer");
 
     close(sock);
     close(fd);
+}
 
-    // Wait briefly to let JS detect completion (progress = 1.0) before resetting
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-    bytesTransferred_ = 0;
-    totalBytes_ = 0;
+TransferEngine::SendContext::SendContext(const TransferOptions &options,
+                                         IoCounters &ioCounters,
+                                         PipelineCounters &pipelineCounters)
+    : fileSender(options.zeroCopySend, options.chunkSize, ioCounters),
+      compressing(false),
+      digests(options.chunkDigests),
+      cacheWindow(options.cacheWindow)
+{
+    // The pipeline depth doubles as the io_uring batch size
+    if (options.ioUring)
+        uring = UringSender::create(options.pipelineDepth > 0 ? options.pipelineDepth : kUringBatch,
+                                    options.chunkSize, ioCounters);
+    if (!uring && options.pipelineDepth > 0)
+        pipeline = std::make_unique<SendPipeline>(options.pipelineDepth, options.chunkSize, pipelineCounters,
+                                                  ioCounters.telemetry, ioCounters.buffers);
+    if (options.compression && options.compressionWorkers > 0)
+        compressor = std::make_unique<SendPipeline>(std::max<size_t>(options.pipelineDepth, kCompressDepth),
+                                                    options.chunkSize, pipelineCounters,
+                                                    ioCounters.telemetry, ioCounters.buffers,
+                                                    options.compressionWorkers);
+    // Rings the buffer pool cannot spare right now: send without them
+    if (pipeline && !pipeline->ready())
+    {
+        LOGI("Buffer pool full, sending without read-ahead");
+        pipeline.reset();
+    }
+    if (compressor && !compressor->ready())
+    {
+        LOGI("Buffer pool full, sending uncompressed");
+        compressor.reset();
+    }
+    if (digests && !pipeline)
+        hasher = std::make_unique<ChunkHasher>(ioCounters);
 }
 
-std::string TransferEngine::getCurrentFileName() const
+uint16_t TransferEngine::SendContext::helloFlags() const
 {
-    std::lock_guard<std::mutex> lock(fileInfoMutex_);
-    return currentFileName_;
+    return (digests ? HELLO_FLAG_DIGESTS : 0) |
+           (compressor ? HELLO_FLAG_COMPRESSION : 0);
 }
 
-uint64_t TransferEngine::getCurrentFileSize() const
+const char *TransferEngine::SendContext::pathName() const
 {
-    std::lock_guard<std::mutex> lock(fileInfoMutex_);
-    return currentFileSize_;
-}
\ No newline at end of file
+    if (compressing)
+        return "lz4";
+    if (uring)
+        return "io_uring";
+    if (pipeline)
+        return "pipeline";
+    return sendPathName(fileSender.path());
+}
+
+// Sends [offset, end) of `fd` as DataChunkHeader frames, advancing
+// `offset`. Stops early on cancel; the caller sends the end marker.
+bool TransferEngine::sendChunks(TransferSession &session, int sock, int fd,
+                                uint64_t &offset, uint64_t end,
+                                uint32_t chunkSize, SendContext &sendContext)
+{
+    FileDigest *digest = sendContext.digests ? &sendContext.fileDigest : nullptr;
+    ChunkHasher *hasher = sendContext.hasher.get();
+
+    sendContext.compressing = sendContext.compressor && sampleCompressible(fd, offset, end);
+    SendPipeline *pipeline = sendContext.compressing ? sendContext.compressor.get()
+                                                     : sendContext.pipeline.get();
+
+    // Batched paths hand back chunks as they leave; their turnaround is
+    // the gap between two hand-backs
+    Telemetry &telemetry = ioCounters_.telemetry;
+    uint64_t chunkStart = telemetry.start();
+    ReadScheduler reads(fd, offset, sendContext.cacheWindow);
+    uint64_t sent = offset;
+
+    if (sendContext.uring && !sendContext.compressing)
+    {
+        return sendContext.uring->run(sock, fd, offset, end, session.cancelFlag(),
+                                      [&](uint32_t n)
+                                      {
+                                          session.addProgress(n);
+                                          reads.advance(sent += n);
+                                          telemetry.record(Probe::Chunk, chunkStart, n);
+                                          chunkStart = telemetry.start();
+                                      },
+                                      hasher, digest);
+    }
+
+    if (pipeline)
+    {
+        uint64_t before = offset;
+        bool ok = pipeline->run(sock, fd, offset, end, session.cancelFlag(),
+                                [&](uint32_t n, uint32_t wireBytes)
+                                {
+                                    session.addProgress(n, wireBytes);
+                                    reads.advance(sent += n);
+                                    telemetry.record(Probe::Chunk, chunkStart, n);
+                                    chunkStart = telemetry.start();
+                                },
+                                digest);
+        ioCounters_.copiedBytes += offset - before;
+        if (digest)
+            ioCounters_.hashedBytes += offset - before;
+        return ok;
+    }
+
+    FileSender &fileSender = sendContext.fileSender;
+
+    // The hasher reads a few chunks ahead of the socket, so each digest
+    // is usually ready by the time its payload is out
+    uint64_t hashEnd = offset;
+    if (hasher)
+        hasher->reset(fd, offset);
+
+    // Each chunk's digest waits to go out with the next chunk's header,
+    // so the framing between two payloads takes one segment
+    char head[sizeof(ChunkDigest) + sizeof(DataChunkHeader)];
+    size_t headLength = 0;
+
+    while (!session.cancelled() && offset < end)
+    {
+        uint64_t left = end - offset;
+        uint32_t n = left < chunkSize ? (uint32_t)left : chunkSize;
+
+        if (hasher)
+        {
+            for (; hashEnd < end && hasher->pending() < kHashAhead; hashEnd += chunkSize)
+            {
+                uint64_t rest = end - hashEnd;
+                hasher->request(hashEnd, rest < chunkSize ? (uint32_t)rest : chunkSize);
+            }
+        }
+
+        DataChunkHeader hdr{};
+        hdr.length = n;
+        memcpy(head + headLength, &hdr, sizeof(hdr));
+        headLength += sizeof(hdr);
+
+        if (!fileSender.sendRange(sock, fd, offset, n, head, headLength))
+        {
+            LOGE("Failed to send chunk at offset %llu", (unsigned long long)offset);
+            return false;
+        }
+        headLength = 0;
+
+        if (hasher)
+        {
+            ChunkDigest chunkDigest{};
+            if (!hasher->next(chunkDigest.xxh3))
+            {
+                LOGE("File read failed at offset %llu", (unsigned long long)offset);
+                return false;
+            }
+            memcpy(head, &chunkDigest, sizeof(chunkDigest));
+            headLength = sizeof(chunkDigest);
+            digest->add(offset, chunkDigest.xxh3);
+        }
+        offset += n;
+        session.addProgress(n);
+        reads.advance(offset);
+        telemetry.record(Probe::Chunk, chunkStart, n);
+        chunkStart = telemetry.start();
+    }
+
+    if (headLength > 0 && !sendAll(sock, head, headLength))
+    {
+        LOGE("Failed to send ChunkDigest");
+        return false;
+    }
+    return true;
+}
+
+bool TransferEngine::sendEndOfFile(int sock, SendContext &sendContext)
+{
+    // Header and stream digest leave in one send
+    char frame[sizeof(DataChunkHeader) + sizeof(ChunkDigest)] = {};
+    ChunkDigest digest{sendContext.fileDigest.value};
+    memcpy(frame + sizeof(DataChunkHeader), &digest, sizeof(digest));
+    sendContext.fileDigest.reset();
+
+    size_t len = sendContext.digests ? sizeof(frame) : sizeof(DataChunkHeader);
+    return sendAll(sock, frame, len);
+}
+
+std::string TransferEngine::getCurrentFileName(uint32_t sessionId) const
+{
+    std::shared_ptr<TransferSession> session = resolveSession(sessionId);
+    return session ? session->fileName() : std::string();
+}
+
+uint64_t TransferEngine::getCurrentFileSize(uint32_t sessionId) const
+{
+    std::shared_ptr<TransferSession> session = resolveSession(sessionId);
+    return session ? session->fileSize() : 0;
+}
@@ -0,0 +1,230 @@
+#include "transfer_scheduler.h"
+#include <algorithm>
+#include "net_utils.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Burst allowance of a bucket: this share of a second's bytes, but
+    // never less than a default chunk
+    constexpr double kBurstSeconds = 0.1;
+    constexpr double kMinBurst = 256 * 1024;
+
+    double burst(uint64_t rate)
+    {
+        return std::max(rate * kBurstSeconds, kMinBurst);
+    }
+}
+
+static_assert(TransferScheduler::kMaxHold < std::chrono::seconds(kSocketTimeoutSeconds),
+              "a held send must resume before its receiver times out");
+
+// ===============================
+// TokenBucket
+// ===============================
+
+TokenBucket::TokenBucket(uint64_t bytesPerSecond)
+    : rate_(bytesPerSecond),
+      tokens_(burst(bytesPerSecond)),
+      refilled_(Clock::now()) {}
+
+void TokenBucket::refill(Clock::time_point now)
+{
+    double seconds = std::chrono::duration<double>(now - refilled_).count();
+    refilled_ = now;
+    if (seconds > 0)
+        tokens_ = std::min(tokens_ + seconds * rate_, burst(rate_));
+}
+
+void TokenBucket::setRate(uint64_t bytesPerSecond)
+{
+    refill(Clock::now());
+    rate_ = bytesPerSecond;
+    if (rate_ == 0)
+        tokens_ = 0;
+}
+
+TokenBucket::Clock::duration TokenBucket::take(uint64_t bytes, Clock::time_point now)
+{
+    if (rate_ == 0)
+        return Clock::duration::zero();
+    refill(now);
+    tokens_ -= (double)bytes;
+    if (tokens_ >= 0)
+        return Clock::duration::zero();
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens_ / rate_));
+}
+
+// ===============================
+// TransferScheduler
+// ===============================
+
+TransferScheduler::TransferScheduler()
+    : nextOrder_(0),
+      maxActive_(0) {}
+
+void TransferScheduler::setLimits(uint16_t maxActive, uint64_t bytesPerSecond)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    global_.setRate(bytesPerSecond);
+    if (maxActive_ != maxActive)
+    {
+        maxActive_ = maxActive;
+        reschedule();
+    }
+    changed_.notify_all();
+}
+
+void TransferScheduler::add(TransferSession &session, const SendJob &job)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::unique_ptr<Job>(
+        new Job{&session, job.priority, nextOrder_++, TokenBucket(job.bytesPerSecond), false, false, false, false}));
+    reschedule();
+}
+
+void TransferScheduler::remove(TransferSession &session)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(jobs_.begin(), jobs_.end(), [&session](const std::unique_ptr<Job> &job)
+                           { return job->session == &session; });
+    if (it == jobs_.end())
+        return;
+    jobs_.erase(it);
+    reschedule();
+}
+
+TransferScheduler::Job *TransferScheduler::find(uint32_t sessionId) const
+{
+    for (const auto &job : jobs_)
+        if (job->session->id() == sessionId)
+            return job.get();
+    return nullptr;
+}
+
+void TransferScheduler::reschedule()
+{
+    std::vector<Job *> queue;
+    queue.reserve(jobs_.size());
+    for (const auto &job : jobs_)
+        queue.push_back(job.get());
+    std::sort(queue.begin(), queue.end(), [](const Job *a, const Job *b)
+              { return a->priority != b->priority ? a->priority > b->priority : a->order < b->order; });
+
+    // Released jobs run on top of the cap, so they are not ranked
+    bool changed = false;
+    size_t rank = 0;
+    for (Job *queued : queue)
+    {
+        Job &job = *queued;
+        if (job.released)
+            continue;
+        bool active = maxActive_ == 0 || rank++ < maxActive_;
+        if (active == job.active)
+            continue;
+        if (!active && job.started)
+            LOGI("Session %u held for higher priority sends", job.session->id());
+        job.active = active;
+        changed = true;
+    }
+    if (changed)
+        changed_.notify_all();
+}
+
+bool TransferScheduler::waitActive(std::unique_lock<std::mutex> &lock, Job &job)
+{
+    TransferSession &session = *job.session;
+    if (job.active || session.cancelled())
+        return !session.cancelled();
+
+    SessionPhase phase = session.phase();
+    session.setPhase(SessionPhase::Queued);
+    auto picked = [&]
+    { return job.active || session.cancelled(); };
+    if (!job.started)
+    {
+        // Not connected yet, so nothing waits on it
+        changed_.wait(lock, picked);
+    }
+    else
+    {
+        job.throttled = true;
+        if (!changed_.wait_for(lock, kMaxHold, picked))
+        {
+            LOGI("Session %u held for %lld s, sending past the active limit", session.id(),
+                 (long long)kMaxHold.count());
+            job.released = true;
+            job.active = true;
+        }
+    }
+    session.setPhase(phase);
+    return !session.cancelled();
+}
+
+bool TransferScheduler::admit(TransferSession &session)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    Job *job = find(session.id());
+    if (!job)
+        return !session.cancelled();
+    bool admitted = waitActive(lock, *job);
+    job->started = true;
+    return admitted;
+}
+
+void TransferScheduler::pace(TransferSession &session, uint64_t wireBytes)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    Job *job = find(session.id());
+    if (!job)
+        return;
+
+    // Both buckets are charged now; the longer debt decides the wait
+    auto now = TokenBucket::Clock::now();
+    auto wait = std::max(job->bucket.take(wireBytes, now), global_.take(wireBytes, now));
+    if (wait > TokenBucket::Clock::duration::zero())
+    {
+        job->throttled = true;
+        changed_.wait_until(lock, now + wait, [&]
+                            { return session.cancelled(); });
+    }
+    waitActive(lock, *job);
+}
+
+bool TransferScheduler::setPriority(uint32_t sessionId, int priority)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Job *job = find(sessionId);
+    if (!job)
+        return false;
+    job->priority = priority;
+    reschedule();
+    return true;
+}
+
+bool TransferScheduler::setRateLimit(uint32_t sessionId, uint64_t bytesPerSecond)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Job *job = find(sessionId);
+    if (!job)
+        return false;
+    job->bucket.setRate(bytesPerSecond);
+    return true;
+}
+
+bool TransferScheduler::throttled(uint32_t sessionId) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Job *job = find(sessionId);
+    return job && job->throttled;
+}
+
+void TransferScheduler::wake()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    changed_.notify_all();
+}
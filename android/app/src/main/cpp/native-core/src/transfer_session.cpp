@@ -0,0 +1,244 @@
+#include "transfer_session.h"
+#include <algorithm>
+
+using namespace swiftshare;
+
+const char *swiftshare::sessionDirectionName(SessionDirection direction)
+{
+    return direction == SessionDirection::Send ? "send" : "receive";
+}
+
+const char *swiftshare::sessionStateName(SessionState state)
+{
+    switch (state)
+    {
+    case SessionState::Active:
+        return "active";
+    case SessionState::Completed:
+        return "completed";
+    case SessionState::Failed:
+        return "failed";
+    case SessionState::Cancelled:
+        return "cancelled";
+    }
+    return "unknown";
+}
+
+const char *swiftshare::sessionPhaseName(SessionPhase phase)
+{
+    switch (phase)
+    {
+    case SessionPhase::Connecting:
+        return "connecting";
+    case SessionPhase::Negotiating:
+        return "negotiating";
+    case SessionPhase::Transferring:
+        return "transferring";
+    case SessionPhase::Verifying:
+        return "verifying";
+    case SessionPhase::Done:
+        return "done";
+    case SessionPhase::Queued:
+        return "queued";
+    }
+    return "unknown";
+}
+
+// ===============================
+// Session
+// ===============================
+
+TransferSession::TransferSession(uint32_t id, SessionDirection direction)
+    : fileBytes_(0),
+      sessionBytes_(0),
+      wireBytes_(0),
+      fileSize_(0),
+      totalBytes_(0),
+      fileIndex_(0),
+      fileCount_(0),
+      state_(SessionState::Active),
+      phase_(SessionPhase::Connecting),
+      retired_(false),
+      failed_(false),
+      cancelled_(false),
+      id_(id),
+      direction_(direction),
+      started_(std::chrono::steady_clock::now()),
+      finishedMs_(-1),
+      tuning_{} {}
+
+void TransferSession::begin(uint32_t fileCount, uint64_t totalBytes)
+{
+    fileIndex_ = 0;
+    fileCount_ = fileCount;
+    sessionBytes_ = 0;
+    wireBytes_ = 0;
+    totalBytes_ = totalBytes;
+}
+
+void TransferSession::beginFile(uint32_t index, const std::string &filename, uint64_t fileSize)
+{
+    {
+        std::lock_guard<std::mutex> lock(nameMutex_);
+        fileName_ = filename;
+    }
+    fileBytes_ = 0;
+    fileSize_ = fileSize;
+    fileIndex_ = index;
+}
+
+void TransferSession::addProgress(uint64_t bytes, uint64_t wireBytes)
+{
+    fileBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    sessionBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    wireBytes_.fetch_add(wireBytes, std::memory_order_relaxed);
+    if (pacer_ && wireBytes > 0)
+        pacer_(wireBytes);
+}
+
+void TransferSession::setTuning(const LinkTuning &tuning)
+{
+    std::lock_guard<std::mutex> lock(nameMutex_);
+    tuning_ = tuning;
+}
+
+void TransferSession::finish()
+{
+    if (fileCount_ > 0 && sessionBytes_ >= totalBytes_ && !failed_)
+        state_ = SessionState::Completed;
+    else if (cancelled_)
+        state_ = SessionState::Cancelled;
+    else
+        state_ = SessionState::Failed;
+    phase_ = SessionPhase::Done;
+
+    finishedMs_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - started_)
+                      .count();
+}
+
+double TransferSession::fileProgress() const
+{
+    uint64_t size = fileSize_;
+    if (size == 0)
+        return 0.0;
+    return (double)fileBytes_.load(std::memory_order_relaxed) / (double)size;
+}
+
+SessionProgress TransferSession::progress() const
+{
+    return SessionProgress{fileIndex_.load(),
+                           fileCount_.load(),
+                           sessionBytes_.load(std::memory_order_relaxed),
+                           totalBytes_.load()};
+}
+
+std::string TransferSession::fileName() const
+{
+    std::lock_guard<std::mutex> lock(nameMutex_);
+    return fileName_;
+}
+
+SessionStats TransferSession::stats() const
+{
+    int64_t finished = finishedMs_;
+    uint64_t elapsed = finished >= 0
+                           ? (uint64_t)finished
+                           : (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::steady_clock::now() - started_)
+                                 .count();
+
+    LinkTuning tuning;
+    {
+        std::lock_guard<std::mutex> lock(nameMutex_);
+        tuning = tuning_;
+    }
+
+    return SessionStats{id_,
+                        direction_,
+                        state_,
+                        phase_,
+                        progress(),
+                        fileName(),
+                        fileSize_,
+                        fileBytes_.load(std::memory_order_relaxed),
+                        wireBytes_.load(std::memory_order_relaxed),
+                        elapsed,
+                        tuning};
+}
+
+// ===============================
+// Registry
+// ===============================
+
+std::shared_ptr<TransferSession> SessionRegistry::create(SessionDirection direction)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto session = std::make_shared<TransferSession>(nextId_++, direction);
+    if (nextId_ == 0)
+        nextId_ = 1;
+    sessions_.push_back(session);
+    return session;
+}
+
+std::shared_ptr<TransferSession> SessionRegistry::find(uint32_t id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &session : sessions_)
+    {
+        if (session->id() == id)
+            return session;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<TransferSession> SessionRegistry::latest() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = sessions_.rbegin(); it != sessions_.rend(); ++it)
+    {
+        if (!(*it)->retired_)
+            return *it;
+    }
+    return nullptr;
+}
+
+std::vector<SessionStats> SessionRegistry::list() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<SessionStats> result;
+    result.reserve(sessions_.size());
+    for (const auto &session : sessions_)
+        result.push_back(session->stats());
+    return result;
+}
+
+void SessionRegistry::retire(TransferSession &session)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    session.retired_ = true;
+
+    // Forget the oldest retired sessions beyond the retention window
+    size_t retired = std::count_if(sessions_.begin(), sessions_.end(),
+                                   [](const std::shared_ptr<TransferSession> &s)
+                                   { return s->retired_.load(); });
+    for (auto it = sessions_.begin(); it != sessions_.end() && retired > kRetained;)
+    {
+        if ((*it)->retired_)
+        {
+            it = sessions_.erase(it);
+            retired--;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void SessionRegistry::cancelAll()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &session : sessions_)
+        session->cancel();
+}
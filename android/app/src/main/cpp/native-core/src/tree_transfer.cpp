@@ -0,0 +1,617 @@
+#include "transfer_engine.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <thread>
+#include <chrono>
+#include "protocol.h"
+#include "net_utils.h"
+#include "link_tuner.h"
+#include "tree_walker.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Files up to this size are packed, unless the chunk size is smaller
+    constexpr uint32_t kPackLimit = 256 * 1024;
+    // A pack is cut once it holds this much
+    constexpr uint32_t kPackBytes = 1024 * 1024;
+    // Packs read ahead by the sender and written behind by the receiver
+    constexpr size_t kPackWorkers = 4;
+    constexpr unsigned kWalkWorkers = 4;
+    // Root names that are taken by the time they are created
+    constexpr int kRootAttempts = 8;
+
+    // Files [first, first + count) of the manifest and their bytes
+    struct Pack
+    {
+        size_t first = 0;
+        size_t count = 0;
+        uint64_t length = 0;
+        PooledBuffer payload; // at least `length` bytes, once taken from the pool
+        bool complete = true; // every file read in full
+    };
+
+    bool safeRelativePath(const std::string &path)
+    {
+        if (path.empty() || path.size() > 4096 || path[0] == '/' || path.find('\0') != std::string::npos)
+            return false;
+        for (size_t start = 0; start <= path.size();)
+        {
+            size_t end = path.find('/', start);
+            if (end == std::string::npos)
+                end = path.size();
+            std::string part = path.substr(start, end - start);
+            if (part.empty() || part == "." || part == "..")
+                return false;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    bool recvPath(int sock, uint16_t length, std::string &path)
+    {
+        path.resize(length);
+        return length == 0 || recvAll(sock, path.data(), length);
+    }
+
+    void setMtime(int fd, int64_t mtimeNs)
+    {
+        timespec times[2] = {{0, UTIME_OMIT},
+                             {(time_t)(mtimeNs / 1000000000), (long)(mtimeNs % 1000000000)}};
+        futimens(fd, times);
+    }
+
+    // Splits the small files at the front of `files` into packs
+    std::vector<Pack> planPacks(const std::vector<TreeFile> &files, uint32_t packLimit)
+    {
+        std::vector<Pack> packs;
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < files.size() && files[i].size <= packLimit; ++i)
+        {
+            if (packs.empty() || packs.back().count == MAX_PACK_FILES ||
+                bytes + files[i].size > kPackBytes)
+            {
+                packs.push_back(Pack{i, 0, 0, {}, true});
+                bytes = 0;
+            }
+            packs.back().count++;
+            packs.back().length += files[i].size;
+            bytes += files[i].size;
+        }
+        return packs;
+    }
+
+    // Reads the files of `pack` back to back into its payload. A file
+    // that shrank since the walk is padded with zeros and leaves the pack
+    // incomplete.
+    Pack loadPack(Pack pack, const std::string &root, const std::vector<TreeFile> &files,
+                  Telemetry &telemetry)
+    {
+        char *out = pack.payload.data();
+        for (size_t i = pack.first; i < pack.first + pack.count; ++i)
+        {
+            const TreeFile &file = files[i];
+            uint64_t done = 0;
+            int fd = open((root + "/" + file.path).c_str(), O_RDONLY | O_CLOEXEC);
+            while (fd >= 0 && done < file.size)
+            {
+                uint64_t readStart = telemetry.start();
+                ssize_t n = pread(fd, out + done, file.size - done, (off_t)done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                telemetry.record(Probe::Read, readStart, (uint64_t)n);
+                done += (uint64_t)n;
+            }
+            if (fd >= 0)
+                close(fd);
+            if (done < file.size)
+            {
+                LOGE("Could not read %s in full (%llu of %llu bytes)", file.path.c_str(),
+                     (unsigned long long)done, (unsigned long long)file.size);
+                memset(out + done, 0, file.size - done);
+                pack.complete = false;
+            }
+            out += file.size;
+        }
+        return pack;
+    }
+
+    // Creates the files of one received pack under `rootFd`; returns how
+    // many were written in full
+    size_t writePack(int rootFd, const std::vector<TreeFile> &files, const Pack &pack,
+                     Telemetry &telemetry)
+    {
+        size_t written = 0;
+        const char *in = pack.payload.data();
+        for (size_t i = pack.first; i < pack.first + pack.count; ++i)
+        {
+            const TreeFile &file = files[i];
+            int fd = openat(rootFd, file.path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                LOGE("Cannot create %s (errno=%d)", file.path.c_str(), errno);
+                in += file.size;
+                continue;
+            }
+
+            uint64_t done = 0;
+            while (done < file.size)
+            {
+                uint64_t writeStart = telemetry.start();
+                ssize_t n = write(fd, in + done, file.size - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                telemetry.record(Probe::Write, writeStart, (uint64_t)n);
+                done += (uint64_t)n;
+            }
+            if (done == file.size)
+            {
+                setMtime(fd, file.mtimeNs);
+                written++;
+            }
+            else
+            {
+                LOGE("Short write to %s (errno=%d)", file.path.c_str(), errno);
+            }
+            close(fd);
+            in += file.size;
+        }
+        return written;
+    }
+}
+
+// ===============================
+// Receiver
+// ===============================
+
+bool TransferEngine::receiveTree(TransferSession &session, int client, const HelloPacket &hello,
+                                 SocketReceiver &socketReceiver)
+{
+    TreeManifest manifest{};
+    if (!recvAll(client, &manifest, sizeof(manifest)) ||
+        manifest.fileCount > MAX_TREE_FILES || manifest.directoryCount > MAX_TREE_DIRECTORIES ||
+        manifest.chunkSize == 0 || manifest.packLimit > MAX_PACK_BYTES || manifest.rootNameLen == 0)
+    {
+        LOGE("Invalid tree manifest");
+        return false;
+    }
+
+    std::string rootName;
+    std::vector<std::string> directories(manifest.directoryCount);
+    std::vector<TreeFile> files(manifest.fileCount);
+    bool valid = recvPath(client, manifest.rootNameLen, rootName);
+    for (auto &dir : directories)
+    {
+        uint16_t length = 0;
+        valid = valid && recvAll(client, &length, sizeof(length)) && recvPath(client, length, dir) &&
+                safeRelativePath(dir);
+    }
+    uint64_t totalBytes = 0;
+    for (auto &file : files)
+    {
+        TreeFileEntry entry{};
+        valid = valid && recvAll(client, &entry, sizeof(entry)) &&
+                recvPath(client, entry.pathLen, file.path) && safeRelativePath(file.path);
+        file.size = entry.fileSize;
+        file.mtimeNs = entry.mtimeNs;
+        totalBytes += entry.fileSize;
+    }
+    if (!valid)
+    {
+        LOGE("Tree manifest read failed or holds an unsafe path");
+        return false;
+    }
+
+    // Directories are created before the sender is told to go ahead, so
+    // every file below has its parent in place
+    std::string rootPath = createTreeRoot(rootName);
+    int rootFd = rootPath.empty() ? -1 : open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (size_t i = 0; rootFd >= 0 && i < directories.size(); ++i)
+    {
+        if (mkdirat(rootFd, directories[i].c_str(), 0775) != 0 && errno != EEXIST)
+        {
+            LOGE("Cannot create directory %s (errno=%d)", directories[i].c_str(), errno);
+            close(rootFd);
+            rootFd = -1;
+        }
+    }
+
+    uint8_t status = rootFd >= 0 ? STATUS_OK : STATUS_ERROR;
+    if (!sendAll(client, &status, sizeof(status)) || rootFd < 0)
+    {
+        if (rootFd >= 0)
+            close(rootFd);
+        return false;
+    }
+
+    LOGI("Tree %s: receiving %zu files in %zu directories, %llu bytes", rootPath.c_str(),
+         files.size(), directories.size(), (unsigned long long)totalBytes);
+    session.begin(std::max<uint32_t>(manifest.fileCount, 1), totalBytes);
+    session.setPhase(SessionPhase::Transferring);
+
+    std::unique_ptr<ChunkHasher> hasher;
+    if (hello.flags & HELLO_FLAG_DIGESTS)
+        hasher = std::make_unique<ChunkHasher>(ioCounters_);
+
+    // Packs are handed to writers so file creation overlaps the network
+    Telemetry &telemetry = ioCounters_.telemetry;
+    std::deque<std::future<size_t>> writers;
+    size_t completed = 0;
+    bool streamOk = true;
+
+    size_t i = 0;
+    while (i < files.size() && streamOk && !session.cancelled())
+    {
+        if (files[i].size <= manifest.packLimit)
+        {
+            uint64_t chunkStart = telemetry.start();
+            PackHeader header{};
+            streamOk = recvAll(client, &header, sizeof(header));
+            uint64_t length = 0;
+            for (size_t k = i; streamOk && k < i + header.fileCount && k < files.size(); ++k)
+                length += files[k].size <= manifest.packLimit ? files[k].size : MAX_PACK_BYTES + 1ull;
+            if (streamOk && (header.fileCount == 0 || header.fileCount > MAX_PACK_FILES ||
+                             header.fileCount > files.size() - i ||
+                             header.length > MAX_PACK_BYTES || header.length != length))
+            {
+                LOGE("Pack of %u files does not match the manifest at file %zu", header.fileCount, i);
+                streamOk = false;
+            }
+            if (!streamOk)
+                break;
+
+            // Nothing is held here, so waiting for the pool is safe; the
+            // pack goes back to it once its writer is done
+            Pack pack{i, header.fileCount, header.length, ioCounters_.buffers.acquire(header.length), true};
+            if (!pack.payload)
+            {
+                streamOk = false;
+                break;
+            }
+            ChunkDigest digest{};
+            streamOk = recvAll(client, pack.payload.data(), header.length) &&
+                       (!hasher || recvAll(client, &digest, sizeof(digest)));
+            if (streamOk && hasher)
+            {
+                ioCounters_.hashedBytes += header.length;
+                if (xxh3_64(pack.payload.data(), header.length) != digest.xxh3)
+                {
+                    LOGE("Pack digest mismatch at file %zu", i);
+                    ioCounters_.digestFailures++;
+                    session.fail();
+                    streamOk = false;
+                }
+            }
+            if (!streamOk)
+                break;
+
+            session.beginFile((uint32_t)i, files[i].path, header.length);
+            session.addProgress(header.length);
+            telemetry.record(Probe::Chunk, chunkStart, header.length);
+
+            if (writers.size() == kPackWorkers)
+            {
+                completed += writers.front().get();
+                writers.pop_front();
+            }
+            // The task keeps its captures until its future goes, so the
+            // pack hands its buffer back as soon as it is written
+            writers.push_back(std::async(std::launch::async,
+                                         [&files, &telemetry, rootFd, pack = std::move(pack)]() mutable
+                                         {
+                                             size_t written = writePack(rootFd, files, pack, telemetry);
+                                             pack.payload.release();
+                                             return written;
+                                         }));
+            i += header.fileCount;
+            continue;
+        }
+
+        const TreeFile &file = files[i];
+        int fd = openat(rootFd, file.path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            // The stream cannot skip a file it has no room for
+            LOGE("Cannot create %s (errno=%d)", file.path.c_str(), errno);
+            break;
+        }
+        session.beginFile((uint32_t)i, file.path, file.size);
+        uint64_t offset = 0;
+        streamOk = receiveChunks(session, client, fd, offset, file.size, manifest.chunkSize,
+                                 socketReceiver, nullptr, hasher.get(), -1,
+                                 hello.flags & HELLO_FLAG_COMPRESSION);
+        if (offset == file.size)
+        {
+            setMtime(fd, file.mtimeNs);
+            completed++;
+        }
+        else
+        {
+            LOGE("Tree file %s incomplete (%llu of %llu bytes)", file.path.c_str(),
+                 (unsigned long long)offset, (unsigned long long)file.size);
+        }
+        close(fd);
+        i++;
+    }
+
+    for (auto &writer : writers)
+        completed += writer.get();
+    close(rootFd);
+
+    if (completed < files.size())
+        session.fail();
+    LOGI("Tree finished: %zu of %zu files complete", completed, files.size());
+    return true;
+}
+
+std::string TransferEngine::createTreeRoot(const std::string &name)
+{
+    // Native names are reserved in the index; mkdir() failing with
+    // EEXIST means someone else got there first
+    if (receivePaths_.ready())
+    {
+        for (int attempt = 0; attempt < kRootAttempts; ++attempt)
+        {
+            std::vector<std::string> paths = receivePaths_.reserve({name});
+            if (paths.empty())
+                break;
+            if (mkdir(paths[0].c_str(), 0775) == 0)
+                return paths[0];
+            if (errno != EEXIST)
+            {
+                LOGE("Cannot create %s (errno=%d)", paths[0].c_str(), errno);
+                break;
+            }
+        }
+        return std::string();
+    }
+
+    if (!pathResolver_)
+    {
+        LOGE("No path resolver set!");
+        return std::string();
+    }
+    std::string path = pathResolver_(name);
+    if (path.empty() || (mkdir(path.c_str(), 0775) != 0 && errno != EEXIST))
+    {
+        LOGE("Failed to create tree root for %s", name.c_str());
+        return std::string();
+    }
+    return path;
+}
+
+// ===============================
+// Sender
+// ===============================
+
+uint32_t TransferEngine::startSenderTree(const std::string &directory,
+                                         const std::string &ip,
+                                         uint16_t port,
+                                         const SendJob &job)
+{
+    if (directory.empty())
+        return 0;
+
+    return launchSend(job, [=, this](TransferSession &session)
+                      { treeSenderThread(session, directory, ip, port); });
+}
+
+void TransferEngine::treeSenderThread(TransferSession &session,
+                                      const std::string &directory,
+                                      const std::string &ip,
+                                      uint16_t port)
+{
+    TransferOptions options = sendOptions(ip);
+
+    // Canonical, so "dir/." and "dir/" are still named "dir"
+    char resolved[PATH_MAX];
+    if (!realpath(directory.c_str(), resolved))
+    {
+        LOGE("Cannot resolve %s (errno=%d)", directory.c_str(), errno);
+        return;
+    }
+    std::string root = resolved;
+    std::string rootName = root.substr(root.find_last_of('/') + 1);
+
+    auto walkStart = std::chrono::steady_clock::now();
+    TreeListing listing;
+    unsigned workers = std::clamp(std::thread::hardware_concurrency(), 1u, kWalkWorkers);
+    if (rootName.empty() || !walkTree(root, listing, workers))
+        return;
+    if (listing.files.size() > MAX_TREE_FILES || listing.directories.size() > MAX_TREE_DIRECTORIES)
+    {
+        LOGE("Tree %s is too large to send (%zu files)", root.c_str(), listing.files.size());
+        return;
+    }
+    LOGI("Walked %s: %zu files in %zu directories in %.1f ms", root.c_str(), listing.files.size(),
+         listing.directories.size(),
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - walkStart).count());
+
+    // Small files first, each group still in path order
+    uint32_t packLimit = std::min(options.chunkSize, kPackLimit);
+    std::vector<TreeFile> &files = listing.files;
+    std::stable_partition(files.begin(), files.end(), [packLimit](const TreeFile &file)
+                          { return file.size <= packLimit; });
+
+    int sock = connectPeer(ip, port, options.autoTune ? 0 : kDefaultSocketBuffer, options);
+    if (sock < 0)
+        return;
+    session.setPhase(SessionPhase::Negotiating);
+
+    SendContext sendContext(options, ioCounters_, pipelineCounters_);
+
+    // HELLO + manifest leave in one write
+    std::vector<char> header;
+    auto append = [&header](const void *data, size_t len)
+    {
+        const char *p = static_cast<const char *>(data);
+        header.insert(header.end(), p, p + len);
+    };
+
+    HelloPacket hello{};
+    memcpy(hello.magic, MAGIC, 4);
+    hello.version = VERSION;
+    hello.mode = MODE_TREE;
+    hello.flags = sendContext.helloFlags();
+    append(&hello, sizeof(hello));
+
+    TreeManifest manifest{};
+    manifest.directoryCount = (uint32_t)listing.directories.size();
+    manifest.fileCount = (uint32_t)files.size();
+    manifest.totalBytes = listing.totalBytes;
+    manifest.chunkSize = options.chunkSize;
+    manifest.packLimit = packLimit;
+    manifest.rootNameLen = (uint16_t)std::min<size_t>(rootName.size(), UINT16_MAX);
+    append(&manifest, sizeof(manifest));
+    append(rootName.data(), manifest.rootNameLen);
+
+    for (const auto &dir : listing.directories)
+    {
+        uint16_t length = (uint16_t)dir.size();
+        append(&length, sizeof(length));
+        append(dir.data(), length);
+    }
+    for (const auto &file : files)
+    {
+        TreeFileEntry entry{};
+        entry.fileSize = file.size;
+        entry.mtimeNs = file.mtimeNs;
+        entry.pathLen = (uint16_t)file.path.size();
+        append(&entry, sizeof(entry));
+        append(file.path.data(), entry.pathLen);
+    }
+
+    uint8_t status = STATUS_ERROR;
+    if (!sendAll(sock, header.data(), header.size()) ||
+        !recvAll(sock, &status, sizeof(status)) || status != STATUS_OK)
+    {
+        LOGE("Tree handshake failed");
+        close(sock);
+        return;
+    }
+    header = std::vector<char>();
+
+    LOGI("Tree: sending %zu files, %llu bytes", files.size(), (unsigned long long)listing.totalBytes);
+    session.begin(std::max<uint32_t>(manifest.fileCount, 1), listing.totalBytes);
+    session.setPhase(SessionPhase::Transferring);
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<LinkTuner> tuner;
+    if (options.autoTune)
+        tuner = std::make_unique<LinkTuner>(std::vector<int>{sock}, options.chunkSize, session);
+
+    // Packs are read by a few loaders ahead of the socket; each one goes
+    // out as header, payload and digest in one gathered send. Their
+    // buffers are taken here, not by the loaders, and only waited for
+    // with nothing loading and no pack in hand, so read-ahead shrinks
+    // rather than stalls when the pool runs low.
+    Telemetry &telemetry = ioCounters_.telemetry;
+    std::vector<Pack> plan = planPacks(files, packLimit);
+    std::deque<std::future<Pack>> loading;
+    size_t planned = 0;
+    bool ok = true;
+    auto refill = [&](bool mayWait)
+    {
+        while (loading.size() < kPackWorkers && planned < plan.size())
+        {
+            bool wait = mayWait && loading.empty();
+            plan[planned].payload = ioCounters_.buffers.acquire(plan[planned].length, wait);
+            if (!plan[planned].payload)
+            {
+                ok = ok && !wait;
+                break;
+            }
+            loading.push_back(std::async(std::launch::async, [&root, &files, &telemetry, pack = std::move(plan[planned])]() mutable
+                                         { return loadPack(std::move(pack), root, files, telemetry); }));
+            planned++;
+        }
+    };
+
+    refill(true);
+    while (!loading.empty() && ok && !session.cancelled())
+    {
+        Pack pack = loading.front().get();
+        loading.pop_front();
+        refill(false);
+
+        uint64_t chunkStart = telemetry.start();
+        PackHeader packHeader{(uint32_t)pack.count, (uint32_t)pack.length};
+        ChunkDigest digest{};
+        iovec iov[3] = {{&packHeader, sizeof(packHeader)},
+                        {pack.payload.data(), pack.length},
+                        {&digest, sizeof(digest)}};
+        if (sendContext.digests)
+        {
+            digest.xxh3 = xxh3_64(pack.payload.data(), pack.length);
+            ioCounters_.hashedBytes += pack.length;
+        }
+
+        session.beginFile((uint32_t)pack.first, files[pack.first].path, pack.length);
+        uint64_t sendStart = telemetry.start();
+        ok = sendAllVectored(sock, iov, sendContext.digests ? 3 : 2);
+        telemetry.record(Probe::Send, sendStart, pack.length);
+        if (!ok)
+            break;
+        ioCounters_.copiedBytes += pack.length;
+        session.addProgress(pack.length);
+        telemetry.record(Probe::Chunk, chunkStart, pack.length);
+        if (!pack.complete)
+            session.fail();
+
+        pack.payload.release();
+        refill(true);
+    }
+    // Loaders still running hold references into this frame
+    for (auto &pending : loading)
+        pending.wait();
+
+    size_t first = plan.empty() ? 0 : plan.back().first + plan.back().count;
+    for (size_t i = first; i < files.size() && ok && !session.cancelled(); ++i)
+    {
+        const TreeFile &file = files[i];
+        session.beginFile((uint32_t)i, file.path, file.size);
+
+        // An unreadable file is sent as empty; the receiver sees it short
+        int fd = open((root + "/" + file.path).c_str(), O_RDONLY | O_CLOEXEC);
+        uint64_t offset = 0;
+        if (fd >= 0)
+        {
+            ok = sendChunks(session, sock, fd, offset, file.size, options.chunkSize, sendContext);
+            close(fd);
+        }
+        else
+        {
+            LOGE("Failed to open file: %s", file.path.c_str());
+        }
+        ok = ok && !session.cancelled() && sendEndOfFile(sock, sendContext);
+    }
+
+    if (tuner)
+    {
+        tuner->finish();
+        rememberLink(session, ip, tuner->tuning());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOGI("Tree %s %s: %zu files (%.1f MB) in %.2f s", rootName.c_str(), ok ? "sent" : "aborted",
+         files.size(), session.progress().bytesTransferred / (1024.0 * 1024.0), seconds);
+
+    close(sock);
+}
@@ -0,0 +1,167 @@
+#include "tree_walker.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Directories waiting to be listed, shared by the walkers. The walk
+    // is over once the queue is empty and nobody is listing.
+    class WalkQueue
+    {
+    public:
+        explicit WalkQueue(std::string root)
+            : busy_(0)
+        {
+            pending_.push_back(std::move(root));
+        }
+
+        // Blocks until there is a directory to list or the walk is over
+        bool take(std::string &relative)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this]
+                          { return !pending_.empty() || busy_ == 0; });
+            if (pending_.empty())
+                return false;
+            relative = std::move(pending_.front());
+            pending_.pop_front();
+            busy_++;
+            return true;
+        }
+
+        void push(std::vector<std::string> &found)
+        {
+            if (found.empty())
+                return;
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &dir : found)
+                pending_.push_back(std::move(dir));
+            found.clear();
+            changed_.notify_all();
+        }
+
+        void done()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_ == 0 && pending_.empty())
+                changed_.notify_all();
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::deque<std::string> pending_;
+        unsigned busy_;
+    };
+
+    std::string join(const std::string &relative, const char *name)
+    {
+        return relative.empty() ? std::string(name) : relative + "/" + name;
+    }
+
+    // Lists one directory into `listing`; subdirectories go to `found`
+    void listDirectory(const std::string &root, const std::string &relative,
+                       TreeListing &listing, std::vector<std::string> &found)
+    {
+        std::string full = relative.empty() ? root : root + "/" + relative;
+        int dirFd = open(full.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *dir = dirFd >= 0 ? fdopendir(dirFd) : nullptr;
+        if (!dir)
+        {
+            LOGE("Cannot list %s (errno=%d)", full.c_str(), errno);
+            if (dirFd >= 0)
+                close(dirFd);
+            return;
+        }
+
+        while (dirent *entry = readdir(dir))
+        {
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            // d_type spares the stat for directories; files need their
+            // size anyway
+            if (entry->d_type == DT_DIR)
+            {
+                found.push_back(join(relative, name));
+                continue;
+            }
+            if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+                continue;
+
+            struct stat st{};
+            if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            if (S_ISDIR(st.st_mode))
+                found.push_back(join(relative, name));
+            else if (S_ISREG(st.st_mode))
+                listing.files.push_back({join(relative, name), (uint64_t)st.st_size,
+                                         (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec});
+        }
+        closedir(dir);
+
+        listing.directories.insert(listing.directories.end(), found.begin(), found.end());
+    }
+}
+
+bool swiftshare::walkTree(const std::string &root, TreeListing &listing, unsigned workers)
+{
+    struct stat st{};
+    if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || access(root.c_str(), R_OK | X_OK) != 0)
+    {
+        LOGE("Cannot walk %s", root.c_str());
+        return false;
+    }
+
+    // Each walker fills its own listing; they are merged at the end
+    WalkQueue queue{std::string()};
+    std::vector<TreeListing> partial(std::max(1u, workers));
+    std::vector<std::thread> threads;
+    for (auto &mine : partial)
+    {
+        threads.emplace_back([&root, &queue, &mine]()
+                             {
+                                 std::string relative;
+                                 std::vector<std::string> found;
+                                 while (queue.take(relative))
+                                 {
+                                     listDirectory(root, relative, mine, found);
+                                     queue.push(found);
+                                     queue.done();
+                                 } });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    listing = TreeListing{};
+    for (auto &mine : partial)
+    {
+        listing.directories.insert(listing.directories.end(),
+                                   std::make_move_iterator(mine.directories.begin()),
+                                   std::make_move_iterator(mine.directories.end()));
+        listing.files.insert(listing.files.end(),
+                             std::make_move_iterator(mine.files.begin()),
+                             std::make_move_iterator(mine.files.end()));
+    }
+    std::sort(listing.directories.begin(), listing.directories.end());
+    std::sort(listing.files.begin(), listing.files.end(),
+              [](const TreeFile &a, const TreeFile &b)
+              { return a.path < b.path; });
+    for (const auto &file : listing.files)
+        listing.totalBytes += file.size;
+    return true;
+}
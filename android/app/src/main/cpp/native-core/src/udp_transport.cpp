@@ -0,0 +1,1471 @@
+#include "udp_transport.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <queue>
+#include <random>
+#include <thread>
+#include "key_exchange.h"
+#include "net_utils.h"
+#include "protocol.h"
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Both rings hold this many packets: the most a sender keeps
+    // unacknowledged, and the most a receiver buffers ahead of its caller
+    constexpr uint32_t kRing = UDP_SACK_PACKETS;
+    constexpr unsigned kBatch = 32;      // datagrams per sendmmsg()/recvmmsg()
+    constexpr unsigned kReceiveBatches = 4; // before the loop turns to other work
+    constexpr unsigned kLocalIov = 64;   // packets per readv()/sendmsg() on the pair
+    constexpr int kLocalBuffer = 2 * 1024 * 1024;
+    constexpr int kUdpBuffer = 4 * 1024 * 1024;
+
+    constexpr int64_t kSynIntervalUs = 200'000;
+    constexpr int64_t kConnectTimeoutUs = 5'000'000;
+    constexpr int64_t kKeepaliveUs = 1'000'000;
+    constexpr int64_t kIdleTimeoutUs = 15'000'000;
+    // After both streams have ended, so a lost last ACK can be repeated
+    constexpr int64_t kLingerUs = 1'000'000;
+
+    // In-order DATA packets per ACK; a gap or a duplicate is ACKed at once
+    constexpr uint32_t kAckEvery = 8;
+    constexpr int64_t kAckDelayUs = 1000;
+
+    constexpr int64_t kInitialRtoUs = 200'000;
+    constexpr int64_t kMinRtoUs = 20'000;
+    constexpr int64_t kMaxRtoUs = 2'000'000;
+    // A packet is lost once one sent this much later has been ACKed
+    constexpr int64_t kMinReorderUs = 1000;
+
+    // Rate model, after BBR: the sender paces at a gain times the largest
+    // delivery rate of the last kBandwidthRounds round trips, doubling
+    // each round at start-up, and keeps cwndGain bandwidth-delay products
+    // in flight
+    constexpr uint32_t kInitialWindow = 32; // packets
+    constexpr uint32_t kMinWindow = 16;
+    constexpr double kStartupGain = 2.885;  // 2 / ln 2
+    constexpr double kCwndGain = 2.0;
+    constexpr double kProbeGains[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+    constexpr uint32_t kBandwidthRounds = 10;
+    constexpr int64_t kMinRttWindowUs = 10'000'000;
+    // Wi-Fi ACKs arrive in bursts; the window covers at least this long
+    constexpr int64_t kAckAggregationUs = 4000;
+    // Pacing debt older than this is forgiven rather than sent in a burst
+    constexpr int64_t kMaxBurstUs = 1000;
+    constexpr double kMinPacingRate = 128 * 1024;
+
+    constexpr size_t kDataOffset = sizeof(UdpHeader);
+
+    int64_t nowUs()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    uint32_t wireTime(int64_t us)
+    {
+        return (uint32_t)us;
+    }
+
+    void setBuffers(int sock, int size)
+    {
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    void setNonBlocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    // A packet of the outgoing stream, kept until the peer has it
+    struct SentPacket
+    {
+        uint32_t sequence = 0;
+        uint16_t length = 0; // payload
+        bool acked = false;
+        bool inFlight = false; // sent, neither ACKed nor given up as lost
+        bool lost = false;     // waiting to be sent again
+        bool resent = false;
+        bool appLimited = false;
+        int64_t sentUs = 0;
+        // Delivery state when it was sent, for its rate sample
+        uint64_t delivered = 0;
+        int64_t deliveredUs = 0;
+        int64_t firstSentUs = 0;
+        uint8_t datagram[MAX_UDP_DATAGRAM]; // UdpHeader, then the payload
+
+        UdpHeader &header() { return *reinterpret_cast<UdpHeader *>(datagram); }
+        uint8_t *payload() { return datagram + kDataOffset; }
+        size_t size() const { return kDataOffset + length; }
+    };
+
+    // A packet of the incoming stream; kept after delivery until the slot
+    // is reused, so parity can still draw on it
+    struct ReceivedPacket
+    {
+        uint32_t sequence = 0;
+        bool present = false;
+        uint16_t length = 0;
+        uint8_t flags = 0;
+        uint8_t data[MAX_UDP_DATA];
+    };
+
+    // A PARITY waiting for all but one of its packets
+    struct ParityGroup
+    {
+        uint32_t first;
+        UdpParity parity;
+        uint16_t length;
+        uint8_t data[MAX_UDP_DATA];
+    };
+    constexpr size_t kMaxParityGroups = 64;
+
+    struct Delayed
+    {
+        int64_t dueUs;
+        uint64_t order;
+        std::vector<uint8_t> datagram;
+
+        bool operator>(const Delayed &other) const
+        {
+            return dueUs != other.dueUs ? dueUs > other.dueUs : order > other.order;
+        }
+    };
+
+    class UdpConnection : public std::enable_shared_from_this<UdpConnection>
+    {
+    public:
+        UdpConnection(int sock, int local, uint32_t id, const UdpSettings &settings,
+                      std::shared_ptr<UdpCounters> counters, int64_t handshakeRttUs)
+            : sock_(sock),
+              local_(local),
+              id_(id),
+              settings_(settings),
+              counters_(std::move(counters)),
+              sent_(kRing),
+              received_(kRing),
+              random_(std::random_device{}())
+        {
+            int64_t now = nowUs();
+            lastHeardUs_ = now;
+            lastSentUs_ = now;
+            deliveredUs_ = now;
+            firstSentUs_ = now;
+            // Only a first guess at the timeout: the model measures the
+            // path itself once data flows
+            if (handshakeRttUs > 0)
+            {
+                srttUs_ = handshakeRttUs;
+                rttVarUs_ = handshakeRttUs / 2;
+                rtoUs_ = std::clamp(srttUs_ + 4 * rttVarUs_, kMinRtoUs, kMaxRtoUs);
+            }
+            updateModel();
+        }
+
+        ~UdpConnection()
+        {
+            close(sock_);
+            close(local_);
+        }
+
+        void start()
+        {
+            std::thread([self = shared_from_this()]()
+                        { self->run(); })
+                .detach();
+        }
+
+    private:
+        // ===============================
+        // Event loop
+        // ===============================
+
+        void run()
+        {
+            while (!finished_)
+            {
+                int64_t now = nowUs();
+                flushDelayed(now);
+                receive(now);
+                if (finished_)
+                    break;
+                deliver();
+                fill();
+                now = nowUs();
+                checkTimers(now);
+                if (finished_)
+                    break;
+                if (ackPending_ && (ackNow_ || now >= ackDueUs_))
+                    sendAck(now);
+                pump(now);
+                wait();
+            }
+            LOGI("Reliable UDP %08x closed: %llu packets, %llu resent, %llu rebuilt from parity",
+                 id_, (unsigned long long)packets_, (unsigned long long)resent_,
+                 (unsigned long long)rebuilt_);
+        }
+
+        void wait()
+        {
+            int64_t now = nowUs();
+            int64_t deadline = now + kKeepaliveUs;
+            auto until = [&](int64_t due)
+            { deadline = std::min(deadline, due); };
+
+            if (canSend())
+                until(nextSendUs_);
+            if (ackPending_)
+                until(ackNow_ ? now : ackDueUs_);
+            if (inFlight_ > 0)
+                until(rtoDeadlineUs_);
+            if (lingerUntilUs_ > 0)
+                until(lingerUntilUs_);
+            if (!delayed_.empty())
+                until(delayed_.top().dueUs);
+            until(lastSentUs_ + kKeepaliveUs);
+            until(lastHeardUs_ + kIdleTimeoutUs);
+
+            pollfd fds[2] = {{sock_, POLLIN, 0}, {local_, 0, 0}};
+            if (!localEnded_ && sendEnd_ - sendUna_ < kRing)
+                fds[1].events |= POLLIN;
+            if (wantWrite_)
+                fds[1].events |= POLLOUT;
+
+            int64_t waitUs = std::max<int64_t>(deadline - now, 0);
+            timespec timeout{(time_t)(waitUs / 1'000'000), (long)(waitUs % 1'000'000) * 1000};
+            ppoll(fds, fds[1].events ? 2 : 1, &timeout, nullptr);
+            if (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))
+                wantWrite_ = false;
+        }
+
+        void checkTimers(int64_t now)
+        {
+            if (now - lastHeardUs_ >= kIdleTimeoutUs)
+            {
+                LOGE("Reliable UDP %08x: peer silent, dropping connection", id_);
+                abort(true);
+                return;
+            }
+            if (lingerUntilUs_ > 0 && now >= lingerUntilUs_)
+            {
+                finished_ = true;
+                return;
+            }
+            if (inFlight_ > 0 && now >= rtoDeadlineUs_)
+                onRetransmissionTimeout(now);
+            if (now - lastSentUs_ >= kKeepaliveUs)
+            {
+                ackPending_ = true;
+                ackNow_ = true;
+            }
+        }
+
+        // Both streams ended and our end of them acknowledged
+        void checkDone(int64_t now)
+        {
+            if (lingerUntilUs_ == 0 && peerEnded_ && finQueued_ && sendUna_ > finSequence_)
+                lingerUntilUs_ = now + std::max(kLingerUs, 3 * rtoUs_);
+        }
+
+        // Ends the connection at once; the caller sees its socket close
+        void abort(bool tellPeer)
+        {
+            if (tellPeer)
+            {
+                UdpHeader reset{UDP_RESET, 0, 0, id_, 0, wireTime(nowUs())};
+                send(sock_, &reset, sizeof(reset), MSG_DONTWAIT);
+            }
+            shutdown(local_, SHUT_RDWR);
+            finished_ = true;
+        }
+
+        // The peer's socket is gone. Expected while lingering, once it
+        // has finished first. Every datagram of a batch can report it.
+        void unreachable()
+        {
+            if (finished_)
+                return;
+            if (lingerUntilUs_ > 0)
+            {
+                finished_ = true;
+                return;
+            }
+            LOGE("Reliable UDP %08x: peer unreachable", id_);
+            abort(false);
+        }
+
+        // ===============================
+        // Local end
+        // ===============================
+
+        // Caller's bytes into packets
+        void fill()
+        {
+            if (sendEnd_ - sendUna_ == kRing)
+                localDrained_ = false;
+            while (!localEnded_ && sendEnd_ - sendUna_ < kRing)
+            {
+                uint32_t room = std::min<uint32_t>(kRing - (sendEnd_ - sendUna_), kLocalIov);
+                iovec iov[kLocalIov];
+                for (uint32_t i = 0; i < room; ++i)
+                {
+                    SentPacket &packet = sent_[(sendEnd_ + i) % kRing];
+                    iov[i] = {packet.payload(), MAX_UDP_DATA};
+                }
+                ssize_t n = readv(local_, iov, (int)room);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    localDrained_ = true;
+                    return;
+                }
+                if (n <= 0)
+                {
+                    // Closed or shut down for writing: the outgoing stream ends
+                    localEnded_ = true;
+                    localDrained_ = true;
+                    break;
+                }
+                size_t left = (size_t)n;
+                while (left > 0)
+                {
+                    uint16_t length = (uint16_t)std::min<size_t>(left, MAX_UDP_DATA);
+                    queuePacket(length, 0);
+                    left -= length;
+                }
+                localDrained_ = (size_t)n < room * (size_t)MAX_UDP_DATA;
+                if (localDrained_)
+                    return;
+            }
+            if (localEnded_ && !finQueued_ && sendEnd_ - sendUna_ < kRing)
+            {
+                finSequence_ = sendEnd_;
+                finQueued_ = true;
+                queuePacket(0, UDP_FLAG_FIN);
+            }
+        }
+
+        void queuePacket(uint16_t length, uint8_t flags)
+        {
+            SentPacket &packet = sent_[sendEnd_ % kRing];
+            packet.sequence = sendEnd_++;
+            packet.length = length;
+            packet.acked = false;
+            packet.inFlight = false;
+            packet.lost = false;
+            packet.resent = false;
+            packet.header() = UdpHeader{UDP_DATA, flags, length, id_, packet.sequence, 0};
+        }
+
+        // In-order packets to the caller
+        void deliver()
+        {
+            while (!wantWrite_ && receiveRead_ < receiveNext_)
+            {
+                iovec iov[kLocalIov];
+                int count = 0;
+                bool fin = false;
+                for (uint32_t seq = receiveRead_; seq < receiveNext_ && count < (int)kLocalIov; ++seq)
+                {
+                    ReceivedPacket &packet = received_[seq % kRing];
+                    if (packet.flags & UDP_FLAG_FIN)
+                    {
+                        fin = count == 0;
+                        break;
+                    }
+                    size_t skip = seq == receiveRead_ ? readOffset_ : 0;
+                    iov[count++] = {packet.data + skip, packet.length - skip};
+                }
+
+                if (fin)
+                {
+                    // Everything before it is out: the incoming stream ends
+                    shutdown(local_, SHUT_WR);
+                    receiveRead_++;
+                    readOffset_ = 0;
+                    peerEnded_ = true;
+                    checkDone(nowUs());
+                    continue;
+                }
+
+                msghdr msg{};
+                msg.msg_iov = iov;
+                msg.msg_iovlen = count;
+                ssize_t n = sendmsg(local_, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    wantWrite_ = true;
+                    return;
+                }
+                if (n < 0)
+                {
+                    // The caller closed its end with data still arriving
+                    LOGE("Reliable UDP %08x: local end closed, resetting", id_);
+                    abort(true);
+                    return;
+                }
+                consume((size_t)n);
+            }
+            // Let a sender stalled on a full window go on
+            uint32_t window = receiveWindow();
+            if (advertisedWindow_ < kRing / 4 && window >= kRing / 2)
+            {
+                ackPending_ = true;
+                ackNow_ = true;
+            }
+        }
+
+        void consume(size_t bytes)
+        {
+            while (bytes > 0)
+            {
+                ReceivedPacket &packet = received_[receiveRead_ % kRing];
+                size_t left = packet.length - readOffset_;
+                if (bytes < left)
+                {
+                    readOffset_ += bytes;
+                    return;
+                }
+                bytes -= left;
+                receiveRead_++;
+                readOffset_ = 0;
+            }
+        }
+
+        // ===============================
+        // Datagrams in
+        // ===============================
+
+        void receive(int64_t now)
+        {
+            static thread_local uint8_t buffers[kBatch][MAX_UDP_DATAGRAM];
+            for (unsigned round = 0; round < kReceiveBatches && !finished_; ++round)
+            {
+                mmsghdr msgs[kBatch];
+                iovec iov[kBatch];
+                for (unsigned i = 0; i < kBatch; ++i)
+                {
+                    iov[i] = {buffers[i], MAX_UDP_DATAGRAM};
+                    msgs[i] = {};
+                    msgs[i].msg_hdr.msg_iov = &iov[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int got = recvmmsg(sock_, msgs, kBatch, MSG_DONTWAIT, nullptr);
+                if (got < 0)
+                {
+                    if (errno == ECONNREFUSED)
+                        unreachable();
+                    return;
+                }
+                for (int i = 0; i < got && !finished_; ++i)
+                    handle(buffers[i], msgs[i].msg_len, now);
+                if (got < (int)kBatch)
+                    return;
+            }
+        }
+
+        void handle(const uint8_t *datagram, size_t size, int64_t now)
+        {
+            if (size < sizeof(UdpHeader))
+                return;
+            UdpHeader header;
+            memcpy(&header, datagram, sizeof(header));
+            if (header.connection != id_ || header.length > size - sizeof(header))
+                return;
+            lastHeardUs_ = now;
+            const uint8_t *payload = datagram + sizeof(header);
+
+            switch (header.type)
+            {
+            case UDP_DATA:
+                if (header.length <= MAX_UDP_DATA)
+                    onData(header, payload);
+                break;
+            case UDP_PARITY:
+                if (header.length >= sizeof(UdpParity) && header.length - sizeof(UdpParity) <= MAX_UDP_DATA)
+                    onParity(header, payload);
+                break;
+            case UDP_ACK:
+                if (header.length >= sizeof(UdpAck))
+                {
+                    UdpAck ack;
+                    memcpy(&ack, payload, sizeof(ack));
+                    onAck(ack, now);
+                }
+                break;
+            case UDP_RESET:
+                LOGE("Reliable UDP %08x reset by peer", id_);
+                abort(false);
+                break;
+            default:
+                break;
+            }
+        }
+
+        bool haveReceived(uint32_t sequence) const
+        {
+            const ReceivedPacket &packet = received_[sequence % kRing];
+            return packet.present && packet.sequence == sequence;
+        }
+
+        uint32_t receiveWindow() const
+        {
+            return receiveRead_ + kRing - receiveNext_;
+        }
+
+        void onData(const UdpHeader &header, const uint8_t *payload)
+        {
+            uint32_t seq = header.sequence;
+            ackPending_ = true;
+            lastEcho_ = header.timestamp;
+            if (seq < receiveNext_ || seq >= receiveRead_ + kRing || haveReceived(seq))
+            {
+                // Our ACK went missing
+                ackNow_ = true;
+                return;
+            }
+            if (seq > receiveEnd_)
+                ackNow_ = true; // a new gap
+            store(seq, payload, header.length, header.flags);
+            if (header.flags & UDP_FLAG_FIN)
+                ackNow_ = true;
+            tryParityFor(seq);
+        }
+
+        void store(uint32_t seq, const uint8_t *payload, uint16_t length, uint8_t flags)
+        {
+            ReceivedPacket &packet = received_[seq % kRing];
+            packet.sequence = seq;
+            packet.present = true;
+            packet.length = length;
+            packet.flags = flags;
+            memcpy(packet.data, payload, length);
+
+            receiveEnd_ = std::max(receiveEnd_, seq + 1);
+            while (receiveNext_ < receiveRead_ + kRing && haveReceived(receiveNext_))
+                receiveNext_++;
+            if (++unacked_ >= kAckEvery)
+                ackNow_ = true;
+            if (ackDueUs_ == 0)
+                ackDueUs_ = nowUs() + kAckDelayUs;
+            ackPending_ = true;
+        }
+
+        void onParity(const UdpHeader &header, const uint8_t *payload)
+        {
+            ParityGroup group;
+            group.first = header.sequence;
+            memcpy(&group.parity, payload, sizeof(UdpParity));
+            group.length = (uint16_t)(header.length - sizeof(UdpParity));
+            if (group.parity.count == 0 || group.parity.count > kRing)
+                return;
+            memcpy(group.data, payload + sizeof(UdpParity), group.length);
+            if (group.first + group.parity.count <= receiveNext_)
+                return; // nothing missing
+
+            if (!recover(group))
+            {
+                if (parity_.size() == kMaxParityGroups)
+                    parity_.pop_front();
+                parity_.push_back(group);
+            }
+        }
+
+        void tryParityFor(uint32_t seq)
+        {
+            for (auto it = parity_.begin(); it != parity_.end();)
+            {
+                bool settled = it->first + it->parity.count <= receiveNext_;
+                if (!settled && seq >= it->first && seq < it->first + it->parity.count)
+                    settled = recover(*it);
+                it = settled ? parity_.erase(it) : it + 1;
+            }
+        }
+
+        // Rebuilds the one packet of `group` still missing. True once the
+        // group is of no further use: rebuilt, complete, or its other
+        // packets gone from the ring.
+        bool recover(const ParityGroup &group)
+        {
+            uint32_t missing = 0;
+            uint32_t missingCount = 0;
+            for (uint32_t seq = group.first; seq < group.first + group.parity.count; ++seq)
+            {
+                if (haveReceived(seq))
+                    continue;
+                if (seq < receiveNext_ || seq >= receiveRead_ + kRing)
+                    return true;
+                missing = seq;
+                if (++missingCount > 1)
+                    return false;
+            }
+            if (missingCount == 0)
+                return true;
+
+            uint8_t data[MAX_UDP_DATA];
+            memcpy(data, group.data, group.length);
+            uint16_t length = group.parity.lengths;
+            uint8_t flags = group.parity.flags;
+            for (uint32_t seq = group.first; seq < group.first + group.parity.count; ++seq)
+            {
+                if (seq == missing)
+                    continue;
+                const ReceivedPacket &packet = received_[seq % kRing];
+                for (uint16_t i = 0; i < packet.length; ++i)
+                    data[i] ^= packet.data[i];
+                length ^= packet.length;
+                flags ^= packet.flags;
+            }
+            if (length > group.length)
+                return true; // inconsistent; the sender resends it anyway
+
+            store(missing, data, length, flags);
+            ackNow_ = true;
+            rebuilt_++;
+            counters_->recovered++;
+            return true;
+        }
+
+        void sendAck(int64_t now)
+        {
+            uint8_t datagram[sizeof(UdpHeader) + sizeof(UdpAck)];
+            UdpHeader header{UDP_ACK, 0, sizeof(UdpAck), id_, 0, wireTime(now)};
+            UdpAck ack{};
+            ack.cumulative = receiveNext_;
+            ack.window = receiveWindow();
+            ack.echo = lastEcho_;
+            uint32_t end = std::min(receiveEnd_, receiveNext_ + 1 + UDP_SACK_PACKETS);
+            for (uint32_t seq = receiveNext_ + 1; seq < end; ++seq)
+            {
+                if (haveReceived(seq))
+                {
+                    uint32_t bit = seq - receiveNext_ - 1;
+                    ack.sack[bit / 8] |= (uint8_t)(1u << (bit % 8));
+                }
+            }
+            memcpy(datagram, &header, sizeof(header));
+            memcpy(datagram + sizeof(header), &ack, sizeof(ack));
+            transmit(datagram, sizeof(datagram), now);
+            flush();
+
+            advertisedWindow_ = ack.window;
+            ackPending_ = false;
+            ackNow_ = false;
+            ackDueUs_ = 0;
+            unacked_ = 0;
+        }
+
+        // ===============================
+        // ACKs in
+        // ===============================
+
+        void onAck(const UdpAck &ack, int64_t now)
+        {
+            if (ack.cumulative > sendNext_)
+                return;
+            peerCumulative_ = std::max(peerCumulative_, ack.cumulative);
+            peerWindow_ = ack.window;
+
+            SentPacket *newest = nullptr;
+            bool any = false;
+            auto markAcked = [&](uint32_t seq)
+            {
+                SentPacket &packet = sent_[seq % kRing];
+                if (packet.sequence != seq || packet.acked)
+                    return;
+                packet.acked = true;
+                if (packet.inFlight)
+                {
+                    packet.inFlight = false;
+                    inFlight_--;
+                    inFlightBytes_ -= packet.size();
+                }
+                packet.lost = false;
+                // ACKed sooner than any round trip: the first copy got
+                // there, just late. Wait longer before calling a gap lost.
+                if (packet.resent && now - packet.sentUs < minRttUs_)
+                    reorderUs_ = std::min(reorderUs_ * 2, std::max(srttUs_, kMinReorderUs));
+                delivered_ += packet.size();
+                if (!newest || packet.sentUs > newest->sentUs)
+                    newest = &packet;
+                any = true;
+            };
+
+            // One past the highest packet the peer has
+            uint32_t top = ack.cumulative;
+            for (uint32_t seq = sendUna_; seq < ack.cumulative; ++seq)
+                markAcked(seq);
+            for (uint32_t word = 0; word < UDP_SACK_PACKETS / 8; ++word)
+            {
+                for (uint8_t bits = ack.sack[word]; bits; bits &= bits - 1)
+                {
+                    uint32_t seq = ack.cumulative + 1 + word * 8 + std::countr_zero(bits);
+                    if (seq < sendNext_)
+                    {
+                        markAcked(seq);
+                        top = seq + 1;
+                    }
+                }
+            }
+            while (sendUna_ < sendNext_ && sent_[sendUna_ % kRing].acked)
+                sendUna_++;
+
+            if (!any)
+                return;
+
+            uint32_t rtt = wireTime(now) - ack.echo;
+            if (rtt < (uint32_t)kMaxRtoUs * 4)
+                sampleRtt(rtt, now);
+            rtoDeadlineUs_ = now + rtoUs_;
+
+            // Rate sample from the newest packet delivered
+            deliveredUs_ = now;
+            firstSentUs_ = newest->sentUs;
+            if (appLimitedUntil_ > 0 && delivered_ > appLimitedUntil_)
+                appLimitedUntil_ = 0;
+            bool roundStart = newest->delivered >= nextRoundDelivered_;
+            if (roundStart)
+                nextRoundDelivered_ = delivered_;
+            int64_t interval = std::max(newest->sentUs - newest->firstSentUs, now - newest->deliveredUs);
+            if (interval > 0 && interval >= minRttUs_)
+                sampleBandwidth((double)(delivered_ - newest->delivered) * 1e6 / interval,
+                                newest->appLimited, roundStart, now);
+            else if (roundStart)
+                sampleBandwidth(0, true, true, now);
+
+            rackSentUs_ = std::max(rackSentUs_, newest->sentUs);
+            detectLosses(ack, top);
+            updateModel();
+            checkDone(now);
+        }
+
+        // Gaps below `top` that were sent well before a packet the peer
+        // already has
+        void detectLosses(const UdpAck &ack, uint32_t top)
+        {
+            int64_t reorder = std::max(minRttUs_ / 4, reorderUs_);
+            auto check = [&](uint32_t seq)
+            {
+                SentPacket &packet = sent_[seq % kRing];
+                if (packet.sequence == seq && packet.inFlight && packet.sentUs + reorder <= rackSentUs_)
+                    markLost(packet);
+            };
+
+            if (ack.cumulative < top)
+                check(ack.cumulative);
+            for (uint32_t word = 0; word < UDP_SACK_PACKETS / 8; ++word)
+            {
+                uint32_t base = ack.cumulative + 1 + word * 8;
+                if (base >= top)
+                    break;
+                for (uint8_t holes = (uint8_t)~ack.sack[word]; holes; holes &= holes - 1)
+                {
+                    uint32_t seq = base + std::countr_zero(holes);
+                    if (seq >= top)
+                        break;
+                    check(seq);
+                }
+            }
+        }
+
+        void markLost(SentPacket &packet)
+        {
+            packet.inFlight = false;
+            packet.lost = true;
+            inFlight_--;
+            inFlightBytes_ -= packet.size();
+            lost_.push_back(packet.sequence);
+        }
+
+        void onRetransmissionTimeout(int64_t now)
+        {
+            bool any = false;
+            for (uint32_t seq = sendUna_; seq < sendNext_; ++seq)
+            {
+                SentPacket &packet = sent_[seq % kRing];
+                if (packet.inFlight && packet.sentUs + rtoUs_ <= now)
+                {
+                    markLost(packet);
+                    any = true;
+                }
+            }
+            if (any)
+                rtoUs_ = std::min(rtoUs_ * 2, kMaxRtoUs);
+            rtoDeadlineUs_ = now + rtoUs_;
+        }
+
+        // ===============================
+        // Rate model
+        // ===============================
+
+        void sampleRtt(int64_t rtt, int64_t now)
+        {
+            rtt = std::max<int64_t>(rtt, 1);
+            if (srttUs_ == 0)
+            {
+                srttUs_ = rtt;
+                rttVarUs_ = rtt / 2;
+            }
+            else
+            {
+                int64_t delta = std::abs(srttUs_ - rtt);
+                rttVarUs_ = (3 * rttVarUs_ + delta) / 4;
+                srttUs_ = (7 * srttUs_ + rtt) / 8;
+            }
+            rtoUs_ = std::clamp(srttUs_ + 4 * rttVarUs_, kMinRtoUs, kMaxRtoUs);
+            if (minRttUs_ == 0 || rtt <= minRttUs_ || now - minRttStampUs_ > kMinRttWindowUs)
+            {
+                minRttUs_ = rtt;
+                minRttStampUs_ = now;
+            }
+        }
+
+        void sampleBandwidth(double rate, bool appLimited, bool roundStart, int64_t now)
+        {
+            if (roundStart)
+            {
+                rounds_++;
+                bandwidth_[rounds_ % kBandwidthRounds] = 0;
+            }
+            double &slot = bandwidth_[rounds_ % kBandwidthRounds];
+            if (!appLimited || rate >= bottleneck_)
+                slot = std::max(slot, rate);
+            bottleneck_ = *std::max_element(std::begin(bandwidth_), std::end(bandwidth_));
+
+            if (phase_ == Phase::Drain && inFlightBytes_ <= bdp())
+            {
+                phase_ = Phase::ProbeBandwidth;
+                cycle_ = 2 + random_() % 6;
+                cycleStampUs_ = now;
+            }
+            if (!roundStart)
+                return;
+            switch (phase_)
+            {
+            case Phase::Startup:
+                if (bottleneck_ >= fullBandwidth_ * 1.25)
+                {
+                    fullBandwidth_ = bottleneck_;
+                    fullRounds_ = 0;
+                }
+                else if (!appLimited && ++fullRounds_ >= 3)
+                {
+                    phase_ = Phase::Drain;
+                }
+                break;
+            case Phase::Drain:
+                break;
+            case Phase::ProbeBandwidth:
+                if (now - cycleStampUs_ > minRttUs_)
+                {
+                    cycle_ = (cycle_ + 1) % std::size(kProbeGains);
+                    cycleStampUs_ = now;
+                }
+                break;
+            }
+        }
+
+        double bdp() const
+        {
+            return bottleneck_ * std::max(minRttUs_, kAckAggregationUs) / 1e6;
+        }
+
+        void updateModel()
+        {
+            double gain = phase_ == Phase::Startup ? kStartupGain
+                          : phase_ == Phase::Drain ? 1 / kStartupGain
+                                                   : kProbeGains[cycle_];
+            uint32_t window = kInitialWindow;
+            double rate;
+            if (bottleneck_ > 0)
+            {
+                rate = gain * bottleneck_;
+                double cwndGain = phase_ == Phase::ProbeBandwidth ? kCwndGain : kStartupGain;
+                window = (uint32_t)std::ceil(cwndGain * bdp() / MAX_UDP_DATAGRAM);
+            }
+            else
+            {
+                // Nothing measured yet: the initial window per round trip
+                int64_t rtt = std::max<int64_t>(srttUs_ ? srttUs_ : 1000, 1);
+                rate = kStartupGain * kInitialWindow * MAX_UDP_DATAGRAM * 1e6 / rtt;
+            }
+            pacingRate_ = std::max(rate, kMinPacingRate);
+            window_ = std::clamp(window, kMinWindow, kRing);
+        }
+
+        // ===============================
+        // Datagrams out
+        // ===============================
+
+        bool windowOpen() const
+        {
+            return inFlight_ < window_;
+        }
+
+        bool newData() const
+        {
+            return sendNext_ < sendEnd_ && sendNext_ < peerCumulative_ + peerWindow_;
+        }
+
+        bool groupFull() const
+        {
+            return settings_.fecGroup > 0 && parityCount_ >= settings_.fecGroup;
+        }
+
+        // A group left part-way because the caller has nothing more yet
+        bool groupStalled() const
+        {
+            return parityCount_ > 0 && !newData() && localDrained_;
+        }
+
+        bool canSend() const
+        {
+            return windowOpen() && (!lost_.empty() || groupFull() || newData() || groupStalled());
+        }
+
+        // Sends what pacing and the window allow: resends first, then
+        // parity for a finished group, then new packets
+        void pump(int64_t now)
+        {
+            nextSendUs_ = std::max(nextSendUs_, now - kMaxBurstUs);
+            while (nextSendUs_ <= now)
+            {
+                size_t bytes = 0;
+                if (!windowOpen())
+                    break;
+                if (!lost_.empty())
+                {
+                    uint32_t seq = lost_.front();
+                    lost_.pop_front();
+                    SentPacket &packet = sent_[seq % kRing];
+                    if (packet.sequence != seq || !packet.lost)
+                        continue;
+                    bytes = sendPacket(packet, now);
+                    packet.resent = true;
+                    resent_++;
+                    counters_->retransmits++;
+                }
+                else if (groupFull())
+                {
+                    bytes = sendParity(now);
+                }
+                else if (newData())
+                {
+                    SentPacket &packet = sent_[sendNext_++ % kRing];
+                    bytes = sendPacket(packet, now);
+                    if (settings_.fecGroup > 0)
+                        addParity(packet);
+                    packets_++;
+                    counters_->packetsSent++;
+                }
+                else if (groupStalled())
+                {
+                    bytes = sendParity(now);
+                }
+                else
+                {
+                    if (localDrained_)
+                        appLimitedUntil_ = std::max<uint64_t>(delivered_ + inFlightBytes_, 1);
+                    break;
+                }
+                nextSendUs_ += (int64_t)(bytes * 1e6 / pacingRate_);
+            }
+            flush();
+        }
+
+        size_t sendPacket(SentPacket &packet, int64_t now)
+        {
+            if (inFlight_ == 0)
+                rtoDeadlineUs_ = now + rtoUs_;
+            packet.header().timestamp = wireTime(now);
+            packet.sentUs = now;
+            packet.delivered = delivered_;
+            packet.deliveredUs = deliveredUs_;
+            packet.firstSentUs = firstSentUs_;
+            packet.appLimited = appLimitedUntil_ > 0;
+            packet.inFlight = true;
+            packet.lost = false;
+            inFlight_++;
+            inFlightBytes_ += packet.size();
+            transmit(packet.datagram, packet.size(), now);
+            return packet.size();
+        }
+
+        void addParity(SentPacket &packet)
+        {
+            if (parityCount_ == 0)
+            {
+                parityFirst_ = packet.sequence;
+                parityLength_ = 0;
+                parityLengths_ = 0;
+                parityFlags_ = 0;
+            }
+            if (packet.length > parityLength_)
+            {
+                memset(parityData_ + parityLength_, 0, packet.length - parityLength_);
+                parityLength_ = packet.length;
+            }
+            const uint8_t *payload = packet.payload();
+            for (uint16_t i = 0; i < packet.length; ++i)
+                parityData_[i] ^= payload[i];
+            parityLengths_ ^= packet.length;
+            parityFlags_ ^= packet.header().flags;
+            parityCount_++;
+        }
+
+        size_t sendParity(int64_t now)
+        {
+            uint8_t datagram[MAX_UDP_DATAGRAM];
+            uint16_t length = (uint16_t)(sizeof(UdpParity) + parityLength_);
+            UdpHeader header{UDP_PARITY, 0, length, id_, parityFirst_, wireTime(now)};
+            UdpParity parity{(uint16_t)parityCount_, parityLengths_, parityFlags_, {}};
+            memcpy(datagram, &header, sizeof(header));
+            memcpy(datagram + sizeof(header), &parity, sizeof(parity));
+            memcpy(datagram + sizeof(header) + sizeof(parity), parityData_, parityLength_);
+            parityCount_ = 0;
+            counters_->paritySent++;
+            transmit(datagram, sizeof(header) + length, now);
+            return sizeof(header) + length;
+        }
+
+        // Queues a datagram for the next flush(), through the impairment
+        void transmit(const uint8_t *datagram, size_t size, int64_t now)
+        {
+            lastSentUs_ = now;
+            const LinkImpairment &impairment = settings_.impairment;
+            if (impairment.loss > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < impairment.loss)
+            {
+                counters_->impairedDrops++;
+                return;
+            }
+            if (impairment.delayMs > 0 || impairment.jitterMs > 0)
+            {
+                int64_t delay = (int64_t)impairment.delayMs * 1000;
+                if (impairment.jitterMs > 0)
+                    delay += random_() % ((uint64_t)impairment.jitterMs * 1000);
+                delayed_.push(Delayed{now + delay, delayedOrder_++,
+                                      std::vector<uint8_t>(datagram, datagram + size)});
+                return;
+            }
+            if (batchCount_ == kBatch)
+                flush();
+            memcpy(batch_[batchCount_], datagram, size);
+            batchSizes_[batchCount_++] = size;
+        }
+
+        void flushDelayed(int64_t now)
+        {
+            while (!delayed_.empty() && delayed_.top().dueUs <= now)
+            {
+                const std::vector<uint8_t> &datagram = delayed_.top().datagram;
+                if (batchCount_ == kBatch)
+                    flush();
+                memcpy(batch_[batchCount_], datagram.data(), datagram.size());
+                batchSizes_[batchCount_++] = datagram.size();
+                delayed_.pop();
+            }
+            flush();
+        }
+
+        void flush()
+        {
+            mmsghdr msgs[kBatch];
+            iovec iov[kBatch];
+            unsigned sentCount = 0;
+            while (sentCount < batchCount_)
+            {
+                unsigned count = batchCount_ - sentCount;
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    iov[i] = {batch_[sentCount + i], batchSizes_[sentCount + i]};
+                    msgs[i] = {};
+                    msgs[i].msg_hdr.msg_iov = &iov[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int n = sendmmsg(sock_, msgs, count, MSG_DONTWAIT);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    if (n < 0 && errno == ECONNREFUSED)
+                    {
+                        batchCount_ = 0;
+                        unreachable();
+                        return;
+                    }
+                    // A full socket buffer drops the rest, like the network would
+                    break;
+                }
+                sentCount += (unsigned)n;
+            }
+            batchCount_ = 0;
+        }
+
+        enum class Phase
+        {
+            Startup,
+            Drain,
+            ProbeBandwidth
+        };
+
+        const int sock_;
+        const int local_;
+        const uint32_t id_;
+        const UdpSettings settings_;
+        std::shared_ptr<UdpCounters> counters_;
+        bool finished_ = false;
+
+        // Outgoing stream: [sendUna_, sendNext_) sent, [sendNext_, sendEnd_)
+        // read from the caller and waiting
+        std::vector<SentPacket> sent_;
+        uint32_t sendUna_ = 0;
+        uint32_t sendNext_ = 0;
+        uint32_t sendEnd_ = 0;
+        uint32_t inFlight_ = 0;
+        uint64_t inFlightBytes_ = 0;
+        std::deque<uint32_t> lost_;
+        uint32_t peerCumulative_ = 0;
+        uint32_t peerWindow_ = kRing;
+        bool localEnded_ = false;
+        bool localDrained_ = false; // the caller's last bytes are all read
+        bool finQueued_ = false;
+        uint32_t finSequence_ = 0;
+
+        // Parity of the group being sent
+        uint32_t parityFirst_ = 0;
+        uint32_t parityCount_ = 0;
+        uint16_t parityLength_ = 0;
+        uint16_t parityLengths_ = 0;
+        uint8_t parityFlags_ = 0;
+        uint8_t parityData_[MAX_UDP_DATA];
+
+        // Incoming stream: [receiveRead_, receiveNext_) complete and not
+        // yet taken by the caller, [receiveNext_, receiveEnd_) partly arrived
+        std::vector<ReceivedPacket> received_;
+        uint32_t receiveRead_ = 0;
+        size_t readOffset_ = 0; // into the packet at receiveRead_
+        uint32_t receiveNext_ = 0;
+        uint32_t receiveEnd_ = 0;
+        bool peerEnded_ = false;
+        bool wantWrite_ = false;
+        std::deque<ParityGroup> parity_;
+
+        bool ackPending_ = false;
+        bool ackNow_ = false;
+        int64_t ackDueUs_ = 0;
+        uint32_t unacked_ = 0;
+        uint32_t lastEcho_ = 0;
+        uint32_t advertisedWindow_ = kRing;
+
+        // Timers
+        int64_t lastHeardUs_;
+        int64_t lastSentUs_;
+        int64_t rtoDeadlineUs_ = 0;
+        int64_t lingerUntilUs_ = 0;
+        int64_t nextSendUs_ = 0;
+
+        // Round-trip times
+        int64_t srttUs_ = 0;
+        int64_t rttVarUs_ = 0;
+        int64_t rtoUs_ = kInitialRtoUs;
+        int64_t minRttUs_ = 0;
+        int64_t minRttStampUs_ = 0;
+        int64_t rackSentUs_ = 0; // newest send time among ACKed packets
+        int64_t reorderUs_ = kMinReorderUs; // grows with spurious resends
+
+        // Delivery rate
+        uint64_t delivered_ = 0;
+        int64_t deliveredUs_;
+        int64_t firstSentUs_;
+        uint64_t appLimitedUntil_ = 0;
+        uint64_t nextRoundDelivered_ = 0;
+        uint64_t rounds_ = 0;
+        double bandwidth_[kBandwidthRounds] = {};
+        double bottleneck_ = 0; // bytes per second
+        Phase phase_ = Phase::Startup;
+        double fullBandwidth_ = 0;
+        uint32_t fullRounds_ = 0;
+        uint32_t cycle_ = 0;
+        int64_t cycleStampUs_ = 0;
+        double pacingRate_ = kMinPacingRate;
+        uint32_t window_ = kInitialWindow;
+
+        // Datagrams waiting for flush(), and those the impairment holds
+        uint8_t batch_[kBatch][MAX_UDP_DATAGRAM];
+        size_t batchSizes_[kBatch];
+        unsigned batchCount_ = 0;
+        std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed_;
+        uint64_t delayedOrder_ = 0;
+        std::mt19937_64 random_;
+
+        uint64_t packets_ = 0;
+        uint64_t resent_ = 0;
+        uint64_t rebuilt_ = 0;
+    };
+
+    uint32_t newConnectionId()
+    {
+        uint32_t id = 0;
+        while (id == 0)
+        {
+            if (!randomBytes(&id, sizeof(id)))
+                id = (uint32_t)nowUs();
+        }
+        return id;
+    }
+
+    // Starts the connection's thread on a connected UDP socket; returns
+    // the caller's end of the pair in `local`
+    std::shared_ptr<UdpConnection> startConnection(int sock, uint32_t id, const UdpSettings &settings,
+                                                   std::shared_ptr<UdpCounters> counters,
+                                                   int64_t handshakeRttUs, int &local)
+    {
+        local = -1;
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0)
+        {
+            LOGE("socketpair failed (errno=%d)", errno);
+            close(sock);
+            return nullptr;
+        }
+        int buffer = kLocalBuffer;
+        for (int end : pair)
+            setsockopt(end, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        setNonBlocking(sock);
+        setNonBlocking(pair[1]);
+
+        auto connection = std::make_shared<UdpConnection>(sock, pair[1], id, settings, std::move(counters),
+                                                          handshakeRttUs);
+        connection->start();
+        local = pair[0];
+        return connection;
+    }
+}
+
+int swiftshare::connectUdp(const std::string &ip, uint16_t port, const UdpSettings &settings,
+                           std::shared_ptr<UdpCounters> counters)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
+    {
+        LOGE("Invalid IP address");
+        return -1;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        LOGE("socket() failed");
+        return -1;
+    }
+    setBuffers(sock, kUdpBuffer);
+    // Connected to the listener for the handshake, so a host without one
+    // answers with an ICMP error rather than silence
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOGE("connect() failed");
+        close(sock);
+        return -1;
+    }
+
+    uint32_t id = newConnectionId();
+    int64_t start = nowUs();
+    int64_t nextSyn = start;
+    for (;;)
+    {
+        int64_t now = nowUs();
+        if (now - start >= kConnectTimeoutUs)
+        {
+            LOGE("No reliable-UDP receiver answered at %s:%u", ip.c_str(), port);
+            close(sock);
+            return -1;
+        }
+        if (now >= nextSyn)
+        {
+            uint8_t syn[sizeof(UdpHeader) + sizeof(UdpSyn)];
+            UdpHeader header{UDP_SYN, 0, sizeof(UdpSyn), id, 0, wireTime(now)};
+            UdpSyn body{UDP_VERSION, {}};
+            memcpy(syn, &header, sizeof(header));
+            memcpy(syn + sizeof(header), &body, sizeof(body));
+            send(sock, syn, sizeof(syn), 0);
+            nextSyn = now + kSynIntervalUs;
+        }
+
+        pollfd fd{sock, POLLIN, 0};
+        if (poll(&fd, 1, (int)((nextSyn - now + 999) / 1000)) <= 0)
+            continue;
+        uint8_t reply[MAX_UDP_DATAGRAM];
+        ssize_t n = recv(sock, reply, sizeof(reply), MSG_DONTWAIT);
+        if (n < 0 && errno == ECONNREFUSED)
+        {
+            LOGE("No reliable-UDP receiver at %s:%u", ip.c_str(), port);
+            close(sock);
+            return -1;
+        }
+        UdpHeader header;
+        UdpSynAck synAck;
+        if (n < (ssize_t)(sizeof(header) + sizeof(synAck)))
+            continue;
+        memcpy(&header, reply, sizeof(header));
+        memcpy(&synAck, reply + sizeof(header), sizeof(synAck));
+        if (header.type != UDP_SYN_ACK || header.connection != id || synAck.port == 0)
+            continue;
+
+        int64_t rtt = (int64_t)(wireTime(nowUs()) - header.timestamp);
+        addr.sin_port = htons(synAck.port);
+        if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            LOGE("connect() failed");
+            close(sock);
+            return -1;
+        }
+
+        int local;
+        if (!startConnection(sock, id, settings, std::move(counters), rtt, local))
+            return -1;
+        // Times out like a TCP socket from connectToReceiver() would
+        setSocketTimeouts(local);
+        LOGI("Reliable UDP %08x to %s:%u (rtt %.2f ms, parity every %u packets)", id, ip.c_str(),
+             synAck.port, rtt / 1000.0, settings.fecGroup);
+        return local;
+    }
+}
+
+// ===============================
+// UdpListener
+// ===============================
+
+UdpListener::UdpListener() : sock_(-1) {}
+
+UdpListener::~UdpListener()
+{
+    if (sock_ >= 0)
+        close(sock_);
+}
+
+bool UdpListener::open(uint16_t port)
+{
+    sock_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (sock_ < 0)
+    {
+        LOGE("socket() failed");
+        return false;
+    }
+    int yes = 1;
+    setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock_, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOGE("Reliable UDP bind failed on port %u (errno=%d)", port, errno);
+        close(sock_);
+        sock_ = -1;
+        return false;
+    }
+    return true;
+}
+
+void UdpListener::accept(const UdpSettings &settings, const std::shared_ptr<UdpCounters> &counters,
+                         const std::function<void(int local)> &onConnection)
+{
+    accepted_.erase(std::remove_if(accepted_.begin(), accepted_.end(), [](const Accepted &a)
+                                   { return a.alive.expired(); }),
+                    accepted_.end());
+
+    for (;;)
+    {
+        uint8_t datagram[MAX_UDP_DATAGRAM];
+        sockaddr_in from{};
+        socklen_t fromLen = sizeof(from);
+        ssize_t n = recvfrom(sock_, datagram, sizeof(datagram), 0, (sockaddr *)&from, &fromLen);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return;
+
+        UdpHeader header;
+        UdpSyn syn;
+        if (n < (ssize_t)(sizeof(header) + sizeof(syn)))
+            continue;
+        memcpy(&header, datagram, sizeof(header));
+        memcpy(&syn, datagram + sizeof(header), sizeof(syn));
+        if (header.type != UDP_SYN || header.connection == 0 || syn.version != UDP_VERSION)
+            continue;
+
+        auto it = std::find_if(accepted_.begin(), accepted_.end(), [&](const Accepted &a)
+                               { return a.connection == header.connection &&
+                                        a.peer.sin_addr.s_addr == from.sin_addr.s_addr &&
+                                        a.peer.sin_port == from.sin_port; });
+        uint16_t port;
+        if (it != accepted_.end())
+        {
+            port = it->port; // our SYN_ACK was lost
+        }
+        else
+        {
+            int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            if (sock < 0)
+            {
+                LOGE("socket() failed");
+                continue;
+            }
+            setBuffers(sock, kUdpBuffer);
+            sockaddr_in any{};
+            any.sin_family = AF_INET;
+            socklen_t len = sizeof(any);
+            if (bind(sock, (sockaddr *)&any, sizeof(any)) < 0 ||
+                connect(sock, (sockaddr *)&from, sizeof(from)) < 0 ||
+                getsockname(sock, (sockaddr *)&any, &len) < 0)
+            {
+                LOGE("Reliable UDP socket setup failed (errno=%d)", errno);
+                close(sock);
+                continue;
+            }
+            port = ntohs(any.sin_port);
+
+            int local;
+            auto connection = startConnection(sock, header.connection, settings, counters, 0, local);
+            if (!connection)
+                continue;
+            accepted_.push_back(Accepted{from, header.connection, port, connection});
+            char address[INET_ADDRSTRLEN] = {};
+            inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+            LOGI("Reliable UDP %08x from %s", header.connection, address);
+            onConnection(local);
+        }
+
+        uint8_t reply[sizeof(UdpHeader) + sizeof(UdpSynAck)];
+        UdpHeader answer{UDP_SYN_ACK, 0, sizeof(UdpSynAck), header.connection, 0, header.timestamp};
+        UdpSynAck body{port, {}};
+        memcpy(reply, &answer, sizeof(answer));
+        memcpy(reply + sizeof(answer), &body, sizeof(body));
+        sendto(sock_, reply, sizeof(reply), 0, (sockaddr *)&from, sizeof(from));
+    }
+}
@@ -0,0 +1,105 @@
+#include "wire_codec.h"
+#include "telemetry.h"
+#include <sys/socket.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Exact readers only ever hold framing
+    constexpr size_t kFramingBuffer = 2 * wire::kMaxFraming;
+    // Smallest buffer worth a refill of a buffered reader
+    constexpr size_t kMinBuffer = 64 * 1024;
+}
+
+FrameReader::FrameReader(int sock, bool buffered, Telemetry &telemetry)
+    : sock_(sock),
+      buffered_(buffered),
+      buffer_(nullptr),
+      capacity_(0),
+      start_(0),
+      end_(0),
+      bound_(0),
+      telemetry_(telemetry) {}
+
+FrameReader::~FrameReader()
+{
+    free(buffer_);
+}
+
+void FrameReader::setBound(uint64_t streamBytes)
+{
+    bound_ = streamBytes > pending() ? streamBytes - pending() : 0;
+}
+
+bool FrameReader::read(void *data, size_t len, size_t ahead)
+{
+    if (pending() < len && !fill(len, ahead))
+        return false;
+    memcpy(data, buffer_ + start_, len);
+    start_ += len;
+    return true;
+}
+
+const char *FrameReader::take(size_t max, size_t &len)
+{
+    size_t want = std::min(max, std::max(capacity_ / 4, (size_t)1));
+    if (pending() < want && !fill(want, 0) && pending() == 0)
+        return nullptr;
+    len = std::min(max, pending());
+    const char *data = buffer_ + start_;
+    start_ += len;
+    return data;
+}
+
+// Reads until `need` bytes are buffered. Exact readers stop at `need`
+// plus `ahead`; buffered ones take whatever the socket has, within the
+// bound.
+bool FrameReader::fill(size_t need, size_t ahead)
+{
+    if (!buffer_)
+    {
+        // Sized for the stream, so a small file does not cost a large buffer
+        capacity_ = buffered_ ? (size_t)std::clamp<uint64_t>(bound_ + pending(), kMinBuffer, kBufferSize)
+                              : kFramingBuffer;
+        buffer_ = static_cast<char *>(malloc(capacity_));
+        if (!buffer_)
+        {
+            LOGE("Failed to allocate frame buffer");
+            return false;
+        }
+    }
+    if (need > capacity_)
+        return false;
+
+    if (start_ > 0)
+    {
+        memmove(buffer_, buffer_ + start_, end_ - start_);
+        end_ -= start_;
+        start_ = 0;
+    }
+
+    while (end_ < need)
+    {
+        size_t missing = need - end_;
+        size_t want = buffered_ ? std::max<uint64_t>(missing, std::min<uint64_t>(capacity_ - end_, bound_))
+                                : std::min(missing + ahead, capacity_ - end_);
+        uint64_t t0 = telemetry_.start();
+        ssize_t n = recv(sock_, buffer_ + end_, want, buffered_ ? 0 : MSG_WAITALL);
+        telemetry_.record(Probe::Recv, t0, n > 0 ? (uint64_t)n : 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        end_ += (size_t)n;
+        bound_ -= std::min<uint64_t>(bound_, (uint64_t)n);
+    }
+    return true;
+}
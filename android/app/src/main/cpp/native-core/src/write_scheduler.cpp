@@ -0,0 +1,121 @@
+#include "write_scheduler.h"
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // O_DIRECT needs block-aligned offsets; a resume may start anywhere
+    constexpr uint64_t kDirectAlign = 4096;
+
+    // bionic declares sync_file_range() from API 26 on. Before that the
+    // syscall is usable directly where 64-bit arguments need no pairing.
+    int syncRange(int fd, uint64_t offset, uint64_t length, unsigned int flags)
+    {
+#if !defined(__ANDROID__) || __ANDROID_API__ >= 26
+        return sync_file_range(fd, (off64_t)offset, (off64_t)length, flags);
+#elif defined(__LP64__)
+        return (int)syscall(__NR_sync_file_range, fd, (off64_t)offset, (off64_t)length, flags);
+#else
+        // Old 32-bit releases can only wait, so a window is flushed when
+        // it is due to be dropped rather than started early
+        (void)offset;
+        (void)length;
+        return (flags & SYNC_FILE_RANGE_WAIT_AFTER) ? fdatasync(fd) : 0;
+#endif
+    }
+}
+
+bool swiftshare::preallocate(int fd, uint64_t offset, uint64_t end)
+{
+    if (end <= offset)
+        return true;
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)(end - offset)) == 0)
+        return true;
+    if (errno == ENOSPC)
+    {
+        LOGE("Not enough space for %llu more bytes", (unsigned long long)(end - offset));
+        return false;
+    }
+    // EOPNOTSUPP and friends: the file is written without a reservation
+    return true;
+}
+
+// ===============================
+// Receiver
+// ===============================
+
+WriteScheduler::WriteScheduler(int fd, uint64_t offset, uint64_t fileSize, uint32_t window, bool direct)
+    : fd_(fd),
+      started_(offset),
+      dropped_(offset),
+      window_(window),
+      direct_(false)
+{
+    preallocate(fd, offset, fileSize);
+    posix_fadvise(fd, (off_t)offset, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (direct && offset % kDirectAlign == 0)
+    {
+        int flags = fcntl(fd, F_GETFL);
+        direct_ = flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+        if (!direct_)
+            LOGI("O_DIRECT refused (errno=%d), writing through the page cache", errno);
+    }
+}
+
+WriteScheduler::~WriteScheduler()
+{
+    if (window_ > 0 && !direct_)
+        syncRange(fd_, started_, 0, SYNC_FILE_RANGE_WRITE);
+}
+
+void WriteScheduler::advance(uint64_t end)
+{
+    if (window_ == 0 || direct_)
+        return;
+
+    while (end - started_ >= window_)
+    {
+        syncRange(fd_, started_, window_, SYNC_FILE_RANGE_WRITE);
+        started_ += window_;
+
+        // The previous window had a whole window's time to reach the
+        // disk, so this wait is usually short
+        if (started_ - dropped_ > window_)
+        {
+            syncRange(fd_, dropped_, window_,
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd_, (off_t)dropped_, window_, POSIX_FADV_DONTNEED);
+            dropped_ += window_;
+        }
+    }
+}
+
+// ===============================
+// Sender
+// ===============================
+
+ReadScheduler::ReadScheduler(int fd, uint64_t offset, uint32_t window)
+    : fd_(fd),
+      dropped_(offset),
+      window_(window)
+{
+    posix_fadvise(fd, (off_t)offset, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void ReadScheduler::advance(uint64_t end)
+{
+    if (window_ == 0 || end - dropped_ < 2 * (uint64_t)window_)
+        return;
+    // Keep the last window: a short send may still re-read its tail
+    uint64_t upTo = end - window_;
+    posix_fadvise(fd_, (off_t)dropped_, (off_t)(upTo - dropped_), POSIX_FADV_DONTNEED);
+    dropped_ = upTo;
+}
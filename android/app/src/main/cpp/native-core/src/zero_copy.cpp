@@ -0,0 +1,531 @@
+#include "zero_copy.h"
+#include "io_uring_backend.h"
+#include "compression.h"
+#include "net_utils.h"
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define LOG_TAG "SwiftShare"
+#include "log.h"
+
+using namespace swiftshare;
+
+namespace
+{
+    // Errors meaning "this fd pair does not support the fast path",
+    // as opposed to a real I/O failure.
+    bool isUnsupported(int err)
+    {
+        return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == ESPIPE;
+    }
+
+    // pwrite() through the page cache on an O_DIRECT file, for the
+    // writes that are not block aligned. Fails with EINVAL on any other.
+    ssize_t pwriteBuffered(int fd, const char *data, size_t len, off_t offset)
+    {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || !(flags & O_DIRECT))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        if (fcntl(fd, F_SETFL, flags & ~O_DIRECT) != 0)
+            return -1;
+        ssize_t w = pwrite(fd, data, len, offset);
+        int err = errno;
+        fcntl(fd, F_SETFL, flags);
+        errno = err;
+        return w;
+    }
+}
+
+const char *swiftshare::sendPathName(SendPath path)
+{
+    switch (path)
+    {
+    case SendPath::Sendfile:
+        return "sendfile";
+    case SendPath::Splice:
+        return "splice";
+    case SendPath::Copy:
+        return "copy";
+    }
+    return "unknown";
+}
+
+FileSender::FileSender(bool zeroCopy, size_t copyBufferSize, IoCounters &counters)
+    : path_(zeroCopy ? SendPath::Sendfile : SendPath::Copy),
+      pipe_{-1, -1},
+      copyBufferSize_(copyBufferSize),
+      counters_(counters) {}
+
+FileSender::~FileSender()
+{
+    if (pipe_[0] >= 0)
+        close(pipe_[0]);
+    if (pipe_[1] >= 0)
+        close(pipe_[1]);
+}
+
+bool FileSender::openPipe()
+{
+    if (pipe_[0] >= 0)
+        return true;
+    if (pipe2(pipe_, O_CLOEXEC) < 0)
+    {
+        pipe_[0] = pipe_[1] = -1;
+        return false;
+    }
+    // Large pipe lets one splice pair move a whole chunk
+    fcntl(pipe_[1], F_SETPIPE_SZ, (int)copyBufferSize_);
+    return true;
+}
+
+bool FileSender::sendRange(int sock, int fd, uint64_t offset, size_t length,
+                           const void *head, size_t headLength)
+{
+    size_t remaining = length;
+
+    // The copy path gathers the framing into its first send; the
+    // zero-copy paths cork it so it leaves with the payload
+    if (headLength > 0 && path_ != SendPath::Copy)
+    {
+        uint64_t t0 = counters_.telemetry.start();
+        bool sent = sendAll(sock, head, headLength, MSG_MORE);
+        counters_.telemetry.record(Probe::Send, t0, headLength);
+        if (!sent)
+        {
+            LOGE("send() failed during data transfer");
+            return false;
+        }
+        headLength = 0;
+    }
+
+    if (path_ == SendPath::Sendfile)
+    {
+        if (!sendWithSendfile(sock, fd, offset, remaining))
+            return false;
+        if (remaining == 0)
+            return true;
+    }
+
+    if (path_ == SendPath::Splice)
+    {
+        if (!sendWithSplice(sock, fd, offset, remaining))
+            return false;
+        if (remaining == 0)
+            return true;
+    }
+
+    return sendWithCopy(sock, fd, offset, remaining, head, headLength);
+}
+
+// Returns false on hard failure. On an unsupported fd pair, downgrades
+// path_ and returns true with `remaining` still non-zero.
+bool FileSender::sendWithSendfile(int sock, int fd, uint64_t &offset, size_t &remaining)
+{
+    while (remaining > 0)
+    {
+        off_t off = (off_t)offset;
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t s = sendfile(sock, fd, &off, remaining);
+        counters_.telemetry.record(Probe::Send, t0, s > 0 ? (uint64_t)s : 0);
+        if (s < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (isUnsupported(errno))
+            {
+                LOGI("sendfile unsupported (errno=%d), trying splice", errno);
+                path_ = SendPath::Splice;
+                return true;
+            }
+            LOGE("sendfile failed (errno=%d)", errno);
+            return false;
+        }
+        if (s == 0)
+        {
+            LOGE("File ended early during sendfile");
+            return false;
+        }
+        if ((size_t)s < remaining)
+            counters_.telemetry.shortWrite();
+        offset += (uint64_t)s;
+        remaining -= (size_t)s;
+        counters_.zeroCopyBytes += (uint64_t)s;
+    }
+    return true;
+}
+
+bool FileSender::sendWithSplice(int sock, int fd, uint64_t &offset, size_t &remaining)
+{
+    if (!openPipe())
+    {
+        LOGI("pipe unavailable, using copy path");
+        path_ = SendPath::Copy;
+        return true;
+    }
+
+    while (remaining > 0)
+    {
+        loff_t off = (loff_t)offset;
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t in = splice(fd, &off, pipe_[1], nullptr, remaining,
+                            SPLICE_F_MOVE | SPLICE_F_MORE);
+        counters_.telemetry.record(Probe::Read, t0, in > 0 ? (uint64_t)in : 0);
+        if (in < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (isUnsupported(errno))
+            {
+                LOGI("splice unsupported (errno=%d), using copy path", errno);
+                path_ = SendPath::Copy;
+                return true;
+            }
+            LOGE("splice from file failed (errno=%d)", errno);
+            return false;
+        }
+        if (in == 0)
+        {
+            LOGE("File ended early during splice");
+            return false;
+        }
+
+        // Drain the pipe completely; leftovers would corrupt the stream
+        ssize_t drained = 0;
+        while (drained < in)
+        {
+            uint64_t t1 = counters_.telemetry.start();
+            ssize_t out = splice(pipe_[0], nullptr, sock, nullptr, in - drained,
+                                 SPLICE_F_MOVE | SPLICE_F_MORE);
+            counters_.telemetry.record(Probe::Send, t1, out > 0 ? (uint64_t)out : 0);
+            if (out < 0 && errno == EINTR)
+                continue;
+            if (out <= 0)
+            {
+                LOGE("splice to socket failed (errno=%d)", errno);
+                return false;
+            }
+            drained += out;
+        }
+
+        offset += (uint64_t)in;
+        remaining -= (size_t)in;
+        counters_.zeroCopyBytes += (uint64_t)in;
+    }
+    return true;
+}
+
+bool FileSender::sendWithCopy(int sock, int fd, uint64_t &offset, size_t &remaining,
+                              const void *head, size_t headLength)
+{
+    // Held for this range only, so idle senders keep no memory
+    PooledBuffer buffer = counters_.buffers.acquire(copyBufferSize_);
+    if (!buffer)
+        return false;
+
+    while (remaining > 0)
+    {
+        size_t want = remaining < buffer.size() ? remaining : buffer.size();
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t n = pread(fd, buffer.data(), want, (off_t)offset);
+        counters_.telemetry.record(Probe::Read, t0, n > 0 ? (uint64_t)n : 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            LOGE("File read failed or ended early");
+            return false;
+        }
+        if ((size_t)n < want)
+            counters_.telemetry.shortRead();
+
+        if (headLength > 0)
+        {
+            iovec iov[2] = {{const_cast<void *>(head), headLength}, {buffer.data(), (size_t)n}};
+            uint64_t t1 = counters_.telemetry.start();
+            bool sent = sendAllVectored(sock, iov, 2);
+            counters_.telemetry.record(Probe::Send, t1, headLength + (size_t)n);
+            if (!sent)
+            {
+                LOGE("send() failed during data transfer");
+                return false;
+            }
+            headLength = 0;
+            offset += (uint64_t)n;
+            remaining -= (size_t)n;
+            counters_.copiedBytes += (uint64_t)n;
+            continue;
+        }
+
+        ssize_t sent = 0;
+        while (sent < n)
+        {
+            uint64_t t1 = counters_.telemetry.start();
+            ssize_t s = send(sock, buffer.data() + sent, n - sent, 0);
+            counters_.telemetry.record(Probe::Send, t1, s > 0 ? (uint64_t)s : 0);
+            if (s < 0 && errno == EINTR)
+                continue;
+            if (s <= 0)
+            {
+                LOGE("send() failed during data transfer");
+                return false;
+            }
+            if (s < n - sent)
+                counters_.telemetry.shortWrite();
+            sent += s;
+        }
+
+        offset += (uint64_t)n;
+        remaining -= (size_t)n;
+        counters_.copiedBytes += (uint64_t)n;
+    }
+    return true;
+}
+
+SocketReceiver::SocketReceiver(bool zeroCopy, bool ioUring, IoCounters &counters)
+    : zeroCopy_(zeroCopy),
+      pipe_{-1, -1},
+      counters_(counters)
+{
+    if (ioUring)
+        uring_ = UringReceiver::create(counters_);
+    if (uring_)
+        zeroCopy_ = false;
+
+    if (zeroCopy_)
+    {
+        if (pipe2(pipe_, O_CLOEXEC) < 0)
+        {
+            LOGI("pipe unavailable, receiving via copy path");
+            pipe_[0] = pipe_[1] = -1;
+            zeroCopy_ = false;
+        }
+        else
+        {
+            fcntl(pipe_[1], F_SETPIPE_SZ, (int)kBufferSize);
+        }
+    }
+}
+
+SocketReceiver::~SocketReceiver()
+{
+    if (pipe_[0] >= 0)
+        close(pipe_[0]);
+    if (pipe_[1] >= 0)
+        close(pipe_[1]);
+}
+
+bool SocketReceiver::receiveRange(int sock, int fd, uint64_t offset, size_t length)
+{
+    if (uring_)
+        return uring_->receiveRange(sock, fd, offset, length);
+
+    size_t remaining = length;
+
+    if (zeroCopy_)
+    {
+        if (!receiveWithSplice(sock, fd, offset, remaining))
+            return false;
+        if (remaining == 0)
+            return true;
+    }
+
+    return receiveWithCopy(sock, fd, offset, remaining);
+}
+
+bool SocketReceiver::receiveCompressed(int sock, int fd, uint64_t offset,
+                                       size_t wireLength, size_t rawLength)
+{
+    // The payload, then what it decodes to
+    PooledBuffer buffer = counters_.buffers.acquire(wireLength + rawLength);
+    if (!buffer)
+        return false;
+    char *packed = buffer.data();
+    char *unpacked = packed + wireLength;
+
+    if (!recvAll(sock, packed, wireLength))
+    {
+        LOGE("Short read of compressed chunk");
+        return false;
+    }
+    if (!lz4Decompress(packed, wireLength, unpacked, rawLength))
+    {
+        LOGE("Corrupt compressed chunk at offset %llu", (unsigned long long)offset);
+        return false;
+    }
+    return writeAll(fd, unpacked, rawLength, offset);
+}
+
+bool SocketReceiver::writeRange(int fd, uint64_t offset, const char *data, size_t length)
+{
+    return writeAll(fd, data, length, offset);
+}
+
+bool SocketReceiver::copyFromFile(int from, uint64_t fromOffset, int fd, uint64_t offset, size_t length)
+{
+    // pread/pwrite rather than copy_file_range(), which the app seccomp
+    // filter of older Android releases does not allow
+    PooledBuffer buffer = counters_.buffers.acquire(kBufferSize);
+    if (!buffer)
+        return false;
+
+    while (length > 0)
+    {
+        size_t want = length < kBufferSize ? length : kBufferSize;
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t n = pread(from, buffer.data(), want, (off_t)fromOffset);
+        counters_.telemetry.record(Probe::Read, t0, n > 0 ? (uint64_t)n : 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            LOGE("Basis read failed at offset %llu", (unsigned long long)fromOffset);
+            return false;
+        }
+        if (!writeAll(fd, buffer.data(), (size_t)n, offset))
+            return false;
+        fromOffset += (uint64_t)n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Returns false on hard failure. If the file refuses splice, the pipe is
+// drained through the buffer, zeroCopy_ is cleared and true is returned
+// with `remaining` still non-zero.
+bool SocketReceiver::receiveWithSplice(int sock, int fd, uint64_t &offset, size_t &remaining)
+{
+    while (remaining > 0)
+    {
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t in = splice(sock, nullptr, pipe_[1], nullptr, remaining,
+                            SPLICE_F_MOVE | SPLICE_F_MORE);
+        counters_.telemetry.record(Probe::Recv, t0, in > 0 ? (uint64_t)in : 0);
+        if (in < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (isUnsupported(errno))
+            {
+                LOGI("splice from socket unsupported (errno=%d), using copy path", errno);
+                zeroCopy_ = false;
+                return true;
+            }
+            LOGE("splice from socket failed (errno=%d)", errno);
+            return false;
+        }
+        if (in == 0)
+        {
+            LOGE("Peer closed connection mid-chunk");
+            return false;
+        }
+        if ((size_t)in < remaining)
+            counters_.telemetry.shortRead();
+        remaining -= (size_t)in;
+
+        ssize_t drained = 0;
+        while (drained < in)
+        {
+            loff_t off = (loff_t)offset;
+            uint64_t t1 = counters_.telemetry.start();
+            ssize_t out = splice(pipe_[0], nullptr, fd, &off, in - drained, SPLICE_F_MOVE);
+            counters_.telemetry.record(Probe::Write, t1, out > 0 ? (uint64_t)out : 0);
+            if (out < 0 && errno == EINTR)
+                continue;
+            if (out < 0 && isUnsupported(errno))
+            {
+                LOGI("splice to file unsupported (errno=%d), using copy path", errno);
+                zeroCopy_ = false;
+                return drainPipeToFile(fd, offset, (size_t)(in - drained));
+            }
+            if (out <= 0)
+            {
+                LOGE("splice to file failed (errno=%d)", errno);
+                return false;
+            }
+            drained += out;
+            offset += (uint64_t)out;
+            counters_.zeroCopyBytes += (uint64_t)out;
+        }
+    }
+    return true;
+}
+
+bool SocketReceiver::drainPipeToFile(int fd, uint64_t &offset, size_t pending)
+{
+    PooledBuffer buffer = counters_.buffers.acquire(kBufferSize);
+    if (!buffer)
+        return false;
+
+    while (pending > 0)
+    {
+        size_t want = pending < kBufferSize ? pending : kBufferSize;
+        ssize_t n = read(pipe_[0], buffer.data(), want);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        if (!writeAll(fd, buffer.data(), (size_t)n, offset))
+            return false;
+        pending -= (size_t)n;
+    }
+    return true;
+}
+
+bool SocketReceiver::receiveWithCopy(int sock, int fd, uint64_t &offset, size_t &remaining)
+{
+    PooledBuffer buffer = counters_.buffers.acquire(kBufferSize);
+    if (!buffer)
+        return false;
+
+    while (remaining > 0)
+    {
+        size_t want = remaining < kBufferSize ? remaining : kBufferSize;
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t n = recv(sock, buffer.data(), want, MSG_WAITALL);
+        counters_.telemetry.record(Probe::Recv, t0, n > 0 ? (uint64_t)n : 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n != (ssize_t)want)
+        {
+            counters_.telemetry.shortRead();
+            LOGE("Short read from socket (%zd of %zu)", n, want);
+            return false;
+        }
+        if (!writeAll(fd, buffer.data(), want, offset))
+            return false;
+        remaining -= want;
+    }
+    return true;
+}
+
+bool SocketReceiver::writeAll(int fd, const char *data, size_t len, uint64_t &offset)
+{
+    size_t written = 0;
+    while (written < len)
+    {
+        uint64_t t0 = counters_.telemetry.start();
+        ssize_t w = pwrite(fd, data + written, len - written, (off_t)offset);
+        if (w < 0 && errno == EINVAL)
+            w = pwriteBuffered(fd, data + written, len - written, (off_t)offset);
+        counters_.telemetry.record(Probe::Write, t0, w > 0 ? (uint64_t)w : 0);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+        {
+            LOGE("Short write to file (errno=%d)", errno);
+            return false;
+        }
+        if ((size_t)w < len - written)
+            counters_.telemetry.shortWrite();
+        written += (size_t)w;
+        offset += (uint64_t)w;
+        counters_.copiedBytes += (uint64_t)w;
+    }
+    return true;
+}
@@ -0,0 +1,144 @@
+// XXH64 and XXH3 against values from the reference implementation
+// (xxHash 0.8), on the buffer its own sanity checks use.
+
+#include "test_harness.h"
+#include "checksum.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace swiftshare;
+
+namespace
+{
+    constexpr uint64_t kSeed = 0x9E3779B185EBCA8DULL;
+
+    struct XxhVector
+    {
+        size_t length;
+        uint64_t xxh64;
+        uint64_t xxh64Seeded;
+        uint64_t xxh3;
+        uint64_t xxh3Seeded;
+    };
+
+    // Lengths cover every XXH3 size class (0, 1-3, 4-8, 9-16, 17-128,
+    // 129-240 and long) and XXH64's 32-byte stripes with their tails
+    const XxhVector kVectors[] = {
+        {0, 0xEF46DB3751D8E999ULL, 0x0B303D920EC349DFULL, 0x2D06800538D394C2ULL, 0xA8A6B918B2F0364AULL},
+        {1, 0xE934A84ADB052768ULL, 0x9C6678669FCD2E6DULL, 0xC44BDFF4074EECDBULL, 0x032BE332DD766EF8ULL},
+        {3, 0xFF7E1959CB50794AULL, 0x281B7CBB86CC6A05ULL, 0x54247382A8D6B94DULL, 0x634B8990B4976373ULL},
+        {4, 0x9136A0DCA57457EEULL, 0xCCFE4EAD7E01983CULL, 0xE5DC74BC51848A51ULL, 0xAA2E7ECCB0C8F747ULL},
+        {8, 0xCDBCF538E71D1348ULL, 0x768161B4E5A58DFAULL, 0x24CCC9ACAA9F65E4ULL, 0x8F973410999B8F6BULL},
+        {9, 0x554B1AE991EDA6B6ULL, 0x6A7EF24927B938A0ULL, 0x14D5001C15DD3F2BULL, 0xB3AE7333D9013F60ULL},
+        {16, 0x98C90B57FDFCB55CULL, 0x85446BBA49CB7DF1ULL, 0x981B17D36C7498C9ULL, 0x663F29333B4DB6B1ULL},
+        {17, 0x0D39A2D051A30C2CULL, 0x1DD902D73122EDA0ULL, 0x796F5ACD3A60F862ULL, 0xF3EC5067F4306DB3ULL},
+        {128, 0x90CA021457D96DC5ULL, 0xFCEF9BEB2CE440A6ULL, 0xFCFF24126754D861ULL, 0x73FDE75280646649ULL},
+        {129, 0x41C280132D697ABAULL, 0xAEB872C374EABF84ULL, 0x98F1B0A679A2CA29ULL, 0x21FFFDBCA099C844ULL},
+        {240, 0xB81838D483BAEE53ULL, 0x7C3C8490FE0C1B94ULL, 0x81C3C2B67F568CCFULL, 0xCC0F58C27EF3D8EEULL},
+        {241, 0x95D76C8B4D8FC4D6ULL, 0x6BD0DB4EF4123409ULL, 0xC5A639ECD2030E5EULL, 0xDDA9B0A161D4829AULL},
+        {1024, 0x4775BF7CACE4D177ULL, 0xCFBC5E785FF33CCDULL, 0xDD85C9B5C1109C5CULL, 0xEF368A8A2EBABAEFULL},
+        {2367, 0xA82418DDEC0EA581ULL, 0x363B532C35E01E25ULL, 0xCB37AEB9E5D361EDULL, 0xD2DB3415B942B42AULL},
+        {100000, 0x2F2257F45994FF6AULL, 0xA53C361A45679B06ULL, 0x34D658192A014311ULL, 0x0682260A8A5AFE82ULL},
+    };
+
+    // xxHash's sanity buffer: the top byte of a running PRIME64 product
+    std::vector<uint8_t> sanityBuffer(size_t length)
+    {
+        std::vector<uint8_t> buffer(length);
+        uint64_t generator = 2654435761ULL;
+        for (uint8_t &byte : buffer)
+        {
+            byte = (uint8_t)(generator >> 56);
+            generator *= 11400714785074694797ULL;
+        }
+        return buffer;
+    }
+}
+
+TEST(checksum, xxh64_reference)
+{
+    std::vector<uint8_t> buffer = sanityBuffer(100000);
+    for (const XxhVector &v : kVectors)
+    {
+        CHECK(xxh64(buffer.data(), v.length) == v.xxh64);
+        CHECK(xxh64(buffer.data(), v.length, kSeed) == v.xxh64Seeded);
+    }
+}
+
+TEST(checksum, xxh64_streaming)
+{
+    std::vector<uint8_t> buffer = sanityBuffer(100000);
+    for (const XxhVector &v : kVectors)
+    {
+        // Uneven pieces, so updates straddle the 32-byte stripes
+        for (size_t piece : {1, 7, 31, 33, 4096})
+        {
+            Xxh64 hash(kSeed);
+            for (size_t offset = 0; offset < v.length; offset += piece)
+                hash.update(buffer.data() + offset, std::min(piece, v.length - offset));
+            CHECK(hash.digest() == v.xxh64Seeded);
+        }
+    }
+
+    Xxh64 hash;
+    hash.update(buffer.data(), 17);
+    hash.reset(0);
+    hash.update(buffer.data(), 1024);
+    CHECK(hash.digest() == kVectors[12].xxh64);
+}
+
+TEST(checksum, xxh3_reference)
+{
+    std::vector<uint8_t> buffer = sanityBuffer(100000);
+    for (const XxhVector &v : kVectors)
+    {
+        CHECK(xxh3_64(buffer.data(), v.length) == v.xxh3);
+        CHECK(xxh3_64(buffer.data(), v.length, kSeed) == v.xxh3Seeded);
+    }
+
+    // Same input at every alignment the vector kernels may see
+    for (size_t shift = 1; shift < 64; ++shift)
+    {
+        std::vector<uint8_t> shifted(shift);
+        shifted.insert(shifted.end(), buffer.begin(), buffer.begin() + 2367);
+        CHECK(xxh3_64(shifted.data() + shift, 2367) == kVectors[13].xxh3);
+    }
+}
+
+TEST(checksum, xxh64_file)
+{
+    std::vector<uint8_t> buffer = sanityBuffer(100000);
+    char path[] = "/tmp/swiftshare-test-XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    unlink(path);
+    REQUIRE(write(fd, buffer.data(), buffer.size()) == (ssize_t)buffer.size());
+
+    uint64_t digest = 0;
+    CHECK(xxh64File(fd, 0, buffer.size(), digest) && digest == kVectors[14].xxh64);
+    CHECK(xxh64File(fd, 1000, 1024, digest) && digest == xxh64(buffer.data() + 1000, 1024));
+    CHECK(!xxh64File(fd, buffer.size() - 10, 11, digest));
+    close(fd);
+}
+
+TEST(checksum, file_digest_is_order_independent)
+{
+    FileDigest forward, backward;
+    for (uint64_t i = 0; i < 16; ++i)
+        forward.add(i * 65536, xxh3_64(&i, sizeof(i)));
+    for (uint64_t i = 16; i-- > 0;)
+        backward.add(i * 65536, xxh3_64(&i, sizeof(i)));
+    CHECK(forward.value == backward.value);
+
+    // Swapping two chunks' contents must change it
+    FileDigest swapped;
+    for (uint64_t i = 0; i < 16; ++i)
+    {
+        uint64_t content = i == 3 ? 4 : i == 4 ? 3 : i;
+        swapped.add(i * 65536, xxh3_64(&content, sizeof(content)));
+    }
+    CHECK(swapped.value != forward.value);
+}
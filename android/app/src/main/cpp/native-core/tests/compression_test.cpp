@@ -0,0 +1,130 @@
+// LZ4 block codec: a block from the reference encoder, round trips, and
+// malformed input the decoder must refuse without reading or writing
+// out of bounds.
+
+#include "test_harness.h"
+#include "compression.h"
+#include <cstring>
+#include <string>
+
+using namespace swiftshare;
+
+namespace
+{
+    const char kText[] = "SwiftShare sends files fast. SwiftShare sends files fast, fast, fast. SwiftShare!";
+
+    // kText through lz4.block.compress() of the reference library
+    const uint8_t kReferenceBlock[] = {
+        0xff, 0x0e, 0x53, 0x77, 0x69, 0x66, 0x74, 0x53, 0x68, 0x61, 0x72, 0x65, 0x20, 0x73,
+        0x65, 0x6e, 0x64, 0x73, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x73, 0x20, 0x66, 0x61, 0x73,
+        0x74, 0x2e, 0x20, 0x1d, 0x00, 0x08, 0x11, 0x2c, 0x23, 0x00, 0x02, 0x06, 0x00, 0x04,
+        0x29, 0x00, 0x50, 0x68, 0x61, 0x72, 0x65, 0x21};
+
+    std::vector<uint8_t> randomData(size_t length, uint64_t state)
+    {
+        std::vector<uint8_t> data(length);
+        for (uint8_t &byte : data)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            byte = (uint8_t)state;
+        }
+        return data;
+    }
+
+    // Log-like lines: long matches, short matches and fresh literals
+    std::vector<uint8_t> textData(size_t length)
+    {
+        std::string text;
+        for (uint32_t line = 0; text.size() < length; ++line)
+            text += "2026-10-16 12:00:" + std::to_string(line % 60) + " chunk " +
+                    std::to_string(line * 7919) + " received ok\n";
+        return std::vector<uint8_t>(text.begin(), text.begin() + length);
+    }
+
+    bool roundTrips(const std::vector<uint8_t> &raw, size_t &compressedSize)
+    {
+        std::vector<uint8_t> compressed(raw.size() + raw.size() / 255 + 16);
+        compressedSize = lz4Compress(raw.data(), raw.size(), compressed.data(), compressed.size());
+        if (compressedSize == 0 && !raw.empty())
+            return false;
+        std::vector<uint8_t> decoded(raw.size());
+        return lz4Decompress(compressed.data(), compressedSize, decoded.data(), decoded.size()) &&
+               decoded == raw;
+    }
+}
+
+TEST(compression, decodes_reference_block)
+{
+    size_t rawLength = sizeof(kText) - 1;
+    std::vector<uint8_t> decoded(rawLength);
+    CHECK(lz4Decompress(kReferenceBlock, sizeof(kReferenceBlock), decoded.data(), rawLength));
+    CHECK(memcmp(decoded.data(), kText, rawLength) == 0);
+}
+
+TEST(compression, round_trip)
+{
+    size_t compressedSize = 0;
+    for (size_t length : {1, 12, 13, 64, 4095, 65536, 1 << 20})
+    {
+        std::vector<uint8_t> text = textData(length);
+        CHECK(roundTrips(text, compressedSize));
+        if (length >= 4095)
+            CHECK(compressedSize < length / 2);
+
+        CHECK(roundTrips(std::vector<uint8_t>(length, 0), compressedSize));
+        CHECK(roundTrips(randomData(length, length), compressedSize));
+    }
+}
+
+TEST(compression, gives_up_past_capacity)
+{
+    std::vector<uint8_t> raw = randomData(65536, 42);
+    std::vector<uint8_t> compressed(raw.size());
+    CHECK(lz4Compress(raw.data(), raw.size(), compressed.data(), raw.size() / 2) == 0);
+
+    std::vector<uint8_t> text = textData(65536);
+    size_t size = lz4Compress(text.data(), text.size(), compressed.data(), compressed.size());
+    CHECK(size > 0);
+    CHECK(lz4Compress(text.data(), text.size(), compressed.data(), size - 1) == 0);
+}
+
+TEST(compression, rejects_malformed_input)
+{
+    size_t rawLength = sizeof(kText) - 1;
+    std::vector<uint8_t> out(rawLength + 64);
+
+    // Every truncation of a valid block
+    for (size_t length = 0; length < sizeof(kReferenceBlock); ++length)
+        CHECK(!lz4Decompress(kReferenceBlock, length, out.data(), rawLength));
+
+    // A valid block against the wrong declared size
+    CHECK(!lz4Decompress(kReferenceBlock, sizeof(kReferenceBlock), out.data(), rawLength - 1));
+    CHECK(!lz4Decompress(kReferenceBlock, sizeof(kReferenceBlock), out.data(), rawLength + 1));
+
+    // One literal, then a match reaching back before the output
+    const uint8_t beforeStart[] = {0x10, 'a', 0x02, 0x00, 0x00};
+    CHECK(!lz4Decompress(beforeStart, sizeof(beforeStart), out.data(), 6));
+    // Offset zero
+    const uint8_t zeroOffset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+    CHECK(!lz4Decompress(zeroOffset, sizeof(zeroOffset), out.data(), 6));
+    // Literal run longer than the input
+    const uint8_t shortLiterals[] = {0x50, 'a', 'b'};
+    CHECK(!lz4Decompress(shortLiterals, sizeof(shortLiterals), out.data(), 5));
+    // Length continuation bytes running off the end
+    const uint8_t openLength[] = {0xf0, 0xff, 0xff};
+    CHECK(!lz4Decompress(openLength, sizeof(openLength), out.data(), out.size()));
+    // Match longer than the output
+    const uint8_t longMatch[] = {0x1f, 'a', 0x01, 0x00, 0x40, 0x10, 'b'};
+    CHECK(!lz4Decompress(longMatch, sizeof(longMatch), out.data(), 16));
+
+    // Noise: any verdict, as long as nothing outside the buffers is
+    // touched (run under ASan to prove it)
+    for (uint64_t seed = 1; seed <= 2000; ++seed)
+    {
+        std::vector<uint8_t> noise = randomData(1 + seed % 300, seed);
+        std::vector<uint8_t> target(seed % 1000);
+        lz4Decompress(noise.data(), noise.size(), target.data(), target.size());
+    }
+}
@@ -0,0 +1,329 @@
+// Known-answer tests of the primitives behind encrypted connections:
+// SHA-256 (FIPS 180-4), HKDF (RFC 5869), X25519 (RFC 7748) and both AEAD
+// suites (RFC 8439, and the AES-256 cases of the GCM specification).
+
+#include "test_harness.h"
+#include "aead.h"
+#include "key_exchange.h"
+#include <cstring>
+
+using namespace swiftshare;
+using test::fromHex;
+using test::toHex;
+
+namespace
+{
+    struct AeadVector
+    {
+        const char *key;
+        const char *nonce;
+        const char *aad;
+        const char *plaintext;
+        const char *ciphertext;
+        const char *tag;
+    };
+
+    // Seals the plaintext in place, compares against the vector, opens it
+    // again, then checks that a flipped bit in the ciphertext, the AAD or
+    // the tag is refused and the buffer wiped
+    void checkAead(AeadSuite suite, const AeadVector &v)
+    {
+        std::vector<uint8_t> key = fromHex(v.key);
+        std::vector<uint8_t> nonce = fromHex(v.nonce);
+        std::vector<uint8_t> aad = fromHex(v.aad);
+        std::vector<uint8_t> plaintext = fromHex(v.plaintext);
+        REQUIRE(key.size() == kAeadKeySize && nonce.size() == kAeadNonceSize);
+
+        Aead aead(suite, key.data());
+        std::vector<uint8_t> data = plaintext;
+        uint8_t tag[kAeadTagSize];
+        aead.seal(nonce.data(), aad.data(), aad.size(), data.data(), data.size(), tag);
+        CHECK(toHex(data.data(), data.size()) == v.ciphertext);
+        CHECK(toHex(tag, sizeof(tag)) == v.tag);
+
+        std::vector<uint8_t> sealed = data;
+        CHECK(aead.open(nonce.data(), aad.data(), aad.size(), data.data(), data.size(), tag));
+        CHECK(data == plaintext);
+
+        if (!sealed.empty())
+        {
+            data = sealed;
+            data[data.size() / 2] ^= 0x01;
+            CHECK(!aead.open(nonce.data(), aad.data(), aad.size(), data.data(), data.size(), tag));
+            CHECK(data == std::vector<uint8_t>(data.size(), 0));
+        }
+        if (!aad.empty())
+        {
+            data = sealed;
+            aad[0] ^= 0x80;
+            CHECK(!aead.open(nonce.data(), aad.data(), aad.size(), data.data(), data.size(), tag));
+            aad[0] ^= 0x80;
+        }
+        data = sealed;
+        tag[kAeadTagSize - 1] ^= 0x01;
+        CHECK(!aead.open(nonce.data(), aad.data(), aad.size(), data.data(), data.size(), tag));
+    }
+}
+
+// ===============================
+// SHA-256, HMAC, HKDF
+// ===============================
+
+TEST(crypto, sha256)
+{
+    uint8_t digest[kSha256Size];
+    Sha256 sha;
+    sha.update("abc", 3);
+    sha.digest(digest);
+    CHECK(toHex(digest, sizeof(digest)) ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Two blocks, fed across the block boundary
+    const char *message = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha.reset();
+    sha.update(message, 30);
+    sha.update(message + 30, strlen(message) - 30);
+    sha.digest(digest);
+    CHECK(toHex(digest, sizeof(digest)) ==
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+// RFC 5869 A.1 and A.3 (the latter with empty salt and info)
+TEST(crypto, hkdf)
+{
+    std::vector<uint8_t> ikm(22, 0x0b);
+    std::vector<uint8_t> salt = fromHex("000102030405060708090a0b0c");
+    std::vector<uint8_t> info = fromHex("f0f1f2f3f4f5f6f7f8f9");
+    uint8_t prk[kSha256Size];
+    uint8_t okm[42];
+
+    hkdfExtract(salt.data(), salt.size(), ikm.data(), ikm.size(), prk);
+    CHECK(toHex(prk, sizeof(prk)) ==
+          "077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5");
+    hkdfExpand(prk, info.data(), info.size(), okm, sizeof(okm));
+    CHECK(toHex(okm, sizeof(okm)) ==
+          "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf"
+          "34007208d5b887185865");
+
+    hkdfExtract(nullptr, 0, ikm.data(), ikm.size(), prk);
+    CHECK(toHex(prk, sizeof(prk)) ==
+          "19ef24a32c717b167f33a91d6f648bdf96596776afdb6377ac434c1c293ccb04");
+    hkdfExpand(prk, nullptr, 0, okm, sizeof(okm));
+    CHECK(toHex(okm, sizeof(okm)) ==
+          "8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d"
+          "9d201395faa4b61a96c8");
+}
+
+// ===============================
+// X25519
+// ===============================
+
+// RFC 7748 5.2, first vector
+TEST(crypto, x25519_scalar_multiplication)
+{
+    std::vector<uint8_t> scalar = fromHex("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4");
+    std::vector<uint8_t> u = fromHex("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c");
+    uint8_t out[kX25519KeySize];
+    CHECK(x25519(out, scalar.data(), u.data()));
+    CHECK(toHex(out, sizeof(out)) ==
+          "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552");
+}
+
+// RFC 7748 6.1: both public keys from the base point, then the shared
+// secret from either side
+TEST(crypto, x25519_diffie_hellman)
+{
+    std::vector<uint8_t> alice = fromHex("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a");
+    std::vector<uint8_t> bob = fromHex("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb");
+    uint8_t basePoint[kX25519KeySize] = {9};
+    uint8_t alicePublic[kX25519KeySize], bobPublic[kX25519KeySize];
+    CHECK(x25519(alicePublic, alice.data(), basePoint));
+    CHECK(x25519(bobPublic, bob.data(), basePoint));
+    CHECK(toHex(alicePublic, kX25519KeySize) ==
+          "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a");
+    CHECK(toHex(bobPublic, kX25519KeySize) ==
+          "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f");
+
+    uint8_t aliceShared[kX25519KeySize], bobShared[kX25519KeySize];
+    CHECK(x25519(aliceShared, alice.data(), bobPublic));
+    CHECK(x25519(bobShared, bob.data(), alicePublic));
+    CHECK(toHex(aliceShared, kX25519KeySize) ==
+          "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742");
+    CHECK(memcmp(aliceShared, bobShared, kX25519KeySize) == 0);
+}
+
+TEST(crypto, x25519_rejects_small_order_points)
+{
+    std::vector<uint8_t> scalar = fromHex("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4");
+    uint8_t zero[kX25519KeySize] = {};
+    uint8_t one[kX25519KeySize] = {1};
+    uint8_t out[kX25519KeySize];
+    CHECK(!x25519(out, scalar.data(), zero));
+    CHECK(!x25519(out, scalar.data(), one));
+}
+
+TEST(crypto, x25519_keypair)
+{
+    uint8_t privateA[kX25519KeySize], publicA[kX25519KeySize];
+    uint8_t privateB[kX25519KeySize], publicB[kX25519KeySize];
+    REQUIRE(x25519Keypair(privateA, publicA));
+    REQUIRE(x25519Keypair(privateB, publicB));
+    CHECK(memcmp(publicA, publicB, kX25519KeySize) != 0);
+
+    uint8_t sharedA[kX25519KeySize], sharedB[kX25519KeySize];
+    CHECK(x25519(sharedA, privateA, publicB));
+    CHECK(x25519(sharedB, privateB, publicA));
+    CHECK(memcmp(sharedA, sharedB, kX25519KeySize) == 0);
+}
+
+// Values from an independent Python Elligator 2 (RFC 9380 6.7.1)
+TEST(crypto, cpace_generator)
+{
+    uint8_t point[kX25519KeySize];
+    cpaceGenerator("123456", 6, point);
+    CHECK(toHex(point, kX25519KeySize) ==
+          "398c9d1f5ab3faededc3d83ad0d8b0eff64016f89656329a73c80e5cca427b39");
+    cpaceGenerator(nullptr, 0, point);
+    CHECK(toHex(point, kX25519KeySize) ==
+          "9ea517966d9dad4740140136a0c2c28b20f8851f4e88be5358826b4525062509");
+}
+
+TEST(crypto, cpace_agrees_only_on_the_same_secret)
+{
+    uint8_t generatorA[kX25519KeySize], generatorB[kX25519KeySize];
+    cpaceGenerator("123456", 6, generatorA);
+    cpaceGenerator("123457", 6, generatorB);
+
+    uint8_t privateA[kX25519KeySize], publicA[kX25519KeySize];
+    uint8_t privateB[kX25519KeySize], publicB[kX25519KeySize];
+    uint8_t privateC[kX25519KeySize], publicC[kX25519KeySize];
+    REQUIRE(x25519Keypair(privateA, publicA, generatorA));
+    REQUIRE(x25519Keypair(privateB, publicB, generatorA));
+    REQUIRE(x25519Keypair(privateC, publicC, generatorB));
+
+    uint8_t sharedA[kX25519KeySize], sharedB[kX25519KeySize];
+    CHECK(x25519(sharedA, privateA, publicB));
+    CHECK(x25519(sharedB, privateB, publicA));
+    CHECK(memcmp(sharedA, sharedB, kX25519KeySize) == 0);
+
+    uint8_t sharedC[kX25519KeySize];
+    CHECK(x25519(sharedA, privateA, publicC));
+    CHECK(x25519(sharedC, privateC, publicA));
+    CHECK(memcmp(sharedA, sharedC, kX25519KeySize) != 0);
+
+    uint8_t smallOrder[kX25519KeySize] = {1};
+    CHECK(!x25519Keypair(privateA, publicA, smallOrder));
+}
+
+// ===============================
+// AEAD suites
+// ===============================
+
+// RFC 8439 2.8.2
+TEST(crypto, chacha20_poly1305)
+{
+    AeadVector v{
+        "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f",
+        "070000004041424344454647",
+        "50515253c0c1c2c3c4c5c6c7",
+        // "Ladies and Gentlemen of the class of '99: If I could offer you
+        // only one tip for the future, sunscreen would be it."
+        "4c616469657320616e642047656e746c656d656e206f662074686520636c6173"
+        "73206f66202739393a204966204920636f756c64206f6666657220796f75206f"
+        "6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73"
+        "637265656e20776f756c642062652069742e",
+        "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+        "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+        "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+        "3ff4def08e4b7a9de576d26586cec64b6116",
+        "1ae10b594f09e26a7e902ecbd0600691",
+    };
+    checkAead(AeadSuite::ChaCha20Poly1305, v);
+}
+
+// GCM specification test cases 13, 14 and 16 (AES-256)
+TEST(crypto, aes_256_gcm)
+{
+    if (!aesGcmAccelerated())
+    {
+        test::skip("no AES and carry-less multiply instructions on this CPU");
+        return;
+    }
+
+    const char *zeroKey = "0000000000000000000000000000000000000000000000000000000000000000";
+    checkAead(AeadSuite::Aes256Gcm, {zeroKey, "000000000000000000000000", "", "", "",
+                                     "530f8afbc74536b9a963b4f1c4cb738b"});
+    checkAead(AeadSuite::Aes256Gcm, {zeroKey, "000000000000000000000000", "",
+                                     "00000000000000000000000000000000",
+                                     "cea7403d4d606b6e074ec5d3baf39d18",
+                                     "d0d1c8a799996bf0265b98b5d48ab919"});
+    checkAead(AeadSuite::Aes256Gcm,
+              {"feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+               "cafebabefacedbaddecaf888",
+               "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+               "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+               "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+               "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+               "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+               "76fc6ece0f4e1768cddf8853bb2d551b"});
+}
+
+// Messages long enough for the eight-block ChaCha20 and two-block
+// Poly1305 steps, then a four-block batch and a partial block; tags
+// from an independent implementation
+TEST(crypto, chacha20_poly1305_long)
+{
+    uint8_t key[kAeadKeySize], nonce[kAeadNonceSize];
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = (uint8_t)i;
+    for (size_t i = 0; i < sizeof(nonce); ++i)
+        nonce[i] = (uint8_t)i;
+    const uint8_t aad[4] = {0x10, 0x20, 0x30, 0x40};
+
+    struct
+    {
+        size_t length;
+        const char *tag;
+    } cases[] = {{1000, "752e2be98de187f24c34542a105d8b7e"},
+                 {4196, "a17ca7433925425adf45989fd7672e60"}};
+
+    Aead aead(AeadSuite::ChaCha20Poly1305, key);
+    for (const auto &c : cases)
+    {
+        std::vector<uint8_t> data(c.length);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = (uint8_t)(i * 7 + 3);
+        uint8_t tag[kAeadTagSize];
+        aead.seal(nonce, aad, sizeof(aad), data.data(), data.size(), tag);
+        CHECK(toHex(tag, sizeof(tag)) == c.tag);
+    }
+}
+
+// Both suites over lengths around the 16-byte block and the 8-block
+// stride of the accelerated paths, checked against each other's opens
+TEST(crypto, aead_round_trip_lengths)
+{
+    uint8_t key[kAeadKeySize], nonce[kAeadNonceSize];
+    REQUIRE(randomBytes(key, sizeof(key)) && randomBytes(nonce, sizeof(nonce)));
+
+    std::vector<AeadSuite> suites{AeadSuite::ChaCha20Poly1305};
+    if (aesGcmAccelerated())
+        suites.push_back(AeadSuite::Aes256Gcm);
+
+    for (AeadSuite suite : suites)
+    {
+        Aead aead(suite, key);
+        for (size_t len : {1, 15, 16, 17, 63, 64, 127, 128, 129, 255, 256, 1000, 65536 + 7})
+        {
+            std::vector<uint8_t> plaintext(len);
+            for (size_t i = 0; i < len; ++i)
+                plaintext[i] = (uint8_t)(i * 31 + len);
+            std::vector<uint8_t> data = plaintext;
+            uint8_t tag[kAeadTagSize];
+            aead.seal(nonce, "hdr", 3, data.data(), len, tag);
+            CHECK(data != plaintext);
+            CHECK(aead.open(nonce, "hdr", 3, data.data(), len, tag));
+            CHECK(data == plaintext);
+        }
+    }
+}
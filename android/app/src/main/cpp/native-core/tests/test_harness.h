@@ -0,0 +1,53 @@
+#pragma once
+
+// Minimal harness for the host tests, so the standalone build needs no
+// test framework. TEST(suite, name) registers a case; the runner takes
+// suite names on the command line (none runs every suite), which is how
+// CMakeLists.txt gives each suite its own ctest entry.
+//
+// CHECK() records a failure and carries on; REQUIRE() also returns from
+// the case, for checks the rest of it depends on.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace swiftshare::test
+{
+    using TestFunction = void (*)();
+
+    int registerTest(const char *suite, const char *name, TestFunction run);
+    void fail(const char *file, int line, const char *expression);
+    // Marks the running case as skipped on this host, e.g. for lack of an
+    // instruction set; `reason` is printed with it
+    void skip(const char *reason);
+
+    // "00ff10" -> {0x00, 0xff, 0x10}
+    std::vector<uint8_t> fromHex(const char *hex);
+    std::string toHex(const void *data, size_t len);
+
+} // namespace swiftshare::test
+
+#define TEST(suite, name)                                                               \
+    static void suite##_##name();                                                       \
+    static const int suite##_##name##_registered =                                      \
+        ::swiftshare::test::registerTest(#suite, #name, suite##_##name);                 \
+    static void suite##_##name()
+
+#define CHECK(expression)                                                    \
+    do                                                                       \
+    {                                                                        \
+        if (!(expression))                                                   \
+            ::swiftshare::test::fail(__FILE__, __LINE__, #expression);       \
+    } while (0)
+
+#define REQUIRE(expression)                                                  \
+    do                                                                       \
+    {                                                                        \
+        if (!(expression))                                                   \
+        {                                                                    \
+            ::swiftshare::test::fail(__FILE__, __LINE__, #expression);       \
+            return;                                                          \
+        }                                                                    \
+    } while (0)
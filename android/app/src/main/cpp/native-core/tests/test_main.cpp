@@ -0,0 +1,125 @@
+// Runner for the host tests; see test_harness.h.
+//
+//   native_core_tests [--verbose] [SUITE...]
+
+#include "test_harness.h"
+#include "log.h"
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+using namespace swiftshare;
+
+namespace
+{
+    struct TestCase
+    {
+        const char *suite;
+        const char *name;
+        test::TestFunction run;
+    };
+
+    // Filled by static initializers, so it must not be a plain global
+    std::vector<TestCase> &registry()
+    {
+        static std::vector<TestCase> cases;
+        return cases;
+    }
+
+    int failures = 0;
+    bool skipped = false;
+    bool verboseLog = false;
+
+    // Engine errors are part of a failure's story; the rest is noise
+    void testLogSink(LogLevel level, const char *tag, const char *message)
+    {
+        if (level == LogLevel::Error || verboseLog)
+            fprintf(stderr, "%c/%s: %s\n", level == LogLevel::Error ? 'E' : 'I', tag, message);
+    }
+}
+
+int swiftshare::test::registerTest(const char *suite, const char *name, TestFunction run)
+{
+    registry().push_back({suite, name, run});
+    return 0;
+}
+
+void swiftshare::test::fail(const char *file, int line, const char *expression)
+{
+    failures++;
+    fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expression);
+}
+
+void swiftshare::test::skip(const char *reason)
+{
+    skipped = true;
+    printf("  skipped: %s\n", reason);
+}
+
+std::vector<uint8_t> swiftshare::test::fromHex(const char *hex)
+{
+    auto nibble = [](char c)
+    {
+        return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    };
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2)
+        bytes.push_back((uint8_t)(nibble(hex[i]) << 4 | nibble(hex[i + 1])));
+    return bytes;
+}
+
+std::string swiftshare::test::toHex(const void *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    std::string hex;
+    for (size_t i = 0; i < len; ++i)
+    {
+        hex += digits[p[i] >> 4];
+        hex += digits[p[i] & 15];
+    }
+    return hex;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> suites;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+            verboseLog = true;
+        else
+            suites.push_back(argv[i]);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    setLogSink(testLogSink);
+
+    int ran = 0, failed = 0;
+    for (const TestCase &test : registry())
+    {
+        bool selected = suites.empty();
+        for (const std::string &suite : suites)
+            selected |= suite == test.suite;
+        if (!selected)
+            continue;
+
+        printf("[ RUN  ] %s.%s\n", test.suite, test.name);
+        fflush(stdout);
+        int before = failures;
+        skipped = false;
+        test.run();
+        ran++;
+        bool ok = failures == before;
+        failed += ok ? 0 : 1;
+        printf("[ %s ] %s.%s\n", !ok ? "FAIL" : skipped ? "SKIP" : " OK ", test.suite, test.name);
+        fflush(stdout);
+    }
+
+    if (ran == 0)
+    {
+        fprintf(stderr, "no tests matched\n");
+        return 2;
+    }
+    printf("%d of %d tests passed\n", ran - failed, ran);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,516 @@
+// Loopback transfers between two engines in this process, one per
+// transport and feature, each checked byte for byte at the receiver.
+//
+// Every case listens on its own port and works in a fresh directory
+// under /tmp, removed when the case ends.
+
+#include "test_harness.h"
+#include "transfer_engine.h"
+#include "aead.h"
+#include "io_uring_backend.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+using namespace swiftshare;
+using namespace std::chrono_literals;
+
+namespace
+{
+    // Below Linux's ephemeral range (32768 on), where a connection of an
+    // earlier case could still hold a port a later case listens on
+    constexpr uint16_t kBasePort = 27900;
+    // Generous for one CPU under a sanitizer; a hang fails instead
+    constexpr auto kSettleTimeout = 120s;
+
+    class TempDir
+    {
+    public:
+        TempDir()
+        {
+            char path[] = "/tmp/swiftshare-test-XXXXXX";
+            if (mkdtemp(path))
+                path_ = path;
+        }
+        ~TempDir()
+        {
+            if (!path_.empty())
+                nftw(path_.c_str(), [](const char *path, const struct stat *, int, FTW *)
+                     { return remove(path); }, 16, FTW_DEPTH | FTW_PHYS);
+        }
+
+        const std::string &path() const { return path_; }
+
+    private:
+        std::string path_;
+    };
+
+    bool writeFile(const std::string &path, const std::vector<uint8_t> &data)
+    {
+        int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+        bool ok = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+        close(fd);
+        return ok;
+    }
+
+    bool readFile(const std::string &path, std::vector<uint8_t> &data)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st{};
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+        data.resize((size_t)st.st_size);
+        bool ok = st.st_size == 0 || read(fd, data.data(), data.size()) == (ssize_t)data.size();
+        close(fd);
+        return ok;
+    }
+
+    bool sameFile(const std::string &path, const std::vector<uint8_t> &expected)
+    {
+        std::vector<uint8_t> actual;
+        return readFile(path, actual) && actual == expected;
+    }
+
+    std::vector<uint8_t> randomData(size_t length, uint64_t state)
+    {
+        std::vector<uint8_t> data(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            data[i] = (uint8_t)state;
+        }
+        return data;
+    }
+
+    size_t settledReceives(const TransferEngine &rx)
+    {
+        size_t settled = 0;
+        for (const SessionStats &stats : rx.listSessions())
+            if (stats.direction == SessionDirection::Receive && stats.state != SessionState::Active)
+                settled++;
+        return settled;
+    }
+
+    // A receiving and a sending engine on 127.0.0.1, the receiver saving
+    // into `received` under the case's directory
+    struct Loopback
+    {
+        explicit Loopback(uint16_t portOffset, const TransferOptions &options = {})
+            : port(kBasePort + portOffset),
+              received(dir.path() + "/received")
+        {
+            setOptions(options);
+            rx.setReceiveDirectory(received);
+            rx.startReceiver(port);
+            // The receiver binds on its own thread
+            std::this_thread::sleep_for(200ms);
+        }
+
+        void setOptions(TransferOptions options)
+        {
+            // Fixed chunks and small ones, so even short files take many
+            options.autoTune = false;
+            options.chunkSize = 64 * 1024;
+            tx.setOptions(options);
+            rx.setOptions(options);
+        }
+
+        // Waits for send `id` and the receive it started to settle;
+        // false on a timeout. `sent` gets the send's final stats.
+        bool settle(uint32_t id, SessionStats &sent)
+        {
+            auto deadline = std::chrono::steady_clock::now() + kSettleTimeout;
+            do
+            {
+                if (!tx.getSessionStats(id, sent))
+                    return false;
+                if (sent.state != SessionState::Active && settledReceives(rx) > receives)
+                {
+                    receives = settledReceives(rx);
+                    return true;
+                }
+                std::this_thread::sleep_for(1ms);
+            } while (std::chrono::steady_clock::now() < deadline);
+            return false;
+        }
+
+        // Sends one file and waits for both ends; true if both completed
+        bool send(const std::string &path)
+        {
+            SessionStats sent{};
+            uint32_t id = tx.startSender(path, "127.0.0.1", port);
+            return id != 0 && settle(id, sent) && sent.state == SessionState::Completed &&
+                   lastReceive() == SessionState::Completed;
+        }
+
+        SessionState lastReceive() const
+        {
+            uint32_t newest = 0;
+            SessionState state = SessionState::Active;
+            for (const SessionStats &stats : rx.listSessions())
+            {
+                if (stats.direction == SessionDirection::Receive && stats.id > newest)
+                {
+                    newest = stats.id;
+                    state = stats.state;
+                }
+            }
+            return state;
+        }
+
+        TempDir dir;
+        uint16_t port;
+        std::string received;
+        size_t receives = 0;
+        // Declared last, so they are gone before the directory
+        TransferEngine rx;
+        TransferEngine tx;
+    };
+
+    // Sends a few sizes around the chunk size through `loopback`
+    void checkFiles(Loopback &loopback)
+    {
+        REQUIRE(!loopback.dir.path().empty());
+        const size_t sizes[] = {0, 1, 64 * 1024, 3 * 1024 * 1024 + 123};
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        {
+            std::string name = "file" + std::to_string(i) + ".bin";
+            std::vector<uint8_t> data = randomData(sizes[i], i + 1);
+            REQUIRE(writeFile(loopback.dir.path() + "/" + name, data));
+            CHECK(loopback.send(loopback.dir.path() + "/" + name));
+            CHECK(sameFile(loopback.received + "/" + name, data));
+        }
+    }
+}
+
+TEST(transfer, plain)
+{
+    Loopback loopback(0);
+    checkFiles(loopback);
+}
+
+TEST(transfer, plain_copy_paths)
+{
+    TransferOptions options;
+    options.zeroCopySend = false;
+    options.zeroCopyReceive = false;
+    options.pipelineDepth = 4;
+    Loopback loopback(1, options);
+    checkFiles(loopback);
+}
+
+// The 3 MB file is large enough to stripe across the streams
+TEST(transfer, striped)
+{
+    TransferOptions options;
+    options.streams = 4;
+    Loopback loopback(10, options);
+    checkFiles(loopback);
+}
+
+TEST(transfer, io_uring_receive)
+{
+    IoUring probe;
+    if (!probe.init(4) || !probe.supportsDataPlane())
+    {
+        test::skip("io_uring unavailable in this kernel");
+        return;
+    }
+
+    TransferOptions options;
+    options.ioUring = true;
+    Loopback loopback(12, options);
+    checkFiles(loopback);
+    CHECK(loopback.rx.getIoStats().uringBytes > 0);
+}
+
+// checkFiles' random data samples as incompressible and goes raw; a
+// text-like file goes out as LZ4 chunks
+TEST(transfer, compressed)
+{
+    TransferOptions options;
+    options.compression = true;
+    Loopback loopback(13, options);
+    checkFiles(loopback);
+
+    std::string text;
+    for (int i = 0; text.size() < 3 * 1024 * 1024; ++i)
+        text += "frame " + std::to_string(i) + ": decoded, 1920x1080, keyframe=" +
+                std::to_string(i % 30 == 0) + "\n";
+    std::vector<uint8_t> data(text.begin(), text.end());
+    std::string source = loopback.dir.path() + "/decoder.log";
+    REQUIRE(writeFile(source, data));
+    CHECK(loopback.send(source));
+    CHECK(sameFile(loopback.received + "/decoder.log", data));
+
+    IoStats stats = loopback.tx.getIoStats();
+    CHECK(stats.compressedChunks > 0);
+    CHECK(stats.compressOutBytes < stats.compressInBytes);
+}
+
+TEST(transfer, encrypted)
+{
+    std::vector<uint8_t> suites{SUITE_CHACHA20_POLY1305};
+    if (aesGcmAccelerated())
+        suites.push_back(SUITE_AES_256_GCM);
+
+    for (size_t i = 0; i < suites.size(); ++i)
+    {
+        TransferOptions options;
+        options.encryption = true;
+        options.encryptionSuites = suites[i];
+        options.pairingSecret = "123456";
+        Loopback loopback((uint16_t)(2 + i), options);
+        checkFiles(loopback);
+    }
+}
+
+TEST(transfer, encrypted_refuses_plaintext)
+{
+    TransferOptions options;
+    options.encryption = true;
+    Loopback loopback(4, options);
+    REQUIRE(!loopback.dir.path().empty());
+
+    TransferOptions plain;
+    plain.autoTune = false;
+    loopback.tx.setOptions(plain);
+    std::string source = loopback.dir.path() + "/secret.bin";
+    REQUIRE(writeFile(source, randomData(100000, 7)));
+
+    // The receiver drops the connection before it opens a session, so
+    // only the send is waited for
+    uint32_t id = loopback.tx.startSender(source, "127.0.0.1", loopback.port);
+    REQUIRE(id != 0);
+    SessionStats sent{};
+    auto deadline = std::chrono::steady_clock::now() + kSettleTimeout;
+    do
+    {
+        std::this_thread::sleep_for(1ms);
+        REQUIRE(loopback.tx.getSessionStats(id, sent));
+    } while (sent.state == SessionState::Active && std::chrono::steady_clock::now() < deadline);
+    CHECK(sent.state == SessionState::Failed);
+    CHECK(access((loopback.received + "/secret.bin").c_str(), F_OK) != 0);
+}
+
+TEST(transfer, reliable_udp)
+{
+    TransferOptions options;
+    options.reliableUdp = true;
+    Loopback loopback(5, options);
+    checkFiles(loopback);
+}
+
+TEST(transfer, reliable_udp_lossy)
+{
+    TransferOptions options;
+    options.reliableUdp = true;
+    options.udpFecGroup = 8;
+    options.udpImpairment.loss = 0.02;
+    Loopback loopback(6, options);
+    checkFiles(loopback);
+
+    IoStats stats = loopback.tx.getIoStats();
+    CHECK(stats.udpRetransmits + stats.udpRecovered > 0);
+}
+
+// A second send of an edited file rebuilds it from the first copy
+TEST(transfer, delta)
+{
+    TransferOptions options;
+    options.deltaSync = true;
+    Loopback loopback(7, options);
+    REQUIRE(!loopback.dir.path().empty());
+
+    std::string source = loopback.dir.path() + "/video.mp4";
+    std::vector<uint8_t> data = randomData(8 * 1024 * 1024, 11);
+    REQUIRE(writeFile(source, data));
+    REQUIRE(loopback.send(source));
+    REQUIRE(sameFile(loopback.received + "/video.mp4", data));
+
+    // Edit the middle, cut a block out further on and grow the tail
+    std::vector<uint8_t> edit = randomData(5000, 12);
+    std::copy(edit.begin(), edit.end(), data.begin() + 3 * 1024 * 1024 + 17);
+    data.erase(data.begin() + 6 * 1024 * 1024, data.begin() + 6 * 1024 * 1024 + 100000);
+    std::vector<uint8_t> tail = randomData(300000, 13);
+    data.insert(data.end(), tail.begin(), tail.end());
+    REQUIRE(writeFile(source, data));
+
+    uint64_t reusedBefore = loopback.tx.getIoStats().deltaReusedBytes +
+                            loopback.rx.getIoStats().deltaReusedBytes;
+    CHECK(loopback.send(source));
+    CHECK(sameFile(loopback.received + "/video-1.mp4", data));
+    uint64_t reused = loopback.tx.getIoStats().deltaReusedBytes +
+                      loopback.rx.getIoStats().deltaReusedBytes - reusedBefore;
+    CHECK(reused > data.size() / 2);
+}
+
+// The checkFiles sizes as one session on a single connection
+TEST(transfer, session)
+{
+    Loopback loopback(11);
+    REQUIRE(!loopback.dir.path().empty());
+
+    const size_t sizes[] = {0, 1, 64 * 1024, 3 * 1024 * 1024 + 123};
+    std::vector<std::string> names;
+    std::vector<std::string> paths;
+    std::vector<std::vector<uint8_t>> contents;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        names.push_back("part" + std::to_string(i) + ".bin");
+        paths.push_back(loopback.dir.path() + "/" + names.back());
+        contents.push_back(randomData(sizes[i], 30 + i));
+        REQUIRE(writeFile(paths.back(), contents.back()));
+    }
+
+    SessionStats sent{};
+    uint32_t id = loopback.tx.startSenderSession(paths, "127.0.0.1", loopback.port);
+    REQUIRE(id != 0);
+    REQUIRE(loopback.settle(id, sent));
+    CHECK(sent.state == SessionState::Completed);
+    CHECK(sent.progress.fileCount == paths.size());
+    CHECK(loopback.lastReceive() == SessionState::Completed);
+    for (size_t i = 0; i < contents.size(); ++i)
+        CHECK(sameFile(loopback.received + "/" + names[i], contents[i]));
+}
+
+// Three sends started together run one at a time, sharing the rate limit
+TEST(transfer, scheduled)
+{
+    TransferOptions options;
+    options.maxActiveSends = 1;
+    options.sendRateLimit = 8 * 1024 * 1024;
+    Loopback loopback(14, options);
+    REQUIRE(!loopback.dir.path().empty());
+
+    std::vector<uint32_t> ids;
+    std::vector<std::vector<uint8_t>> contents;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        std::string source = loopback.dir.path() + "/queued" + std::to_string(i) + ".bin";
+        contents.push_back(randomData(2 * 1024 * 1024, 40 + i));
+        REQUIRE(writeFile(source, contents.back()));
+        ids.push_back(loopback.tx.startSender(source, "127.0.0.1", loopback.port));
+        REQUIRE(ids.back() != 0);
+    }
+
+    // A send part way through its file holds the only slot
+    size_t mostSending = 0;
+    size_t active;
+    auto deadline = start + kSettleTimeout;
+    do
+    {
+        std::this_thread::sleep_for(1ms);
+        active = 0;
+        size_t sending = 0;
+        for (const SessionStats &stats : loopback.tx.listSessions())
+        {
+            if (stats.direction != SessionDirection::Send || stats.state != SessionState::Active)
+                continue;
+            active++;
+            if (stats.progress.bytesTransferred > 0 && stats.progress.bytesTransferred < stats.progress.totalBytes)
+                sending++;
+        }
+        mostSending = std::max(mostSending, sending);
+    } while (active > 0 && std::chrono::steady_clock::now() < deadline);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    while (settledReceives(loopback.rx) < ids.size() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(1ms);
+
+    CHECK(mostSending == 1);
+    // 6 MB at 8 MB/s, less the 100 ms burst
+    CHECK(elapsed >= 600ms);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        SessionStats sent{};
+        REQUIRE(loopback.tx.getSessionStats(ids[i], sent));
+        CHECK(sent.state == SessionState::Completed);
+        CHECK(sameFile(loopback.received + "/queued" + std::to_string(i) + ".bin", contents[i]));
+    }
+}
+
+TEST(transfer, tree)
+{
+    Loopback loopback(8);
+    REQUIRE(!loopback.dir.path().empty());
+
+    std::string root = loopback.dir.path() + "/album";
+    const char *files[] = {"a.jpg", "empty.txt", "sub/b.jpg", "sub/deeper/c.raw", "z/d"};
+    const size_t sizes[] = {200000, 0, 1, 2 * 1024 * 1024 + 5, 65536};
+    REQUIRE(mkdir(root.c_str(), 0755) == 0);
+    REQUIRE(mkdir((root + "/sub").c_str(), 0755) == 0);
+    REQUIRE(mkdir((root + "/sub/deeper").c_str(), 0755) == 0);
+    REQUIRE(mkdir((root + "/z").c_str(), 0755) == 0);
+    std::vector<std::vector<uint8_t>> contents;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+    {
+        contents.push_back(randomData(sizes[i], 100 + i));
+        REQUIRE(writeFile(root + "/" + files[i], contents.back()));
+    }
+
+    SessionStats sent{};
+    uint32_t id = loopback.tx.startSenderTree(root, "127.0.0.1", loopback.port);
+    REQUIRE(id != 0);
+    REQUIRE(loopback.settle(id, sent));
+    CHECK(sent.state == SessionState::Completed);
+    CHECK(loopback.lastReceive() == SessionState::Completed);
+    for (size_t i = 0; i < contents.size(); ++i)
+        CHECK(sameFile(loopback.received + "/album/" + files[i], contents[i]));
+}
+
+// A send cut off past the first journal commit continues from it
+TEST(transfer, resume)
+{
+    TransferOptions options;
+    options.sendRateLimit = 32 * 1024 * 1024;
+    Loopback loopback(9, options);
+    REQUIRE(!loopback.dir.path().empty());
+    loopback.rx.setResumeDirectory(loopback.dir.path() + "/journals");
+
+    std::string source = loopback.dir.path() + "/backup.tar";
+    uint64_t size = ResumeJournal::kCommitInterval + 16 * 1024 * 1024;
+    std::vector<uint8_t> data = randomData(size, 21);
+    REQUIRE(writeFile(source, data));
+
+    uint32_t id = loopback.tx.startSender(source, "127.0.0.1", loopback.port);
+    REQUIRE(id != 0);
+    SessionStats sent{};
+    auto deadline = std::chrono::steady_clock::now() + kSettleTimeout;
+    do
+    {
+        std::this_thread::sleep_for(5ms);
+        REQUIRE(loopback.tx.getSessionStats(id, sent));
+    } while (sent.progress.bytesTransferred < ResumeJournal::kCommitInterval + 4 * 1024 * 1024 &&
+             sent.state == SessionState::Active && std::chrono::steady_clock::now() < deadline);
+    REQUIRE(sent.state == SessionState::Active);
+    loopback.tx.cancelSession(id);
+    REQUIRE(loopback.settle(id, sent));
+    CHECK(sent.state == SessionState::Cancelled);
+
+    loopback.setOptions({});
+    id = loopback.tx.startSender(source, "127.0.0.1", loopback.port);
+    REQUIRE(id != 0);
+    REQUIRE(loopback.settle(id, sent));
+    CHECK(sent.state == SessionState::Completed);
+    CHECK(loopback.lastReceive() == SessionState::Completed);
+    // Only what followed the commit crossed the wire again
+    CHECK(sent.wireBytes <= size - ResumeJournal::kCommitInterval);
+    // into the partial file, not a new one
+    CHECK(sameFile(loopback.received + "/backup.tar", data));
+    CHECK(access((loopback.received + "/backup-1.tar").c_str(), F_OK) != 0);
+}
@@ -9,20 +9,23 @@ object FilePathResolver {
 
     private const val TAG = "SwiftShare"
 
+    // Called once at install; native code then names files itself with
+    // the same rules as getReceiveFilePath (native-core path_resolver.h)
+    @JvmStatic // JNI entrypoint
+    fun getReceiveDirectory(@Suppress("UNUSED_PARAMETER") context: Context): String? {
+        return try {
+            receiveDirectory().absolutePath
+        } catch (e: Exception) {
+            Log.e(TAG, "Failed to get receive directory", e)
+            null
+        }
+    }
+
     @JvmStatic // JNI entrypoint
     fun getReceiveFilePath(@Suppress("UNUSED_PARAMETER") context: Context, filename: String): String? {
         return try {
             Log.i(TAG, "Resolving path for: $filename")
-            val dir = File(
-                Environment.getExternalStoragePublicDirectory(Environment.DIRECTORY_DOWNLOADS),
-                "SwiftShareX"
-            )
-
-            if (!dir.exists()) {
-                val created = dir.mkdirs()
-                Log.i(TAG, "Created directory: $created at ${dir.absolutePath}")
-            }
-
+            val dir = receiveDirectory()
             val cleanName = sanitizeName(filename)
             val uniqueName = ensureUniqueName(dir, cleanName)
             val filePath = File(dir, uniqueName).absolutePath
@@ -34,6 +37,19 @@ object FilePathResolver {
         }
     }
 
+    private fun receiveDirectory(): File {
+        val dir = File(
+            Environment.getExternalStoragePublicDirectory(Environment.DIRECTORY_DOWNLOADS),
+            "SwiftShareX"
+        )
+
+        if (!dir.exists()) {
+            val created = dir.mkdirs()
+            Log.i(TAG, "Created directory: $created at ${dir.absolutePath}")
+        }
+        return dir
+    }
+
     private fun sanitizeName(filename: String): String {
         val pendingPattern = Regex("^\\.pending-\\d+-")
         var name = filename.replace(pendingPattern, "")
@@ -41,6 +57,7 @@ object FilePathResolver {
         if (name.startsWith('.')) {
             name = name.removePrefix(".")
         }
+        name = name.replace('/', '_')
         if (name.isBlank()) {
             name = "file"
         }
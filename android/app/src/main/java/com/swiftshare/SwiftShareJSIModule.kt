@@ -1,9 +1,12 @@
 package com.swiftshare
 
+import android.content.Context
+import android.net.wifi.WifiManager
 import com.facebook.react.bridge.NativeModule
 import com.facebook.react.bridge.ReactApplicationContext
 import com.facebook.react.bridge.ReactMethod
 import com.facebook.react.bridge.ReactContextBaseJavaModule
+import com.facebook.react.turbomodule.core.CallInvokerHolderImpl
 
 class SwiftShareJSIModule(
     private val reactContext: ReactApplicationContext
@@ -16,6 +19,9 @@ class SwiftShareJSIModule(
         }
     }
 
+    // Wi-Fi drops multicast frames to save power unless a lock is held
+    private var multicastLock: WifiManager.MulticastLock? = null
+
     override fun getName(): String = "SwiftShareJSI"
 
     @ReactMethod
@@ -25,11 +31,33 @@ class SwiftShareJSIModule(
             throw IllegalStateException("JS runtime not ready")
         }
 
+        // Lets native code push progress events onto the JS thread
+        val callInvokerHolder = reactContext.jsCallInvokerHolder as? CallInvokerHolderImpl
+
         // Ensure JSI interactions run on the JS thread to avoid crashes
         reactContext.runOnJSQueueThread {
-            nativeInstall(runtimePtr)
+            nativeInstall(runtimePtr, callInvokerHolder)
         }
     }
+
+    // Held while peer discovery runs so multicast beacons get through
+    @ReactMethod
+    fun setMulticastLock(held: Boolean) {
+        if (held) {
+            if (multicastLock == null) {
+                val wifi = reactContext.applicationContext
+                    .getSystemService(Context.WIFI_SERVICE) as? WifiManager ?: return
+                multicastLock = wifi.createMulticastLock("SwiftShareDiscovery").apply {
+                    setReferenceCounted(false)
+                    acquire()
+                }
+            }
+        } else {
+            multicastLock?.release()
+            multicastLock = null
+        }
+    }
+
     // JNI hooks
-    private external fun nativeInstall(runtimePtr: Long)
+    private external fun nativeInstall(runtimePtr: Long, callInvokerHolder: CallInvokerHolderImpl?)
 }
\ No newline at end of file
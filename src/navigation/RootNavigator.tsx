@@ -44,6 +44,7 @@ type NavigatorProps = {
   pickerError: string | null;
   transferMode: 'idle' | 'sending' | 'receiving';
   progress: number;
+  transferRate: { bytesPerSecond: number; etaMs: number } | null;
   transferPort: number;
   sentFiles: Array<{
     id: string;
@@ -78,6 +79,7 @@ const RootNavigator: React.FC<NavigatorProps> = ({
   pickerError,
   transferMode,
   progress,
+  transferRate,
   transferPort,
   sentFiles,
   receivedFiles,
@@ -124,6 +126,7 @@ const RootNavigator: React.FC<NavigatorProps> = ({
                 pickerError={pickerError}
                 transferMode={transferMode}
                 progress={progress}
+                transferRate={transferRate}
                 sentFiles={sentFiles}
                 receivedFiles={receivedFiles}
                 onPickFile={onPickFile}
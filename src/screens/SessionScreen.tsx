@@ -15,6 +15,7 @@ import EmptyState from '../components/EmptyState';
 import SendConfirmationModal from '../modals/SendConfirmationModal';
 import { ActionRow } from '../components/ActionRow';
 import TabBar, { TabItem } from '../components/TabBar';
+import { formatTransferRate } from '../utils/fileUtils';
 
 type Role = 'send' | 'receive';
 
@@ -49,6 +50,7 @@ type Props = {
   pickerError: string | null;
   transferMode: 'idle' | 'sending' | 'receiving';
   progress: number;
+  transferRate: { bytesPerSecond: number; etaMs: number } | null;
   sentFiles: FileTransferRecord[];
   receivedFiles: FileTransferRecord[];
   onPickFile: () => void;
@@ -66,6 +68,7 @@ const SessionScreen: React.FC<Props> = ({
   pickerError: _pickerError,
   transferMode,
   progress,
+  transferRate,
   sentFiles,
   receivedFiles,
   onPickFile,
@@ -266,7 +269,12 @@ const SessionScreen: React.FC<Props> = ({
                 }
                 subtitle={
                   transferMode === 'sending' || transferMode === 'receiving'
-                    ? 'Transfer in progress'
+                    ? transferRate
+                      ? formatTransferRate(
+                          transferRate.bytesPerSecond,
+                          transferRate.etaMs,
+                        )
+                      : 'Transfer in progress'
                     : 'Choose a file to share'
                 }
                 disabled={
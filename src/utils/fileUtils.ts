@@ -28,9 +28,28 @@ const formatRelativeTime = (date: Date) => {
   return date.toLocaleDateString();
 };
 
+// "12.3 MB/s · 0:42 left"; the ETA is left out while unknown
+const formatTransferRate = (bytesPerSecond: number, etaMs: number) => {
+  const rate = `${formatFileSize(Math.round(bytesPerSecond))}/s`;
+  if (etaMs < 0) return rate;
+  const seconds = Math.ceil(etaMs / 1000);
+  const minutes = Math.floor(seconds / 60);
+  const eta =
+    minutes >= 60
+      ? `${Math.floor(minutes / 60)}h ${minutes % 60}m`
+      : `${minutes}:${String(seconds % 60).padStart(2, '0')}`;
+  return `${rate} · ${eta} left`;
+};
+
 const getFileExtension = (filename: string) => {
   const parts = filename.split('.');
   return parts.length > 1 ? parts[parts.length - 1].toUpperCase() : 'FILE';
 };
 
-export { formatFileSize, formatTime, getFileExtension, formatRelativeTime };
+export {
+  formatFileSize,
+  formatTime,
+  formatTransferRate,
+  getFileExtension,
+  formatRelativeTime,
+};